@@ -180,12 +180,14 @@ pi_cli_status_t do_meter_read_spec(char *subcmd) {
   pi_p4_id_t direct_t_id = pi_p4info_meter_get_direct(p4info_curr, m_id);
   pi_status_t rc;
   pi_meter_spec_t meter_spec;
+  int flags = PI_METER_FLAGS_HW_SYNC;
   if (direct_t_id == PI_INVALID_ID) {
     size_t index = handle;
-    rc = pi_meter_read(sess, dev_tgt, m_id, index, &meter_spec);
+    rc = pi_meter_read(sess, dev_tgt, m_id, index, flags, &meter_spec);
   } else {
     pi_entry_handle_t entry_handle = handle;
-    rc = pi_meter_read_direct(sess, dev_tgt, m_id, entry_handle, &meter_spec);
+    rc = pi_meter_read_direct(sess, dev_tgt, m_id, entry_handle, flags,
+                              &meter_spec);
   }
   if (rc != PI_STATUS_SUCCESS) {
     printf("Error when trying to read meter spec\n");
@@ -0,0 +1,203 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_FRONTENDS_CPP_BATCH_H_
+#define PI_FRONTENDS_CPP_BATCH_H_
+
+#include <PI/frontends/cpp/tables.h>
+#include <PI/pi.h>
+
+#include <future>
+#include <vector>
+
+namespace pi {
+
+namespace detail {
+
+// Byte storage shared by all the operations of a batch: match keys and action
+// data are copied here when the operation is recorded. The memory is kept by
+// clear(), so a batch which is reused does not allocate once it has reached
+// its peak size.
+class BatchBuffer {
+ public:
+  size_t append(const char *data, size_t size) {
+    size_t offset = buffer.size();
+    buffer.insert(buffer.end(), data, data + size);
+    return offset;
+  }
+
+  char *at(size_t offset) { return buffer.data() + offset; }
+
+  void clear() { buffer.clear(); }
+
+ private:
+  std::vector<char> buffer;
+};
+
+}  // namespace detail
+
+// Records match table operations and sends them all at once, between
+// pi_batch_begin and pi_batch_end, with submit(). Every recording function
+// returns the index of the operation, which can be used to retrieve its status
+// (and the entry handle for additions) once the batch has been submitted.
+// Because the operations are copied, the MatchKey / ActionData objects can be
+// reused for the next entry right away. An operation with an ActionEntry which
+// was never initialized is not sent: its status is
+// PI_STATUS_INVALID_ENTRY_TYPE.
+// With a target which pipelines batches (e.g. bmv2 with "pipeline_batches"),
+// per-operation errors may only be reported by pi_batch_end, in which case
+// they are returned by submit() but not reflected in the operation's result.
+class MatchTableBatch {
+ public:
+  struct Result {
+    pi_status_t status;
+    pi_entry_handle_t entry_handle;
+  };
+
+  explicit MatchTableBatch(const MatchTable &table);
+
+  size_t entry_add(const MatchKey &match_key, const ActionEntry &action_entry,
+                   bool overwrite);
+  size_t entry_add(const MatchKey &match_key, const ActionData &action_data,
+                   bool overwrite);
+
+  size_t entry_delete(pi_entry_handle_t entry_handle);
+  size_t entry_delete_wkey(const MatchKey &match_key);
+
+  size_t entry_modify(pi_entry_handle_t entry_handle,
+                      const ActionEntry &action_entry);
+  size_t entry_modify_wkey(const MatchKey &match_key,
+                           const ActionEntry &action_entry);
+
+  size_t size() const { return ops.size(); }
+  bool empty() const { return ops.empty(); }
+
+  // Sends all the recorded operations, even if some of them fail. Returns the
+  // first error, or the status of pi_batch_end.
+  pi_status_t submit(bool hw_sync = false);
+
+  // Same as submit(), but the operations are sent by a separate thread. This
+  // thread is shared by all the batches (MatchTableBatch and ActProfBatch),
+  // which are sent one at a time, in the order in which submit_async was
+  // called. The batch must not be modified until the future is ready, and the
+  // session must not be used for anything else in the meantime.
+  std::future<pi_status_t> submit_async(bool hw_sync = false);
+
+  // only valid after submit()
+  const Result &result(size_t index) const { return results.at(index); }
+
+  // removes all the operations, but keeps the memory
+  void clear();
+
+ private:
+  enum class OpType { ADD, DELETE, DELETE_WKEY, MODIFY, MODIFY_WKEY };
+
+  struct Op {
+    OpType type;
+    bool overwrite;
+    pi_entry_handle_t entry_handle;
+    detail::PiMatchKey match_key;
+    size_t mk_offset;
+    pi_action_entry_type_t action_type;
+    detail::PiActionData action_data;
+    size_t ad_offset;
+    pi_indirect_handle_t indirect_handle;
+    // error detected when the operation was recorded, if any
+    pi_status_t record_status;
+  };
+
+  Op &new_op(OpType type);
+  void record_match_key(Op *op, const MatchKey &match_key);
+  void record_action_data(Op *op, const ActionData &action_data);
+  void record_action_entry(Op *op, const ActionEntry &action_entry);
+  pi_status_t send_one(Op *op, Result *result);
+
+  pi_session_handle_t sess;
+  pi_dev_tgt_t dev_tgt;
+  pi_p4_id_t table_id;
+  std::vector<Op> ops{};
+  std::vector<Result> results{};
+  detail::BatchBuffer buffer{};
+};
+
+// Same as MatchTableBatch, for action profile operations. For member_create
+// and group_create, the handle of the new member / group is in the result.
+class ActProfBatch {
+ public:
+  struct Result {
+    pi_status_t status;
+    pi_indirect_handle_t handle;
+  };
+
+  explicit ActProfBatch(const ActProf &act_prof);
+
+  size_t member_create(const ActionData &action_data);
+  size_t member_delete(pi_indirect_handle_t member_handle);
+  size_t member_modify(pi_indirect_handle_t member_handle,
+                       const ActionData &action_data);
+
+  size_t group_create(size_t max_size);
+  size_t group_delete(pi_indirect_handle_t group_handle);
+  size_t group_add_member(pi_indirect_handle_t group_handle,
+                          pi_indirect_handle_t member_handle);
+  size_t group_remove_member(pi_indirect_handle_t group_handle,
+                             pi_indirect_handle_t member_handle);
+
+  size_t size() const { return ops.size(); }
+  bool empty() const { return ops.empty(); }
+
+  // see MatchTableBatch
+  pi_status_t submit(bool hw_sync = false);
+  std::future<pi_status_t> submit_async(bool hw_sync = false);
+
+  const Result &result(size_t index) const { return results.at(index); }
+
+  void clear();
+
+ private:
+  enum class OpType {
+    MEMBER_CREATE, MEMBER_DELETE, MEMBER_MODIFY,
+    GROUP_CREATE, GROUP_DELETE, GROUP_ADD_MEMBER, GROUP_REMOVE_MEMBER
+  };
+
+  struct Op {
+    OpType type;
+    pi_indirect_handle_t handle;  // member or group handle
+    pi_indirect_handle_t member_handle;  // for group membership operations
+    size_t max_size;
+    detail::PiActionData action_data;
+    size_t ad_offset;
+  };
+
+  Op &new_op(OpType type);
+  void record_action_data(Op *op, const ActionData &action_data);
+  pi_status_t send_one(Op *op, Result *result);
+
+  pi_session_handle_t sess;
+  pi_dev_tgt_t dev_tgt;
+  pi_p4_id_t act_prof_id;
+  std::vector<Op> ops{};
+  std::vector<Result> results{};
+  detail::BatchBuffer buffer{};
+};
+
+}  // namespace pi
+
+#endif  // PI_FRONTENDS_CPP_BATCH_H_
@@ -0,0 +1,48 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_FRONTENDS_CPP_HASH_H_
+#define PI_FRONTENDS_CPP_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pi {
+
+// Fast non-cryptographic 64-bit hash, used for MatchKey objects. The generic
+// implementation consumes the input 32, 16 then 8 bytes at a time. On x86-64
+// CPUs with SSE4.2, a CRC32C-based implementation is selected at runtime
+// instead. The 2 implementations return different values, so hashes must not
+// be persisted or exchanged between processes.
+uint64_t hash_bytes(const char *data, size_t size, uint64_t seed = 0);
+
+namespace detail {
+
+// exposed for benchmarking / testing purposes only
+uint64_t hash_bytes_generic(const char *data, size_t size, uint64_t seed);
+// must only be called if hash_has_crc32c() returns true
+uint64_t hash_bytes_crc32c(const char *data, size_t size, uint64_t seed);
+bool hash_has_crc32c();
+
+}  // namespace detail
+
+}  // namespace pi
+
+#endif  // PI_FRONTENDS_CPP_HASH_H_
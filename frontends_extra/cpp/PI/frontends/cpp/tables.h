@@ -24,15 +24,139 @@
 #include <PI/pi.h>
 
 #include <string>
-#include <vector>
+#include <utility>
 
+#include <cassert>
 #include <cstdint>
+#include <cstring>
 
 namespace pi {
 
 // TODO(antonin): temporary
 typedef int error_code_t;
 
+// see batch.h
+class MatchTableBatch;
+class ActProfBatch;
+
+namespace detail {
+
+// Byte buffer which stores up to N bytes inline and falls back to the heap
+// for larger sizes. Used by MatchKey and ActionData so that building one for
+// a typical table does not require any memory allocation.
+template <size_t N>
+class SmallBuffer {
+ public:
+  explicit SmallBuffer(size_t size)
+      : _size(size), heap((size > N) ? new char[size]() : nullptr) {
+    if (!heap) std::memset(inline_data, 0, size);
+  }
+
+  ~SmallBuffer() { delete[] heap; }
+
+  SmallBuffer(const SmallBuffer &other)
+      : _size(other._size),
+        heap((other._size > N) ? new char[other._size] : nullptr) {
+    std::memcpy(data(), other.data(), _size);
+  }
+
+  SmallBuffer &operator=(const SmallBuffer &other) {
+    if (this == &other) return *this;
+    if (other._size > N && other._size != _size) {
+      delete[] heap;
+      heap = new char[other._size];
+    } else if (other._size <= N) {
+      delete[] heap;
+      heap = nullptr;
+    }
+    _size = other._size;
+    std::memcpy(data(), other.data(), _size);
+    return *this;
+  }
+
+  // the moved-from buffer is left empty
+  SmallBuffer(SmallBuffer &&other) noexcept
+      : _size(other._size), heap(other.heap) {
+    if (!heap) std::memcpy(inline_data, other.inline_data, _size);
+    other._size = 0;
+    other.heap = nullptr;
+  }
+
+  SmallBuffer &operator=(SmallBuffer &&other) noexcept {
+    if (this == &other) return *this;
+    delete[] heap;
+    _size = other._size;
+    heap = other.heap;
+    if (!heap) std::memcpy(inline_data, other.inline_data, _size);
+    other._size = 0;
+    other.heap = nullptr;
+    return *this;
+  }
+
+  char *data() { return heap ? heap : inline_data; }
+  const char *data() const { return heap ? heap : inline_data; }
+
+  size_t size() const { return _size; }
+
+  bool is_inline() const { return heap == nullptr; }
+
+ private:
+  size_t _size;
+  char *heap;
+  char inline_data[N];
+};
+
+// pi_match_key_t and pi_action_data_t are opaque outside of libpi. These 2
+// classes store one inline, so that MatchKey and ActionData do not have to
+// allocate it. The methods are defined in tables.cpp, which also checks that
+// the storage is large enough. The data buffer is not owned: set_data() has
+// to be called again every time the buffer moves (e.g. when the owner is
+// copied), and never in a const method, so that a const object can be used
+// by several threads at once.
+class PiMatchKey {
+ public:
+  PiMatchKey() = default;
+  PiMatchKey(const pi_p4info_t *p4info, pi_p4_id_t table_id,
+             size_t data_size);
+  explicit PiMatchKey(const pi_match_key_t *pi_match_key);
+
+  void set_data(char *data);
+
+  void set_priority(uint32_t priority);
+  uint32_t get_priority() const;
+
+  const pi_match_key_t *get() const {
+    return reinterpret_cast<const pi_match_key_t *>(storage);
+  }
+
+  static constexpr size_t kStorageSize = 6 * sizeof(void *);
+
+ private:
+  alignas(void *) char storage[kStorageSize];
+};
+
+class PiActionData {
+ public:
+  PiActionData() = default;
+  PiActionData(const pi_p4info_t *p4info, pi_p4_id_t action_id,
+               size_t data_size);
+
+  void set_data(char *data);
+
+  // the PI API takes a non-const pointer in pi_table_entry_t, but does not
+  // modify the action data
+  pi_action_data_t *get() const {
+    return reinterpret_cast<pi_action_data_t *>(const_cast<char *>(storage));
+  }
+
+  static constexpr size_t kStorageSize = 6 * sizeof(void *);
+
+ private:
+  alignas(void *) char storage[kStorageSize];
+};
+
+}  // namespace detail
+
 class MatchKeyReader {
  public:
   explicit MatchKeyReader(const pi_match_key_t *match_key);
@@ -59,8 +183,10 @@ class MatchKeyReader {
 
 class MatchKey {
   friend class MatchTable;
+  friend class MatchTableBatch;
   friend struct MatchKeyHash;
   friend struct MatchKeyEq;
+  friend struct MatchKeyView;
 
  public:
   MatchKey(const pi_p4info_t *p4info, pi_p4_id_t table_id);
@@ -113,10 +239,13 @@ class MatchKey {
   error_code_t set_valid(pi_p4_id_t f_id, bool key);
   error_code_t get_valid(pi_p4_id_t f_id, bool *key) const;
 
+  // keys up to this size are stored inline, without any memory allocation
+  static constexpr size_t kInlineSize = 64;
+
   MatchKey(const MatchKey &other);
   MatchKey &operator=(const MatchKey &other);
-  MatchKey(MatchKey &&other) = default;
-  MatchKey &operator=(MatchKey &&other) = default;
+  MatchKey(MatchKey &&other) noexcept;
+  MatchKey &operator=(MatchKey &&other) noexcept;
 
  private:
   template <typename T>
@@ -124,29 +253,52 @@ class MatchKey {
   error_code_t format(pi_p4_id_t f_id, const char *ptr, size_t s,
                       size_t offset, size_t *written);
 
-  pi_match_key_t *get() const {
-    return match_key;
-  }
+  const pi_match_key_t *get() const { return match_key.get(); }
 
   const pi_p4info_t *p4info;
   pi_p4_id_t table_id;
   size_t nset{0};
   size_t mk_size;
-  std::vector<char> _data;
-  pi_match_key_t *match_key;
-  MatchKeyReader reader;
+  detail::SmallBuffer<kInlineSize> _data;
+  // points to _data, see detail::PiMatchKey
+  detail::PiMatchKey match_key;
 };
 
 // MatchKeyHash and MatchKeyEq can be used to store MatchKey objects into an
 // unordered_map. They take into account the table id and the match key data
-// (including the priority).
+// (including the priority). The hash is not cached in the MatchKey, so that
+// a const MatchKey can be hashed by several threads at once; callers which
+// need it several times (e.g. a lookup followed by an insert) should keep it.
+
+// Non-owning view of a match key: table id, priority and match key bytes. It
+// can be built from a MatchKey or directly from a pi_match_key_t (e.g. one
+// returned by pi_table_entries_fetch), without copying the key data. The view
+// is only valid as long as the underlying match key is.
+struct MatchKeyView {
+  MatchKeyView(pi_p4_id_t table_id, uint32_t priority, const char *data,
+               size_t size)
+      : table_id(table_id), priority(priority), data(data), size(size) { }
+  explicit MatchKeyView(const MatchKey &mk);
+  explicit MatchKeyView(const pi_match_key_t *pi_match_key);
+
+  pi_p4_id_t table_id;
+  uint32_t priority;
+  const char *data;
+  size_t size;
+};
 
+// MatchKeyHash and MatchKeyEq also accept MatchKeyView objects, and a view
+// hashes to the same value as the MatchKey it was built from. This lets a
+// container of MatchKey objects be probed with a view (heterogeneous lookup).
 struct MatchKeyHash {
   size_t operator()(const MatchKey &mk) const;
+  size_t operator()(const MatchKeyView &view) const;
 };
 
 struct MatchKeyEq {
   bool operator()(const MatchKey &mk1, const MatchKey &mk2) const;
+  bool operator()(const MatchKey &mk, const MatchKeyView &view) const;
+  bool operator()(const MatchKeyView &view1, const MatchKeyView &view2) const;
 };
 
 class ActionDataReader {
@@ -164,10 +316,21 @@ class ActionDataReader {
 class ActionData {
   friend class MatchTable;
   friend class ActProf;
+  friend class MatchTableBatch;
+  friend class ActProfBatch;
  public:
   ActionData(const pi_p4info_t *p4info, pi_p4_id_t action_id);
   ~ActionData();
 
+  // action data up to this size is stored inline, without any memory
+  // allocation
+  static constexpr size_t kInlineSize = 64;
+
+  ActionData(const ActionData &other);
+  ActionData &operator=(const ActionData &other);
+  ActionData(ActionData &&other) noexcept;
+  ActionData &operator=(ActionData &&other) noexcept;
+
   void reset();
 
   template <typename T>
@@ -178,14 +341,15 @@ class ActionData {
 
   error_code_t get_arg(pi_p4_id_t ap_id, std::string *arg) const;
 
+  // read-only access to the PI representation, e.g. to keep a copy of it
+  const pi_action_data_t *pi_action_data() const { return get(); }
+
  private:
   template <typename T>
   error_code_t format(pi_p4_id_t ap_id, T v);
   error_code_t format(pi_p4_id_t ap_id, const char *ptr, size_t s);
 
-  pi_action_data_t *get() const {
-    return action_data;
-  }
+  pi_action_data_t *get() const { return action_data.get(); }
 
   const pi_p4info_t *p4info;
 #ifdef __clang__
@@ -194,14 +358,15 @@ class ActionData {
   pi_p4_id_t action_id;
   size_t nset{0};
   size_t ad_size;
-  std::vector<char> _data;
-  pi_action_data_t *action_data;
-  ActionDataReader reader;
+  detail::SmallBuffer<kInlineSize> _data;
+  // points to _data, see detail::PiMatchKey
+  detail::PiActionData action_data;
 };
 
 class ActionEntry {
  public:
   friend class MatchTable;
+  friend class MatchTableBatch;
 
   ActionEntry()
       : tag(Tag::NONE) { }
@@ -250,6 +415,9 @@ class ActionEntry {
     return _indirect_handle;
   }
 
+  bool is_action_data() const { return tag == Tag::ACTION_DATA; }
+  bool is_indirect_handle() const { return tag == Tag::INDIRECT_HANDLE; }
+
  private:
   enum class Tag { NONE, ACTION_DATA, INDIRECT_HANDLE } tag;
 
@@ -288,9 +456,15 @@ class MatchTable {
                         pi_entry_handle_t *entry_handle);
   pi_status_t default_entry_set(const ActionData &action_data);
 
+  // returns an empty batch of operations for this table, you need to include
+  // PI/frontends/cpp/batch.h to use it
+  MatchTableBatch batch() const;
+
   // many more APIs
 
  private:
+  friend class MatchTableBatch;
+
   pi_table_entry_t build_table_entry(const ActionEntry &action_entry) const;
 
   pi_session_handle_t sess;
@@ -327,7 +501,12 @@ class ActProf {
   pi_status_t group_remove_member(pi_indirect_handle_t group_handle,
                                   pi_indirect_handle_t member_handle);
 
+  // see MatchTable::batch
+  ActProfBatch batch() const;
+
  private:
+  friend class ActProfBatch;
+
   pi_session_handle_t sess;
   pi_dev_tgt_t dev_tgt;
 #ifdef __clang__
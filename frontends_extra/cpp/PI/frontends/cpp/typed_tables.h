@@ -0,0 +1,272 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Support code for the C++ table bindings generated by pi_gen_cpp (see
+// generators/cpp). The generated code describes each table and action with
+// compile-time constants (ids, offsets, bitwidths), so building a match key or
+// action data does not require any p4info lookup, and using a field with the
+// wrong match type or a value of the wrong type is a compile error. Code using
+// these classes has to be linked with libpifecpp.
+
+#ifndef PI_FRONTENDS_CPP_TYPED_TABLES_H_
+#define PI_FRONTENDS_CPP_TYPED_TABLES_H_
+
+#include <PI/frontends/cpp/tables.h>
+#include <PI/pi.h>
+
+#include <array>
+#include <type_traits>
+
+#include <cstdint>
+#include <cstring>
+
+namespace pi {
+
+namespace typed {
+
+namespace detail {
+
+template <size_t Bitwidth>
+struct FieldTraits {
+  static constexpr size_t nbytes = (Bitwidth + 7) / 8;
+  static constexpr char byte0_mask = (Bitwidth % 8 == 0) ?
+      static_cast<char>(0xff) : static_cast<char>((1 << (Bitwidth % 8)) - 1);
+};
+
+}  // namespace detail
+
+// Writes v in network byte order, the same way MatchKey::set_* and
+// ActionData::set_arg do. The number of bytes is known at compile time so the
+// loop is fully unrolled. Signed values are written in two's complement.
+template <size_t Bitwidth, typename T>
+inline void
+write_value(char *dst, T v) {
+  static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value,
+                "value must be an integer or a byte array");
+  static_assert(sizeof(T) * 8 >= Bitwidth,
+                "integer type is too narrow for this field");
+  constexpr size_t nbytes = detail::FieldTraits<Bitwidth>::nbytes;
+  auto u = static_cast<uint64_t>(v);
+  for (size_t i = 0; i < nbytes; i++) {
+    dst[nbytes - 1 - i] = static_cast<char>(u & 0xff);
+    u >>= 8;
+  }
+  dst[0] &= detail::FieldTraits<Bitwidth>::byte0_mask;
+}
+
+template <size_t Bitwidth>
+inline void
+write_bytes(char *dst, const char *v) {
+  std::memcpy(dst, v, detail::FieldTraits<Bitwidth>::nbytes);
+  dst[0] &= detail::FieldTraits<Bitwidth>::byte0_mask;
+}
+
+// same encoding as emit_uint32 in PI/int/serialize.h
+inline void
+write_prefix_length(char *dst, int prefix_length) {
+  uint32_t v = static_cast<uint32_t>(prefix_length);
+  std::memcpy(dst, &v, sizeof(v));
+}
+
+// TableInfo is a generated struct, which provides the table id, the match key
+// size and whether the table requires a priority. The generated MatchKey
+// class for the table inherits from this one and adds one setter per match
+// field.
+template <typename TableInfo>
+class MatchKey {
+ public:
+  explicit MatchKey(const pi_p4info_t *p4info)
+      : match_key(p4info, TableInfo::id, TableInfo::match_key_size) {
+    _data.fill(0);
+    match_key.set_data(_data.data());
+  }
+
+  // the data pointer has to follow the copied buffer, see pi::detail
+  MatchKey(const MatchKey &other)
+      : _data(other._data), match_key(other.match_key) {
+    match_key.set_data(_data.data());
+  }
+
+  MatchKey &operator=(const MatchKey &other) {
+    _data = other._data;
+    match_key = other.match_key;
+    match_key.set_data(_data.data());
+    return *this;
+  }
+
+  void set_priority(int priority) {
+    static_assert(TableInfo::requires_priority,
+                  "table does not have ternary or range match fields");
+    match_key.set_priority(priority);
+  }
+
+  const pi_match_key_t *get() const { return match_key.get(); }
+
+ protected:
+  char *data() { return _data.data(); }
+
+ private:
+  std::array<char, TableInfo::match_key_size> _data;
+  pi::detail::PiMatchKey match_key;
+};
+
+// ActionInfo is a generated struct, which provides the action id and the
+// action data size.
+template <typename ActionInfo>
+class ActionData {
+ public:
+  explicit ActionData(const pi_p4info_t *p4info)
+      : action_data(p4info, ActionInfo::id, ActionInfo::action_data_size) {
+    _data.fill(0);
+    action_data.set_data(_data.data());
+  }
+
+  // see MatchKey
+  ActionData(const ActionData &other)
+      : _data(other._data), action_data(other.action_data) {
+    action_data.set_data(_data.data());
+  }
+
+  ActionData &operator=(const ActionData &other) {
+    _data = other._data;
+    action_data = other.action_data;
+    action_data.set_data(_data.data());
+    return *this;
+  }
+
+  pi_action_data_t *get() const { return action_data.get(); }
+
+ protected:
+  char *data() { return _data.data(); }
+
+ private:
+  std::array<char, ActionInfo::action_data_size> _data;
+  pi::detail::PiActionData action_data;
+};
+
+// Same operations as pi::MatchTable, but the action has to be one of the
+// table's actions, and only indirect tables accept indirect handles. Both
+// are checked at compile time.
+template <typename TableInfo, typename Key>
+class MatchTable {
+ public:
+  MatchTable(pi_session_handle_t sess, pi_dev_tgt_t dev_tgt)
+      : sess(sess), dev_tgt(dev_tgt) { }
+
+  template <typename ActionInfo>
+  pi_status_t entry_add(const Key &match_key,
+                        const ActionData<ActionInfo> &action_data,
+                        bool overwrite, pi_entry_handle_t *entry_handle) {
+    auto entry = build_table_entry(action_data);
+    return pi_table_entry_add(sess, dev_tgt, TableInfo::id, match_key.get(),
+                              &entry, overwrite, entry_handle);
+  }
+
+  pi_status_t entry_add(const Key &match_key,
+                        pi_indirect_handle_t indirect_handle, bool overwrite,
+                        pi_entry_handle_t *entry_handle) {
+    auto entry = build_table_entry(indirect_handle);
+    return pi_table_entry_add(sess, dev_tgt, TableInfo::id, match_key.get(),
+                              &entry, overwrite, entry_handle);
+  }
+
+  pi_status_t entry_delete(pi_entry_handle_t entry_handle) {
+    return pi_table_entry_delete(sess, dev_tgt.dev_id, TableInfo::id,
+                                 entry_handle);
+  }
+
+  pi_status_t entry_delete_wkey(const Key &match_key) {
+    return pi_table_entry_delete_wkey(sess, dev_tgt.dev_id, TableInfo::id,
+                                      match_key.get());
+  }
+
+  template <typename ActionInfo>
+  pi_status_t entry_modify(pi_entry_handle_t entry_handle,
+                           const ActionData<ActionInfo> &action_data) {
+    auto entry = build_table_entry(action_data);
+    return pi_table_entry_modify(sess, dev_tgt.dev_id, TableInfo::id,
+                                 entry_handle, &entry);
+  }
+
+  template <typename ActionInfo>
+  pi_status_t entry_modify_wkey(const Key &match_key,
+                                const ActionData<ActionInfo> &action_data) {
+    auto entry = build_table_entry(action_data);
+    return pi_table_entry_modify_wkey(sess, dev_tgt.dev_id, TableInfo::id,
+                                      match_key.get(), &entry);
+  }
+
+  pi_status_t entry_modify(pi_entry_handle_t entry_handle,
+                           pi_indirect_handle_t indirect_handle) {
+    auto entry = build_table_entry(indirect_handle);
+    return pi_table_entry_modify(sess, dev_tgt.dev_id, TableInfo::id,
+                                 entry_handle, &entry);
+  }
+
+  pi_status_t entry_modify_wkey(const Key &match_key,
+                                pi_indirect_handle_t indirect_handle) {
+    auto entry = build_table_entry(indirect_handle);
+    return pi_table_entry_modify_wkey(sess, dev_tgt.dev_id, TableInfo::id,
+                                      match_key.get(), &entry);
+  }
+
+  template <typename ActionInfo>
+  pi_status_t default_entry_set(const ActionData<ActionInfo> &action_data) {
+    auto entry = build_table_entry(action_data);
+    return pi_table_default_action_set(sess, dev_tgt, TableInfo::id, &entry);
+  }
+
+ private:
+  template <typename ActionInfo>
+  static pi_table_entry_t
+  build_table_entry(const ActionData<ActionInfo> &action_data) {
+    static_assert(!TableInfo::is_indirect,
+                  "indirect tables only accept indirect handles");
+    static_assert(TableInfo::has_action(ActionInfo::id),
+                  "action is not one of the table's actions");
+    pi_table_entry_t entry;
+    entry.entry_type = PI_ACTION_ENTRY_TYPE_DATA;
+    entry.entry.action_data = action_data.get();
+    entry.entry_properties = NULL;
+    entry.direct_res_config = NULL;
+    return entry;
+  }
+
+  static pi_table_entry_t
+  build_table_entry(pi_indirect_handle_t indirect_handle) {
+    static_assert(TableInfo::is_indirect,
+                  "table does not have an action profile");
+    pi_table_entry_t entry;
+    entry.entry_type = PI_ACTION_ENTRY_TYPE_INDIRECT;
+    entry.entry.indirect_handle = indirect_handle;
+    entry.entry_properties = NULL;
+    entry.direct_res_config = NULL;
+    return entry;
+  }
+
+  pi_session_handle_t sess;
+  pi_dev_tgt_t dev_tgt;
+};
+
+}  // namespace typed
+
+}  // namespace pi
+
+#endif  // PI_FRONTENDS_CPP_TYPED_TABLES_H_
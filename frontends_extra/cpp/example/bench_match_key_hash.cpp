@@ -0,0 +1,256 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Compares the MatchKey hash functions (the generic and the CRC32C
+// implementations of pi::hash_bytes, as well as the Jenkins one-at-a-time
+// hash we used before) on realistic match keys: IPv4 and IPv6 LPM keys and
+// 5-tuple exact keys, laid out the way PI formats them. For each key set, we
+// report the throughput, the number of full-width collisions and how evenly
+// the keys are spread across hash table buckets. The program exits with a
+// non-zero status if one of the pi::hash_bytes implementations has a
+// collision or a bucket distribution which is clearly worse than random.
+
+#include <PI/frontends/cpp/hash.h>
+#include <PI/frontends/cpp/tables.h>
+#include <PI/p4info.h>
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr size_t kNumKeys = 1 << 20;
+// a power of 2 and a prime, since std::unordered_map uses prime bucket counts
+// with libstdc++ and power-of-2 bucket counts with other implementations
+constexpr size_t kNumBucketsPow2 = 1 << 18;
+constexpr size_t kNumBucketsPrime = 262139;
+// for random hashes, chi2 / num_buckets is ~1 with a stddev of ~0.003
+constexpr double kMaxChi2Ratio = 1.05;
+
+struct KeySet {
+  std::string name;
+  size_t key_size;
+  std::vector<char> data;  // key_size * kNumKeys bytes
+
+  const char *key(size_t i) const { return data.data() + i * key_size; }
+};
+
+void
+append_uint32(std::vector<char> *v, uint32_t x) {
+  x = htonl(x);
+  auto p = reinterpret_cast<const char *>(&x);
+  v->insert(v->end(), p, p + sizeof(x));
+}
+
+void
+append_uint16(std::vector<char> *v, uint16_t x) {
+  x = htons(x);
+  auto p = reinterpret_cast<const char *>(&x);
+  v->insert(v->end(), p, p + sizeof(x));
+}
+
+// a routing table: mostly /24 prefixes, some /16 and a tail of /32 host
+// routes; host bits are always 0 so there is very little entropy
+KeySet
+make_ipv4_lpm() {
+  KeySet ks{"ipv4 lpm", 8, {}};
+  ks.data.reserve(ks.key_size * kNumKeys);
+  for (size_t i = 0; i < kNumKeys; i++) {
+    uint32_t addr, pLen;
+    if (i % 16 == 0) {
+      addr = static_cast<uint32_t>(i >> 4) << 16;
+      pLen = 16;
+    } else if (i % 16 == 1) {
+      addr = 0x0a000000 | static_cast<uint32_t>(i);
+      pLen = 32;
+    } else {
+      addr = 0x0b000000 + (static_cast<uint32_t>(i) << 8);
+      pLen = 24;
+    }
+    append_uint32(&ks.data, addr);
+    append_uint32(&ks.data, pLen);
+  }
+  return ks;
+}
+
+// 2001:db8:<site>:<subnet>::/64 prefixes, with a few /48 aggregates
+KeySet
+make_ipv6_lpm() {
+  KeySet ks{"ipv6 lpm", 20, {}};
+  ks.data.reserve(ks.key_size * kNumKeys);
+  for (size_t i = 0; i < kNumKeys; i++) {
+    append_uint32(&ks.data, 0x20010db8);
+    if (i % 64 == 0) {
+      append_uint32(&ks.data, static_cast<uint32_t>(i >> 6) << 16);
+      append_uint32(&ks.data, 0);
+      append_uint32(&ks.data, 0);
+      append_uint32(&ks.data, 48);
+    } else {
+      append_uint32(&ks.data, static_cast<uint32_t>(i));
+      append_uint32(&ks.data, 0);
+      append_uint32(&ks.data, 0);
+      append_uint32(&ks.data, 64);
+    }
+  }
+  return ks;
+}
+
+// TCP / UDP flows from a /16 of clients to a handful of servers
+KeySet
+make_5_tuple() {
+  KeySet ks{"5-tuple", 13, {}};
+  ks.data.reserve(ks.key_size * kNumKeys);
+  for (size_t i = 0; i < kNumKeys; i++) {
+    append_uint32(&ks.data, 0x0a000000 | static_cast<uint32_t>(i & 0xffff));
+    append_uint32(&ks.data, 0xc0a80001 + static_cast<uint32_t>((i >> 16) & 3));
+    append_uint16(&ks.data, static_cast<uint16_t>(32768 + (i >> 18)));
+    append_uint16(&ks.data, (i & 1) ? 443 : 80);
+    ks.data.push_back((i & 2) ? 17 : 6);
+  }
+  return ks;
+}
+
+uint64_t
+hash_jenkins(const char *data, size_t size, uint64_t seed) {
+  // what MatchKeyHash used before, including the sign extension of char
+  uint32_t hash = static_cast<uint32_t>(seed);
+  for (size_t i = 0; i < size; i++) {
+    hash += data[i];
+    hash += hash << 10;
+    hash ^= hash >> 6;
+  }
+  hash += hash << 3;
+  hash ^= hash >> 11;
+  hash += hash << 15;
+  return hash;
+}
+
+using HashFn = uint64_t (*)(const char *, size_t, uint64_t);
+
+double
+chi2_ratio(const std::vector<uint64_t> &hashes, size_t num_buckets,
+           bool use_mask) {
+  std::vector<uint32_t> buckets(num_buckets, 0);
+  for (auto h : hashes)
+    buckets[use_mask ? (h & (num_buckets - 1)) : (h % num_buckets)]++;
+  double expected = static_cast<double>(hashes.size()) / num_buckets;
+  double chi2 = 0;
+  for (auto c : buckets) chi2 += (c - expected) * (c - expected) / expected;
+  return chi2 / num_buckets;
+}
+
+// returns false if the hash quality is not acceptable
+bool
+evaluate(const char *name, HashFn fn, const KeySet &ks) {
+  std::vector<uint64_t> hashes(kNumKeys);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kNumKeys; i++)
+    hashes[i] = fn(ks.key(i), ks.key_size, 0);
+  auto end = std::chrono::steady_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - start).count();
+
+  double chi2_pow2 = chi2_ratio(hashes, kNumBucketsPow2, true);
+  double chi2_prime = chi2_ratio(hashes, kNumBucketsPrime, false);
+  std::sort(hashes.begin(), hashes.end());
+  size_t collisions = 0;
+  for (size_t i = 1; i < kNumKeys; i++)
+    if (hashes[i] == hashes[i - 1]) collisions++;
+
+  std::printf("%-10s %-10s %6.2f ns/key %8zu collisions "
+              "chi2 (pow2) %6.3f chi2 (prime) %6.3f\n",
+              ks.name.c_str(), name, static_cast<double>(ns) / kNumKeys,
+              collisions, chi2_pow2, chi2_prime);
+  return collisions == 0 && chi2_pow2 < kMaxChi2Ratio &&
+      chi2_prime < kMaxChi2Ratio;
+}
+
+// end-to-end: unordered_map insertions + lookups of ipv4_lpm MatchKey objects
+void
+bench_match_key_map() {
+  pi_p4info_t *p4info;
+  std::ifstream istream(TESTDATADIR "/" "simple_router.json");
+  std::string config((std::istreambuf_iterator<char>(istream)),
+                     std::istreambuf_iterator<char>());
+  pi_add_config(config.c_str(), PI_CONFIG_TYPE_BMV2_JSON, &p4info);
+  auto t_id = pi_p4info_table_id_from_name(p4info, "ipv4_lpm");
+  auto mf_id = pi_p4info_table_match_field_id_from_name(
+      p4info, t_id, "ipv4.dstAddr");
+
+  constexpr size_t kNumEntries = 100000;
+  std::vector<pi::MatchKey> keys;
+  keys.reserve(kNumEntries);
+  for (size_t i = 0; i < kNumEntries; i++) {
+    keys.emplace_back(p4info, t_id);
+    keys.back().set_lpm(mf_id, static_cast<uint32_t>(i << 8), 24);
+  }
+
+  std::unordered_map<pi::MatchKey, size_t, pi::MatchKeyHash, pi::MatchKeyEq>
+      map;
+  map.reserve(kNumEntries);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kNumEntries; i++) map.emplace(keys[i], i);
+  size_t found = 0;
+  for (size_t i = 0; i < kNumEntries; i++) found += map.count(keys[i]);
+  auto end = std::chrono::steady_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - start).count();
+  std::printf("MatchKey map insert + find: %.1f ns/key (%zu found)\n",
+              static_cast<double>(ns) / kNumEntries, found);
+
+  pi_destroy_config(p4info);
+}
+
+}  // namespace
+
+int main() {
+  pi_init(256, NULL);
+
+  std::printf("CRC32C available: %s\n",
+              pi::detail::hash_has_crc32c() ? "yes" : "no");
+
+  std::vector<KeySet> key_sets;
+  key_sets.push_back(make_ipv4_lpm());
+  key_sets.push_back(make_ipv6_lpm());
+  key_sets.push_back(make_5_tuple());
+
+  bool ok = true;
+  for (const auto &ks : key_sets) {
+    evaluate("jenkins", hash_jenkins, ks);
+    ok &= evaluate("generic", pi::detail::hash_bytes_generic, ks);
+    if (pi::detail::hash_has_crc32c())
+      ok &= evaluate("crc32c", pi::detail::hash_bytes_crc32c, ks);
+  }
+
+  bench_match_key_map();
+
+  pi_destroy();
+  if (!ok) std::fprintf(stderr, "Hash quality check FAILED\n");
+  return ok ? 0 : 1;
+}
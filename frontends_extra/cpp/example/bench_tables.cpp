@@ -0,0 +1,184 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Measures the number of heap allocations and the time needed to build a
+// MatchKey / ActionData and add the entry, using the dummy target. The
+// allocations made by the target itself (malloc) are not counted, only the
+// ones made by the C++ frontend (operator new).
+
+#include <PI/frontends/cpp/batch.h>
+#include <PI/frontends/cpp/tables.h>
+#include <PI/p4info.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> num_allocs{0};
+
+}  // namespace
+
+void *operator new(size_t size) {
+  num_allocs++;
+  void *ptr = std::malloc(size);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+pi_p4info_t *p4info = nullptr;
+pi_session_handle_t sess;
+pi_dev_tgt_t dev_tgt = {0, 0xffff};
+
+constexpr size_t kIterations = 100000;
+// smaller than the table sizes, entries get overwritten
+constexpr uint32_t kNumKeys = 512;
+
+template <typename F>
+void run(const char *name, F f) {
+  size_t allocs_before = num_allocs;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kIterations; i++) {
+    if (f(i)) {
+      std::fprintf(stderr, "%s: error at iteration %zu\n", name, i);
+      std::exit(1);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - start).count();
+  std::printf("%-28s %10.2f allocs/op %10.1f ns/op\n", name,
+              static_cast<double>(num_allocs - allocs_before) / kIterations,
+              static_cast<double>(ns) / kIterations);
+}
+
+}  // namespace
+
+int main() {
+  pi_init(256, NULL);
+  std::ifstream istream(TESTDATADIR "/" "simple_router.json");
+  std::string config((std::istreambuf_iterator<char>(istream)),
+                     std::istreambuf_iterator<char>());
+  pi_add_config(config.c_str(), PI_CONFIG_TYPE_BMV2_JSON, &p4info);
+
+  pi_assign_extra_t assign_options[1];
+  std::memset(assign_options, 0, sizeof(assign_options));
+  assign_options[0].end_of_extras = true;
+  pi_assign_device(0, p4info, assign_options);
+  pi_session_init(&sess);
+
+  auto t_lpm = pi_p4info_table_id_from_name(p4info, "ipv4_lpm");
+  auto mf_lpm = pi_p4info_table_match_field_id_from_name(
+      p4info, t_lpm, "ipv4.dstAddr");
+  auto a_nhop = pi_p4info_action_id_from_name(p4info, "set_nhop");
+  auto ap_nhop = pi_p4info_action_param_id_from_name(
+      p4info, a_nhop, "nhop_ipv4");
+  auto ap_port = pi_p4info_action_param_id_from_name(p4info, a_nhop, "port");
+  auto t_fwd = pi_p4info_table_id_from_name(p4info, "forward");
+  auto mf_fwd = pi_p4info_table_match_field_id_from_name(
+      p4info, t_fwd, "routing_metadata.nhop_ipv4");
+  auto a_dmac = pi_p4info_action_id_from_name(p4info, "set_dmac");
+  auto ap_dmac = pi_p4info_action_param_id_from_name(p4info, a_dmac, "dmac");
+
+  pi::MatchTable mt_lpm(sess, dev_tgt, p4info, t_lpm);
+  pi::MatchTable mt_fwd(sess, dev_tgt, p4info, t_fwd);
+
+  run("ipv4_lpm build + add", [&](size_t i) {
+    pi::MatchKey mk(p4info, t_lpm);
+    auto key = static_cast<uint32_t>(i % kNumKeys);
+    pi::error_code_t rc = mk.set_lpm(mf_lpm, key, 32);
+    pi::ActionEntry ae;
+    ae.init_action_data(p4info, a_nhop);
+    rc |= ae.mutable_action_data()->set_arg(ap_nhop, static_cast<uint32_t>(i));
+    rc |= ae.mutable_action_data()->set_arg(ap_port, static_cast<uint16_t>(1));
+    pi_entry_handle_t h;
+    return rc | mt_lpm.entry_add(mk, ae, true, &h);
+  });
+
+  run("forward build + add", [&](size_t i) {
+    pi::MatchKey mk(p4info, t_fwd);
+    auto key = static_cast<uint32_t>(i % kNumKeys);
+    pi::error_code_t rc = mk.set_exact(mf_fwd, key);
+    pi::ActionEntry ae;
+    ae.init_action_data(p4info, a_dmac);
+    char dmac[6] = {0, 1, 2, 3, 4, 5};
+    rc |= ae.mutable_action_data()->set_arg(ap_dmac, dmac, sizeof(dmac));
+    pi_entry_handle_t h;
+    return rc | mt_fwd.entry_add(mk, ae, true, &h);
+  });
+
+  // the MatchKey and ActionData are reused for every entry, the batch is
+  // submitted every kBatchSize operations
+  constexpr size_t kBatchSize = 256;
+  auto batch = mt_lpm.batch();
+  pi::MatchKey batch_mk(p4info, t_lpm);
+  pi::ActionData batch_ad(p4info, a_nhop);
+  run("ipv4_lpm batched add", [&](size_t i) {
+    batch_mk.reset();
+    auto key = static_cast<uint32_t>(i % kNumKeys);
+    pi::error_code_t rc = batch_mk.set_lpm(mf_lpm, key, 32);
+    batch_ad.reset();
+    rc |= batch_ad.set_arg(ap_nhop, static_cast<uint32_t>(i));
+    rc |= batch_ad.set_arg(ap_port, static_cast<uint16_t>(1));
+    batch.entry_add(batch_mk, batch_ad, true);
+    if (batch.size() == kBatchSize) {
+      rc |= batch.submit();
+      batch.clear();
+    }
+    return rc;
+  });
+
+  std::vector<pi::MatchKey> keys;
+  keys.reserve(kIterations);
+  run("MatchKey copy", [&](size_t i) {
+    pi::MatchKey mk(p4info, t_lpm);
+    pi::error_code_t rc = mk.set_lpm(mf_lpm, static_cast<uint32_t>(i), 32);
+    keys.push_back(mk);
+    return rc;
+  });
+  keys.clear();
+
+  pi::MatchKey mk_template(p4info, t_lpm);
+  run("MatchKey move", [&](size_t) {
+    pi::MatchKey mk(mk_template);
+    keys.push_back(std::move(mk));
+    return 0;
+  });
+  keys.clear();
+
+  pi_session_cleanup(sess);
+  pi_remove_device(0);
+  pi_destroy_config(p4info);
+  pi_destroy();
+}
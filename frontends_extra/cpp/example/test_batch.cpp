@@ -0,0 +1,234 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Tests MatchTableBatch and ActProfBatch with the dummy target, for
+// unittest.p4. The program exits with a non-zero status if one of the checks
+// fails.
+
+#include <PI/frontends/cpp/batch.h>
+#include <PI/frontends/cpp/tables.h>
+#include <PI/p4info.h>
+#include <PI/pi.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+pi_p4info_t *p4info = nullptr;
+pi_session_handle_t sess;
+pi_dev_tgt_t dev_tgt = {0, 0xffff};
+int failures = 0;
+
+void
+check(bool cond, const char *what) {
+  if (cond) return;
+  std::fprintf(stderr, "FAILED: %s\n", what);
+  failures++;
+}
+
+size_t
+num_entries(pi_p4_id_t t_id) {
+  pi_table_fetch_res_t *res;
+  if (pi_table_entries_fetch(sess, dev_tgt.dev_id, t_id, &res) !=
+      PI_STATUS_SUCCESS) {
+    return 0;
+  }
+  size_t n = pi_table_entries_num(res);
+  pi_table_entries_fetch_done(sess, res);
+  return n;
+}
+
+class ExactOne {
+ public:
+  ExactOne()
+      : t_id(pi_p4info_table_id_from_name(p4info, "ExactOne")),
+        f_id(pi_p4info_table_match_field_id_from_name(
+            p4info, t_id, "header_test.field32")),
+        a_id(pi_p4info_action_id_from_name(p4info, "actionA")),
+        p_id(pi_p4info_action_param_id_from_name(p4info, a_id, "param")),
+        table(sess, dev_tgt, p4info, t_id) { }
+
+  pi::MatchKey key(uint32_t v) const {
+    pi::MatchKey mk(p4info, t_id);
+    mk.set_exact(f_id, v);
+    return mk;
+  }
+
+  pi::ActionData data(uint64_t v) const {
+    pi::ActionData ad(p4info, a_id);
+    ad.set_arg(p_id, v);
+    return ad;
+  }
+
+  pi_p4_id_t t_id;
+  pi_p4_id_t f_id;
+  pi_p4_id_t a_id;
+  pi_p4_id_t p_id;
+  pi::MatchTable table;
+};
+
+void
+test_match_table() {
+  ExactOne t;
+  auto batch = t.table.batch();
+  auto ad = t.data(1);
+  // the objects are copied when recorded, so they can be reused right away
+  auto mk = t.key(1);
+  auto i1 = batch.entry_add(mk, ad, false);
+  mk.set_exact(t.f_id, static_cast<uint32_t>(2));
+  auto i2 = batch.entry_add(mk, ad, false);
+  auto i_dup = batch.entry_add(mk, ad, false);
+  check(batch.size() == 3, "batch size");
+  check(batch.submit() != PI_STATUS_SUCCESS, "submit with a duplicate");
+  check(batch.result(i1).status == PI_STATUS_SUCCESS, "add 1");
+  check(batch.result(i2).status == PI_STATUS_SUCCESS, "add 2");
+  check(batch.result(i_dup).status != PI_STATUS_SUCCESS, "duplicate add");
+  check(num_entries(t.t_id) == 2, "2 entries added");
+  auto h1 = batch.result(i1).entry_handle;
+
+  // an ActionEntry which was never initialized is not sent, the other
+  // operations are
+  batch.clear();
+  check(batch.empty(), "clear");
+  pi::ActionEntry uninitialized;
+  pi::ActionEntry action_entry;
+  action_entry.init_action_data(p4info, t.a_id);
+  action_entry.mutable_action_data()->set_arg(t.p_id,
+                                              static_cast<uint64_t>(9));
+  auto i_bad = batch.entry_modify(h1, uninitialized);
+  auto i_mod = batch.entry_modify(h1, action_entry);
+  auto i_mod_wkey = batch.entry_modify_wkey(t.key(2), action_entry);
+  check(batch.submit() == PI_STATUS_INVALID_ENTRY_TYPE,
+        "submit with an uninitialized action entry");
+  check(batch.result(i_bad).status == PI_STATUS_INVALID_ENTRY_TYPE,
+        "uninitialized action entry");
+  check(batch.result(i_mod).status == PI_STATUS_SUCCESS, "modify");
+  check(batch.result(i_mod_wkey).status == PI_STATUS_SUCCESS,
+        "modify with key");
+
+  batch.clear();
+  auto i_del = batch.entry_delete(h1);
+  auto i_del_wkey = batch.entry_delete_wkey(t.key(2));
+  check(batch.submit() == PI_STATUS_SUCCESS, "submit deletes");
+  check(batch.result(i_del).status == PI_STATUS_SUCCESS, "delete");
+  check(batch.result(i_del_wkey).status == PI_STATUS_SUCCESS,
+        "delete with key");
+  check(num_entries(t.t_id) == 0, "all entries deleted");
+}
+
+void
+test_act_prof() {
+  auto ap_id = pi_p4info_act_prof_id_from_name(p4info, "ActProfWS");
+  auto a_id = pi_p4info_action_id_from_name(p4info, "actionA");
+  auto p_id = pi_p4info_action_param_id_from_name(p4info, a_id, "param");
+  pi::ActProf ap(sess, dev_tgt, p4info, ap_id);
+  pi::ActionData ad(p4info, a_id);
+  ad.set_arg(p_id, static_cast<uint64_t>(1));
+
+  auto batch = ap.batch();
+  auto i_m1 = batch.member_create(ad);
+  auto i_m2 = batch.member_create(ad);
+  auto i_g = batch.group_create(4);
+  check(batch.submit() == PI_STATUS_SUCCESS, "submit creates");
+  auto m1 = batch.result(i_m1).handle;
+  auto m2 = batch.result(i_m2).handle;
+  auto g = batch.result(i_g).handle;
+  check(m1 != m2, "member handles");
+
+  batch.clear();
+  ad.set_arg(p_id, static_cast<uint64_t>(2));
+  batch.member_modify(m1, ad);
+  batch.group_add_member(g, m1);
+  batch.group_add_member(g, m2);
+  batch.group_remove_member(g, m2);
+  check(batch.submit() == PI_STATUS_SUCCESS, "submit updates");
+  for (size_t i = 0; i < batch.size(); i++)
+    check(batch.result(i).status == PI_STATUS_SUCCESS, "update");
+
+  batch.clear();
+  batch.group_remove_member(g, m1);
+  batch.group_delete(g);
+  batch.member_delete(m1);
+  batch.member_delete(m2);
+  check(batch.submit() == PI_STATUS_SUCCESS, "submit deletes");
+}
+
+// the batches are all sent by the same thread, in submission order
+void
+test_submit_async() {
+  ExactOne t;
+  constexpr size_t kNumBatches = 8;
+  constexpr uint32_t kEntriesPerBatch = 16;
+  std::vector<pi::MatchTableBatch> batches;
+  for (size_t i = 0; i < kNumBatches; i++) {
+    batches.push_back(t.table.batch());
+    for (uint32_t j = 0; j < kEntriesPerBatch; j++) {
+      batches.back().entry_add(t.key(i * kEntriesPerBatch + j), t.data(j),
+                               false);
+    }
+  }
+  std::vector<std::future<pi_status_t> > futures;
+  for (auto &batch : batches) futures.push_back(batch.submit_async());
+  for (auto &future : futures)
+    check(future.get() == PI_STATUS_SUCCESS, "async submit");
+  check(num_entries(t.t_id) == kNumBatches * kEntriesPerBatch,
+        "entries added asynchronously");
+
+  // a batch can be submitted again once its future is ready
+  auto &batch = batches.front();
+  batch.clear();
+  for (size_t i = 0; i < kNumBatches * kEntriesPerBatch; i++)
+    batch.entry_delete_wkey(t.key(i));
+  check(batch.submit_async().get() == PI_STATUS_SUCCESS, "async deletes");
+  check(num_entries(t.t_id) == 0, "entries deleted asynchronously");
+}
+
+}  // namespace
+
+int main() {
+  pi_init(256, NULL);
+  std::ifstream istream(UNITTEST_DATADIR "/" "unittest.json");
+  std::string config((std::istreambuf_iterator<char>(istream)),
+                     std::istreambuf_iterator<char>());
+  pi_add_config(config.c_str(), PI_CONFIG_TYPE_BMV2_JSON, &p4info);
+
+  pi_assign_extra_t assign_options[1];
+  std::memset(assign_options, 0, sizeof(assign_options));
+  assign_options[0].end_of_extras = true;
+  pi_assign_device(dev_tgt.dev_id, p4info, assign_options);
+  pi_session_init(&sess);
+
+  test_match_table();
+  test_act_prof();
+  test_submit_async();
+
+  pi_session_cleanup(sess);
+  pi_remove_device(dev_tgt.dev_id);
+  pi_destroy_config(p4info);
+  pi_destroy();
+  if (failures > 0) std::fprintf(stderr, "%d check(s) FAILED\n", failures);
+  return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,274 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Checks the code generated by pi_gen_cpp for unittest.p4 (pi_cpp_tables.h):
+// the match keys and action data built with the generated setters must be
+// byte for byte identical to the ones built with the generic pi::MatchKey and
+// pi::ActionData, which look up the field offsets and bitwidths in the
+// p4info. The typed table operations are then run on the dummy target. The
+// program exits with a non-zero status if one of the checks fails.
+
+#include <PI/frontends/cpp/tables.h>
+#include <PI/int/pi_int.h>
+#include <PI/p4info.h>
+#include <PI/pi.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <streambuf>
+#include <string>
+
+#include "pi_cpp_tables.h"
+
+namespace {
+
+namespace ut = unittest;
+
+pi_p4info_t *p4info = nullptr;
+int failures = 0;
+
+void
+check(bool cond, const char *what) {
+  if (cond) return;
+  std::fprintf(stderr, "FAILED: %s\n", what);
+  failures++;
+}
+
+// compares the table id, the priority and the key bytes
+bool
+same_key(const pi_match_key_t *typed, const pi::MatchKey &generic) {
+  return pi::MatchKeyEq()(pi::MatchKeyView(generic),
+                          pi::MatchKeyView(typed));
+}
+
+bool
+same_data(const pi_action_data_t *typed, const pi::ActionData &generic) {
+  auto ad = generic.pi_action_data();
+  return typed->action_id == ad->action_id &&
+      typed->data_size == ad->data_size &&
+      !std::memcmp(typed->data, ad->data, ad->data_size);
+}
+
+pi_p4_id_t
+table_id(const char *name) {
+  return pi_p4info_table_id_from_name(p4info, name);
+}
+
+pi_p4_id_t
+field_id(pi_p4_id_t t_id, const char *name) {
+  return pi_p4info_table_match_field_id_from_name(p4info, t_id, name);
+}
+
+void
+test_exact() {
+  auto t_id = table_id("ExactOne");
+  check(ut::tables::ExactOne::Info::id == t_id, "ExactOne id");
+  ut::tables::ExactOne::MatchKey typed(p4info);
+  typed.set_header_test_field32(0x0a0b0c0du);
+  pi::MatchKey generic(p4info, t_id);
+  generic.set_exact(field_id(t_id, "header_test.field32"), 0x0a0b0c0du);
+  check(same_key(typed.get(), generic), "ExactOne key");
+
+  // byte array setter
+  const char v[4] = {'\x0a', '\x0b', '\x0c', '\x0d'};
+  ut::tables::ExactOne::MatchKey typed_bytes(p4info);
+  typed_bytes.set_header_test_field32(v);
+  check(same_key(typed_bytes.get(), generic), "ExactOne key from bytes");
+}
+
+// the bits beyond the bitwidth must be masked out
+void
+test_exact_non_aligned() {
+  auto t_id = table_id("ExactOneNonAligned");
+  ut::tables::ExactOneNonAligned::MatchKey typed(p4info);
+  typed.set_header_test_field12(static_cast<uint16_t>(0xfabc));
+  pi::MatchKey generic(p4info, t_id);
+  generic.set_exact(field_id(t_id, "header_test.field12"),
+                    static_cast<uint16_t>(0xfabc));
+  check(same_key(typed.get(), generic), "ExactOneNonAligned key");
+}
+
+void
+test_lpm() {
+  auto t_id = table_id("LpmOne");
+  ut::tables::LpmOne::MatchKey typed(p4info);
+  typed.set_header_test_field32(0x0a000000u, 12);
+  pi::MatchKey generic(p4info, t_id);
+  generic.set_lpm(field_id(t_id, "header_test.field32"), 0x0a000000u, 12);
+  check(same_key(typed.get(), generic), "LpmOne key");
+}
+
+void
+test_ternary() {
+  auto t_id = table_id("TernaryOne");
+  ut::tables::TernaryOne::MatchKey typed(p4info);
+  typed.set_header_test_field32(0x0a000001u, 0xff0000ffu);
+  typed.set_priority(7);
+  pi::MatchKey generic(p4info, t_id);
+  generic.set_ternary(field_id(t_id, "header_test.field32"), 0x0a000001u,
+                      0xff0000ffu);
+  generic.set_priority(7);
+  check(same_key(typed.get(), generic), "TernaryOne key");
+}
+
+void
+test_range() {
+  auto t_id = table_id("RangeOne");
+  ut::tables::RangeOne::MatchKey typed(p4info);
+  typed.set_header_test_field32(100u, 2000u);
+  typed.set_priority(1);
+  pi::MatchKey generic(p4info, t_id);
+  generic.set_range(field_id(t_id, "header_test.field32"), 100u, 2000u);
+  generic.set_priority(1);
+  check(same_key(typed.get(), generic), "RangeOne key");
+}
+
+void
+test_mix_many() {
+  auto t_id = table_id("MixMany");
+  ut::tables::MixMany::MatchKey typed(p4info);
+  typed.set_header_test_field32(0xdeadbeefu);
+  typed.set_header_test_field16(static_cast<uint16_t>(0xab00), 8);
+  typed.set_header_test_field20(0xfffabcdu, 0xff0ffu);
+  typed.set_header_test_valid(true);
+  typed.set_priority(3);
+  pi::MatchKey generic(p4info, t_id);
+  generic.set_exact(field_id(t_id, "header_test.field32"), 0xdeadbeefu);
+  generic.set_lpm(field_id(t_id, "header_test.field16"),
+                  static_cast<uint16_t>(0xab00), 8);
+  generic.set_ternary(field_id(t_id, "header_test.field20"), 0xfffabcdu,
+                      0xff0ffu);
+  generic.set_valid(field_id(t_id, "header_test._valid"), true);
+  generic.set_priority(3);
+  check(same_key(typed.get(), generic), "MixMany key");
+
+  // copies point to their own buffer
+  auto copy = typed;
+  typed.set_header_test_field32(0u);
+  check(same_key(copy.get(), generic), "MixMany key copy");
+  check(!same_key(typed.get(), generic), "MixMany key after copy");
+}
+
+void
+test_action_data() {
+  auto a_id = pi_p4info_action_id_from_name(p4info, "actionA");
+  check(ut::actions::actionA::Info::id == a_id, "actionA id");
+  ut::actions::actionA::ActionData typed(p4info);
+  typed.set_param(0xa1a2a3a4a5a6u);
+  pi::ActionData generic(p4info, a_id);
+  generic.set_arg(pi_p4info_action_param_id_from_name(p4info, a_id, "param"),
+                  static_cast<uint64_t>(0xa1a2a3a4a5a6u));
+  check(same_data(typed.get(), generic), "actionA data");
+
+  auto b_id = pi_p4info_action_id_from_name(p4info, "actionB");
+  ut::actions::actionB::ActionData typed_b(p4info);
+  typed_b.set_param(static_cast<uint8_t>(0x7f));
+  pi::ActionData generic_b(p4info, b_id);
+  generic_b.set_arg(pi_p4info_action_param_id_from_name(p4info, b_id, "param"),
+                    static_cast<uint8_t>(0x7f));
+  check(same_data(typed_b.get(), generic_b), "actionB data");
+}
+
+pi_indirect_handle_t
+fetch_indirect_handle(pi_session_handle_t sess, pi_p4_id_t t_id) {
+  pi_table_fetch_res_t *res;
+  pi_indirect_handle_t h = 0;
+  if (pi_table_entries_fetch(sess, 0, t_id, &res) != PI_STATUS_SUCCESS)
+    return h;
+  if (pi_table_entries_num(res) == 1) {
+    pi_table_ma_entry_t entry;
+    pi_entry_handle_t entry_handle;
+    pi_table_entries_next(res, &entry, &entry_handle);
+    if (entry.entry.entry_type == PI_ACTION_ENTRY_TYPE_INDIRECT)
+      h = entry.entry.entry.indirect_handle;
+  }
+  pi_table_entries_fetch_done(sess, res);
+  return h;
+}
+
+// the typed table operations, using the dummy target
+void
+test_indirect_table(pi_session_handle_t sess) {
+  pi_dev_tgt_t dev_tgt = {0, 0xffff};
+  auto t_id = table_id("IndirectWS");
+  auto ap_id = pi_p4info_act_prof_id_from_name(p4info, "ActProfWS");
+  ut::actions::actionA::ActionData ad(p4info);
+  pi_indirect_handle_t mbr_1, mbr_2;
+  ad.set_param(static_cast<uint64_t>(1));
+  check(pi_act_prof_mbr_create(sess, dev_tgt, ap_id, ad.get(), &mbr_1) ==
+        PI_STATUS_SUCCESS, "member 1 create");
+  ad.set_param(static_cast<uint64_t>(2));
+  check(pi_act_prof_mbr_create(sess, dev_tgt, ap_id, ad.get(), &mbr_2) ==
+        PI_STATUS_SUCCESS, "member 2 create");
+
+  ut::tables::IndirectWS::Table table(sess, dev_tgt);
+  ut::tables::IndirectWS::MatchKey mk(p4info);
+  mk.set_header_test_field32(0x0a000001u);
+  pi_entry_handle_t entry_handle;
+  check(table.entry_add(mk, mbr_1, false, &entry_handle) == PI_STATUS_SUCCESS,
+        "IndirectWS entry_add");
+  check(fetch_indirect_handle(sess, t_id) == mbr_1, "IndirectWS added");
+  check(table.entry_modify(entry_handle, mbr_2) == PI_STATUS_SUCCESS,
+        "IndirectWS entry_modify");
+  check(fetch_indirect_handle(sess, t_id) == mbr_2, "IndirectWS modified");
+  check(table.entry_modify_wkey(mk, mbr_1) == PI_STATUS_SUCCESS,
+        "IndirectWS entry_modify_wkey");
+  check(fetch_indirect_handle(sess, t_id) == mbr_1,
+        "IndirectWS modified with key");
+  check(table.entry_delete_wkey(mk) == PI_STATUS_SUCCESS,
+        "IndirectWS entry_delete_wkey");
+
+  pi_act_prof_mbr_delete(sess, dev_tgt.dev_id, ap_id, mbr_1);
+  pi_act_prof_mbr_delete(sess, dev_tgt.dev_id, ap_id, mbr_2);
+}
+
+}  // namespace
+
+int main() {
+  pi_init(256, NULL);
+  std::ifstream istream(UNITTEST_DATADIR "/" "unittest.json");
+  std::string config((std::istreambuf_iterator<char>(istream)),
+                     std::istreambuf_iterator<char>());
+  pi_add_config(config.c_str(), PI_CONFIG_TYPE_BMV2_JSON, &p4info);
+
+  test_exact();
+  test_exact_non_aligned();
+  test_lpm();
+  test_ternary();
+  test_range();
+  test_mix_many();
+  test_action_data();
+
+  pi_assign_extra_t assign_options[1];
+  std::memset(assign_options, 0, sizeof(assign_options));
+  assign_options[0].end_of_extras = true;
+  pi_assign_device(0, p4info, assign_options);
+  pi_session_handle_t sess;
+  pi_session_init(&sess);
+  test_indirect_table(sess);
+  pi_session_cleanup(sess);
+  pi_remove_device(0);
+
+  pi_destroy_config(p4info);
+  pi_destroy();
+  if (failures > 0) std::fprintf(stderr, "%d check(s) FAILED\n", failures);
+  return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,414 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <PI/frontends/cpp/batch.h>
+#include <PI/frontends/cpp/tables.h>
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pi {
+
+namespace {
+
+// Runs the batches submitted with submit_async, one at a time and in
+// submission order, on a single thread which is started on first use and
+// reused afterwards.
+class AsyncSubmitter {
+ public:
+  using Task = std::packaged_task<pi_status_t()>;
+
+  static AsyncSubmitter *get() {
+    static AsyncSubmitter submitter;
+    return &submitter;
+  }
+
+  template <typename F>
+  std::future<pi_status_t> submit(F f) {
+    Task task(std::move(f));
+    auto future = task.get_future();
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!thread.joinable()) thread = std::thread(&AsyncSubmitter::loop, this);
+    tasks.push_back(std::move(task));
+    cv.notify_one();
+    return future;
+  }
+
+  // the batches which are still queued are sent before the thread exits
+  ~AsyncSubmitter() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stop = true;
+      cv.notify_one();
+    }
+    if (thread.joinable()) thread.join();
+  }
+
+ private:
+  AsyncSubmitter() = default;
+
+  void loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      cv.wait(lock, [this] { return stop || !tasks.empty(); });
+      if (tasks.empty()) return;
+      auto task = std::move(tasks.front());
+      tasks.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  std::deque<Task> tasks{};
+  bool stop{false};
+  std::thread thread{};
+};
+
+// Common to MatchTableBatch and ActProfBatch: sends all the operations
+// between pi_batch_begin and pi_batch_end, even if some of them fail, and
+// returns the first error.
+template <typename Result, typename SendOne>
+pi_status_t
+submit_ops(pi_session_handle_t sess, bool hw_sync, size_t num_ops,
+           std::vector<Result> *results, SendOne send_one) {
+  results->assign(num_ops, Result{PI_STATUS_SUCCESS, 0});
+  pi_status_t status = pi_batch_begin(sess);
+  if (status != PI_STATUS_SUCCESS) return status;
+  pi_status_t first_error = PI_STATUS_SUCCESS;
+  for (size_t i = 0; i < num_ops; i++) {
+    auto &result = (*results)[i];
+    result.status = send_one(i, &result);
+    if (result.status != PI_STATUS_SUCCESS && first_error == PI_STATUS_SUCCESS)
+      first_error = result.status;
+  }
+  status = pi_batch_end(sess, hw_sync);
+  return (first_error != PI_STATUS_SUCCESS) ? first_error : status;
+}
+
+}  // namespace
+
+MatchTableBatch
+MatchTable::batch() const {
+  return MatchTableBatch(*this);
+}
+
+ActProfBatch
+ActProf::batch() const {
+  return ActProfBatch(*this);
+}
+
+MatchTableBatch::MatchTableBatch(const MatchTable &table)
+    : sess(table.sess), dev_tgt(table.dev_tgt), table_id(table.table_id) { }
+
+MatchTableBatch::Op &
+MatchTableBatch::new_op(OpType type) {
+  ops.emplace_back();
+  auto &op = ops.back();
+  op.type = type;
+  op.overwrite = false;
+  op.entry_handle = 0;
+  op.action_type = PI_ACTION_ENTRY_TYPE_NONE;
+  op.record_status = PI_STATUS_SUCCESS;
+  return op;
+}
+
+void
+MatchTableBatch::record_match_key(Op *op, const MatchKey &match_key) {
+  op->match_key = match_key.match_key;
+  op->match_key.set_data(nullptr);  // set by send_one
+  op->mk_offset = buffer.append(match_key._data.data(), match_key.mk_size);
+}
+
+void
+MatchTableBatch::record_action_data(Op *op, const ActionData &action_data) {
+  op->action_type = PI_ACTION_ENTRY_TYPE_DATA;
+  op->action_data = action_data.action_data;
+  op->action_data.set_data(nullptr);  // set by send_one
+  op->ad_offset = buffer.append(action_data._data.data(),
+                                action_data.ad_size);
+}
+
+void
+MatchTableBatch::record_action_entry(Op *op,
+                                     const ActionEntry &action_entry) {
+  switch (action_entry.type()) {
+    case ActionEntry::Tag::NONE:
+      op->record_status = PI_STATUS_INVALID_ENTRY_TYPE;
+      break;
+    case ActionEntry::Tag::ACTION_DATA:
+      record_action_data(op, action_entry.action_data());
+      break;
+    case ActionEntry::Tag::INDIRECT_HANDLE:
+      op->action_type = PI_ACTION_ENTRY_TYPE_INDIRECT;
+      op->indirect_handle = action_entry.indirect_handle();
+      break;
+  }
+}
+
+size_t
+MatchTableBatch::entry_add(const MatchKey &match_key,
+                           const ActionEntry &action_entry, bool overwrite) {
+  auto &op = new_op(OpType::ADD);
+  op.overwrite = overwrite;
+  record_match_key(&op, match_key);
+  record_action_entry(&op, action_entry);
+  return ops.size() - 1;
+}
+
+size_t
+MatchTableBatch::entry_add(const MatchKey &match_key,
+                           const ActionData &action_data, bool overwrite) {
+  auto &op = new_op(OpType::ADD);
+  op.overwrite = overwrite;
+  record_match_key(&op, match_key);
+  record_action_data(&op, action_data);
+  return ops.size() - 1;
+}
+
+size_t
+MatchTableBatch::entry_delete(pi_entry_handle_t entry_handle) {
+  auto &op = new_op(OpType::DELETE);
+  op.entry_handle = entry_handle;
+  return ops.size() - 1;
+}
+
+size_t
+MatchTableBatch::entry_delete_wkey(const MatchKey &match_key) {
+  auto &op = new_op(OpType::DELETE_WKEY);
+  record_match_key(&op, match_key);
+  return ops.size() - 1;
+}
+
+size_t
+MatchTableBatch::entry_modify(pi_entry_handle_t entry_handle,
+                              const ActionEntry &action_entry) {
+  auto &op = new_op(OpType::MODIFY);
+  op.entry_handle = entry_handle;
+  record_action_entry(&op, action_entry);
+  return ops.size() - 1;
+}
+
+size_t
+MatchTableBatch::entry_modify_wkey(const MatchKey &match_key,
+                                   const ActionEntry &action_entry) {
+  auto &op = new_op(OpType::MODIFY_WKEY);
+  record_match_key(&op, match_key);
+  record_action_entry(&op, action_entry);
+  return ops.size() - 1;
+}
+
+// the buffer cannot grow anymore at this stage, so we can finally point the
+// PI structures to it
+pi_status_t
+MatchTableBatch::send_one(Op *op, Result *result) {
+  if (op->record_status != PI_STATUS_SUCCESS) return op->record_status;
+  if (op->type != OpType::DELETE && op->type != OpType::MODIFY)
+    op->match_key.set_data(buffer.at(op->mk_offset));
+
+  pi_table_entry_t entry;
+  entry.entry_type = op->action_type;
+  entry.entry_properties = NULL;
+  entry.direct_res_config = NULL;
+  if (op->action_type == PI_ACTION_ENTRY_TYPE_DATA) {
+    op->action_data.set_data(buffer.at(op->ad_offset));
+    entry.entry.action_data = op->action_data.get();
+  } else if (op->action_type == PI_ACTION_ENTRY_TYPE_INDIRECT) {
+    entry.entry.indirect_handle = op->indirect_handle;
+  }
+
+  auto dev_id = dev_tgt.dev_id;
+  switch (op->type) {
+    case OpType::ADD:
+      // the handle is written to result directly, which means that it will
+      // be valid even if the target only fills it in during pi_batch_end
+      return pi_table_entry_add(sess, dev_tgt, table_id, op->match_key.get(),
+                                &entry, op->overwrite, &result->entry_handle);
+    case OpType::DELETE:
+      return pi_table_entry_delete(sess, dev_id, table_id, op->entry_handle);
+    case OpType::DELETE_WKEY:
+      return pi_table_entry_delete_wkey(sess, dev_id, table_id,
+                                        op->match_key.get());
+    case OpType::MODIFY:
+      return pi_table_entry_modify(sess, dev_id, table_id, op->entry_handle,
+                                   &entry);
+    case OpType::MODIFY_WKEY:
+      return pi_table_entry_modify_wkey(sess, dev_id, table_id,
+                                        op->match_key.get(), &entry);
+  }
+  return PI_STATUS_SUCCESS;  // unreachable
+}
+
+pi_status_t
+MatchTableBatch::submit(bool hw_sync) {
+  return submit_ops(sess, hw_sync, ops.size(), &results,
+                    [this](size_t i, Result *result) {
+                      return send_one(&ops[i], result);
+                    });
+}
+
+std::future<pi_status_t>
+MatchTableBatch::submit_async(bool hw_sync) {
+  return AsyncSubmitter::get()->submit(
+      [this, hw_sync]() { return submit(hw_sync); });
+}
+
+void
+MatchTableBatch::clear() {
+  ops.clear();
+  results.clear();
+  buffer.clear();
+}
+
+ActProfBatch::ActProfBatch(const ActProf &act_prof)
+    : sess(act_prof.sess), dev_tgt(act_prof.dev_tgt),
+      act_prof_id(act_prof.act_prof_id) { }
+
+ActProfBatch::Op &
+ActProfBatch::new_op(OpType type) {
+  ops.emplace_back();
+  auto &op = ops.back();
+  op.type = type;
+  op.handle = 0;
+  op.member_handle = 0;
+  op.max_size = 0;
+  return op;
+}
+
+void
+ActProfBatch::record_action_data(Op *op, const ActionData &action_data) {
+  op->action_data = action_data.action_data;
+  op->action_data.set_data(nullptr);  // set by send_one
+  op->ad_offset = buffer.append(action_data._data.data(),
+                                action_data.ad_size);
+}
+
+size_t
+ActProfBatch::member_create(const ActionData &action_data) {
+  auto &op = new_op(OpType::MEMBER_CREATE);
+  record_action_data(&op, action_data);
+  return ops.size() - 1;
+}
+
+size_t
+ActProfBatch::member_delete(pi_indirect_handle_t member_handle) {
+  auto &op = new_op(OpType::MEMBER_DELETE);
+  op.handle = member_handle;
+  return ops.size() - 1;
+}
+
+size_t
+ActProfBatch::member_modify(pi_indirect_handle_t member_handle,
+                            const ActionData &action_data) {
+  auto &op = new_op(OpType::MEMBER_MODIFY);
+  op.handle = member_handle;
+  record_action_data(&op, action_data);
+  return ops.size() - 1;
+}
+
+size_t
+ActProfBatch::group_create(size_t max_size) {
+  auto &op = new_op(OpType::GROUP_CREATE);
+  op.max_size = max_size;
+  return ops.size() - 1;
+}
+
+size_t
+ActProfBatch::group_delete(pi_indirect_handle_t group_handle) {
+  auto &op = new_op(OpType::GROUP_DELETE);
+  op.handle = group_handle;
+  return ops.size() - 1;
+}
+
+size_t
+ActProfBatch::group_add_member(pi_indirect_handle_t group_handle,
+                               pi_indirect_handle_t member_handle) {
+  auto &op = new_op(OpType::GROUP_ADD_MEMBER);
+  op.handle = group_handle;
+  op.member_handle = member_handle;
+  return ops.size() - 1;
+}
+
+size_t
+ActProfBatch::group_remove_member(pi_indirect_handle_t group_handle,
+                                  pi_indirect_handle_t member_handle) {
+  auto &op = new_op(OpType::GROUP_REMOVE_MEMBER);
+  op.handle = group_handle;
+  op.member_handle = member_handle;
+  return ops.size() - 1;
+}
+
+pi_status_t
+ActProfBatch::send_one(Op *op, Result *result) {
+  auto dev_id = dev_tgt.dev_id;
+  switch (op->type) {
+    case OpType::MEMBER_CREATE:
+      op->action_data.set_data(buffer.at(op->ad_offset));
+      return pi_act_prof_mbr_create(sess, dev_tgt, act_prof_id,
+                                    op->action_data.get(), &result->handle);
+    case OpType::MEMBER_DELETE:
+      return pi_act_prof_mbr_delete(sess, dev_id, act_prof_id, op->handle);
+    case OpType::MEMBER_MODIFY:
+      op->action_data.set_data(buffer.at(op->ad_offset));
+      return pi_act_prof_mbr_modify(sess, dev_id, act_prof_id, op->handle,
+                                    op->action_data.get());
+    case OpType::GROUP_CREATE:
+      return pi_act_prof_grp_create(sess, dev_tgt, act_prof_id, op->max_size,
+                                    &result->handle);
+    case OpType::GROUP_DELETE:
+      return pi_act_prof_grp_delete(sess, dev_id, act_prof_id, op->handle);
+    case OpType::GROUP_ADD_MEMBER:
+      return pi_act_prof_grp_add_mbr(sess, dev_id, act_prof_id, op->handle,
+                                     op->member_handle);
+    case OpType::GROUP_REMOVE_MEMBER:
+      return pi_act_prof_grp_remove_mbr(sess, dev_id, act_prof_id,
+                                        op->handle, op->member_handle);
+  }
+  return PI_STATUS_SUCCESS;  // unreachable
+}
+
+pi_status_t
+ActProfBatch::submit(bool hw_sync) {
+  return submit_ops(sess, hw_sync, ops.size(), &results,
+                    [this](size_t i, Result *result) {
+                      return send_one(&ops[i], result);
+                    });
+}
+
+std::future<pi_status_t>
+ActProfBatch::submit_async(bool hw_sync) {
+  return AsyncSubmitter::get()->submit(
+      [this, hw_sync]() { return submit(hw_sync); });
+}
+
+void
+ActProfBatch::clear() {
+  ops.clear();
+  results.clear();
+  buffer.clear();
+}
+
+}  // namespace pi
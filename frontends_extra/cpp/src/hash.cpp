@@ -0,0 +1,184 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <PI/frontends/cpp/hash.h>
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PI_HASH_HAVE_CRC32C
+#include <nmmintrin.h>
+#endif
+
+namespace pi {
+
+namespace {
+
+constexpr uint64_t kP0 = 0xa0761d6478bd642full;
+constexpr uint64_t kP1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t kP2 = 0x8ebc6af09c88c6e3ull;
+constexpr uint64_t kP3 = 0x589965cc75374cc3ull;
+
+// 64x64 -> 128 bit multiplication, folded back to 64 bits
+inline uint64_t
+mix(uint64_t a, uint64_t b) {
+  __uint128_t r = static_cast<__uint128_t>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+// the unaligned loads are done with memcpy, which the compiler turns into a
+// single mov; note that the hash value depends on the host byte order
+inline uint64_t
+load64(const unsigned char *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t
+load32(const unsigned char *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+#ifdef PI_HASH_HAVE_CRC32C
+
+// only the low 32 bits of v are consumed
+__attribute__((target("sse4.2"))) inline uint32_t
+crc32(uint32_t crc, uint64_t v) {
+  return _mm_crc32_u32(crc, static_cast<uint32_t>(v));
+}
+
+#endif  // PI_HASH_HAVE_CRC32C
+
+using HashFn = uint64_t (*)(const char *, size_t, uint64_t);
+
+HashFn
+select_hash_fn() {
+#ifdef PI_HASH_HAVE_CRC32C
+  if (detail::hash_has_crc32c()) return detail::hash_bytes_crc32c;
+#endif
+  return detail::hash_bytes_generic;
+}
+
+}  // namespace
+
+namespace detail {
+
+uint64_t
+hash_bytes_generic(const char *data, size_t size, uint64_t seed) {
+  auto p = reinterpret_cast<const unsigned char *>(data);
+  size_t len = size;
+  seed ^= mix(seed ^ kP0, kP1 ^ size);
+  while (len > 32) {
+    uint64_t h1 = mix(load64(p) ^ kP1, load64(p + 8) ^ seed);
+    uint64_t h2 = mix(load64(p + 16) ^ kP2, load64(p + 24) ^ seed);
+    seed = h1 ^ h2;
+    p += 32;
+    len -= 32;
+  }
+  if (len > 16) {
+    seed = mix(load64(p) ^ kP2, load64(p + 8) ^ seed);
+    p += 16;
+    len -= 16;
+  }
+  // the last 1 to 16 bytes, possibly with overlapping loads
+  uint64_t a = 0, b = 0;
+  if (len > 8) {
+    a = load64(p);
+    b = load64(p + len - 8);
+  } else if (len >= 4) {
+    a = load32(p);
+    b = load32(p + len - 4);
+  } else if (len > 0) {
+    a = (static_cast<uint64_t>(p[0]) << 16) |
+        (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+  }
+  return mix(kP3 ^ size, mix(a ^ kP1, b ^ seed));
+}
+
+#ifdef PI_HASH_HAVE_CRC32C
+
+// CRC32C only produces 32 bits, so we run 2 lanes, one for the low and one
+// for the high half of each 64-bit word. Because CRC32C is a bijection on
+// 32-bit inputs, 2 keys of up to 8 bytes never collide before the final
+// multiplication, which spreads the 2 lanes across all 64 bits of the result.
+__attribute__((target("sse4.2"))) uint64_t
+hash_bytes_crc32c(const char *data, size_t size, uint64_t seed) {
+  auto p = reinterpret_cast<const unsigned char *>(data);
+  size_t len = size;
+  uint32_t c1 = static_cast<uint32_t>(seed);
+  uint32_t c2 = static_cast<uint32_t>((seed >> 32) ^ size);
+  while (len >= 16) {
+    uint64_t w0 = load64(p), w1 = load64(p + 8);
+    c1 = crc32(crc32(c1, w0), w1);
+    c2 = crc32(crc32(c2, w0 >> 32), w1 >> 32);
+    p += 16;
+    len -= 16;
+  }
+  if (len >= 8) {
+    uint64_t w = load64(p);
+    c1 = crc32(c1, w);
+    c2 = crc32(c2, w >> 32);
+    p += 8;
+    len -= 8;
+  }
+  // the last 1 to 7 bytes, the size was mixed into c2 at the beginning so
+  // overlapping loads are fine
+  if (len >= 4) {
+    c1 = crc32(c1, load32(p));
+    c2 = crc32(c2, load32(p + len - 4));
+  } else if (len > 0) {
+    c1 = crc32(c1, (static_cast<uint64_t>(p[0]) << 16) |
+               (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1]);
+  }
+  return mix((static_cast<uint64_t>(c1) << 32 | c2) ^ kP1, seed ^ kP2);
+}
+
+bool
+hash_has_crc32c() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#else
+
+uint64_t
+hash_bytes_crc32c(const char *data, size_t size, uint64_t seed) {
+  return hash_bytes_generic(data, size, seed);
+}
+
+bool
+hash_has_crc32c() {
+  return false;
+}
+
+#endif  // PI_HASH_HAVE_CRC32C
+
+}  // namespace detail
+
+uint64_t
+hash_bytes(const char *data, size_t size, uint64_t seed) {
+  static const HashFn hash_fn = select_hash_fn();
+  return hash_fn(data, size, seed);
+}
+
+}  // namespace pi
@@ -20,13 +20,16 @@
 
 #include <arpa/inet.h>
 
+#include <PI/frontends/cpp/hash.h>
 #include <PI/frontends/cpp/tables.h>
 #include <PI/p4info.h>
 
 #include <PI/int/pi_int.h>
 #include <PI/int/serialize.h>
 
+#include <new>
 #include <string>
+#include <utility>
 
 #include <cstring>
 
@@ -160,38 +163,129 @@ MatchKeyReader::get_priority() const {
   return match_key->priority;
 }
 
-MatchKey::MatchKey(const pi_p4info_t *p4info, pi_p4_id_t table_id)
-    : p4info(p4info), table_id(table_id),
-      mk_size(pi_p4info_table_match_key_size(p4info, table_id)),
-      _data(sizeof(*match_key) + mk_size),
-      match_key(reinterpret_cast<decltype(match_key)>(_data.data())),
-      reader(match_key) {
-  // std::allocator is using standard new, no alignment issue with the cast
-  // above
+namespace detail {
+
+static_assert(sizeof(pi_match_key_t) <= PiMatchKey::kStorageSize,
+              "PiMatchKey storage is too small");
+static_assert(alignof(pi_match_key_t) <= alignof(void *),
+              "PiMatchKey storage is not aligned enough");
+static_assert(sizeof(pi_action_data_t) <= PiActionData::kStorageSize,
+              "PiActionData storage is too small");
+static_assert(alignof(pi_action_data_t) <= alignof(void *),
+              "PiActionData storage is not aligned enough");
+
+PiMatchKey::PiMatchKey(const pi_p4info_t *p4info, pi_p4_id_t table_id,
+                       size_t data_size) {
+  auto match_key = new(storage) pi_match_key_t;
   match_key->p4info = p4info;
   match_key->table_id = table_id;
   match_key->priority = 0;
-  match_key->data_size = mk_size;
-  match_key->data = _data.data() + sizeof(*match_key);
+  match_key->data_size = data_size;
+  match_key->data = nullptr;
+}
+
+PiMatchKey::PiMatchKey(const pi_match_key_t *pi_match_key) {
+  auto match_key = new(storage) pi_match_key_t(*pi_match_key);
+  match_key->data = nullptr;
+}
+
+void
+PiMatchKey::set_data(char *data) {
+  reinterpret_cast<pi_match_key_t *>(storage)->data = data;
+}
+
+void
+PiMatchKey::set_priority(uint32_t priority) {
+  reinterpret_cast<pi_match_key_t *>(storage)->priority = priority;
+}
+
+uint32_t
+PiMatchKey::get_priority() const {
+  return get()->priority;
+}
+
+PiActionData::PiActionData(const pi_p4info_t *p4info, pi_p4_id_t action_id,
+                           size_t data_size) {
+  auto action_data = new(storage) pi_action_data_t;
+  action_data->p4info = p4info;
+  action_data->action_id = action_id;
+  action_data->data_size = data_size;
+  action_data->data = nullptr;
+}
+
+void
+PiActionData::set_data(char *data) {
+  get()->data = data;
+}
+
+}  // namespace detail
+
+MatchKey::MatchKey(const pi_p4info_t *p4info, pi_p4_id_t table_id)
+    : p4info(p4info), table_id(table_id),
+      mk_size(pi_p4info_table_match_key_size(p4info, table_id)),
+      _data(mk_size), match_key(p4info, table_id, mk_size) {
+  match_key.set_data(_data.data());
 }
 
 MatchKey::MatchKey(const pi_match_key_t *pi_match_key)
     : p4info(pi_match_key->p4info), table_id(pi_match_key->table_id),
       mk_size(pi_match_key->data_size),
-      _data(sizeof(*match_key) + mk_size),
-      match_key(reinterpret_cast<decltype(match_key)>(_data.data())),
-      reader(match_key) {
-  *match_key = *pi_match_key;
-  match_key->data = _data.data() + sizeof(*match_key);
-  memcpy(match_key->data, pi_match_key->data, mk_size);
+      _data(mk_size), match_key(pi_match_key) {
+  std::memcpy(_data.data(), pi_match_key->data, mk_size);
+  match_key.set_data(_data.data());
 }
 
 MatchKey::~MatchKey() = default;
 
+// the inline buffer, and therefore the match key data pointer, changes with
+// every copy or move
+
+MatchKey::MatchKey(const MatchKey &other)
+    : p4info(other.p4info), table_id(other.table_id), nset(other.nset),
+      mk_size(other.mk_size), _data(other._data),
+      match_key(other.match_key) {
+  match_key.set_data(_data.data());
+}
+
+MatchKey &
+MatchKey::operator=(const MatchKey &other) {
+  if (this == &other) return *this;
+  p4info = other.p4info;
+  table_id = other.table_id;
+  nset = other.nset;
+  mk_size = other.mk_size;
+  _data = other._data;
+  match_key = other.match_key;
+  match_key.set_data(_data.data());
+  return *this;
+}
+
+MatchKey::MatchKey(MatchKey &&other) noexcept
+    : p4info(other.p4info), table_id(other.table_id), nset(other.nset),
+      mk_size(other.mk_size), _data(std::move(other._data)),
+      match_key(other.match_key) {
+  match_key.set_data(_data.data());
+  other.match_key.set_data(other._data.data());
+}
+
+MatchKey &
+MatchKey::operator=(MatchKey &&other) noexcept {
+  if (this == &other) return *this;
+  p4info = other.p4info;
+  table_id = other.table_id;
+  nset = other.nset;
+  mk_size = other.mk_size;
+  _data = std::move(other._data);
+  match_key = other.match_key;
+  match_key.set_data(_data.data());
+  other.match_key.set_data(other._data.data());
+  return *this;
+}
+
 void
 MatchKey::reset() {
   nset = 0;
-  match_key->priority = 0;
+  match_key.set_priority(0);
 }
 
 void
@@ -199,19 +293,18 @@ MatchKey::from(const pi_match_key_t *pi_match_key) {
   assert(p4info == pi_match_key->p4info);
   assert(table_id == pi_match_key->table_id);
   assert(mk_size == pi_match_key->data_size);
-  *match_key = *pi_match_key;
-  match_key->data = _data.data() + sizeof(*match_key);
-  memcpy(match_key->data, pi_match_key->data, mk_size);
+  match_key.set_priority(pi_match_key->priority);
+  std::memcpy(_data.data(), pi_match_key->data, mk_size);
 }
 
 void
 MatchKey::set_priority(int priority) {
-  match_key->priority = priority;
+  match_key.set_priority(priority);
 }
 
 int
 MatchKey::get_priority() const {
-  return reader.get_priority();
+  return match_key.get_priority();
 }
 
 template <typename T>
@@ -228,7 +321,7 @@ MatchKey::format(pi_p4_id_t f_id, T v, size_t offset, size_t *written) {
   char *data = reinterpret_cast<char *>(&v);
   data += sizeof(T) - bytes;
   data[0] &= byte0_mask;
-  memcpy(match_key->data + offset, data, bytes);
+  memcpy(_data.data() + offset, data, bytes);
   *written = bytes;
   return 0;
 }
@@ -243,7 +336,7 @@ MatchKey::format(pi_p4_id_t f_id, const char *ptr, size_t s, size_t offset,
   const char byte0_mask = pi_p4info_table_match_field_byte0_mask(
       p4info, table_id, f_id);
   if (bytes != s) return 1;
-  char *dst = match_key->data + offset;
+  char *dst = _data.data() + offset;
   memcpy(dst, ptr, bytes);
   dst[0] &= byte0_mask;
   *written = bytes;
@@ -278,7 +371,7 @@ MatchKey::set_exact(pi_p4_id_t f_id, const char *key, size_t s) {
 
 error_code_t
 MatchKey::get_exact(pi_p4_id_t f_id, std::string *key) const {
-  return reader.get_exact(f_id, key);
+  return MatchKeyReader(get()).get_exact(f_id, key);
 }
 
 template <typename T>
@@ -291,7 +384,7 @@ MatchKey::set_lpm(pi_p4_id_t f_id, T key, int prefix_length) {
   error_code_t rc;
   rc = format(f_id, key, offset, &written);
   offset += written;
-  emit_uint32(match_key->data + offset, prefix_length);
+  emit_uint32(_data.data() + offset, prefix_length);
   return rc;
 }
 
@@ -312,13 +405,13 @@ MatchKey::set_lpm(pi_p4_id_t f_id, const char *key, size_t s,
   error_code_t rc;
   rc = format(f_id, key, s, offset, &written);
   offset += written;
-  emit_uint32(match_key->data + offset, prefix_length);
+  emit_uint32(_data.data() + offset, prefix_length);
   return rc;
 }
 
 error_code_t
 MatchKey::get_lpm(pi_p4_id_t f_id, std::string *key, int *prefix_length) const {
-  return reader.get_lpm(f_id, key, prefix_length);
+  return MatchKeyReader(get()).get_lpm(f_id, key, prefix_length);
 }
 
 template <typename T>
@@ -369,7 +462,7 @@ MatchKey::set_ternary(pi_p4_id_t f_id, const char *key, const char *mask,
 error_code_t
 MatchKey::get_ternary(pi_p4_id_t f_id, std::string *key,
                       std::string *mask) const {
-  return reader.get_ternary(f_id, key, mask);
+  return MatchKeyReader(get()).get_ternary(f_id, key, mask);
 }
 
 template <typename T>
@@ -404,62 +497,70 @@ MatchKey::set_range(pi_p4_id_t f_id, const char *start, const char *end,
 error_code_t
 MatchKey::get_range(pi_p4_id_t f_id, std::string *start,
                     std::string *end) const {
-  return reader.get_range(f_id, start, end);
+  return MatchKeyReader(get()).get_range(f_id, start, end);
 }
 
 error_code_t
 MatchKey::set_valid(pi_p4_id_t f_id, bool key) {
   size_t offset = pi_p4info_table_match_field_offset(p4info, table_id, f_id);
-  auto dst = match_key->data + offset;
+  auto dst = _data.data() + offset;
   *dst = key ? 1 : 0;
   return 0;
 }
 
 error_code_t
 MatchKey::get_valid(pi_p4_id_t f_id, bool *key) const {
-  return reader.get_valid(f_id, key);
+  return MatchKeyReader(get()).get_valid(f_id, key);
 }
 
-MatchKey::MatchKey(const MatchKey &other)
-    : p4info(other.p4info),
-      table_id(other.table_id),
-      nset(other.nset),
-      mk_size(other.mk_size),
-      _data(other._data),
-      match_key(reinterpret_cast<decltype(match_key)>(_data.data())),
-      reader(match_key) {
-  match_key->data = _data.data() + sizeof(*match_key);
-}
+namespace {
 
-MatchKey &
-MatchKey::operator=(const MatchKey &other) {
-  MatchKey tmp(other);  // re-use copy-constructor
-  *this = std::move(tmp);  // re-use move-assignment
-  return *this;
+uint64_t
+match_key_hash(pi_p4_id_t table_id, uint32_t priority, const char *data,
+               size_t size) {
+  uint64_t seed = (static_cast<uint64_t>(table_id) << 32) | priority;
+  return hash_bytes(data, size, seed);
 }
 
+}  // namespace
+
+MatchKeyView::MatchKeyView(const MatchKey &mk)
+    : table_id(mk.table_id), priority(mk.match_key.get_priority()),
+      data(mk._data.data()), size(mk.mk_size) { }
+
+MatchKeyView::MatchKeyView(const pi_match_key_t *pi_match_key)
+    : table_id(pi_match_key->table_id), priority(pi_match_key->priority),
+      data(pi_match_key->data), size(pi_match_key->data_size) { }
+
 size_t
 MatchKeyHash::operator()(const MatchKey &mk) const {
-  // compute Jenkins hash
-  // see https://en.wikipedia.org/wiki/Jenkins_hash_function
-  // "seed", maybe not the best choice...
-  uint32_t hash = mk.table_id ^ mk.match_key->priority;
-  for (size_t i = 0; i < mk.mk_size; i++) {
-    hash += mk.match_key->data[i];
-    hash += hash << 10;
-    hash ^= hash >> 6;
-  }
-  hash += hash << 3;
-  hash ^= hash >> 11;
-  hash += hash << 15;
-  return static_cast<size_t>(hash);
+  return static_cast<size_t>(match_key_hash(
+      mk.table_id, mk.match_key.get_priority(), mk._data.data(), mk.mk_size));
+}
+
+size_t
+MatchKeyHash::operator()(const MatchKeyView &view) const {
+  return static_cast<size_t>(
+      match_key_hash(view.table_id, view.priority, view.data, view.size));
 }
 
 bool
 MatchKeyEq::operator()(const MatchKey &mk1, const MatchKey &mk2) const {
-  return (mk1.table_id == mk2.table_id)
-      && (mk1.match_key->priority == mk2.match_key->priority)
-      && (!std::memcmp(mk1.match_key->data, mk2.match_key->data, mk1.mk_size));
+  return (*this)(MatchKeyView(mk1), MatchKeyView(mk2));
+}
+
+bool
+MatchKeyEq::operator()(const MatchKey &mk, const MatchKeyView &view) const {
+  return (*this)(MatchKeyView(mk), view);
+}
+
+bool
+MatchKeyEq::operator()(const MatchKeyView &view1,
+                       const MatchKeyView &view2) const {
+  return (view1.table_id == view2.table_id)
+      && (view1.priority == view2.priority)
+      && (view1.size == view2.size)
+      && (!std::memcmp(view1.data, view2.data, view1.size));
 }
 
 ActionDataReader::ActionDataReader(const pi_action_data_t *action_data)
@@ -484,18 +585,56 @@ ActionDataReader::get_action_id() const {
 ActionData::ActionData(const pi_p4info_t *p4info, pi_p4_id_t action_id)
     : p4info(p4info), action_id(action_id),
       ad_size(pi_p4info_action_data_size(p4info, action_id)),
-      _data(sizeof(*action_data) + ad_size),
-      action_data(reinterpret_cast<decltype(action_data)>(_data.data())),
-      reader(action_data) {
-  // using standard new, no alignment issue with cast above
-  action_data->p4info = p4info;
-  action_data->action_id = action_id;
-  action_data->data_size = ad_size;
-  action_data->data = _data.data() + sizeof(*action_data);
+      _data(ad_size), action_data(p4info, action_id, ad_size) {
+  action_data.set_data(_data.data());
 }
 
 ActionData::~ActionData() { }
 
+// see MatchKey
+
+ActionData::ActionData(const ActionData &other)
+    : p4info(other.p4info), action_id(other.action_id), nset(other.nset),
+      ad_size(other.ad_size), _data(other._data),
+      action_data(other.action_data) {
+  action_data.set_data(_data.data());
+}
+
+ActionData &
+ActionData::operator=(const ActionData &other) {
+  if (this == &other) return *this;
+  p4info = other.p4info;
+  action_id = other.action_id;
+  nset = other.nset;
+  ad_size = other.ad_size;
+  _data = other._data;
+  action_data = other.action_data;
+  action_data.set_data(_data.data());
+  return *this;
+}
+
+ActionData::ActionData(ActionData &&other) noexcept
+    : p4info(other.p4info), action_id(other.action_id), nset(other.nset),
+      ad_size(other.ad_size), _data(std::move(other._data)),
+      action_data(other.action_data) {
+  action_data.set_data(_data.data());
+  other.action_data.set_data(other._data.data());
+}
+
+ActionData &
+ActionData::operator=(ActionData &&other) noexcept {
+  if (this == &other) return *this;
+  p4info = other.p4info;
+  action_id = other.action_id;
+  nset = other.nset;
+  ad_size = other.ad_size;
+  _data = std::move(other._data);
+  action_data = other.action_data;
+  action_data.set_data(_data.data());
+  other.action_data.set_data(other._data.data());
+  return *this;
+}
+
 void
 ActionData::reset() {
   nset = 0;
@@ -516,7 +655,7 @@ ActionData::format(pi_p4_id_t ap_id, T v) {
   char *data = reinterpret_cast<char *>(&v);
   data += sizeof(T) - bytes;
   data[0] &= byte0_mask;
-  memcpy(action_data->data + offset, data, bytes);
+  memcpy(_data.data() + offset, data, bytes);
   return 0;
 }
 
@@ -530,7 +669,7 @@ ActionData::format(pi_p4_id_t ap_id, const char *ptr, size_t s) {
   const char byte0_mask = pi_p4info_action_param_byte0_mask(
       p4info, action_id, ap_id);
   if (bytes != s) return 1;
-  char *dst = action_data->data + offset;
+  char *dst = _data.data() + offset;
   memcpy(dst, ptr, bytes);
   dst[0] &= byte0_mask;
   return 0;
@@ -560,7 +699,7 @@ template error_code_t ActionData::set_arg<int64_t>(pi_p4_id_t, int64_t);
 
 error_code_t
 ActionData::get_arg(pi_p4_id_t ap_id, std::string *arg) const {
-  return reader.get_arg(ap_id, arg);
+  return ActionDataReader(get()).get_arg(ap_id, arg);
 }
 
 
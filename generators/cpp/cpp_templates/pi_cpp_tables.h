@@ -0,0 +1,163 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Generated by pi_gen_cpp, do not edit.
+
+//:: guard = "PI_GEN_CPP_" + p4_prefix.upper() + "_TABLES_H_"
+#ifndef ${guard}
+#define ${guard}
+
+#include <PI/frontends/cpp/typed_tables.h>
+#include <PI/pi.h>
+
+#include <cstddef>
+
+// Integer setters accept any integer type wide enough for the field, byte
+// array setters only accept arrays of the exact field size. Anything else
+// (wrong type, wrong size, setter which does not match the field's match
+// type, action which does not belong to the table) fails to compile.
+
+namespace ${p4_prefix} {
+
+namespace actions {
+
+//:: for a in actions:
+namespace ${a.c_name} {
+
+struct Info {
+  static constexpr pi_p4_id_t id = ${a.id_};
+  static constexpr size_t action_data_size = ${a.action_data_size};
+};
+
+class ActionData : public pi::typed::ActionData<Info> {
+ public:
+  explicit ActionData(const pi_p4info_t *p4info)
+      : pi::typed::ActionData<Info>(p4info) { }
+//::   for p in a.params:
+
+  // ${p.name}, ${p.bitwidth} bits
+//::     if p.fits_integer():
+  template <typename T>
+  void set_${p.c_name}(T v) {
+    pi::typed::write_value<${p.bitwidth}>(data() + ${p.offset}, v);
+  }
+//::     #endif
+  void set_${p.c_name}(const char (&v)[${p.nbytes}]) {
+    pi::typed::write_bytes<${p.bitwidth}>(data() + ${p.offset}, v);
+  }
+//::   #endfor
+};
+
+}  // namespace ${a.c_name}
+
+//:: #endfor
+}  // namespace actions
+
+namespace tables {
+
+//:: for t in tables:
+//::   if t.action_ids:
+//::     has_action_arg = "pi_p4_id_t action_id"
+//::     sep = " ||\n        "
+//::     has_action_expr = sep.join(["action_id == %d" % a for a in t.action_ids])
+//::   else:
+//::     has_action_arg = "pi_p4_id_t"
+//::     has_action_expr = "false"
+//::   #endif
+namespace ${t.c_name} {
+
+struct Info {
+  static constexpr pi_p4_id_t id = ${t.id_};
+  static constexpr size_t match_key_size = ${t.match_key_size};
+  static constexpr bool requires_priority = ${str(t.requires_priority).lower()};
+  static constexpr bool is_indirect = ${str(t.is_indirect).lower()};
+  static constexpr bool has_action(${has_action_arg}) {
+    return ${has_action_expr};
+  }
+};
+
+class MatchKey : public pi::typed::MatchKey<Info> {
+ public:
+  explicit MatchKey(const pi_p4info_t *p4info)
+      : pi::typed::MatchKey<Info>(p4info) { }
+//::   for f in t.fields:
+//::     bw = f.bitwidth
+//::     off = f.offset
+//::     off2 = f.offset + f.nbytes
+//::     array_t = "const char (&%s)[" + str(f.nbytes) + "]"
+
+  // ${f.name}, ${bw} bits, ${MatchType.to_str(f.match_type)}
+//::     if f.match_type == MatchType.VALID:
+  void set_${f.c_name}(bool v) { data()[${off}] = v ? 1 : 0; }
+//::     elif f.match_type == MatchType.EXACT:
+//::       if f.fits_integer():
+  template <typename T>
+  void set_${f.c_name}(T v) {
+    pi::typed::write_value<${bw}>(data() + ${off}, v);
+  }
+//::       #endif
+  void set_${f.c_name}(${array_t % "v"}) {
+    pi::typed::write_bytes<${bw}>(data() + ${off}, v);
+  }
+//::     elif f.match_type == MatchType.LPM:
+//::       if f.fits_integer():
+  template <typename T>
+  void set_${f.c_name}(T v, int prefix_length) {
+    pi::typed::write_value<${bw}>(data() + ${off}, v);
+    pi::typed::write_prefix_length(data() + ${off2}, prefix_length);
+  }
+//::       #endif
+  void set_${f.c_name}(${array_t % "v"}, int prefix_length) {
+    pi::typed::write_bytes<${bw}>(data() + ${off}, v);
+    pi::typed::write_prefix_length(data() + ${off2}, prefix_length);
+  }
+//::     else:
+//::       # ternary (value, mask) and range (start, end) have the same layout
+//::       if f.match_type == MatchType.TERNARY:
+//::         v1, v2 = "v", "mask"
+//::       else:
+//::         v1, v2 = "start", "end"
+//::       #endif
+//::       if f.fits_integer():
+  template <typename T>
+  void set_${f.c_name}(T ${v1}, T ${v2}) {
+    pi::typed::write_value<${bw}>(data() + ${off}, ${v1});
+    pi::typed::write_value<${bw}>(data() + ${off2}, ${v2});
+  }
+//::       #endif
+  void set_${f.c_name}(${array_t % v1},
+      ${array_t % v2}) {
+    pi::typed::write_bytes<${bw}>(data() + ${off}, ${v1});
+    pi::typed::write_bytes<${bw}>(data() + ${off2}, ${v2});
+  }
+//::     #endif
+//::   #endfor
+};
+
+using Table = pi::typed::MatchTable<Info, MatchKey>;
+
+}  // namespace ${t.c_name}
+
+//:: #endfor
+}  // namespace tables
+
+}  // namespace ${p4_prefix}
+
+#endif  // ${guard}
@@ -0,0 +1,168 @@
+# Copyright 2013-present Barefoot Networks, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+#
+# Antonin Bas (antonin@barefootnetworks.com)
+#
+#
+
+
+# -*- coding: utf-8 -*-
+
+# Generates C++ bindings for the tables and actions of a P4 program from the
+# "native" json dump of its p4info (see bin/pi_gen_native_json). The generated
+# header relies on PI/frontends/cpp/typed_tables.h: all the ids, offsets and
+# bitwidths are compile-time constants, so building a match key or action data
+# does not require any p4info lookup.
+
+import os
+import sys
+
+_THIS_DIR = os.path.dirname(os.path.realpath(__file__))
+
+_TEMPLATES_DIR = os.path.join(_THIS_DIR, "cpp_templates")
+
+# the p4info json loader and the template engine wrapper are shared with the PD
+# generator; once installed, both modules are in the same directory
+sys.path.append(os.path.join(_THIS_DIR, os.pardir, "pd"))
+
+import gen_pd
+from gen_pd import MatchType, TableType, bits_to_bytes, get_c_name
+from tenjin_wrapper import render_template
+
+_TENJIN_PREFIX = "//::"  # Use // in prefix for C syntax processing
+
+
+class Field:
+    def __init__(self, name, id_, match_type, bitwidth, offset):
+        self.name = name
+        self.c_name = get_c_name(name)
+        self.id_ = id_
+        self.match_type = match_type
+        self.bitwidth = bitwidth
+        self.nbytes = bits_to_bytes(bitwidth)
+        self.offset = offset
+
+    # integer setters are only generated for fields which fit in a uint64_t
+    def fits_integer(self):
+        return self.bitwidth <= 64
+
+
+def match_field_size(match_type, bitwidth):
+    # must be kept in sync with get_match_key_size_one_field in
+    # include/PI/int/pi_int.h
+    nbytes = bits_to_bytes(bitwidth)
+    if match_type in {MatchType.VALID, MatchType.EXACT}:
+        return nbytes
+    if match_type == MatchType.LPM:
+        return nbytes + 4
+    return 2 * nbytes
+
+
+class CppTable:
+    def __init__(self, t):
+        self.name = t.name
+        self.c_name = get_c_name(t.name)
+        self.id_ = t.id_
+        self.is_indirect = (t.type_ != TableType.SIMPLE)
+        self.action_ids = sorted(a.id_ for a in t.actions.values())
+        self.fields = []
+        offset = 0
+        for name, id_, match_type, bitwidth in t.key:
+            self.fields.append(Field(name, id_, match_type, bitwidth, offset))
+            offset += match_field_size(match_type, bitwidth)
+        self.match_key_size = offset
+        self.requires_priority = any(
+            f.match_type in {MatchType.TERNARY, MatchType.RANGE}
+            for f in self.fields)
+
+
+class CppAction:
+    def __init__(self, a):
+        self.name = a.name
+        self.c_name = get_c_name(a.name)
+        self.id_ = a.id_
+        self.params = []
+        offset = 0
+        for name, id_, bitwidth in a.runtime_data:
+            self.params.append(Field(name, id_, None, bitwidth, offset))
+            offset += bits_to_bytes(bitwidth)
+        self.action_data_size = offset
+
+
+def generate_cpp_source(json_dict, dest_dir, p4_prefix, templates_dir):
+    for d in [gen_pd.TABLES, gen_pd.TABLES_BY_ID, gen_pd.ACTIONS,
+              gen_pd.ACTIONS_BY_ID, gen_pd.ACT_PROFS, gen_pd.ACT_PROFS_BY_ID,
+              gen_pd.COUNTER_ARRAYS, gen_pd.COUNTER_ARRAYS_BY_ID,
+              gen_pd.METER_ARRAYS, gen_pd.METER_ARRAYS_BY_ID]:
+        d.clear()
+
+    gen_pd.load_json(json_dict)
+    render_dict = {}
+    render_dict["p4_prefix"] = p4_prefix
+    render_dict["MatchType"] = MatchType
+    # sorted by id to make the output deterministic
+    render_dict["tables"] = [CppTable(t) for _, t in
+                             sorted(gen_pd.TABLES_BY_ID.items())]
+    render_dict["actions"] = [CppAction(a) for _, a in
+                              sorted(gen_pd.ACTIONS_BY_ID.items())]
+    render_dict["render_dict"] = render_dict
+
+    for template in os.listdir(templates_dir):
+        if gen_pd.ignore_template_file(template):
+            continue
+        with open(os.path.join(dest_dir, template), "w") as f:
+            render_template(f, template, render_dict, templates_dir,
+                            prefix=_TENJIN_PREFIX)
+
+
+import argparse
+import json
+
+parser = argparse.ArgumentParser(description='PI C++ frontend generation')
+parser.add_argument('source', metavar='source', type=str,
+                    help='JSON source.')
+parser.add_argument('--cpp', dest='cpp', type=str,
+                    help='Generate C++ bindings for this P4 program'
+                    ' in this directory. Directory must exist.',
+                    required=True)
+parser.add_argument('--p4-prefix', type=str,
+                    help='P4 name used as the C++ namespace',
+                    default="prog", required=False)
+
+
+def _validate_dir(path):
+    path = os.path.abspath(path)
+    if not os.path.isdir(path):
+        print path, "is not a valid directory"
+        sys.exit(1)
+    return path
+
+
+def main(templates_dir=_TEMPLATES_DIR):
+    args = parser.parse_args()
+
+    path_cpp = _validate_dir(args.cpp)
+
+    print "Generating C++ source files in", path_cpp
+
+    with open(args.source, 'r') as f:
+        json_dict = json.load(f)
+        generate_cpp_source(json_dict, path_cpp, args.p4_prefix,
+                            templates_dir)
+
+
+if __name__ == "__main__":  # pragma: no cover
+    main()
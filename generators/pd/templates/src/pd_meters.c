@@ -135,10 +135,10 @@ ${param_str}
 
 //::   if ma.is_direct:
   rc = pi_meter_read_direct(sess_hdl, convert_dev_tgt(dev_tgt), ${ma.id_},
-                            entry_hdl, &pi_meter_spec);
+                            entry_hdl, PI_METER_FLAGS_NONE, &pi_meter_spec);
 //::   else:
   rc = pi_meter_read(sess_hdl, convert_dev_tgt(dev_tgt), ${ma.id_}, index,
-                     &pi_meter_spec);
+                     PI_METER_FLAGS_NONE, &pi_meter_spec);
 //::   #endif
 
   if (rc != PI_STATUS_SUCCESS) return rc;
@@ -60,10 +60,16 @@ typedef struct {
   pi_meter_type_t meter_type;
 } pi_meter_spec_t;
 
+#define PI_METER_FLAGS_NONE 0
+// read the meter configuration from the hw, instead of letting the target
+// return the last configuration it was given (if it keeps track of it)
+#define PI_METER_FLAGS_HW_SYNC (1 << 0)
+
 //! Reads an indirect meter configuration at the given \p index.
 pi_status_t pi_meter_read(pi_session_handle_t session_handle,
                           pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                          size_t index, pi_meter_spec_t *meter_spec);
+                          size_t index, int flags,
+                          pi_meter_spec_t *meter_spec);
 
 //! Sets an indirect meter configuration at the given \p index.
 pi_status_t pi_meter_set(pi_session_handle_t session_handle,
@@ -73,7 +79,7 @@ pi_status_t pi_meter_set(pi_session_handle_t session_handle,
 //! Reads the direct meter configuration for the given \p entry_handle.
 pi_status_t pi_meter_read_direct(pi_session_handle_t session_handle,
                                  pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                                 pi_entry_handle_t entry_handle,
+                                 pi_entry_handle_t entry_handle, int flags,
                                  pi_meter_spec_t *meter_spec);
 
 //! Sets the direct meter configuration for the given \p entry_handle.
@@ -0,0 +1,130 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file
+//! Low-overhead instrumentation for target implementations. Each
+//! instrumented function gets a slot the first time it is called; calls are
+//! then counted (and optionally timed) in per-thread counters, without any
+//! locking or string lookup on the fast path. Typical use is to add
+//! PI_INSTRUMENT_FUNC() at the beginning of every _pi_* function of a target.
+
+#ifndef PI_INC_PI_TARGET_PI_INSTRUMENT_H_
+#define PI_INC_PI_TARGET_PI_INSTRUMENT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PI_INSTRUMENT_MAX_FUNCS 256
+
+//! Latency histograms use power-of-2 buckets: bucket i counts the calls
+//! which took [2^(i-1), 2^i) nanoseconds, the last bucket is unbounded.
+#define PI_INSTRUMENT_NUM_BUCKETS 32
+
+#define PI_INSTRUMENT_FLAGS_NONE 0
+//! Measure the latency of each call in addition to counting it. The TSC is
+//! used when available, clock_gettime otherwise.
+#define PI_INSTRUMENT_FLAGS_TIMING (1 << 0)
+
+typedef enum {
+  //! "<function name> : <call count>" for each function called at least once,
+  //! sorted by name
+  PI_INSTRUMENT_DUMP_COUNTS = 0,
+  //! call counts and latency statistics
+  PI_INSTRUMENT_DUMP_FULL,
+} pi_instrument_dump_mode_t;
+
+typedef struct {
+  const char *name;
+  // 0 until the function is called for the first time, -1 if there was no
+  // slot left
+  int slot;
+} pi_instrument_fn_t;
+
+typedef struct {
+  int slot;  // 0 if the call is not recorded
+  uint64_t start;
+  void *stats;
+} pi_instrument_call_t;
+
+extern int _pi_instrument_on;
+
+//! Starts recording calls. Counters are reset. Like pi_instrument_destroy, must
+//! not be called while instrumented functions are running.
+void pi_instrument_init(int flags);
+
+//! Stops recording calls and releases all counters. Must not be called while
+//! instrumented functions are running.
+void pi_instrument_destroy();
+
+//! Returns the number of calls made to \p func_name since pi_instrument_init,
+//! or -1 if the function was never called.
+int64_t pi_instrument_get_count(const char *func_name);
+
+//! Returns 0 if success, 1 otherwise.
+int pi_instrument_dump_to_file(const char *path,
+                               pi_instrument_dump_mode_t mode);
+
+pi_instrument_call_t _pi_instrument_call_begin(pi_instrument_fn_t *fn);
+
+void _pi_instrument_call_end(pi_instrument_call_t *call);
+
+static inline pi_instrument_call_t pi_instrument_call_begin(
+    pi_instrument_fn_t *fn) {
+  if (!_pi_instrument_on) {
+    pi_instrument_call_t call = {0, 0, 0};
+    return call;
+  }
+  return _pi_instrument_call_begin(fn);
+}
+
+static inline void pi_instrument_call_end(pi_instrument_call_t *call) {
+  if (call->slot > 0) _pi_instrument_call_end(call);
+}
+
+#ifdef __cplusplus
+}
+
+struct PiInstrumentGuard {
+  explicit PiInstrumentGuard(pi_instrument_fn_t *fn)
+      : call(pi_instrument_call_begin(fn)) {}
+  ~PiInstrumentGuard() { pi_instrument_call_end(&call); }
+  pi_instrument_call_t call;
+};
+
+#define PI_INSTRUMENT_FUNC()                                      \
+  static pi_instrument_fn_t _pi_instrument_fn = {__func__, 0};   \
+  PiInstrumentGuard _pi_instrument_guard(&_pi_instrument_fn)
+
+#else
+
+//! Records the call to the enclosing function, the call ends when the
+//! function returns.
+#define PI_INSTRUMENT_FUNC()                                           \
+  static pi_instrument_fn_t _pi_instrument_fn = {__func__, 0};        \
+  pi_instrument_call_t _pi_instrument_call                            \
+      __attribute__((cleanup(pi_instrument_call_end))) =              \
+          pi_instrument_call_begin(&_pi_instrument_fn)
+
+#endif
+
+#endif  // PI_INC_PI_TARGET_PI_INSTRUMENT_H_
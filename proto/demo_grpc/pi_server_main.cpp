@@ -23,6 +23,8 @@
 #include <PI/proto/pi_server.h>
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <csignal>
 
@@ -30,13 +32,65 @@ using pi::fe::proto::DeviceMgr;
 
 int main(int argc, char** argv) {
   const char *server_address = "0.0.0.0:50051";
-  if (argc > 2) {
-    std::cerr << "Two many arguments.\n";
+  size_t num_cqs = PI_GRPC_DEFAULT_NUM_COMPLETION_QUEUES;
+  size_t write_threads = 1;
+  size_t read_threads = PI_GRPC_DEFAULT_NUM_READ_THREADS;
+  bool shadow_reads = false;
+  auto usage = [argv, server_address, num_cqs, read_threads]() {
     std::cerr << "Usage: " << argv[0]
-              << " [address (default " << server_address << ")].\n";
+              << " [--write-threads N] [--read-threads N] [--shadow-reads]"
+              << " [address (default " << server_address << ")]"
+              << " [number of server threads (default " << num_cqs << ")].\n"
+              << "  --write-threads N: apply the updates of a WriteRequest"
+              << " with up to N threads per device (default 1)\n"
+              << "  --read-threads N: serve up to N Read RPCs at the same"
+              << " time (default " << read_threads << ")\n"
+              << "  --shadow-reads: serve table reads from a copy of the"
+              << " entries kept by the server\n";
+  };
+  auto parse_count = [](const char *arg) -> size_t {
+    try {
+      return std::stoul(arg);
+    } catch (const std::exception &e) {
+      return 0;
+    }
+  };
+  std::vector<const char *> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--shadow-reads") {
+      shadow_reads = true;
+    } else if (arg == "--write-threads") {
+      write_threads = (i + 1 < argc) ? parse_count(argv[++i]) : 0;
+      if (write_threads == 0) {
+        std::cerr << "Invalid number of write threads.\n";
+        usage();
+        return 1;
+      }
+    } else if (arg == "--read-threads") {
+      read_threads = (i + 1 < argc) ? parse_count(argv[++i]) : 0;
+      if (read_threads == 0) {
+        std::cerr << "Invalid number of read threads.\n";
+        usage();
+        return 1;
+      }
+    } else {
+      positional.push_back(argv[i]);
+    }
+  }
+  if (positional.size() > 2) {
+    std::cerr << "Two many arguments.\n";
+    usage();
     return 1;
-  } else if (argc == 2) {
-    server_address = argv[1];
+  }
+  if (positional.size() >= 1) server_address = positional[0];
+  if (positional.size() == 2) {
+    num_cqs = parse_count(positional[1]);
+    if (num_cqs == 0) {
+      std::cerr << "Invalid number of server threads.\n";
+      usage();
+      return 1;
+    }
   }
 
   DeviceMgr::init(256);
@@ -46,6 +100,11 @@ int main(int argc, char** argv) {
     PIGrpcServerForceShutdown(1);  // 1 second deadline
   };
 
+  // one completion queue, and one polling thread, per server thread
+  PIGrpcServerSetNumCompletionQueues(num_cqs);
+  PIGrpcServerSetNumReadThreads(read_threads);
+  PIGrpcServerSetWriteConcurrency(write_threads);
+  PIGrpcServerSetShadowReads(shadow_reads);
   PIGrpcServerRunAddr(server_address);
 
   // TODO(antonin): use sigaction?
@@ -214,11 +214,8 @@ class Tester {
     auto add_entries = [this, t_id, a_id, batch_size](size_t iters) {
       using google::protobuf::Arena;
       for (size_t i = 0; i < iters; i++) {
-        // when arenas are enabled in p4runtime.proto
-        // Arena arena;
-        // p4::TableWriteRequest *request =
-        //     Arena::CreateMessage<p4::TableWriteRequest>(&arena);
-        p4::WriteRequest request;
+        Arena arena;
+        auto &request = *Arena::CreateMessage<p4::WriteRequest>(&arena);
         request.set_device_id(device_id);
         for (size_t j = 0; j < batch_size; j++) {
           auto update = request.add_updates();
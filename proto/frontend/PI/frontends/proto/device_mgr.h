@@ -46,8 +46,13 @@ class DeviceMgr {
   using p4_id_t = uint32_t;
   // may change when we introduce specific error namespace
   using Status = ::google::rpc::Status;
+  // the packet is arena-allocated and only valid for the duration of the call
   using PacketInCb =
       std::function<void(device_id_t, p4::PacketIn *packet, void *cookie)>;
+  // receives the result of a streamed read one chunk at a time; the chunk is
+  // cleared after the call, so the callback may move from it. Returning false
+  // cancels the read.
+  using ReadChunkCb = std::function<bool(p4::ReadResponse *chunk)>;
 
   explicit DeviceMgr(device_id_t device_id);
 
@@ -64,9 +69,37 @@ class DeviceMgr {
   // New write and read methods, meant to replace all the methods below
   Status write(const p4::WriteRequest &request);
 
+  // By default, the updates of a WriteRequest are applied sequentially. With
+  // num_threads > 1, they are partitioned by target entity (table / action
+  // profile / meter) and the partitions are applied concurrently by up to
+  // num_threads threads, preserving the order of updates within a partition.
+  void set_write_concurrency(size_t num_threads);
+
+  // In shadow read mode, a full copy of each table entry (match key, action or
+  // action profile member / group, controller metadata) is kept by the
+  // DeviceMgr and table reads are served from it, without querying the
+  // target. The setting applies from the next call to pipeline_config_set.
+  void set_shadow_reads(bool enable);
+
+  // Fetches the entries of the given table (of all tables if table_id is 0)
+  // from the target and compares them with the shadow copy; returns INTERNAL
+  // if they differ. Writes to the table should not be in progress.
+  Status verify_shadow(p4_id_t table_id) const;
+
   Status read(const p4::ReadRequest &request, p4::ReadResponse *response) const;
   Status read_one(const p4::Entity &entity, p4::ReadResponse *response) const;
 
+  // Streamed version of read: entities are delivered to chunk_cb in chunks of
+  // at most max_entities entities, a chunk being also sent as soon as it
+  // reaches max_bytes bytes (0 means no limit). This bounds the size of each
+  // response message, not the memory used by the read: the entries of a table
+  // are fetched from the target all at once, and chunks are sent while they
+  // are converted. A successful read always sends at least one chunk; if the
+  // read fails, the entities not delivered yet are dropped and the error is
+  // returned. Returns CANCELLED if chunk_cb returned false.
+  Status read(const p4::ReadRequest &request, size_t max_entities,
+              size_t max_bytes, const ReadChunkCb &chunk_cb) const;
+
   Status packet_out_send(const p4::PacketOut &packet) const;
 
   void packet_in_register_cb(PacketInCb cb, void *cookie);
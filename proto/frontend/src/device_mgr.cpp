@@ -20,13 +20,23 @@
 
 #include <PI/frontends/cpp/tables.h>
 #include <PI/frontends/proto/device_mgr.h>
+#include <PI/int/pi_int.h>
 #include <PI/pi.h>
 #include <PI/proto/util.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <cstring>  // std::memcpy
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+
 #include "google/rpc/code.pb.h"
 
 #include "action_helpers.h"
@@ -35,6 +45,7 @@
 #include "p4info_to_and_from_proto.h"  // for p4info_proto_reader
 #include "packet_io_mgr.h"
 #include "table_info_store.h"
+#include "worker_pool.h"
 
 #include "p4/tmp/p4config.pb.h"
 
@@ -77,6 +88,129 @@ pi_meter_spec_t meter_spec_proto_to_pi(const p4::MeterConfig &config) {
   return pi_meter_spec;
 }
 
+// Destination of the entities produced by a read. Without a chunk callback,
+// all the entities are appended to the response provided by the caller. With a
+// callback, entities are accumulated in an internal chunk, which is handed to
+// the callback (and then cleared) every max_entities entities or once it
+// reaches max_bytes bytes (0 means no limit). Chunks are sent as the fetched
+// entries are converted to protobuf, but each table (or action profile...) is
+// still fetched from the target in full first. If the callback returns false,
+// the read is cancelled: the readers check cancelled() and stop early, and any
+// entity added after that is discarded. The chunk is allocated in an arena
+// which lives as long as the read: since a cleared message keeps its repeated
+// elements for reuse, after the first chunk most entities do not require any
+// allocation, and everything is released at once at the end of the read.
+class ReadSink {
+ public:
+  explicit ReadSink(p4::ReadResponse *response)
+      : response(response) { }
+
+  ReadSink(size_t max_entities, size_t max_bytes,
+           const DeviceMgr::ReadChunkCb &chunk_cb)
+      : arena(new google::protobuf::Arena()),
+        response(google::protobuf::Arena::CreateMessage<p4::ReadResponse>(
+            arena.get())),
+        max_entities(max_entities), max_bytes(max_bytes),
+        chunk_cb(&chunk_cb) { }
+
+  p4::Entity *add_entity() {
+    if (chunk_cb != nullptr && response->entities_size() > 0) {
+      // the previous entity is complete, we can account for its size
+      size_t size = response->entities(response->entities_size() - 1)
+          .ByteSizeLong();
+      // tag and length prefix of the repeated field element
+      chunk_bytes += size + 1 +
+          google::protobuf::io::CodedOutputStream::VarintSize64(size);
+      if ((max_entities > 0 &&
+           static_cast<size_t>(response->entities_size()) >= max_entities) ||
+          (max_bytes > 0 && chunk_bytes >= max_bytes)) {
+        send_chunk();
+      }
+    }
+    return response->add_entities();
+  }
+
+  // sends the last chunk, we always send at least one (possibly empty) chunk
+  void flush() {
+    if (chunk_cb == nullptr) return;
+    if (response->entities_size() > 0 || num_chunks_sent == 0) send_chunk();
+  }
+
+  bool cancelled() const { return is_cancelled; }
+
+ private:
+  void send_chunk() {
+    if (!is_cancelled && !(*chunk_cb)(response)) is_cancelled = true;
+    num_chunks_sent++;
+    response->Clear();
+    chunk_bytes = 0;
+  }
+
+  std::unique_ptr<google::protobuf::Arena> arena{nullptr};
+  p4::ReadResponse *response;
+  size_t max_entities{0};
+  size_t max_bytes{0};
+  const DeviceMgr::ReadChunkCb *chunk_cb{nullptr};
+  size_t chunk_bytes{0};
+  size_t num_chunks_sent{0};
+  bool is_cancelled{false};
+};
+
+// In shadow read mode, TableInfoStore keeps a copy of the action of each table
+// entry: 1 byte for the action entry type, followed by either the action id and
+// the action data, or the indirect handle. The type is
+// PI_ACTION_ENTRY_TYPE_NONE for the default entry, which is not returned by
+// table reads.
+size_t shadow_size(const pi_p4info_t *p4info, pi_p4_id_t table_id) {
+  size_t size = sizeof(pi_indirect_handle_t);
+  size_t num_actions;
+  auto action_ids = pi_p4info_table_get_actions(p4info, table_id, &num_actions);
+  for (size_t i = 0; i < num_actions; i++) {
+    size = std::max(size, sizeof(pi_p4_id_t) +
+                    pi_p4info_action_data_size(p4info, action_ids[i]));
+  }
+  return 1 + size;
+}
+
+void shadow_encode(const pi::ActionEntry &action_entry, bool is_default_entry,
+                   char *shadow) {
+  if (is_default_entry) {
+    shadow[0] = PI_ACTION_ENTRY_TYPE_NONE;
+  } else if (action_entry.is_action_data()) {
+    shadow[0] = PI_ACTION_ENTRY_TYPE_DATA;
+    auto action_data = action_entry.action_data().pi_action_data();
+    std::memcpy(shadow + 1, &action_data->action_id, sizeof(pi_p4_id_t));
+    std::memcpy(shadow + 1 + sizeof(pi_p4_id_t), action_data->data,
+                action_data->data_size);
+  } else if (action_entry.is_indirect_handle()) {
+    shadow[0] = PI_ACTION_ENTRY_TYPE_INDIRECT;
+    auto indirect_handle = action_entry.indirect_handle();
+    std::memcpy(shadow + 1, &indirect_handle, sizeof(indirect_handle));
+  } else {
+    shadow[0] = PI_ACTION_ENTRY_TYPE_NONE;
+  }
+}
+
+// action_data is used as storage for the action data descriptor and needs to
+// outlive entry; the action data bytes are not copied
+void shadow_decode(const pi_p4info_t *p4info, const char *shadow,
+                   pi_action_data_t *action_data, pi_table_entry_t *entry) {
+  std::memset(entry, 0, sizeof(*entry));
+  entry->entry_type = static_cast<pi_action_entry_type_t>(shadow[0]);
+  if (entry->entry_type == PI_ACTION_ENTRY_TYPE_DATA) {
+    pi_p4_id_t action_id;
+    std::memcpy(&action_id, shadow + 1, sizeof(action_id));
+    action_data->p4info = p4info;
+    action_data->action_id = action_id;
+    action_data->data_size = pi_p4info_action_data_size(p4info, action_id);
+    action_data->data = const_cast<char *>(shadow + 1 + sizeof(pi_p4_id_t));
+    entry->entry.action_data = action_data;
+  } else if (entry->entry_type == PI_ACTION_ENTRY_TYPE_INDIRECT) {
+    std::memcpy(&entry->entry.indirect_handle, shadow + 1,
+                sizeof(pi_indirect_handle_t));
+  }
+}
+
 }  // namespace
 
 class DeviceMgrImp {
@@ -99,7 +233,10 @@ class DeviceMgrImp {
     for (auto t_id = pi_p4info_table_begin(p4info_new);
          t_id != pi_p4info_table_end(p4info_new);
          t_id = pi_p4info_table_next(p4info_new, t_id)) {
-      table_info_store.add_table(t_id);
+      table_info_store.add_table(
+          t_id, pi_p4info_table_match_key_size(p4info_new, t_id),
+          pi_p4info_table_max_size(p4info_new, t_id),
+          shadow_reads ? shadow_size(p4info_new, t_id) : 0);
     }
 
     action_profs.clear();
@@ -218,60 +355,200 @@ class DeviceMgrImp {
   }
 
   Status write(const p4::WriteRequest &request) {
+    if (write_pool != nullptr && request.updates_size() > 1)
+      return write_concurrent(request);
     Status status;
     status.set_code(Code::OK);
     SessionTemp session(true  /* = batch */);
     for (const auto &update : request.updates()) {
-      const auto &entity = update.entity();
-      switch (entity.entity_case()) {
-        case p4::Entity::kExternEntry:
-          status.set_code(Code::UNIMPLEMENTED);
-          break;
-        case p4::Entity::kTableEntry:
-          status = table_write(update.type(), entity.table_entry(), session);
-          break;
-        case p4::Entity::kActionProfileMember:
-          status = action_profile_member_write(
-              update.type(), entity.action_profile_member(), session);
-          break;
-        case p4::Entity::kActionProfileGroup:
-          status = action_profile_group_write(
-              update.type(), entity.action_profile_group(), session);
-          break;
-        case p4::Entity::kMeterEntry:
-          status = meter_write(update.type(), entity.meter_entry(), session);
-          break;
-        case p4::Entity::kDirectMeterEntry:
-          status = direct_meter_write(
-              update.type(), entity.direct_meter_entry(), session);
-          break;
-        case p4::Entity::kCounterEntry:
-          status.set_code(Code::UNIMPLEMENTED);
-          break;
-        case p4::Entity::kDirectCounterEntry:
-          status.set_code(Code::UNIMPLEMENTED);
-          break;
-        default:
-          status.set_code(Code::UNKNOWN);
-          break;
-      }
+      status = write_one(update, session);
       if (status.code() != Code::OK) break;
     }
     return status;
   }
 
+  Status write_one(const p4::Update &update, const SessionTemp &session) {
+    Status status;
+    const auto &entity = update.entity();
+    switch (entity.entity_case()) {
+      case p4::Entity::kExternEntry:
+        status.set_code(Code::UNIMPLEMENTED);
+        break;
+      case p4::Entity::kTableEntry:
+        status = table_write(update.type(), entity.table_entry(), session);
+        break;
+      case p4::Entity::kActionProfileMember:
+        status = action_profile_member_write(
+            update.type(), entity.action_profile_member(), session);
+        break;
+      case p4::Entity::kActionProfileGroup:
+        status = action_profile_group_write(
+            update.type(), entity.action_profile_group(), session);
+        break;
+      case p4::Entity::kMeterEntry:
+        status = meter_write(update.type(), entity.meter_entry(), session);
+        break;
+      case p4::Entity::kDirectMeterEntry:
+        status = direct_meter_write(
+            update.type(), entity.direct_meter_entry(), session);
+        break;
+      case p4::Entity::kCounterEntry:
+        status.set_code(Code::UNIMPLEMENTED);
+        break;
+      case p4::Entity::kDirectCounterEntry:
+        status.set_code(Code::UNIMPLEMENTED);
+        break;
+      default:
+        status.set_code(Code::UNKNOWN);
+        break;
+    }
+    return status;
+  }
+
+  void set_shadow_reads(bool enable) {
+    shadow_reads = enable;
+  }
+
+  void set_write_concurrency(size_t num_threads) {
+    write_pool.reset(
+        (num_threads > 1) ? new WorkerPool(num_threads - 1) : nullptr);
+  }
+
+  // Returns the id of the entity whose state an update reads and modifies, or
+  // 0 if we cannot tell, in which case the update acts as a barrier. Updates
+  // with different ids can be applied concurrently. Entries of indirect tables
+  // refer to members / groups, so they share the id of their action profile:
+  // this way a member creation followed by a table entry pointing to it is
+  // applied in order.
+  p4_id_t write_partition_id(const p4::Update &update) const {
+    const auto &entity = update.entity();
+    p4_id_t t_id = 0;
+    switch (entity.entity_case()) {
+      case p4::Entity::kTableEntry:
+        t_id = entity.table_entry().table_id();
+        break;
+      case p4::Entity::kDirectMeterEntry:
+        t_id = entity.direct_meter_entry().table_entry().table_id();
+        break;
+      case p4::Entity::kActionProfileMember:
+        return entity.action_profile_member().action_profile_id();
+      case p4::Entity::kActionProfileGroup:
+        return entity.action_profile_group().action_profile_id();
+      case p4::Entity::kMeterEntry:
+        return entity.meter_entry().meter_id();
+      default:
+        return 0;
+    }
+    // an invalid id will be rejected by table_write anyway
+    if (!check_p4_id(t_id, P4ResourceType::TABLE)) return t_id;
+    auto act_prof_id = pi_p4info_table_get_implementation(p4info.get(), t_id);
+    return (act_prof_id == PI_INVALID_ID) ? t_id : act_prof_id;
+  }
+
+  // The updates are split into phases at barriers (see write_partition_id);
+  // the updates of a phase are partitioned by entity, and partitions run
+  // concurrently, each one in its own PI session, with program order
+  // preserved within a partition. Like in the sequential case, we return the
+  // status of the first failed update (in request order): every update which
+  // comes before it is attempted. Unlike in the sequential case, updates which
+  // come after it may have been applied: a partition stops at its first
+  // failure, but the other partitions only skip the updates which come after
+  // the first error recorded *so far*. This check is racy on purpose (it is
+  // just a shortcut), and an update may be started concurrently with the
+  // failure of an earlier update in another partition. No update of a later
+  // phase is started once an update has failed.
+  Status write_concurrent(const p4::WriteRequest &request) {
+    const auto &updates = request.updates();
+    const int num_updates = updates.size();
+    std::vector<Status> statuses(num_updates);
+    std::atomic<int> first_error{num_updates};
+
+    auto record_error = [&statuses, &first_error](int i, Status &&status) {
+      statuses[i] = std::move(status);
+      int current = first_error.load();
+      while (i < current && !first_error.compare_exchange_weak(current, i)) { }
+    };
+
+    auto run_partition = [&](const std::vector<int> &partition) {
+      SessionTemp session(true  /* = batch */);
+      for (auto i : partition) {
+        if (i > first_error.load()) return;  // best effort, see above
+        auto status = write_one(updates.Get(i), session);
+        if (status.code() != Code::OK) {
+          record_error(i, std::move(status));
+          return;
+        }
+      }
+    };
+
+    std::vector<std::vector<int> > partitions;
+    std::unordered_map<p4_id_t, size_t> partition_idx;
+    std::vector<WorkerPool::Task> tasks;
+    int i = 0;
+    while (i < num_updates && i <= first_error.load()) {
+      partitions.clear();
+      partition_idx.clear();
+      for (; i < num_updates; i++) {
+        auto id = write_partition_id(updates.Get(i));
+        if (id == 0) break;  // barrier
+        auto p = partition_idx.emplace(id, partitions.size());
+        if (p.second) partitions.emplace_back();
+        partitions[p.first->second].push_back(i);
+      }
+      if (partitions.size() == 1) {
+        run_partition(partitions.front());
+      } else {
+        tasks.clear();
+        for (const auto &partition : partitions)
+          tasks.emplace_back([&run_partition, &partition] {
+              run_partition(partition); });
+        write_pool->run_all(&tasks);
+      }
+      // the barrier update itself, on its own
+      if (i < num_updates && i <= first_error.load()) {
+        run_partition({i});
+        i++;
+      }
+    }
+
+    if (first_error.load() < num_updates) return statuses[first_error.load()];
+    Status status;
+    status.set_code(Code::OK);
+    return status;
+  }
+
   Status read(const p4::ReadRequest &request,
               p4::ReadResponse *response) const {
+    ReadSink sink(response);
+    return read_common(request, &sink);
+  }
+
+  Status read(const p4::ReadRequest &request, size_t max_entities,
+              size_t max_bytes, const DeviceMgr::ReadChunkCb &chunk_cb) const {
+    ReadSink sink(max_entities, max_bytes, chunk_cb);
+    auto status = read_common(request, &sink);
+    // on error, the entities which have not been delivered yet are discarded
+    if (status.code() == Code::OK) sink.flush();
+    if (sink.cancelled()) status.set_code(Code::CANCELLED);
+    return status;
+  }
+
+  Status read_common(const p4::ReadRequest &request, ReadSink *response) const {
     Status status;
     status.set_code(Code::OK);
     for (const auto &entity : request.entities()) {
       status = read_one(entity, response);
-      if (status.code() != Code::OK) break;
+      if (status.code() != Code::OK || response->cancelled()) break;
     }
     return status;
   }
 
   Status read_one(const p4::Entity &entity, p4::ReadResponse *response) const {
+    ReadSink sink(response);
+    return read_one(entity, &sink);
+  }
+
+  Status read_one(const p4::Entity &entity, ReadSink *response) const {
     Status status;
     SessionTemp session(false  /* = batch */);
     switch (entity.entity_case()) {
@@ -538,39 +815,59 @@ class DeviceMgrImp {
   template <typename T, typename Accessor>
   Status table_read_common(p4_id_t table_id, const SessionTemp &session,
                            T *entries, Accessor An) const {
+    if (table_info_store.shadow_size(table_id) > 0)
+      return table_read_shadow(table_id, entries, An);
+    return table_read_device(table_id, session, entries, An);
+  }
+
+  template <typename T, typename Accessor>
+  Status table_read_device(p4_id_t table_id, const SessionTemp &session,
+                           T *entries, Accessor An) const {
     Status status;
     pi_table_fetch_res_t *res;
-    auto table_lock = table_info_store.lock_table(table_id);
-    auto pi_status = pi_table_entries_fetch(session.get(), device_id,
-                                            table_id, &res);
-    if (pi_status != PI_STATUS_SUCCESS) {
-      status.set_code(Code::UNKNOWN);
-      return status;
+    // The table lock only needs to cover the driver fetch and the lookups in
+    // the local state, so that both are consistent. Converting the entries to
+    // protobuf, which can take a while for large tables, is done once the lock
+    // is released: the fetch result is a private copy which is valid until
+    // pi_table_entries_fetch_done. The lock is shared with other readers.
+    std::vector<pi_table_ma_entry_t> pi_entries;
+    std::vector<uint64_t> controller_metadata;
+    {
+      auto table_lock = table_info_store.lock_table_shared(table_id);
+      auto pi_status = pi_table_entries_fetch(session.get(), device_id,
+                                              table_id, &res);
+      if (pi_status != PI_STATUS_SUCCESS) {
+        status.set_code(Code::UNKNOWN);
+        return status;
+      }
+      auto num_entries = pi_table_entries_num(res);
+      pi_entries.resize(num_entries);
+      controller_metadata.reserve(num_entries);
+      pi_entry_handle_t entry_handle;
+      for (auto &entry : pi_entries) {
+        pi_table_entries_next(res, &entry, &entry_handle);
+        // heterogeneous lookup: the match key returned by PI is not copied
+        auto entry_data = table_info_store.get_entry(
+            table_id, TableInfoStore::MatchKeyView(entry.match_key));
+        // this would point to a serious bug in the implementation, and
+        // shoudn't occur given that we keep the local state in sync with lower
+        // level state thanks to our per-table lock.
+        assert(entry_data != nullptr);
+        controller_metadata.push_back(entry_data->controller_metadata);
+      }
     }
-    auto num_entries = pi_table_entries_num(res);
-    pi_table_ma_entry_t entry;
-    pi_entry_handle_t entry_handle;
+
     Code code = Code::OK;
-    pi::MatchKey mk(p4info.get(), table_id);
-    for (size_t i = 0; i < num_entries; i++) {
-      pi_table_entries_next(res, &entry, &entry_handle);
+    for (size_t i = 0; i < pi_entries.size(); i++) {
+      if (entries->cancelled()) break;
+      auto &entry = pi_entries[i];
       auto table_entry = An(entries);
       table_entry->set_table_id(table_id);
       code = parse_match_key(table_id, entry.match_key, table_entry);
       if (code != Code::OK) break;
       code = parse_action_entry(table_id, &entry.entry, table_entry);
       if (code != Code::OK) break;
-      // TODO(antonin): what I really want to do here is a heterogeneous lookup;
-      // instead I make a copy of the match key in the right format and I use
-      // this for the lookup. If this is a performance issue, we can find a
-      // better solution.
-      mk.from(entry.match_key);
-      auto entry_data = table_info_store.get_entry(table_id, mk);
-      // this would point to a serious bug in the implementation, and shoudn't
-      // occur given that we keep the local state in sync with lower level state
-      // thanks to our per-table lock.
-      assert(entry_data != nullptr);
-      table_entry->set_controller_metadata(entry_data->controller_metadata);
+      table_entry->set_controller_metadata(controller_metadata[i]);
     }
 
     pi_table_entries_fetch_done(session.get(), res);
@@ -579,26 +876,147 @@ class DeviceMgrImp {
     return status;
   }
 
+  // Serves the read from the shadow copy kept in TableInfoStore. Like for
+  // table_read_device, the lock is only held while the entries are copied.
+  template <typename T, typename Accessor>
+  Status table_read_shadow(p4_id_t table_id, T *entries, Accessor An) const {
+    const size_t mk_size = pi_p4info_table_match_key_size(p4info.get(),
+                                                          table_id);
+    const size_t shadow_size = table_info_store.shadow_size(table_id);
+    // each record: priority, controller metadata, match key, shadow
+    constexpr size_t kMkOffset = sizeof(uint32_t) + sizeof(uint64_t);
+    const size_t record_size = kMkOffset + mk_size + shadow_size;
+    std::vector<char> records;
+    {
+      auto table_lock = table_info_store.lock_table_shared(table_id);
+      records.reserve(table_info_store.num_entries(table_id) * record_size);
+      table_info_store.for_each_entry(
+          table_id,
+          [&records, mk_size, shadow_size, record_size](
+              const TableInfoStore::MatchKeyView &mk,
+              const TableInfoStore::Data &data, const char *shadow) {
+            if (shadow[0] == PI_ACTION_ENTRY_TYPE_NONE) return;
+            auto offset = records.size();
+            records.resize(offset + record_size);
+            auto record = records.data() + offset;
+            std::memcpy(record, &mk.priority, sizeof(uint32_t));
+            std::memcpy(record + sizeof(uint32_t), &data.controller_metadata,
+                        sizeof(uint64_t));
+            std::memcpy(record + kMkOffset, mk.data, mk_size);
+            std::memcpy(record + kMkOffset + mk_size, shadow, shadow_size);
+          });
+    }
+
+    Code code = Code::OK;
+    for (size_t offset = 0; offset < records.size(); offset += record_size) {
+      if (entries->cancelled()) break;
+      auto record = records.data() + offset;
+      pi_match_key_t match_key;
+      match_key.p4info = p4info.get();
+      match_key.table_id = table_id;
+      std::memcpy(&match_key.priority, record, sizeof(uint32_t));
+      match_key.data_size = mk_size;
+      match_key.data = record + kMkOffset;
+      pi_action_data_t action_data;
+      pi_table_entry_t entry;
+      shadow_decode(p4info.get(), record + kMkOffset + mk_size, &action_data,
+                    &entry);
+      uint64_t controller_metadata;
+      std::memcpy(&controller_metadata, record + sizeof(uint32_t),
+                  sizeof(uint64_t));
+
+      auto table_entry = An(entries);
+      table_entry->set_table_id(table_id);
+      code = parse_match_key(table_id, &match_key, table_entry);
+      if (code != Code::OK) break;
+      code = parse_action_entry(table_id, &entry, table_entry);
+      if (code != Code::OK) break;
+      table_entry->set_controller_metadata(controller_metadata);
+    }
+
+    Status status;
+    status.set_code(code);
+    return status;
+  }
+
+  // Reads the table both from the target and from the shadow copy and checks
+  // that the entries are the same (in any order).
+  Status table_verify_shadow_one(p4_id_t table_id,
+                                 const SessionTemp &session) const {
+    auto read_sorted = [this, table_id, &session](
+        bool from_shadow, std::vector<std::string> *entries) {
+      google::protobuf::Arena arena;
+      auto response =
+          google::protobuf::Arena::CreateMessage<p4::ReadResponse>(&arena);
+      ReadSink sink(response);
+      auto An = [] (ReadSink *r) {
+        return r->add_entity()->mutable_table_entry(); };
+      auto status = from_shadow ?
+          table_read_shadow(table_id, &sink, An) :
+          table_read_device(table_id, session, &sink, An);
+      for (const auto &entity : response->entities())
+        entries->push_back(entity.table_entry().SerializeAsString());
+      std::sort(entries->begin(), entries->end());
+      return status;
+    };
+    std::vector<std::string> device_entries;
+    std::vector<std::string> shadow_entries;
+    auto status = read_sorted(false, &device_entries);
+    if (status.code() != Code::OK) return status;
+    status = read_sorted(true, &shadow_entries);
+    if (status.code() != Code::OK) return status;
+    if (device_entries != shadow_entries) {
+      status.set_code(Code::INTERNAL);
+      status.set_message(
+          std::string("Shadow copy does not match target state for table ") +
+          pi_p4info_table_name_from_id(p4info.get(), table_id));
+    }
+    return status;
+  }
+
+  Status verify_shadow(p4_id_t table_id) const {
+    Status status;
+    status.set_code(Code::OK);
+    SessionTemp session(false  /* = batch */);
+    if (table_id == 0) {
+      for (auto t_id = pi_p4info_table_begin(p4info.get());
+           t_id != pi_p4info_table_end(p4info.get());
+           t_id = pi_p4info_table_next(p4info.get(), t_id)) {
+        if (table_info_store.shadow_size(t_id) == 0) continue;
+        status = table_verify_shadow_one(t_id, session);
+        if (status.code() != Code::OK) break;
+      }
+      return status;
+    }
+    if (!check_p4_id(table_id, P4ResourceType::TABLE))
+      return make_invalid_p4_id_status();
+    if (table_info_store.shadow_size(table_id) == 0) {
+      status.set_code(Code::FAILED_PRECONDITION);
+      return status;
+    }
+    return table_verify_shadow_one(table_id, session);
+  }
+
   Status table_read_one(p4_id_t table_id, const SessionTemp &session,
-                        p4::ReadResponse *response) const {
+                        ReadSink *response) const {
     return table_read_common(
         table_id, session, response,
         [] (decltype(response) r) {
-          return r->add_entities()->mutable_table_entry(); });
+          return r->add_entity()->mutable_table_entry(); });
   }
 
   // TODO(antonin): full filtering on the match key, action, ...
   // TODO(antonin): direct resources
   Status table_read(const p4::TableEntry &table_entry,
                     const SessionTemp &session,
-                    p4::ReadResponse *response) const {
+                    ReadSink *response) const {
     Status status;
     if (table_entry.table_id() == 0) {  // read all entries for all tables
       for (auto t_id = pi_p4info_table_begin(p4info.get());
            t_id != pi_p4info_table_end(p4info.get());
            t_id = pi_p4info_table_next(p4info.get(), t_id)) {
         status = table_read_one(t_id, session, response);
-        if (status.code() != Code::OK) break;
+        if (status.code() != Code::OK || response->cancelled()) break;
       }
     } else {  // read for a single table
       if (!check_p4_id(table_entry.table_id(), P4ResourceType::TABLE))
@@ -690,6 +1108,7 @@ class DeviceMgrImp {
     for (size_t i = 0; i < num_members; i++) {
       pi_action_data_t *action_data;
       pi_indirect_handle_t member_h;
+      if (entries->cancelled()) break;
       auto member = MAn(entries);
       if (member == nullptr) break;
       member->set_action_profile_id(action_profile_id);
@@ -709,6 +1128,7 @@ class DeviceMgrImp {
       pi_indirect_handle_t *members_h;
       size_t num;
       pi_indirect_handle_t group_h;
+      if (entries->cancelled()) break;
       auto group = GAn(entries);
       if (group == nullptr) break;
       group->set_action_profile_id(action_profile_id);
@@ -738,11 +1158,11 @@ class DeviceMgrImp {
 
   Status action_profile_member_read_one(p4_id_t action_profile_id,
                                         const SessionTemp &session,
-                                        p4::ReadResponse *response) const {
+                                        ReadSink *response) const {
     return action_profile_read_common(
         action_profile_id, session, response,
         [] (decltype(response) r) {
-          return r->add_entities()->mutable_action_profile_member(); },
+          return r->add_entity()->mutable_action_profile_member(); },
         [] (decltype(response)) -> p4::ActionProfileGroup * {
           return nullptr; });
   }
@@ -750,7 +1170,7 @@ class DeviceMgrImp {
   // TODO(antonin): full filtering
   Status action_profile_member_read(const p4::ActionProfileMember &member,
                                     const SessionTemp &session,
-                                    p4::ReadResponse *response) const {
+                                    ReadSink *response) const {
     Status status;
     status.set_code(Code::OK);
     if (member.action_profile_id() == 0) {
@@ -758,7 +1178,7 @@ class DeviceMgrImp {
            act_prof_id != pi_p4info_act_prof_end(p4info.get());
            act_prof_id = pi_p4info_act_prof_next(p4info.get(), act_prof_id)) {
         status = action_profile_member_read_one(act_prof_id, session, response);
-        if (status.code() != Code::OK) break;
+        if (status.code() != Code::OK || response->cancelled()) break;
       }
     } else {
       if (!check_p4_id(member.action_profile_id(),
@@ -772,19 +1192,19 @@ class DeviceMgrImp {
 
   Status action_profile_group_read_one(p4_id_t action_profile_id,
                                        const SessionTemp &session,
-                                       p4::ReadResponse *response) const {
+                                       ReadSink *response) const {
     return action_profile_read_common(
         action_profile_id, session, response,
         [] (decltype(response)) -> p4::ActionProfileMember * {
           return nullptr; },
         [] (decltype(response) r) {
-          return r->add_entities()->mutable_action_profile_group(); });
+          return r->add_entity()->mutable_action_profile_group(); });
   }
 
   // TODO(antonin): full filtering
   Status action_profile_group_read(const p4::ActionProfileGroup &group,
                                    const SessionTemp &session,
-                                   p4::ReadResponse *response) const {
+                                   ReadSink *response) const {
     Status status;
     status.set_code(Code::OK);
     if (group.action_profile_id() == 0) {
@@ -792,7 +1212,7 @@ class DeviceMgrImp {
            act_prof_id != pi_p4info_act_prof_end(p4info.get());
            act_prof_id = pi_p4info_act_prof_next(p4info.get(), act_prof_id)) {
         status = action_profile_group_read_one(act_prof_id, session, response);
-        if (status.code() != Code::OK) break;
+        if (status.code() != Code::OK || response->cancelled()) break;
       }
     } else {
       if (!check_p4_id(group.action_profile_id(),
@@ -815,13 +1235,13 @@ class DeviceMgrImp {
   Status counter_read_one(p4_id_t counter_id,
                           const p4::CounterEntry &counter_entry,
                           const SessionTemp &session,
-                          p4::ReadResponse *response) const {
+                          ReadSink *response) const {
     Status status;
     status.set_code(Code::OK);
     assert(!(pi_p4info_counter_get_direct(p4info.get(), counter_id)
                       != PI_INVALID_ID));
     if (counter_entry.index() != 0) {
-      auto entry = response->add_entities()->mutable_counter_entry();
+      auto entry = response->add_entity()->mutable_counter_entry();
       entry->CopyFrom(counter_entry);
       auto code = counter_read_one_index(session, counter_id, entry);
       if (code != Code::OK) status.set_code(code);
@@ -830,7 +1250,8 @@ class DeviceMgrImp {
     // default index, read all
     auto counter_size = pi_p4info_counter_get_size(p4info.get(), counter_id);
     for (size_t index = 0; index < counter_size; index++) {
-      auto entry = response->add_entities()->mutable_counter_entry();
+      if (response->cancelled()) break;
+      auto entry = response->add_entity()->mutable_counter_entry();
       entry->set_index(index);
       auto code = counter_read_one_index(session, counter_id, entry);
       if (code != Code::OK) {
@@ -843,7 +1264,7 @@ class DeviceMgrImp {
 
   Status counter_read(const p4::CounterEntry &counter_entry,
                       const SessionTemp &session,
-                      p4::ReadResponse *response) const {
+                      ReadSink *response) const {
     Status status;
     status.set_code(Code::OK);
     if (counter_entry.counter_id() == 0) {  // read all entries for all counters
@@ -853,7 +1274,7 @@ class DeviceMgrImp {
         if (pi_p4info_counter_get_direct(p4info.get(), c_id) != PI_INVALID_ID)
           continue;
         status = counter_read_one(c_id, counter_entry, session, response);
-        if (status.code() != Code::OK) break;
+        if (status.code() != Code::OK || response->cancelled()) break;
       }
     } else {  // read for a single counter
       if (!check_p4_id(counter_entry.counter_id(), P4ResourceType::COUNTER))
@@ -1078,9 +1499,14 @@ class DeviceMgrImp {
       return status;
     }
 
+    auto shadow_size = table_info_store.shadow_size(table_id);
+    std::string shadow(shadow_size, '\x00');
+    if (shadow_size > 0)
+      shadow_encode(action_entry, table_entry.match().empty(), &shadow[0]);
     table_info_store.add_entry(
         table_id, match_key,
-        TableInfoStore::Data(handle, table_entry.controller_metadata()));
+        TableInfoStore::Data(handle, table_entry.controller_metadata()),
+        (shadow_size > 0) ? shadow.data() : nullptr);
 
     status.set_code(Code::OK);
     return status;
@@ -1127,6 +1553,12 @@ class DeviceMgrImp {
     }
 
     entry_data->controller_metadata = table_entry.controller_metadata();
+    auto shadow_size = table_info_store.shadow_size(table_id);
+    if (shadow_size > 0) {
+      std::string shadow(shadow_size, '\x00');
+      shadow_encode(action_entry, table_entry.match().empty(), &shadow[0]);
+      table_info_store.update_shadow(table_id, match_key, shadow.data());
+    }
 
     status.set_code(Code::OK);
     return status;
@@ -1205,6 +1637,11 @@ class DeviceMgrImp {
   action_profs{};
 
   TableInfoStore table_info_store;
+
+  // nullptr unless concurrent writes have been enabled
+  std::unique_ptr<WorkerPool> write_pool{nullptr};
+  // takes effect for the next pipeline_config_set
+  bool shadow_reads{false};
 };
 
 DeviceMgr::DeviceMgr(device_id_t device_id) {
@@ -1238,6 +1675,12 @@ DeviceMgr::read(const p4::ReadRequest &request,
   return pimp->read(request, response);
 }
 
+Status
+DeviceMgr::read(const p4::ReadRequest &request, size_t max_entities,
+                size_t max_bytes, const ReadChunkCb &chunk_cb) const {
+  return pimp->read(request, max_entities, max_bytes, chunk_cb);
+}
+
 Status
 DeviceMgr::read_one(const p4::Entity &entity,
                     p4::ReadResponse *response) const {
@@ -1254,6 +1697,21 @@ DeviceMgr::packet_in_register_cb(PacketInCb cb, void *cookie) {
   return pimp->packet_in_register_cb(cb, cookie);
 }
 
+void
+DeviceMgr::set_shadow_reads(bool enable) {
+  pimp->set_shadow_reads(enable);
+}
+
+Status
+DeviceMgr::verify_shadow(p4_id_t table_id) const {
+  return pimp->verify_shadow(table_id);
+}
+
+void
+DeviceMgr::set_write_concurrency(size_t num_threads) {
+  pimp->set_write_concurrency(num_threads);
+}
+
 void
 DeviceMgr::init(size_t max_devices) {
   DeviceMgrImp::init(max_devices);
@@ -24,8 +24,10 @@
 #include <PI/frontends/proto/device_mgr.h>
 #include <PI/pi.h>
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "google/rpc/status.pb.h"
 #include "p4/config/p4info.pb.h"
@@ -59,15 +61,46 @@ class PacketIOMgr {
   static void packet_in_cb(pi_dev_id_t dev_id, const char *pkt, size_t size,
                            void *cookie);
 
+  // Immutable once published. The packet paths never take the mutex and never
+  // block: they register as readers (num_readers), load the current snapshot
+  // and use it until they are done (see StateRef). A writer publishes a new
+  // snapshot by swapping the pointer and retires the old one. Retired
+  // snapshots are deleted by the first writer which observes no reader in
+  // flight, since a reader which starts after the swap can only load the new
+  // snapshot, or by the destructor. Under constant traffic a retired snapshot
+  // may thus be kept until a later update, which is fine since updates
+  // (p4_change, packet_in_register_cb) are rare.
+  struct State {
+    std::shared_ptr<const PacketInMutate> packet_in_mutate{nullptr};
+    std::shared_ptr<const PacketOutMutate> packet_out_mutate{nullptr};
+    PacketInCb cb{};
+    void *cookie{nullptr};
+  };
+
+  // gives access to the current snapshot for the lifetime of the object
+  class StateRef {
+   public:
+    explicit StateRef(const PacketIOMgr *mgr);
+    ~StateRef();
+    const State *operator->() const { return state; }
+
+   private:
+    const PacketIOMgr *mgr;
+    const State *state;
+  };
+
+  // must be called with the mutex held
+  void set_state(std::unique_ptr<const State> new_state);
+
   using Mutex = std::mutex;
   using Lock = std::lock_guard<Mutex>;
   device_id_t device_id;
-  mutable Mutex mutex{};
-  std::unique_ptr<PacketInMutate> packet_in_mutate;
-  std::unique_ptr<PacketOutMutate> packet_out_mutate;
-
-  PacketInCb cb_;
-  void *cookie_;
+  // serializes writers (p4_change and packet_in_register_cb)
+  Mutex mutex{};
+  std::atomic<const State *> state;
+  mutable std::atomic<size_t> num_readers{0};
+  // protected by the mutex
+  std::vector<std::unique_ptr<const State> > retired{};
 };
 
 }  // namespace proto
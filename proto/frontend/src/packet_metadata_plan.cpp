@@ -0,0 +1,218 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "packet_metadata_plan.h"
+
+#include <algorithm>  // for std::fill, std::copy
+#include <string>
+
+#include <cstring>  // for std::memcpy
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+namespace {
+
+// generic_extract and generic_deparse taken from the behavioral-model code
+
+void generic_extract(const char *data, int bit_offset, int bitwidth,
+                     char *dst) {
+  int nbytes = (bitwidth + 7) / 8;
+
+  if (bit_offset == 0 && bitwidth % 8 == 0) {
+    memcpy(dst, data, nbytes);
+    return;
+  }
+
+  int dst_offset = (nbytes << 3) - bitwidth;
+  int i;
+
+  // necessary to ensure correct behavior when shifting right (no sign
+  // extension)
+  auto udata = reinterpret_cast<const unsigned char *>(data);
+
+  int offset = bit_offset - dst_offset;
+  if (offset == 0) {
+    memcpy(dst, udata, nbytes);
+    dst[0] &= (0xFF >> dst_offset);
+  } else if (offset > 0) {  // shift left
+    for (i = 0; i < nbytes - 1; i++) {
+      dst[i] = (udata[i] << offset) | (udata[i + 1] >> (8 - offset));
+    }
+    dst[0] &= (0xFF >> dst_offset);
+    dst[i] = udata[i] << offset;
+    if ((bit_offset + bitwidth) > (nbytes << 3)) {
+      dst[i] |= (udata[i + 1] >> (8 - offset));
+    }
+  } else {  // shift right
+    offset = -offset;
+    dst[0] = udata[0] >> offset;
+    dst[0] &= (0xFF >> dst_offset);
+    for (i = 1; i < nbytes; i++) {
+      dst[i] = (udata[i - 1] << (8 - offset)) | (udata[i] >> offset);
+    }
+  }
+}
+
+void generic_deparse(const char *data, int bitwidth, char *dst,
+                     int hdr_offset) {
+  if (bitwidth == 0) return;
+
+  int nbytes = (bitwidth + 7) / 8;
+
+  if (hdr_offset == 0 && bitwidth % 8 == 0) {
+    memcpy(dst, data, nbytes);
+    return;
+  }
+
+  int field_offset = (nbytes << 3) - bitwidth;
+  int hdr_bytes = (hdr_offset + bitwidth + 7) / 8;
+
+  int i;
+
+  // necessary to ensure correct behavior when shifting right (no sign
+  // extension)
+  auto udata = reinterpret_cast<const unsigned char *>(data);
+
+  // zero out bits we are going to write in dst[0]
+  dst[0] &= (~(0xFF >> hdr_offset));
+
+  int offset = field_offset - hdr_offset;
+  if (offset == 0) {
+    std::copy(data + 1, data + hdr_bytes, dst + 1);
+    dst[0] |= udata[0];
+  } else if (offset > 0) {  // shift left
+    // don't know if this is very efficient, we memset the remaining bytes to 0
+    // so we can use |= and preserve what was originally in dst[0]
+    std::fill(&dst[1], &dst[hdr_bytes], 0);
+    for (i = 0; i < hdr_bytes - 1; i++) {
+      dst[i] |= (udata[i] << offset) | (udata[i + 1] >> (8 - offset));
+    }
+    dst[i] |= udata[i] << offset;
+  } else {  // shift right
+    offset = -offset;
+    dst[0] |= (udata[0] >> offset);
+    if (nbytes == 1) {
+      // dst[1] is always valid, otherwise we would not need to shift the field
+      // to the right
+      dst[1] = udata[0] << (8 - offset);
+      return;
+    }
+    for (i = 1; i < hdr_bytes - 1; i++) {
+      dst[i] = (udata[i - 1] << (8 - offset)) | (udata[i] >> offset);
+    }
+    int tail_offset = (hdr_bytes << 3) - (hdr_offset + bitwidth);
+    dst[i] &= ((1 << tail_offset) - 1);
+    dst[i] |= (udata[i - 1] << (8 - offset));
+  }
+}
+
+}  // namespace
+
+PacketMetadataPlan::PacketMetadataPlan(
+    const p4::config::ControllerPacketMetadata &metadata_hdr) {
+  uint32_t nbits = 0;
+  for (const auto &metadata : metadata_hdr.metadata()) {
+    Field field;
+    field.id = metadata.id();
+    field.byte_offset = nbits / 8;
+    field.bit_offset = nbits % 8;
+    field.bitwidth = metadata.bitwidth();
+    field.nbytes = (field.bitwidth + 7) / 8;
+    field.aligned = (field.bit_offset == 0 && field.bitwidth % 8 == 0);
+    fields.push_back(field);
+    nbits += field.bitwidth;
+  }
+  nbytes = (nbits + 7) / 8;
+}
+
+void
+PacketMetadataPlan::extract(const char *hdr, p4::PacketIn *packet_in) const {
+  packet_in->mutable_metadata()->Reserve(fields.size());
+  for (const auto &field : fields) {
+    auto metadata = packet_in->add_metadata();
+    metadata->set_metadata_id(field.id);
+    auto value = metadata->mutable_value();
+    if (field.aligned) {
+      value->assign(hdr + field.byte_offset, field.nbytes);
+      continue;
+    }
+    // the value is written in place, most values fit in the string's inline
+    // buffer so this does not allocate
+    value->assign(field.nbytes, 0);
+    generic_extract(hdr + field.byte_offset, field.bit_offset, field.bitwidth,
+                    &(*value)[0]);
+  }
+}
+
+const PacketMetadataPlan::Field *
+PacketMetadataPlan::find(uint32_t id, size_t hint) const {
+  // metadata is usually provided in P4Info order
+  if (hint < fields.size() && fields[hint].id == id) return &fields[hint];
+  for (const auto &field : fields)
+    if (field.id == id) return &field;
+  return nullptr;
+}
+
+bool
+PacketMetadataPlan::deparse(const p4::PacketOut &packet_out, char *hdr) const {
+  const auto &metadatas = packet_out.metadata();
+  for (int i = 0; i < metadatas.size(); i++) {
+    const auto &metadata = metadatas.Get(i);
+    auto field = find(metadata.metadata_id(), i);
+    if (field == nullptr || metadata.value().size() != field->nbytes)
+      return false;
+  }
+  // generic_deparse may clear the bits following the field in the last byte,
+  // so unaligned fields have to be written in header order
+  for (size_t i = 0; i < fields.size(); i++) {
+    const auto &field = fields[i];
+    const p4::PacketMetadata *metadata = nullptr;
+    if (i < static_cast<size_t>(metadatas.size()) &&
+        metadatas.Get(i).metadata_id() == field.id) {
+      metadata = &metadatas.Get(i);
+    } else {
+      for (const auto &m : metadatas) {
+        if (m.metadata_id() == field.id) {
+          metadata = &m;
+          break;
+        }
+      }
+    }
+    if (metadata == nullptr) continue;
+    const auto &value = metadata->value();
+    if (field.aligned) {
+      std::memcpy(hdr + field.byte_offset, value.data(), field.nbytes);
+    } else {
+      generic_deparse(value.data(), field.bitwidth, hdr + field.byte_offset,
+                      field.bit_offset);
+    }
+  }
+  return true;
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
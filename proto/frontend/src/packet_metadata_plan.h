@@ -0,0 +1,81 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_PACKET_METADATA_PLAN_H_
+#define SRC_PACKET_METADATA_PLAN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "p4/config/p4info.pb.h"
+#include "p4/p4runtime.pb.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Layout of a controller packet header (packet_in or packet_out), computed once
+// when the P4Info is set, so that the per-packet work does not have to go
+// through the P4Info protobuf message. Byte-aligned fields, the common case,
+// are a plain copy; the bit-level code is only used for the other fields.
+class PacketMetadataPlan {
+ public:
+  explicit PacketMetadataPlan(
+      const p4::config::ControllerPacketMetadata &metadata_hdr);
+
+  // size in bytes of the header which precedes the payload
+  size_t header_size() const { return nbytes; }
+
+  // hdr must point to at least header_size() bytes; one p4::PacketMetadata is
+  // appended to packet_in for each field, in P4Info order
+  void extract(const char *hdr, p4::PacketIn *packet_in) const;
+
+  // hdr must point to header_size() zeroed bytes; fields which are missing
+  // from packet_out are left to 0. Returns false if packet_out includes an
+  // unknown metadata id or a value with the wrong size.
+  bool deparse(const p4::PacketOut &packet_out, char *hdr) const;
+
+ private:
+  struct Field {
+    uint32_t id;
+    uint32_t byte_offset;
+    uint32_t bit_offset;  // in [0, 8)
+    uint32_t bitwidth;
+    uint32_t nbytes;
+    bool aligned;  // bit_offset == 0 and bitwidth is a multiple of 8
+  };
+
+  // returns nullptr if the id is unknown, tries the field at index hint first
+  const Field *find(uint32_t id, size_t hint) const;
+
+  std::vector<Field> fields{};
+  size_t nbytes{0};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_PACKET_METADATA_PLAN_H_
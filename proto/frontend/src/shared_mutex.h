@@ -0,0 +1,110 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_SHARED_MUTEX_H_
+#define SRC_SHARED_MUTEX_H_
+
+#include <condition_variable>
+#include <mutex>
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Reader / writer lock, since std::shared_mutex is not available in C++11. It
+// is writer-preferring: once a writer is waiting, new readers are held back, so
+// a steady stream of reads cannot starve table writes.
+class SharedMutex {
+ public:
+  void lock() {
+    std::unique_lock<std::mutex> lock(mutex);
+    writers_waiting++;
+    writer_cv.wait(lock, [this] { return !writer_active && readers == 0; });
+    writers_waiting--;
+    writer_active = true;
+  }
+
+  void unlock() {
+    std::lock_guard<std::mutex> lock(mutex);
+    writer_active = false;
+    if (writers_waiting > 0)
+      writer_cv.notify_one();
+    else
+      reader_cv.notify_all();
+  }
+
+  void lock_shared() {
+    std::unique_lock<std::mutex> lock(mutex);
+    reader_cv.wait(lock, [this] {
+        return !writer_active && writers_waiting == 0; });
+    readers++;
+  }
+
+  void unlock_shared() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--readers == 0 && writers_waiting > 0) writer_cv.notify_one();
+  }
+
+ private:
+  std::mutex mutex{};
+  std::condition_variable reader_cv{};
+  std::condition_variable writer_cv{};
+  size_t readers{0};
+  size_t writers_waiting{0};
+  bool writer_active{false};
+};
+
+// minimal equivalent of C++14 std::shared_lock
+template <typename M>
+class SharedLock {
+ public:
+  explicit SharedLock(M &m)  // NOLINT(runtime/references)
+      : m(&m) {
+    m.lock_shared();
+  }
+
+  SharedLock(SharedLock &&other) noexcept
+      : m(other.m) {
+    other.m = nullptr;
+  }
+
+  SharedLock(const SharedLock &) = delete;
+  SharedLock &operator=(const SharedLock &) = delete;
+
+  ~SharedLock() { unlock(); }
+
+  void unlock() {
+    if (m != nullptr) m->unlock_shared();
+    m = nullptr;
+  }
+
+ private:
+  M *m;
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_SHARED_MUTEX_H_
@@ -21,9 +21,14 @@
 #include <PI/frontends/cpp/tables.h>
 #include <PI/pi.h>
 
+#include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <memory>
-#include <sstream>
+#include <new>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 
 #include "table_info_store.h"
 
@@ -36,29 +41,270 @@ namespace proto {
 using MatchKey = TableInfoStore::MatchKey;
 using Data = TableInfoStore::Data;
 using Mutex = TableInfoStore::Mutex;
+using MatchKeyView = TableInfoStore::MatchKeyView;
 using Lock = TableInfoStore::Lock;
 
+namespace {
+
+// Flat open-addressing hash table, in the style of Swiss tables. There is one
+// control byte per slot: kEmpty, kDeleted or, for a full slot, the 7 low bits
+// of the match key hash. Control bytes are scanned kGroupWidth at a time, using
+// plain 64-bit arithmetic, so that most probes which do not hit are resolved
+// without looking at the slots. Since all the match keys of a table have the
+// same size, slots are fixed-size records stored inline in a single arena:
+// Data, then priority, then the match key bytes, then the (optional) shadow
+// record. There is no per-entry
+// allocation, and a successful lookup touches the control bytes and one slot.
+class FlatEntryMap {
+ public:
+  FlatEntryMap(pi_p4_id_t t_id, size_t mk_size, size_t max_size,
+               size_t shadow_size)
+      : t_id(t_id), mk_size(mk_size), shadow_size(shadow_size),
+        stride(round_up(kKeyOffset + mk_size + shadow_size, alignof(Data))) {
+    // reserve enough space for the table's max size up-front to avoid rehashing
+    // while the table is being populated
+    allocate(capacity_for(max_size));
+  }
+
+  // does nothing if an entry with the same key already exists
+  void insert(const MatchKeyView &mk, size_t hash, const Data &data,
+              const char *shadow) {
+    if (find(mk, hash) != kNotFound) return;
+    auto i = find_insert_slot(hash);
+    if (growth_left == 0 && ctrl[i] == kEmpty) {
+      // too many tombstones: rehash in place, otherwise grow
+      rehash((num_entries <= capacity * 7 / 16) ? capacity : capacity * 2);
+      i = find_insert_slot(hash);
+    }
+    if (ctrl[i] == kEmpty) growth_left--;
+    set_ctrl(i, h2(hash));
+    new (slot_data(i)) Data(data);
+    std::memcpy(slot(i) + kPriorityOffset, &mk.priority, sizeof(mk.priority));
+    std::memcpy(slot(i) + kKeyOffset, mk.data, mk_size);
+    if (shadow != nullptr)
+      std::memcpy(slot_shadow(i), shadow, shadow_size);
+    else
+      std::memset(slot_shadow(i), 0, shadow_size);
+    num_entries++;
+  }
+
+  void erase(const MatchKeyView &mk, size_t hash) {
+    auto i = find(mk, hash);
+    if (i == kNotFound) return;
+    // if the slot was never part of a full group, no probe sequence ever went
+    // past it, and it can be marked as empty instead of deleted
+    auto empty_before = match_empty(group((i - kGroupWidth) & mask()));
+    auto empty_after = match_empty(group(i));
+    if (empty_before && empty_after &&
+        trailing_slots(empty_after) + leading_slots(empty_before) <
+        kGroupWidth) {
+      set_ctrl(i, kEmpty);
+      growth_left++;
+    } else {
+      set_ctrl(i, kDeleted);
+    }
+    num_entries--;
+  }
+
+  Data *get(const MatchKeyView &mk, size_t hash) {
+    auto i = find(mk, hash);
+    return (i == kNotFound) ? nullptr : slot_data(i);
+  }
+
+  void set_shadow(const MatchKeyView &mk, size_t hash, const char *shadow) {
+    auto i = find(mk, hash);
+    if (i != kNotFound) std::memcpy(slot_shadow(i), shadow, shadow_size);
+  }
+
+  void for_each(const TableInfoStore::EntryVisitor &visitor) const {
+    for (size_t i = 0; i < capacity; i++) {
+      if (ctrl[i] & 0x80) continue;  // empty or deleted
+      visitor(MatchKeyView(t_id, slot_priority(i), slot(i) + kKeyOffset,
+                           mk_size),
+              *slot_data(i), (shadow_size > 0) ? slot_shadow(i) : nullptr);
+    }
+  }
+
+  size_t get_shadow_size() const { return shadow_size; }
+
+  size_t size() const { return num_entries; }
+
+ private:
+  static constexpr size_t kGroupWidth = 8;
+  static constexpr uint8_t kEmpty = 0x80;
+  static constexpr uint8_t kDeleted = 0xfe;
+  static constexpr uint64_t kLsbs = 0x0101010101010101ULL;
+  static constexpr uint64_t kMsbs = 0x8080808080808080ULL;
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+  static constexpr size_t kPriorityOffset = sizeof(Data);
+  static constexpr size_t kKeyOffset = kPriorityOffset + sizeof(uint32_t);
+
+  static size_t round_up(size_t v, size_t alignment) {
+    return (v + alignment - 1) / alignment * alignment;
+  }
+
+  // smallest power of 2 which can hold n entries with a max load of 7/8
+  static size_t capacity_for(size_t n) {
+    size_t capacity = kGroupWidth;
+    while (capacity - capacity / 8 < n) capacity *= 2;
+    return capacity;
+  }
+
+  static uint8_t h2(size_t hash) { return hash & 0x7f; }
+  static size_t h1(size_t hash) { return hash >> 7; }
+
+  // bit 7 of byte i is set iff slot i of the group matches
+  static uint64_t match_h2(uint64_t g, uint8_t h) {
+    // may have false positives, which are eliminated by the key comparison
+    auto x = g ^ (kLsbs * h);
+    return (x - kLsbs) & ~x & kMsbs;
+  }
+  static uint64_t match_empty(uint64_t g) { return g & (~g << 6) & kMsbs; }
+  static uint64_t match_empty_or_deleted(uint64_t g) {
+    return g & (~g << 7) & kMsbs;
+  }
+  static size_t trailing_slots(uint64_t m) { return __builtin_ctzll(m) >> 3; }
+  static size_t leading_slots(uint64_t m) { return __builtin_clzll(m) >> 3; }
+
+  size_t mask() const { return capacity - 1; }
+
+  // the first kGroupWidth control bytes are mirrored after the last one, so
+  // that a group can be loaded from any position without wrapping around
+  uint64_t group(size_t pos) const {
+    uint64_t g;
+    std::memcpy(&g, &ctrl[pos], sizeof(g));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    g = __builtin_bswap64(g);
+#endif
+    return g;
+  }
+
+  void set_ctrl(size_t i, uint8_t c) {
+    ctrl[i] = c;
+    if (i < kGroupWidth) ctrl[capacity + i] = c;
+  }
+
+  char *slot(size_t i) const { return arena.get() + i * stride; }
+  Data *slot_data(size_t i) const { return reinterpret_cast<Data *>(slot(i)); }
+  char *slot_shadow(size_t i) const { return slot(i) + kKeyOffset + mk_size; }
+
+  uint32_t slot_priority(size_t i) const {
+    uint32_t priority;
+    std::memcpy(&priority, slot(i) + kPriorityOffset, sizeof(priority));
+    return priority;
+  }
+
+  size_t find(const MatchKeyView &mk, size_t hash) const {
+    assert(mk.table_id == t_id && mk.size == mk_size);
+    auto pos = h1(hash) & mask();
+    for (size_t step = kGroupWidth; ; step += kGroupWidth) {
+      auto g = group(pos);
+      for (auto m = match_h2(g, h2(hash)); m; m &= m - 1) {
+        auto i = (pos + trailing_slots(m)) & mask();
+        if (slot_priority(i) == mk.priority &&
+            !std::memcmp(slot(i) + kKeyOffset, mk.data, mk_size))
+          return i;
+      }
+      if (match_empty(g)) return kNotFound;
+      pos = (pos + step) & mask();  // triangular probing over groups
+    }
+  }
+
+  size_t find_insert_slot(size_t hash) const {
+    auto pos = h1(hash) & mask();
+    for (size_t step = kGroupWidth; ; step += kGroupWidth) {
+      auto m = match_empty_or_deleted(group(pos));
+      if (m) return (pos + trailing_slots(m)) & mask();
+      pos = (pos + step) & mask();
+    }
+  }
+
+  void allocate(size_t new_capacity) {
+    capacity = new_capacity;
+    ctrl.reset(new uint8_t[capacity + kGroupWidth]);
+    std::memset(ctrl.get(), kEmpty, capacity + kGroupWidth);
+    arena.reset(new char[capacity * stride]);
+    growth_left = capacity - capacity / 8;
+  }
+
+  void rehash(size_t new_capacity) {
+    auto old_capacity = capacity;
+    auto old_ctrl = std::move(ctrl);
+    auto old_arena = std::move(arena);
+    allocate(new_capacity);
+    for (size_t j = 0; j < old_capacity; j++) {
+      if (old_ctrl[j] & 0x80) continue;  // empty or deleted
+      const char *old_slot = old_arena.get() + j * stride;
+      uint32_t priority;
+      std::memcpy(&priority, old_slot + kPriorityOffset, sizeof(priority));
+      auto hash = pi::MatchKeyHash()(
+          MatchKeyView(t_id, priority, old_slot + kKeyOffset, mk_size));
+      auto i = find_insert_slot(hash);
+      set_ctrl(i, h2(hash));
+      new (slot_data(i)) Data(*reinterpret_cast<const Data *>(old_slot));
+      std::memcpy(slot(i) + kPriorityOffset, old_slot + kPriorityOffset,
+                  stride - kPriorityOffset);
+    }
+    growth_left -= num_entries;
+  }
+
+  static_assert(std::is_trivially_destructible<Data>::value,
+                "Data destructor is never called");
+
+  const pi_p4_id_t t_id;
+  const size_t mk_size;
+  const size_t shadow_size;
+  const size_t stride;
+  size_t capacity{0};
+  size_t num_entries{0};
+  size_t growth_left{0};
+  std::unique_ptr<uint8_t[]> ctrl{nullptr};
+  std::unique_ptr<char[]> arena{nullptr};
+};
+
+}  // namespace
+
 class TableInfoStoreOne {
  public:
-  void add_entry(const MatchKey &mk, const Data &data) {
-    data_map.emplace(mk, data);
+  TableInfoStoreOne(pi_p4_id_t t_id, size_t mk_size, size_t max_size,
+                    size_t shadow_size)
+      : entries(t_id, mk_size, max_size, shadow_size) { }
+
+  void add_entry(const MatchKey &mk, const Data &data, const char *shadow) {
+    entries.insert(MatchKeyView(mk), pi::MatchKeyHash()(mk), data, shadow);
   }
 
-  void remove_entry(const MatchKey &mk) {
-    data_map.erase(mk);
+  void update_shadow(const MatchKey &mk, const char *shadow) {
+    entries.set_shadow(MatchKeyView(mk), pi::MatchKeyHash()(mk), shadow);
   }
 
-  Data *get_entry(const MatchKey &mk) {
-    auto it = data_map.find(mk);
-    return (it == data_map.end()) ? nullptr : &it->second;
+  template <typename K>
+  void remove_entry(const K &mk) {
+    entries.erase(MatchKeyView(mk), pi::MatchKeyHash()(mk));
+  }
+
+  template <typename K>
+  Data *get_entry(const K &mk) {
+    return entries.get(MatchKeyView(mk), pi::MatchKeyHash()(mk));
+  }
+
+  size_t num_entries() const { return entries.size(); }
+
+  size_t shadow_size() const { return entries.get_shadow_size(); }
+
+  void for_each_entry(const TableInfoStore::EntryVisitor &visitor) const {
+    entries.for_each(visitor);
   }
 
   Lock lock() const { return Lock(mutex); }
 
+  TableInfoStore::SharedLock lock_shared() const {
+    return TableInfoStore::SharedLock(mutex);
+  }
+
  private:
   mutable Mutex mutex{};
-  std::unordered_map<MatchKey, Data, pi::MatchKeyHash, pi::MatchKeyEq>
-  data_map{};
+  FlatEntryMap entries;
 };
 
 TableInfoStore::TableInfoStore() = default;
@@ -70,17 +316,31 @@ TableInfoStore::lock_table(pi_p4_id_t t_id) const {
   return table->lock();
 }
 
+TableInfoStore::SharedLock
+TableInfoStore::lock_table_shared(pi_p4_id_t t_id) const {
+  auto &table = tables.at(t_id);
+  return table->lock_shared();
+}
+
 void
-TableInfoStore::add_table(pi_p4_id_t t_id) {
-  tables.emplace(
-      t_id, std::unique_ptr<TableInfoStoreOne>(new TableInfoStoreOne()));
+TableInfoStore::add_table(pi_p4_id_t t_id, size_t match_key_size,
+                          size_t max_size, size_t shadow_size) {
+  tables.emplace(t_id, std::unique_ptr<TableInfoStoreOne>(
+      new TableInfoStoreOne(t_id, match_key_size, max_size, shadow_size)));
 }
 
 void
 TableInfoStore::add_entry(pi_p4_id_t t_id, const MatchKey &mk,
-                          const Data &data) {
+                          const Data &data, const char *shadow) {
+  auto &table = tables.at(t_id);
+  table->add_entry(mk, data, shadow);
+}
+
+void
+TableInfoStore::update_shadow(pi_p4_id_t t_id, const MatchKey &mk,
+                              const char *shadow) {
   auto &table = tables.at(t_id);
-  table->add_entry(mk, data);
+  table->update_shadow(mk, shadow);
 }
 
 void
@@ -89,12 +349,43 @@ TableInfoStore::remove_entry(pi_p4_id_t t_id, const MatchKey &mk) {
   table->remove_entry(mk);
 }
 
+void
+TableInfoStore::remove_entry(pi_p4_id_t t_id, const MatchKeyView &mk) {
+  auto &table = tables.at(t_id);
+  table->remove_entry(mk);
+}
+
 Data *
 TableInfoStore::get_entry(pi_p4_id_t t_id, const MatchKey &mk) const {
   auto &table = tables.at(t_id);
   return table->get_entry(mk);
 }
 
+Data *
+TableInfoStore::get_entry(pi_p4_id_t t_id, const MatchKeyView &mk) const {
+  auto &table = tables.at(t_id);
+  return table->get_entry(mk);
+}
+
+size_t
+TableInfoStore::num_entries(pi_p4_id_t t_id) const {
+  auto &table = tables.at(t_id);
+  return table->num_entries();
+}
+
+size_t
+TableInfoStore::shadow_size(pi_p4_id_t t_id) const {
+  auto &table = tables.at(t_id);
+  return table->shadow_size();
+}
+
+void
+TableInfoStore::for_each_entry(pi_p4_id_t t_id,
+                               const EntryVisitor &visitor) const {
+  auto &table = tables.at(t_id);
+  table->for_each_entry(visitor);
+}
+
 void
 TableInfoStore::reset() {
   tables.clear();
@@ -24,10 +24,13 @@
 #include <PI/frontends/cpp/tables.h>
 #include <PI/pi.h>
 
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
 
+#include "shared_mutex.h"
+
 namespace pi {
 
 namespace fe {
@@ -44,6 +47,9 @@ class TableInfoStore {
   // key should be able to change without impacting the hash or equality
   // operator.
   using MatchKey = pi::MatchKey;
+  // lookups can also be done with a non-owning view of the match key, e.g. a
+  // pi_match_key_t returned by pi_table_entries_fetch, without copying it
+  using MatchKeyView = pi::MatchKeyView;
 
   // wish I could use boost::variant for these
   struct Data {
@@ -54,8 +60,9 @@ class TableInfoStore {
     uint64_t controller_metadata{0};
   };
 
-  using Mutex = std::mutex;
+  using Mutex = SharedMutex;
   using Lock = std::unique_lock<Mutex>;
+  using SharedLock = pi::fe::proto::SharedLock<Mutex>;
 
   TableInfoStore();
 
@@ -66,13 +73,43 @@ class TableInfoStore {
   // consistent with lower level driver operations.
   Lock lock_table(pi_p4_id_t t_id) const;
 
-  void add_table(pi_p4_id_t t_id);
+  // Readers of the table state (lookups which do not modify the store) can
+  // share the lock. While a writer is waiting, new readers are blocked, so a
+  // reader should release the lock as soon as it has what it needs.
+  SharedLock lock_table_shared(pi_p4_id_t t_id) const;
+
+  // entries are stored in a flat hash table, with the match key inline, so we
+  // need the (fixed) match key size; the table is pre-sized for max_size
+  // entries. Pointers returned by get_entry are invalidated by add_entry.
+  // If shadow_size is not 0, an opaque shadow_size-byte record is also stored
+  // inline with each entry; the client uses it to keep a copy of the entry's
+  // action, so that table reads can be served without querying the target.
+  void add_table(pi_p4_id_t t_id, size_t match_key_size, size_t max_size,
+                 size_t shadow_size = 0);
+
+  // shadow must point to shadow_size bytes, or be nullptr, in which case the
+  // shadow record is zeroed
+  void add_entry(pi_p4_id_t t_id, const MatchKey &mk, const Data &data,
+                 const char *shadow = nullptr);
 
-  void add_entry(pi_p4_id_t t_id, const MatchKey &mk, const Data &data);
+  // does nothing if there is no such entry
+  void update_shadow(pi_p4_id_t t_id, const MatchKey &mk, const char *shadow);
 
   void remove_entry(pi_p4_id_t t_id, const MatchKey &mk);
+  void remove_entry(pi_p4_id_t t_id, const MatchKeyView &mk);
 
   Data *get_entry(pi_p4_id_t t_id, const MatchKey &mk) const;
+  Data *get_entry(pi_p4_id_t t_id, const MatchKeyView &mk) const;
+
+  size_t num_entries(pi_p4_id_t t_id) const;
+
+  size_t shadow_size(pi_p4_id_t t_id) const;
+
+  // the shadow argument is nullptr if the table was added with shadow_size 0;
+  // the entries must not be modified during the iteration
+  using EntryVisitor = std::function<void(
+      const MatchKeyView &mk, const Data &data, const char *shadow)>;
+  void for_each_entry(pi_p4_id_t t_id, const EntryVisitor &visitor) const;
 
   void reset();
 
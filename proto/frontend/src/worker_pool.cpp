@@ -0,0 +1,114 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "worker_pool.h"
+
+#include <exception>
+#include <vector>
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+struct WorkerPool::Completion {
+  size_t remaining;
+  std::condition_variable cv{};
+  std::exception_ptr error{};
+};
+
+WorkerPool::WorkerPool(size_t num_workers) {
+  for (size_t i = 0; i < num_workers; i++)
+    workers.emplace_back(&WorkerPool::worker_loop, this);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    Lock lock(mutex);
+    stop = true;
+  }
+  cv.notify_all();
+  for (auto &worker : workers) worker.join();
+}
+
+// the task is counted as completed even if it throws, otherwise run_all would
+// wait forever
+void
+WorkerPool::run_one(const QueuedTask &qt) {
+  std::exception_ptr error;
+  try {
+    (*qt.task)();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  Lock lock(mutex);
+  if (error && !qt.completion->error) qt.completion->error = error;
+  if (--qt.completion->remaining == 0) qt.completion->cv.notify_all();
+}
+
+void
+WorkerPool::worker_loop() {
+  Lock lock(mutex);
+  while (true) {
+    cv.wait(lock, [this] { return stop || !queue.empty(); });
+    if (queue.empty()) return;  // stop requested
+    auto qt = queue.front();
+    queue.pop_front();
+    lock.unlock();
+    run_one(qt);
+    lock.lock();
+  }
+}
+
+void
+WorkerPool::run_all(std::vector<Task> *tasks) {
+  if (tasks->empty()) return;
+  Completion completion;
+  completion.remaining = tasks->size();
+  {
+    Lock lock(mutex);
+    for (auto &task : *tasks) queue.push_back({&task, &completion});
+  }
+  cv.notify_all();
+
+  // help with the queue until it is empty; the tasks we run may belong to
+  // another caller, which is fine
+  Lock lock(mutex);
+  while (completion.remaining > 0) {
+    if (queue.empty()) {
+      completion.cv.wait(lock);
+      continue;
+    }
+    auto qt = queue.front();
+    queue.pop_front();
+    lock.unlock();
+    run_one(qt);
+    lock.lock();
+  }
+  lock.unlock();
+  if (completion.error) std::rethrow_exception(completion.error);
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
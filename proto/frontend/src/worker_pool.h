@@ -0,0 +1,82 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_WORKER_POOL_H_
+#define SRC_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Fixed-size pool of threads used to run a set of tasks concurrently. The
+// calling thread also runs tasks while it waits for the set to complete, so a
+// pool with N workers provides a parallelism of N + 1. Several threads can call
+// run_all on the same pool at the same time. If a task throws, the other tasks
+// still run, and run_all rethrows the first exception once they have all
+// completed.
+class WorkerPool {
+ public:
+  using Task = std::function<void()>;
+
+  explicit WorkerPool(size_t num_workers);
+
+  ~WorkerPool();
+
+  // returns once all the tasks have completed
+  void run_all(std::vector<Task> *tasks);
+
+  size_t num_workers() const { return workers.size(); }
+
+ private:
+  struct Completion;
+
+  struct QueuedTask {
+    Task *task;
+    Completion *completion;
+  };
+
+  void worker_loop();
+  void run_one(const QueuedTask &qt);
+
+  using Mutex = std::mutex;
+  using Lock = std::unique_lock<Mutex>;
+  Mutex mutex{};
+  std::condition_variable cv{};
+  std::deque<QueuedTask> queue{};
+  bool stop{false};
+  std::vector<std::thread> workers{};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_WORKER_POOL_H_
@@ -20,10 +20,38 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// What to do with a packet-in when the queue of a stream client is full
+typedef enum {
+  // the new packet is dropped
+  PI_GRPC_PACKET_IN_DROP_NEWEST,
+  // the oldest queued packet is dropped to make room for the new one
+  PI_GRPC_PACKET_IN_DROP_OLDEST
+} PIGrpcPacketInDropPolicy;
+
+#define PI_GRPC_PACKET_IN_DEFAULT_QUEUE_DEPTH 1024
+
+#define PI_GRPC_DEFAULT_NUM_COMPLETION_QUEUES 4
+
+#define PI_GRPC_DEFAULT_NUM_READ_THREADS 4
+
+// Packet-in counters for one StreamChannel client; received counts every
+// packet-in delivered to the client, whether it was queued, sent right away or
+// dropped. The packets still queued when the client disconnects are counted as
+// dropped.
+typedef struct {
+  uint64_t client_id;
+  uint64_t received;
+  uint64_t sent;
+  uint64_t dropped;
+} PIGrpcPacketInClientStats;
+
 // Start server and bind to default address (0.0.0.0:50051)
 void PIGrpcServerRun();
 // Start server and bind to given address (eg. localhost:1234,
@@ -43,6 +71,45 @@ void PIGrpcServerForceShutdown(int deadline_seconds);
 // Once server has been shutdown, cleanup allocated resources.
 void PIGrpcServerCleanup();
 
+// Set the number of completion queues used to serve the RPCs; each one is
+// polled by its own thread, which also runs the handlers of the unary RPCs it
+// receives. StreamChannel is served on an additional queue of its own, so that
+// packet I/O is not held up by slow handlers. Must be called before
+// PIGrpcServerRun / PIGrpcServerRunAddr.
+void PIGrpcServerSetNumCompletionQueues(size_t num_cqs);
+
+// Set the number of threads fetching the entities of Read RPCs, which is the
+// maximum number of Read RPCs served at the same time; other Read RPCs wait for
+// a thread to be available. Must be called before PIGrpcServerRun /
+// PIGrpcServerRunAddr.
+void PIGrpcServerSetNumReadThreads(size_t num_threads);
+
+// Set the number of threads used for each device to apply the updates of a
+// WriteRequest; with more than 1, updates to different entities are applied
+// concurrently (see DeviceMgr::set_write_concurrency). The default is 1. Must
+// be called before PIGrpcServerRun / PIGrpcServerRunAddr.
+void PIGrpcServerSetWriteConcurrency(size_t num_threads);
+
+// If enable is non-zero, table reads are served from a copy of the entries
+// kept by the server instead of querying the target (see
+// DeviceMgr::set_shadow_reads). Disabled by default. Must be called before
+// PIGrpcServerRun / PIGrpcServerRunAddr.
+void PIGrpcServerSetShadowReads(int enable);
+
+// Set the depth of the packet-in queue kept for each StreamChannel client,
+// which absorbs bursts while the previous packet is being written to the
+// client, and what to drop when it is full. A depth of 0 disables queuing. Only
+// applies to clients connecting after the call, so it is best called before
+// PIGrpcServerRun / PIGrpcServerRunAddr.
+void PIGrpcServerSetPacketInQueue(size_t depth,
+                                  PIGrpcPacketInDropPolicy policy);
+
+// Copy the packet-in counters of at most max_clients connected StreamChannel
+// clients to stats. Returns the number of connected clients, which may be
+// larger than max_clients.
+size_t PIGrpcServerGetPacketInStats(PIGrpcPacketInClientStats *stats,
+                                    size_t max_clients);
+
 #ifdef __cplusplus
 }
 #endif
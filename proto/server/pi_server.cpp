@@ -23,11 +23,17 @@
 
 #include <PI/proto/pi_server.h>
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <atomic>
+#include <unordered_map>
+#include <vector>
 
 #include <csignal>
 
@@ -41,14 +47,13 @@
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
-using grpc::ServerReader;
-using grpc::ServerWriter;
-using grpc::ServerReaderWriter;
 using grpc::Status;
 using grpc::StatusCode;
 using grpc::CompletionQueue;
 using grpc::ServerCompletionQueue;
 using grpc::ServerAsyncReaderWriter;
+using grpc::ServerAsyncResponseWriter;
+using grpc::ServerAsyncWriter;
 
 using pi::fe::proto::GnmiMgr;
 using pi::fe::proto::DeviceMgr;
@@ -103,43 +108,234 @@ class ConfigMgrInstance {
   }
 };
 
-DeviceMgr *device_mgr = nullptr;
+// applied to each DeviceMgr when it is created, see
+// PIGrpcServerSetWriteConcurrency and PIGrpcServerSetShadowReads
+size_t write_concurrency = 1;
+bool shadow_reads = false;
+
+// Maps each device id to its DeviceMgr, which is created by the first
+// SetForwardingPipelineConfig for the device and lives until the server is
+// cleaned up. Each DeviceMgr has its own state and locks, so RPCs for
+// different devices do not contend with each other. They do share the
+// completion queue threads though: a slow handler for one device delays the
+// RPCs queued behind it on the same thread, whatever their device. Lookups are
+// done on every RPC and are a single atomic load of an immutable snapshot of
+// the map. The map is copied when a device is added, and the previous copies
+// are only released with the registry; since devices are never removed, there
+// are at most as many copies as devices.
+class DeviceRegistry {
+ public:
+  using device_id_t = DeviceMgr::device_id_t;
+
+  DeviceRegistry() {
+    maps.emplace_back(new DeviceMap());
+    devices.store(maps.back().get());
+  }
+
+  DeviceMgr *get(device_id_t device_id) const {
+    auto current = devices.load();
+    auto it = current->find(device_id);
+    return (it == current->end()) ? nullptr : it->second;
+  }
+
+  DeviceMgr *get_or_create(device_id_t device_id) {
+    std::unique_lock<std::mutex> L(m_);
+    auto device_mgr = get(device_id);
+    if (device_mgr != nullptr) return device_mgr;
+    device_mgr = new DeviceMgr(device_id);
+    device_mgr->set_write_concurrency(write_concurrency);
+    device_mgr->set_shadow_reads(shadow_reads);
+    owned.emplace_back(device_mgr);
+    std::unique_ptr<DeviceMap> new_devices(new DeviceMap(*devices.load()));
+    new_devices->emplace(device_id, device_mgr);
+    devices.store(new_devices.get());
+    maps.push_back(std::move(new_devices));
+    return device_mgr;
+  }
+
+ private:
+  using DeviceMap = std::unordered_map<device_id_t, DeviceMgr *>;
+
+  // serializes writers
+  std::mutex m_;
+  std::vector<std::unique_ptr<DeviceMgr> > owned;
+  // every snapshot ever published, the last one is the current one
+  std::vector<std::unique_ptr<const DeviceMap> > maps;
+  std::atomic<const DeviceMap *> devices{nullptr};
+};
+
+DeviceRegistry *device_registry = nullptr;
+
+Status device_not_configured(DeviceMgr::device_id_t device_id) {
+  return Status(StatusCode::FAILED_PRECONDITION,
+                "No forwarding pipeline config set for device " +
+                std::to_string(device_id));
+}
+
+// per-client packet-in queue, see PIGrpcServerSetPacketInQueue; read once by
+// each new client, and possibly written at the same time
+std::atomic<size_t> packet_in_queue_depth{
+  PI_GRPC_PACKET_IN_DEFAULT_QUEUE_DEPTH};
+std::atomic<PIGrpcPacketInDropPolicy> packet_in_drop_policy{
+  PI_GRPC_PACKET_IN_DROP_NEWEST};
+
+// limits for each ReadResponse message sent in reply to a Read RPC
+constexpr size_t kReadChunkMaxEntities = 1024;
+constexpr size_t kReadChunkMaxBytes = 1 << 20;
+
+// number of completion queues, each polled by its own thread, see
+// PIGrpcServerSetNumCompletionQueues
+size_t num_completion_queues = PI_GRPC_DEFAULT_NUM_COMPLETION_QUEUES;
+
+// number of threads producing the entities of Read RPCs, see
+// PIGrpcServerSetNumReadThreads
+size_t num_read_threads = PI_GRPC_DEFAULT_NUM_READ_THREADS;
+
+using P4RuntimeAsyncService = p4::P4Runtime::AsyncService;
+using gNMIAsyncService = gnmi::gNMI::AsyncService;
+
+// All the RPCs are served with the async API. Every tag placed in a completion
+// queue is a CallTag, and the thread polling the queue calls proceed() on it.
+// The unary RPC handlers below run on the polling threads, Read handlers run on
+// the threads of the ReadPool (see ReadCall) and StreamChannel has a dedicated
+// queue.
+class CallTag {
+ public:
+  virtual ~CallTag() { }
+  virtual void proceed(bool ok = true) = 0;
+};
+
+void poll_completion_queue(ServerCompletionQueue *cq) {
+  void *tag;
+  bool ok;
+  while (cq->Next(&tag, &ok)) static_cast<CallTag *>(tag)->proceed(ok);
+}
+
+// An instance is created for every call of a unary method on a given
+// completion queue: it requests the call, requests the next one when it
+// arrives, runs the handler and deletes itself once the response is sent.
+template <typename Service, typename Request, typename Response>
+class UnaryCall : public CallTag {
+ public:
+  using RequestMethod = void (Service::*)(
+      ServerContext *, Request *, ServerAsyncResponseWriter<Response> *,
+      CompletionQueue *, ServerCompletionQueue *, void *);
+  using Handler = Status (*)(ServerContext *, const Request *, Response *);
+
+  static void start(Service *service, RequestMethod request_method,
+                    Handler handler, ServerCompletionQueue *cq) {
+    new UnaryCall(service, request_method, handler, cq);
+  }
+
+  void proceed(bool ok = true) override {
+    if (!ok || state == State::FINISH) {
+      delete this;
+      return;
+    }
+    start(service, request_method, handler, cq);
+    auto status = handler(&ctx, &request, &response);
+    state = State::FINISH;
+    responder.Finish(response, status, this);
+  }
 
-class gNMIServiceImpl : public gnmi::gNMI::Service {
  private:
-  Status Capabilities(ServerContext *context,
-                      const gnmi::CapabilityRequest *request,
-                      gnmi::CapabilityResponse *response) override {
-    (void) request; (void) response;
+  UnaryCall(Service *service, RequestMethod request_method, Handler handler,
+            ServerCompletionQueue *cq)
+      : service(service), request_method(request_method), handler(handler),
+        cq(cq), responder(&ctx) {
+    (service->*request_method)(&ctx, &request, &responder, cq, cq, this);
+  }
+
+  Service *service;
+  RequestMethod request_method;
+  Handler handler;
+  ServerCompletionQueue *cq;
+  ServerContext ctx{};
+  Request request{};
+  Response response{};
+  ServerAsyncResponseWriter<Response> responder;
+  enum class State {REQUEST, FINISH};
+  State state{State::REQUEST};
+};
+
+// the RequestX methods are members of the WithAsyncMethod_X base classes of
+// Service, hence the separate Base parameter
+template <typename Service, typename Base, typename Request,
+          typename Response>
+void request_unary_call(
+    Service *service,
+    void (Base::*request_method)(
+        ServerContext *, Request *, ServerAsyncResponseWriter<Response> *,
+        CompletionQueue *, ServerCompletionQueue *, void *),
+    Status (*handler)(ServerContext *, const Request *, Response *),
+    ServerCompletionQueue *cq) {
+  UnaryCall<Service, Request, Response>::start(
+      service, request_method, handler, cq);
+}
+
+class gNMIServiceImpl {
+ public:
+  static Status Capabilities(ServerContext *context,
+                             const gnmi::CapabilityRequest *request,
+                             gnmi::CapabilityResponse *response) {
+    (void) context; (void) request; (void) response;
     SIMPLELOG << "gNMI Capabilities\n";
     SIMPLELOG << request->DebugString();
     return Status(StatusCode::UNIMPLEMENTED, "not implemented yet");
   }
 
-  Status Get(ServerContext *context, const gnmi::GetRequest *request,
-             gnmi::GetResponse *response) override {
+  static Status Get(ServerContext *context, const gnmi::GetRequest *request,
+                    gnmi::GetResponse *response) {
+    (void) context;
     SIMPLELOG << "gNMI Get\n";
     SIMPLELOG << request->DebugString();
     auto status = ConfigMgrInstance::get()->get(*request, response);
     return to_grpc_status(status);
   }
 
-  Status Set(ServerContext *context, const gnmi::SetRequest *request,
-             gnmi::SetResponse *response) override {
+  static Status Set(ServerContext *context, const gnmi::SetRequest *request,
+                    gnmi::SetResponse *response) {
+    (void) context;
     SIMPLELOG << "gNMI Set\n";
     SIMPLELOG << request->DebugString();
     auto status = ConfigMgrInstance::get()->set(*request, response);
     return to_grpc_status(status);
   }
 
-  Status Subscribe(
-      ServerContext *context,
-      ServerReaderWriter<gnmi::SubscribeResponse,
-                         gnmi::SubscribeRequest> *stream) override {
-    (void) stream;
+};
+
+// Subscribe is not implemented yet, every call is terminated right away
+class gNMISubscribeCall : public CallTag {
+ public:
+  static void start(gNMIAsyncService *service, ServerCompletionQueue *cq) {
+    new gNMISubscribeCall(service, cq);
+  }
+
+  void proceed(bool ok = true) override {
+    if (!ok || state == State::FINISH) {
+      delete this;
+      return;
+    }
+    start(service, cq);
     SIMPLELOG << "gNMI Subscribe\n";
-    return Status(StatusCode::UNIMPLEMENTED, "not implemented yet");
+    state = State::FINISH;
+    stream.Finish(Status(StatusCode::UNIMPLEMENTED, "not implemented yet"),
+                  this);
   }
+
+ private:
+  gNMISubscribeCall(gNMIAsyncService *service, ServerCompletionQueue *cq)
+      : service(service), cq(cq), stream(&ctx) {
+    service->RequestSubscribe(&ctx, &stream, cq, cq, this);
+  }
+
+  gNMIAsyncService *service;
+  ServerCompletionQueue *cq;
+  ServerContext ctx{};
+  ServerAsyncReaderWriter<gnmi::SubscribeResponse, gnmi::SubscribeRequest>
+  stream;
+  enum class State {REQUEST, FINISH};
+  State state{State::REQUEST};
 };
 
 class StreamChannelClientMgr;
@@ -149,121 +345,354 @@ StreamChannelClientMgr *packet_in_mgr;
 void packet_in_cb(DeviceMgr::device_id_t device_id, p4::PacketIn *packet,
                   void *cookie);
 
-class P4RuntimeServiceImpl : public p4::P4Runtime::Service {
- private:
-  Status Write(ServerContext *context,
-               const p4::WriteRequest *request,
-               p4::WriteResponse *rep) override {
+class P4RuntimeServiceImpl {
+ public:
+  static Status Write(ServerContext *context,
+                      const p4::WriteRequest *request,
+                      p4::WriteResponse *rep) {
     SIMPLELOG << "P4Runtime Write\n";
     SIMPLELOG << request->DebugString();
-    (void) rep;
+    (void) context; (void) rep;
+    auto device_mgr = device_registry->get(request->device_id());
+    if (device_mgr == nullptr)
+      return device_not_configured(request->device_id());
     auto status = device_mgr->write(*request);
     return to_grpc_status(status);
   }
 
-  Status Read(ServerContext *context,
-              const p4::ReadRequest *request,
-              ServerWriter<p4::ReadResponse> *writer) override {
+  // entities are sent back in several ReadResponse messages, so that each
+  // one stays well below the gRPC maximum message size
+  static Status Read(ServerContext *context,
+                     const p4::ReadRequest *request,
+                     const DeviceMgr::ReadChunkCb &chunk_cb) {
+    (void) context;
     SIMPLELOG << "P4Runtime Read\n";
     SIMPLELOG << request->DebugString();
-    p4::ReadResponse response;
-    auto status = device_mgr->read(*request, &response);
-    writer->Write(response);
+    auto device_mgr = device_registry->get(request->device_id());
+    if (device_mgr == nullptr)
+      return device_not_configured(request->device_id());
+    auto status = device_mgr->read(
+        *request, kReadChunkMaxEntities, kReadChunkMaxBytes, chunk_cb);
     return to_grpc_status(status);
   }
 
-  Status SetForwardingPipelineConfig(
+  static Status SetForwardingPipelineConfig(
       ServerContext *context,
       const p4::SetForwardingPipelineConfigRequest *request,
-      p4::SetForwardingPipelineConfigResponse *rep) override {
+      p4::SetForwardingPipelineConfigResponse *rep) {
     SIMPLELOG << "P4Runtime SetForwardingPipelineConfig\n";
-    (void) rep;
+    (void) context; (void) rep;
     for (const auto &config : request->configs()) {
-      if (device_mgr == nullptr) device_mgr = new DeviceMgr(config.device_id());
+      auto device_mgr = device_registry->get_or_create(config.device_id());
       auto status = device_mgr->pipeline_config_set(request->action(), config);
+      if (status.code() != ::google::rpc::Code::OK)
+        return to_grpc_status(status);
       device_mgr->packet_in_register_cb(::packet_in_cb,
                                         static_cast<void *>(packet_in_mgr));
-      // TODO(antonin): multi-device support
-      return to_grpc_status(status);
     }
     return Status::OK;
   }
 
-  Status GetForwardingPipelineConfig(
+  static Status GetForwardingPipelineConfig(
       ServerContext *context,
       const p4::GetForwardingPipelineConfigRequest *request,
-      p4::GetForwardingPipelineConfigResponse *rep) override {
+      p4::GetForwardingPipelineConfigResponse *rep) {
+    (void) context;
     SIMPLELOG << "P4Runtime GetForwardingPipelineConfig\n";
     for (const auto device_id : request->device_ids()) {
-      (void) device_id;
+      auto device_mgr = device_registry->get(device_id);
+      if (device_mgr == nullptr) return device_not_configured(device_id);
       auto status = device_mgr->pipeline_config_get(rep->add_configs());
-      // TODO(antonin): multi-device support
-      return to_grpc_status(status);
+      if (status.code() != ::google::rpc::Code::OK)
+        return to_grpc_status(status);
     }
     return Status::OK;
   }
 };
 
-using P4RuntimeHybridService =
-  p4::P4Runtime::WithAsyncMethod_StreamChannel<P4RuntimeServiceImpl>;
+// Fixed-size pool of threads running the producers of Read calls, so that the
+// number of reads served at the same time is bounded; other reads wait in a
+// queue. drain() waits for the queued reads to complete and joins the threads,
+// after which submit() rejects new reads. It must be called while the
+// completion queues are still polled, since the producers wait for their
+// Writes to complete.
+class ReadPool {
+ public:
+  using Task = std::function<void()>;
+
+  explicit ReadPool(size_t num_threads) {
+    for (size_t i = 0; i < num_threads; i++)
+      threads.emplace_back(&ReadPool::run, this);
+  }
+
+  ~ReadPool() { drain(); }
+
+  // returns false if the pool is draining, in which case task is not run
+  bool submit(Task task) {
+    std::unique_lock<std::mutex> L(m_);
+    if (draining) return false;
+    tasks.push_back(std::move(task));
+    cv.notify_one();
+    return true;
+  }
+
+  void drain() {
+    {
+      std::unique_lock<std::mutex> L(m_);
+      draining = true;
+    }
+    cv.notify_all();
+    for (auto &t : threads)
+      if (t.joinable()) t.join();
+  }
+
+ private:
+  void run() {
+    while (true) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> L(m_);
+        cv.wait(L, [this] { return draining || !tasks.empty(); });
+        if (tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex m_{};
+  std::condition_variable cv{};
+  std::deque<Task> tasks{};
+  bool draining{false};
+  std::vector<std::thread> threads{};
+};
+
+ReadPool *read_pool = nullptr;
+
+// The entities are produced by DeviceMgr::read on a ReadPool thread, so that
+// the polling thread is neither blocked while they are fetched nor while the
+// client receives them. There is at most one ReadResponse chunk in flight: the
+// producer waits for the Write of a chunk to complete before DeviceMgr fills
+// the next one, which bounds the memory used by the call to one chunk, avoids
+// copying the chunk and cancels the read as soon as the client goes away.
+class ReadCall : public CallTag {
+ public:
+  static void start(P4RuntimeAsyncService *service,
+                    ServerCompletionQueue *cq) {
+    new ReadCall(service, cq);
+  }
+
+  void proceed(bool ok = true) override {
+    switch (state) {
+      case State::REQUEST:
+        if (!ok) break;
+        start(service, cq);
+        state = State::WRITE;
+        if (!read_pool->submit([this] { produce(); })) {
+          state = State::FINISH;
+          writer.Finish(
+              Status(StatusCode::UNAVAILABLE, "Server is shutting down"),
+              this);
+        }
+        return;
+      case State::WRITE:
+        {
+          // notified with the lock held: once the producer wakes up, it may
+          // finish the call, which is then deleted
+          std::unique_lock<std::mutex> L(m_);
+          write_pending = false;
+          write_ok = ok;
+          cv.notify_one();
+        }
+        return;
+      case State::FINISH:
+        break;
+    }
+    delete this;
+  }
+
+ private:
+  ReadCall(P4RuntimeAsyncService *service, ServerCompletionQueue *cq)
+      : service(service), cq(cq), writer(&ctx) {
+    service->RequestRead(&ctx, &request, &writer, cq, cq, this);
+  }
+
+  void produce() {
+    auto status = P4RuntimeServiceImpl::Read(
+        &ctx, &request, [this](p4::ReadResponse *chunk) {
+          // the chunk is arena-allocated and reused by DeviceMgr once we
+          // return, so it is written as is (no copy) and we wait for the
+          // Write to complete before handing it back
+          {
+            std::unique_lock<std::mutex> L(m_);
+            write_pending = true;
+          }
+          writer.Write(*chunk, this);
+          return wait_for_write();  // false if the client is gone
+        });
+    {
+      std::unique_lock<std::mutex> L(m_);
+      state = State::FINISH;
+    }
+    // the call may be deleted as soon as Finish completes
+    writer.Finish(status, this);
+  }
+
+  // returns false if the last Write failed
+  bool wait_for_write() {
+    std::unique_lock<std::mutex> L(m_);
+    cv.wait(L, [this] { return !write_pending; });
+    return write_ok;
+  }
+
+  P4RuntimeAsyncService *service;
+  ServerCompletionQueue *cq;
+  ServerContext ctx{};
+  p4::ReadRequest request{};
+  ServerAsyncWriter<p4::ReadResponse> writer;
+  std::mutex m_{};
+  std::condition_variable cv{};
+  bool write_pending{false};
+  bool write_ok{true};
+  enum class State {REQUEST, WRITE, FINISH};
+  State state{State::REQUEST};
+};
 
 class StreamChannelClientMgr {
  public:
-  StreamChannelClientMgr(P4RuntimeHybridService *service,
-                         ServerCompletionQueue* cq)
-      : service_(service), cq_(cq) {
-    new StreamChannelReader(this, service, cq);
+  explicit StreamChannelClientMgr(P4RuntimeAsyncService *service)
+      : service_(service) { }
+
+  // accept StreamChannel clients on the given completion queue
+  void serve(ServerCompletionQueue *cq) {
+    new StreamChannelReader(this, service_, cq);
   }
 
   using ReaderWriter = ServerAsyncReaderWriter<p4::StreamMessageResponse,
                                                p4::StreamMessageRequest>;
 
-  class StreamChannelTag {
-   public:
-    virtual ~StreamChannelTag() { }
-    virtual void proceed(bool ok = true) = 0;
-  };
-
-  class StreamChannelWriter : public StreamChannelTag {
+  // Packet-ins are sent on the stream one at a time; packets arriving while a
+  // Write is in progress are queued (up to queue_depth) and written
+  // back-to-back once the pending Write completes. All but the last Write of
+  // a burst are issued with the buffer hint, letting gRPC coalesce them.
+  // The writer is shared by the reader of the stream and by the threads
+  // sending packet-ins, which may still hold a reference after the client is
+  // gone; once closed, it no longer touches the stream and drops every packet.
+  class StreamChannelWriter : public CallTag {
    public:
-    StreamChannelWriter(ReaderWriter *stream)
-        : stream(stream), state(State::CREATE) { }
+    StreamChannelWriter(ReaderWriter *stream, uint64_t client_id)
+        : stream(stream), client_id(client_id),
+          queue_depth(packet_in_queue_depth.load()),
+          drop_policy(packet_in_drop_policy.load()), state(State::CREATE) { }
 
     void send(DeviceMgr::device_id_t device_id, p4::PacketIn *packet) {
+      (void) device_id;
       {
         std::unique_lock<std::mutex> L(m_);
-        if (state != State::CAN_WRITE) return;
+        stats.received++;
+        if (state == State::DONE) {
+          stats.dropped++;
+          return;
+        }
+        if (state != State::CAN_WRITE) {
+          enqueue(packet);
+          return;
+        }
         state = State::MUST_WAIT;
       }
-      response.set_allocated_packet(packet);
+      // the packet is arena-allocated (see PacketInCb) and the message is
+      // serialized by Write, so we can just borrow it
+      p4::StreamMessageResponse response;
+      response.unsafe_arena_set_allocated_packet(packet);
       stream->Write(response, this);
-      response.release_packet();
+      response.unsafe_arena_release_packet();
     }
 
     void proceed(bool ok = true) override {
-      if (!ok) return;
       std::unique_lock<std::mutex> L(m_);
-      if (state == State::CREATE) {
-        // SIMPLELOG << "CREATE\n";
-        state = State::CAN_WRITE;
-      } else if (state == State::MUST_WAIT) {
-        // SIMPLELOG << "MUST_WAIT\n";
+      if (state == State::MUST_WAIT && ok) stats.sent++;
+      // a failed Write means that the client is gone
+      if (!ok || on_closed) {
+        state = State::DONE;
+        drop_queue();
+        auto cb = std::move(on_closed);
+        L.unlock();
+        if (cb) cb();
+        return;
+      }
+      if (queue.empty()) {
         state = State::CAN_WRITE;
+        return;
       }
+      state = State::MUST_WAIT;
+      p4::StreamMessageResponse response;
+      response.mutable_packet()->Swap(&queue.front());
+      queue.pop_front();
+      auto options = grpc::WriteOptions();
+      if (!queue.empty()) options.set_buffer_hint();
+      L.unlock();
+      stream->Write(response, options, this);
+    }
+
+    // Called by the reader when the client disconnects. The packets still
+    // queued are dropped, and cb is called once no Write is outstanding
+    // anymore, either right away or when the pending Write completes.
+    void close(std::function<void()> cb) {
+      std::unique_lock<std::mutex> L(m_);
+      if (state == State::MUST_WAIT) {
+        on_closed = std::move(cb);
+        return;
+      }
+      state = State::DONE;
+      drop_queue();
+      L.unlock();
+      cb();
+    }
+
+    PIGrpcPacketInClientStats get_stats() const {
+      std::unique_lock<std::mutex> L(m_);
+      auto s = stats;
+      s.client_id = client_id;
+      return s;
     }
 
    private:
+    void enqueue(const p4::PacketIn *packet) {
+      if (queue.size() >= queue_depth) {
+        stats.dropped++;
+        if (queue_depth == 0 || drop_policy == PI_GRPC_PACKET_IN_DROP_NEWEST) {
+          return;
+        }
+        queue.pop_front();
+      }
+      queue.emplace_back();
+      queue.back().CopyFrom(*packet);
+    }
+
+    void drop_queue() {
+      stats.dropped += queue.size();
+      queue.clear();
+    }
+
     ReaderWriter *stream;
-    p4::StreamMessageResponse response{};
+    uint64_t client_id;
+    // the settings when the client connected
+    const size_t queue_depth;
+    const PIGrpcPacketInDropPolicy drop_policy;
+    std::deque<p4::PacketIn> queue{};
+    PIGrpcPacketInClientStats stats{};
+    std::function<void()> on_closed{};
     mutable std::mutex m_;
-    enum class State { CREATE, CAN_WRITE, MUST_WAIT};
+    // DONE: the stream is being (or has been) finished, or a Write failed
+    enum class State { CREATE, CAN_WRITE, MUST_WAIT, DONE };
     State state;  // The current serving state
   };
 
-  class StreamChannelReader : public StreamChannelTag {
+  class StreamChannelReader : public CallTag {
    public:
     StreamChannelReader(StreamChannelClientMgr *mgr,
-                        P4RuntimeHybridService *service,
+                        P4RuntimeAsyncService *service,
                         ServerCompletionQueue* cq)
         : mgr_(mgr), service_(service), cq_(cq),
           stream(&ctx), state(State::CREATE) {
@@ -281,9 +710,10 @@ class StreamChannelClientMgr {
         service_->RequestStreamChannel(&ctx, &stream, cq_, cq_, this);
       } else if (state == State::PROCESS) {
         new StreamChannelReader(mgr_, service_, cq_);
-        writer.reset(new StreamChannelWriter(&stream));
+        writer = std::make_shared<StreamChannelWriter>(
+            &stream, mgr_->next_client_id++);
         writer->proceed();
-        mgr_->register_client(writer.get());
+        mgr_->register_client(writer);
         state = State::READ;
         stream.Read(&request, this);
       } else if (state == State::READ) {
@@ -291,9 +721,16 @@ class StreamChannelClientMgr {
         switch (request.update_case()) {
           case p4::StreamMessageRequest::kArbitration:
             device_id = request.arbitration().device_id();
+            arbitrated = true;
+            mgr_->set_client_device(writer, device_id);
           break;
           case p4::StreamMessageRequest::kPacket:
-            device_mgr->packet_out_send(request.packet());
+            // packet-outs are sent to the device the client arbitrated for
+            if (arbitrated) {
+              auto device_mgr = device_registry->get(device_id);
+              if (device_mgr != nullptr)
+                device_mgr->packet_out_send(request.packet());
+            }
             break;
           default:
             assert(0);
@@ -301,68 +738,99 @@ class StreamChannelClientMgr {
         stream.Read(&request, this);
       } else {
         assert(state == State::FINISH);
-        if (writer) {
-          SIMPLELOG << "Disconnect!!!\n";
-          mgr_->remove_client(writer.get());
-          stream.Finish(Status::OK, this);
+        if (!writer) {  // the call was never started (server shutdown)
+          delete this;
+          return;
         }
+        // no new packet-in reaches the writer once it is removed, but a
+        // Write may still be in progress, and Finish must wait for it
+        mgr_->remove_client(writer.get());
+        writer->close([this] {
+          auto stats = writer->get_stats();
+          SIMPLELOG << "Disconnect!!! packet-in: " << stats.received
+                    << " received, " << stats.sent << " sent, "
+                    << stats.dropped << " dropped\n";
+          stream.Finish(Status::OK, this);
+        });
       }
     }
 
    private:
     DeviceMgr::device_id_t device_id{};
+    bool arbitrated{false};
     p4::StreamMessageRequest request{};
     StreamChannelClientMgr *mgr_;
-    P4RuntimeHybridService *service_;
+    P4RuntimeAsyncService *service_;
     ServerCompletionQueue* cq_;
     ServerContext ctx{};
     ReaderWriter stream;
-    std::unique_ptr<StreamChannelWriter> writer{nullptr};
+    std::shared_ptr<StreamChannelWriter> writer{nullptr};
     enum class State {CREATE, PROCESS, READ, FINISH};
     State state;
   };
 
-  bool next() {
-    void *tag;
-    bool ok;
-    if (!cq_->Next(&tag, &ok)) return false;
-    static_cast<StreamChannelTag *>(tag)->proceed(ok);
-    return true;
-  }
-
+  // packet-ins are only sent to the clients which arbitrated for the device;
+  // the references we take keep the writers alive while we send, even if the
+  // clients disconnect in the meantime
   void notify_clients(DeviceMgr::device_id_t device_id, p4::PacketIn *packet) {
     // SIMPLELOG << "NOTIFYING\n";
-    std::vector<StreamChannelWriter *> clients_;
+    std::vector<std::shared_ptr<StreamChannelWriter> > clients_;
     {
       std::unique_lock<std::mutex> L(mgr_m_);
-      clients_ = clients;
+      auto it = device_clients.find(device_id);
+      if (it == device_clients.end()) return;
+      clients_ = it->second;
     }
-    for (auto c : clients_) c->send(device_id, packet);
+    for (const auto &c : clients_) c->send(device_id, packet);
+  }
+
+  size_t get_stats(PIGrpcPacketInClientStats *stats, size_t max_clients) {
+    std::unique_lock<std::mutex> L(mgr_m_);
+    size_t i = 0;
+    for (; i < clients.size() && i < max_clients; i++)
+      stats[i] = clients[i]->get_stats();
+    return clients.size();
   }
 
  private:
-  void register_client(StreamChannelWriter *client) {
+  using WriterRef = std::shared_ptr<StreamChannelWriter>;
+
+  void register_client(const WriterRef &client) {
     std::unique_lock<std::mutex> L(mgr_m_);
     clients.push_back(client);
   }
 
-  void remove_client(StreamChannelWriter *client) {
+  void remove_client(const StreamChannelWriter *client) {
     std::unique_lock<std::mutex> L(mgr_m_);
-    for (auto it = clients.begin(); it != clients.end(); it++) {
-      if (*it == client) {
-        clients.erase(it);
+    erase_client(&clients, client);
+    for (auto &p : device_clients) erase_client(&p.second, client);
+  }
+
+  // a client may arbitrate again, possibly for a different device
+  void set_client_device(const WriterRef &client,
+                         DeviceMgr::device_id_t device_id) {
+    std::unique_lock<std::mutex> L(mgr_m_);
+    for (auto &p : device_clients) erase_client(&p.second, client.get());
+    device_clients[device_id].push_back(client);
+  }
+
+  static void erase_client(std::vector<WriterRef> *v,
+                           const StreamChannelWriter *client) {
+    for (auto it = v->begin(); it != v->end(); it++) {
+      if (it->get() == client) {
+        v->erase(it);
         break;
       }
     }
   }
 
   mutable std::mutex mgr_m_;
-#ifdef __clang__
-  __attribute__((unused))
-#endif
-  P4RuntimeHybridService *service_;
-  ServerCompletionQueue* cq_;
-  std::vector<StreamChannelWriter *> clients;
+  P4RuntimeAsyncService *service_;
+  // all connected clients
+  std::vector<WriterRef> clients;
+  std::unordered_map<DeviceMgr::device_id_t,
+                     std::vector<WriterRef> > device_clients;
+  std::atomic<uint64_t> next_client_id{0};
 };
 
 void packet_in_cb(DeviceMgr::device_id_t device_id, p4::PacketIn *packet,
@@ -409,17 +877,54 @@ struct PacketInGenerator {
 
 struct ServerData {
   std::string server_address;
-  P4RuntimeHybridService pi_service;
-  gNMIServiceImpl gnmi_service;
+  P4RuntimeAsyncService pi_service;
+  gNMIAsyncService gnmi_service;
   ServerBuilder builder;
   std::unique_ptr<Server> server;
-  std::thread packetin_thread;
-  std::unique_ptr<ServerCompletionQueue> cq_;
+  std::vector<std::unique_ptr<ServerCompletionQueue> > cqs;
+  // StreamChannel calls are served on their own queue, see request_calls
+  std::unique_ptr<ServerCompletionQueue> stream_cq;
+  std::vector<std::thread> cq_threads;
   PacketInGenerator *generator{nullptr};
 };
 
 ServerData *server_data;
 
+// request the first call of every method on the completion queue, each call
+// then requests the next one; StreamChannel is not requested here, so that
+// packet I/O never waits behind a long Write or SetForwardingPipelineConfig
+// handler
+void request_calls(ServerCompletionQueue *cq) {
+  auto pi_service = &server_data->pi_service;
+  request_unary_call(pi_service, &P4RuntimeAsyncService::RequestWrite,
+                     &P4RuntimeServiceImpl::Write, cq);
+  ReadCall::start(pi_service, cq);
+  request_unary_call(
+      pi_service, &P4RuntimeAsyncService::RequestSetForwardingPipelineConfig,
+      &P4RuntimeServiceImpl::SetForwardingPipelineConfig, cq);
+  request_unary_call(
+      pi_service, &P4RuntimeAsyncService::RequestGetForwardingPipelineConfig,
+      &P4RuntimeServiceImpl::GetForwardingPipelineConfig, cq);
+
+  auto gnmi_service = &server_data->gnmi_service;
+  request_unary_call(gnmi_service, &gNMIAsyncService::RequestCapabilities,
+                     &gNMIServiceImpl::Capabilities, cq);
+  request_unary_call(gnmi_service, &gNMIAsyncService::RequestGet,
+                     &gNMIServiceImpl::Get, cq);
+  request_unary_call(gnmi_service, &gNMIAsyncService::RequestSet,
+                     &gNMIServiceImpl::Set, cq);
+  gNMISubscribeCall::start(gnmi_service, cq);
+}
+
+// the Read producers wait for their Writes to complete, so they are drained
+// before the completion queues stop being polled
+void shutdown_completion_queues() {
+  read_pool->drain();
+  for (auto &cq : server_data->cqs) cq->Shutdown();
+  server_data->stream_cq->Shutdown();
+  for (auto &t : server_data->cq_threads) t.join();
+}
+
 }  // namespace
 
 extern "C" {
@@ -432,19 +937,24 @@ void PIGrpcServerRunAddr(const char *server_address) {
     server_data->server_address, grpc::InsecureServerCredentials());
   builder.RegisterService(&server_data->pi_service);
   builder.RegisterService(&server_data->gnmi_service);
-  server_data->cq_ = builder.AddCompletionQueue();
+  for (size_t i = 0; i < num_completion_queues; i++)
+    server_data->cqs.push_back(builder.AddCompletionQueue());
+  server_data->stream_cq = builder.AddCompletionQueue();
 
   server_data->server = builder.BuildAndStart();
   std::cout << "Server listening on " << server_data->server_address << "\n";
 
-  packet_in_mgr = new StreamChannelClientMgr(
-    &server_data->pi_service, server_data->cq_.get());
-
-  auto packet_io = [](StreamChannelClientMgr *mgr) {
-    while (mgr->next()) { }
-  };
+  device_registry = new DeviceRegistry();
+  read_pool = new ReadPool(num_read_threads);
+  packet_in_mgr = new StreamChannelClientMgr(&server_data->pi_service);
 
-  server_data->packetin_thread = std::thread(packet_io, packet_in_mgr);
+  for (auto &cq : server_data->cqs) {
+    request_calls(cq.get());
+    server_data->cq_threads.emplace_back(poll_completion_queue, cq.get());
+  }
+  auto stream_cq = server_data->stream_cq.get();
+  packet_in_mgr->serve(stream_cq);
+  server_data->cq_threads.emplace_back(poll_completion_queue, stream_cq);
 
   // for testing only
   auto manage_generator = [](int s) {
@@ -465,6 +975,34 @@ void PIGrpcServerRunAddr(const char *server_address) {
   // std::thread test_thread(probe, packet_in_mgr);
 }
 
+void PIGrpcServerSetNumCompletionQueues(size_t num_cqs) {
+  num_completion_queues = (num_cqs == 0) ? 1 : num_cqs;
+}
+
+void PIGrpcServerSetNumReadThreads(size_t num_threads) {
+  num_read_threads = (num_threads == 0) ? 1 : num_threads;
+}
+
+void PIGrpcServerSetWriteConcurrency(size_t num_threads) {
+  write_concurrency = (num_threads == 0) ? 1 : num_threads;
+}
+
+void PIGrpcServerSetShadowReads(int enable) {
+  shadow_reads = (enable != 0);
+}
+
+void PIGrpcServerSetPacketInQueue(size_t depth,
+                                  PIGrpcPacketInDropPolicy policy) {
+  packet_in_queue_depth = depth;
+  packet_in_drop_policy = policy;
+}
+
+size_t PIGrpcServerGetPacketInStats(PIGrpcPacketInClientStats *stats,
+                                    size_t max_clients) {
+  if (packet_in_mgr == nullptr) return 0;
+  return packet_in_mgr->get_stats(stats, max_clients);
+}
+
 void PIGrpcServerRun() {
   PIGrpcServerRunAddr("0.0.0.0:50051");
 }
@@ -475,21 +1013,23 @@ void PIGrpcServerWait() {
 
 void PIGrpcServerShutdown() {
   server_data->server->Shutdown();
-  server_data->cq_->Shutdown();
-  server_data->packetin_thread.join();
+  shutdown_completion_queues();
 }
 
 void PIGrpcServerForceShutdown(int deadline_seconds) {
   using clock = std::chrono::system_clock;
   auto deadline = clock::now() + std::chrono::seconds(deadline_seconds);
   server_data->server->Shutdown(deadline);
-  server_data->cq_->Shutdown();
-  server_data->packetin_thread.join();
+  shutdown_completion_queues();
 }
 
 void PIGrpcServerCleanup() {
   if (server_data->generator) delete server_data->generator;
   delete server_data;
+  delete read_pool;
+  read_pool = nullptr;
+  delete device_registry;
+  device_registry = nullptr;
 }
 
 }
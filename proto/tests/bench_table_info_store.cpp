@@ -0,0 +1,187 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Measures the memory used per entry and the lookup time of TableInfoStore,
+// compared with the std::unordered_map<pi::MatchKey, Data> it replaced. The
+// match key is a 5-tuple (13 bytes) with a priority, as for an ACL. Run as
+// "bench_table_info_store [num_entries...]" (default: 1M and 10M entries);
+// "--no-baseline" skips the unordered_map measurements, which need a lot more
+// memory.
+
+#include <malloc.h>  // for mallinfo2
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PI/frontends/cpp/tables.h"
+#include "PI/int/pi_int.h"
+#include "PI/pi.h"
+
+#include "src/table_info_store.h"
+
+namespace {
+
+using pi::fe::proto::TableInfoStore;
+
+// heap memory in use, including the malloc overhead
+size_t bytes_allocated() {
+  auto info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+constexpr pi_p4_id_t kTableId = 0x02000001;
+constexpr size_t kMkSize = 13;
+constexpr size_t kNumLookups = 1000000;
+
+struct Keys {
+  explicit Keys(size_t n) : data(n * kMkSize) {
+    for (size_t i = 0; i < n; i++) {
+      // src addr, dst addr, src port, dst port, protocol
+      auto k = &data[i * kMkSize];
+      uint32_t src = 0x0a000000 + static_cast<uint32_t>(i);
+      uint32_t dst = 0xc0a80000 + static_cast<uint32_t>(i * 7);
+      uint16_t sport = static_cast<uint16_t>(i * 13);
+      uint16_t dport = 80;
+      std::memcpy(k, &src, 4);
+      std::memcpy(k + 4, &dst, 4);
+      std::memcpy(k + 8, &sport, 2);
+      std::memcpy(k + 10, &dport, 2);
+      k[12] = 6;
+    }
+  }
+
+  size_t size() const { return data.size() / kMkSize; }
+
+  pi_match_key_t pi_key(size_t i) const {
+    pi_match_key_t match_key;
+    match_key.p4info = nullptr;
+    match_key.table_id = kTableId;
+    match_key.priority = static_cast<uint32_t>(i % 16);
+    match_key.data_size = kMkSize;
+    match_key.data = const_cast<char *>(&data[i * kMkSize]);
+    return match_key;
+  }
+
+  std::vector<char> data;
+};
+
+std::vector<size_t> lookup_order(size_t n) {
+  std::vector<size_t> order(kNumLookups);
+  uint64_t x = 88172645463325252ULL;
+  for (auto &i : order) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;  // xorshift64
+    i = x % n;
+  }
+  return order;
+}
+
+template <typename F>
+double time_ns(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+void report(const char *name, size_t n, size_t bytes, double insert_ns,
+            double lookup_ns) {
+  std::printf("%-14s %9zu entries %8.1f bytes/entry %8.1f ns/insert "
+              "%8.1f ns/lookup\n", name, n, static_cast<double>(bytes) / n,
+              insert_ns / n, lookup_ns / kNumLookups);
+}
+
+void bench_store(const Keys &keys) {
+  auto n = keys.size();
+  auto order = lookup_order(n);
+  auto bytes_before = bytes_allocated();
+  TableInfoStore store;
+  double insert_ns = time_ns([&] {
+      store.add_table(kTableId, kMkSize, n);
+      for (size_t i = 0; i < n; i++) {
+        auto pi_key = keys.pi_key(i);
+        pi::MatchKey mk(&pi_key);
+        store.add_entry(kTableId, mk, TableInfoStore::Data(i, i));
+      }
+    });
+  auto bytes = bytes_allocated() - bytes_before;
+  size_t found = 0;
+  double lookup_ns = time_ns([&] {
+      for (auto i : order) {
+        auto pi_key = keys.pi_key(i);
+        found += (store.get_entry(
+            kTableId, TableInfoStore::MatchKeyView(&pi_key)) != nullptr);
+      }
+    });
+  if (found != kNumLookups) std::abort();
+  report("TableInfoStore", n, bytes, insert_ns, lookup_ns);
+}
+
+void bench_baseline(const Keys &keys) {
+  auto n = keys.size();
+  auto order = lookup_order(n);
+  auto bytes_before = bytes_allocated();
+  std::unordered_map<pi::MatchKey, TableInfoStore::Data, pi::MatchKeyHash,
+                     pi::MatchKeyEq> map;
+  double insert_ns = time_ns([&] {
+      for (size_t i = 0; i < n; i++) {
+        auto pi_key = keys.pi_key(i);
+        pi::MatchKey mk(&pi_key);
+        map.emplace(mk, TableInfoStore::Data(i, i));
+      }
+    });
+  auto bytes = bytes_allocated() - bytes_before;
+  size_t found = 0;
+  auto pi_key_0 = keys.pi_key(0);
+  pi::MatchKey mk(&pi_key_0);
+  double lookup_ns = time_ns([&] {
+      for (auto i : order) {
+        auto pi_key = keys.pi_key(i);
+        mk.from(&pi_key);
+        found += map.count(mk);
+      }
+    });
+  if (found != kNumLookups) std::abort();
+  report("unordered_map", n, bytes, insert_ns, lookup_ns);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<size_t> sizes;
+  bool baseline = true;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--no-baseline"))
+      baseline = false;
+    else
+      sizes.push_back(std::stoul(argv[i]));
+  }
+  if (sizes.empty()) sizes = {1000000, 10000000};
+
+  for (auto n : sizes) {
+    Keys keys(n);
+    bench_store(keys);
+    if (baseline) bench_baseline(keys);
+  }
+}
@@ -25,6 +25,7 @@
 #include <boost/functional/hash.hpp>
 
 #include <algorithm>  // std::copy
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -334,29 +335,34 @@ class DummySwitch {
                               const pi_match_key_t *match_key,
                               const pi_table_entry_t *table_entry,
                               pi_entry_handle_t *entry_handle) {
+    Lock lock(mutex);
     // constructs DummyTable if not already in map
     return tables[table_id].entry_add(match_key, table_entry, entry_handle);
   }
 
   pi_status_t table_entry_delete_wkey(pi_p4_id_t table_id,
                                       const pi_match_key_t *match_key) {
+    Lock lock(mutex);
     return tables[table_id].entry_delete_wkey(match_key);
   }
 
   pi_status_t table_entry_modify_wkey(pi_p4_id_t table_id,
                                       const pi_match_key_t *match_key,
                                       const pi_table_entry_t *table_entry) {
+    Lock lock(mutex);
     return tables[table_id].entry_modify_wkey(match_key, table_entry);
   }
 
   pi_status_t table_entries_fetch(pi_p4_id_t table_id,
                                   pi_table_fetch_res_t *res) {
+    Lock lock(mutex);
     return tables[table_id].entries_fetch(res);
   }
 
   pi_status_t action_prof_member_create(pi_p4_id_t act_prof_id,
                                         const pi_action_data_t *action_data,
                                         pi_indirect_handle_t *mbr_handle) {
+    Lock lock(mutex);
     // constructs DummyActionProf if not already in map
     return action_profs[act_prof_id].member_create(action_data, mbr_handle);
   }
@@ -364,51 +370,60 @@ class DummySwitch {
   pi_status_t action_prof_member_modify(pi_p4_id_t act_prof_id,
                                         pi_indirect_handle_t mbr_handle,
                                         const pi_action_data_t *action_data) {
+    Lock lock(mutex);
     return action_profs[act_prof_id].member_modify(mbr_handle, action_data);
   }
 
   pi_status_t action_prof_member_delete(pi_p4_id_t act_prof_id,
                                         pi_indirect_handle_t mbr_handle) {
+    Lock lock(mutex);
     return action_profs[act_prof_id].member_delete(mbr_handle);
   }
 
   pi_status_t action_prof_group_create(pi_p4_id_t act_prof_id,
                                        size_t max_size,
                                        pi_indirect_handle_t *grp_handle) {
+    Lock lock(mutex);
     return action_profs[act_prof_id].group_create(max_size, grp_handle);
   }
 
   pi_status_t action_prof_group_delete(pi_p4_id_t act_prof_id,
                                        pi_indirect_handle_t grp_handle) {
+    Lock lock(mutex);
     return action_profs[act_prof_id].group_delete(grp_handle);
   }
 
   pi_status_t action_prof_group_add_member(pi_p4_id_t act_prof_id,
                                            pi_indirect_handle_t grp_handle,
                                            pi_indirect_handle_t mbr_handle) {
+    Lock lock(mutex);
     return action_profs[act_prof_id].group_add_member(grp_handle, mbr_handle);
   }
 
   pi_status_t action_prof_group_remove_member(pi_p4_id_t act_prof_id,
                                            pi_indirect_handle_t grp_handle,
                                            pi_indirect_handle_t mbr_handle) {
+    Lock lock(mutex);
     return action_profs[act_prof_id].group_remove_member(
         grp_handle, mbr_handle);
   }
 
   pi_status_t action_prof_entries_fetch(pi_p4_id_t act_prof_id,
                                         pi_act_prof_fetch_res_t *res) {
+    Lock lock(mutex);
     return action_profs[act_prof_id].entries_fetch(res);
   }
 
   pi_status_t meter_set(pi_p4_id_t meter_id, size_t index,
                         const pi_meter_spec_t *meter_spec) {
+    Lock lock(mutex);
     return meters[meter_id].set(index, meter_spec);
   }
 
   pi_status_t meter_set_direct(pi_p4_id_t meter_id,
                                pi_entry_handle_t entry_handle,
                                const pi_meter_spec_t *meter_spec) {
+    Lock lock(mutex);
     return meters[meter_id].set(entry_handle, meter_spec);
   }
 
@@ -421,6 +436,10 @@ class DummySwitch {
   }
 
  private:
+  // DeviceMgr may apply the updates of a WriteRequest concurrently
+  using Mutex = std::mutex;
+  using Lock = std::lock_guard<Mutex>;
+  mutable Mutex mutex{};
   std::unordered_map<pi_p4_id_t, DummyTable> tables{};
   std::unordered_map<pi_p4_id_t, DummyActionProf> action_profs{};
   std::unordered_map<pi_p4_id_t, DummyMeter> meters{};
@@ -23,6 +23,7 @@
 
 #include <gmock/gmock.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -109,8 +110,9 @@ class DummySwitchMock {
 
  private:
   std::unique_ptr<DummySwitch> sw;
-  pi_indirect_handle_t action_prof_h;
-  pi_entry_handle_t table_h;
+  // written by the (possibly concurrent) calls to the target
+  std::atomic<pi_indirect_handle_t> action_prof_h{0};
+  std::atomic<pi_entry_handle_t> table_h{0};
 };
 
 // used to map device ids to DummySwitchMock instances; thread safe in case we
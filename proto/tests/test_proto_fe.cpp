@@ -1346,6 +1346,317 @@ TEST_F(TernaryOneTest, MatchFieldNoMask) {
   ASSERT_EQ(status.code(), Code::OK);
 }
 
+
+// helpers to build write requests touching several tables
+class MultiTableTest : public DeviceMgrTest {
+ protected:
+  void add_table_entry(p4::WriteRequest *request, const char *t_name,
+                       uint32_t v) {
+    auto t_id = pi_p4info_table_id_from_name(p4info, t_name);
+    auto update = request->add_updates();
+    update->set_type(p4::Update_Type_INSERT);
+    auto table_entry = update->mutable_entity()->mutable_table_entry();
+    table_entry->set_table_id(t_id);
+    auto mf = table_entry->add_match();
+    mf->set_field_id(pi_p4info_table_match_field_id_from_name(
+        p4info, t_id, "header_test.field32"));
+    std::string mf_v(4, '\x00');
+    std::memcpy(&mf_v[0], &v, sizeof(v));
+    if (pi_p4info_table_match_field_info(p4info, t_id, 0)->match_type ==
+        PI_P4INFO_MATCH_TYPE_LPM) {
+      mf->mutable_lpm()->set_value(mf_v);
+      mf->mutable_lpm()->set_prefix_len(32);
+    } else {
+      mf->mutable_exact()->set_value(mf_v);
+    }
+    set_action(table_entry->mutable_action()->mutable_action());
+  }
+
+  void set_action(p4::Action *action) {
+    auto a_id = pi_p4info_action_id_from_name(p4info, "actionA");
+    action->set_action_id(a_id);
+    auto param = action->add_params();
+    param->set_param_id(
+        pi_p4info_action_param_id_from_name(p4info, a_id, "param"));
+    param->set_value(std::string(6, '\x00'));
+  }
+
+  int num_entries(const char *t_name) {
+    auto t_id = pi_p4info_table_id_from_name(p4info, t_name);
+    p4::ReadResponse response;
+    p4::Entity entity;
+    entity.mutable_table_entry()->set_table_id(t_id);
+    EXPECT_EQ(mgr.read_one(entity, &response).code(), Code::OK);
+    return response.entities_size();
+  }
+};
+
+// same as DeviceMgrTest, but the updates of a WriteRequest are partitioned and
+// applied concurrently
+class ConcurrentWriteTest : public MultiTableTest {
+ protected:
+  ConcurrentWriteTest() {
+    mgr.set_write_concurrency(4);
+  }
+};
+
+TEST_F(ConcurrentWriteTest, MultipleTables) {
+  constexpr int num_entries_per_table = 100;
+  p4::WriteRequest request;
+  for (int i = 0; i < num_entries_per_table; i++) {
+    add_table_entry(&request, "ExactOne", i);
+    add_table_entry(&request, "LpmOne", i);
+  }
+  EXPECT_CALL(*mock, table_entry_add(_, _, _, _))
+      .Times(2 * num_entries_per_table);
+  ASSERT_EQ(mgr.write(request).code(), Code::OK);
+
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(2);
+  EXPECT_EQ(num_entries_per_table, num_entries("ExactOne"));
+  EXPECT_EQ(num_entries_per_table, num_entries("LpmOne"));
+}
+
+// the first failed update (duplicate entry) stops its partition, the status of
+// the request is the status of that update
+TEST_F(ConcurrentWriteTest, Error) {
+  p4::WriteRequest request;
+  for (int i = 0; i < 10; i++) {
+    add_table_entry(&request, "ExactOne", (i == 5) ? 0 : i);
+    add_table_entry(&request, "LpmOne", i);
+  }
+  EXPECT_CALL(*mock, table_entry_add(_, _, _, _)).Times(AtLeast(6));
+  EXPECT_NE(mgr.write(request).code(), Code::OK);
+
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(2);
+  EXPECT_EQ(5, num_entries("ExactOne"));
+  // LpmOne updates which come before the failed update must have been applied
+  EXPECT_LE(5, num_entries("LpmOne"));
+}
+
+// entries of an indirect table go to the same partition as their action
+// profile, so a member can be created and used in the same request
+TEST_F(ConcurrentWriteTest, MemberThenIndirectEntry) {
+  auto act_prof_id = pi_p4info_act_prof_id_from_name(p4info, "ActProfWS");
+  auto t_id = pi_p4info_table_id_from_name(p4info, "IndirectWS");
+  p4::WriteRequest request;
+  for (uint32_t i = 0; i < 10; i++) {
+    {
+      auto update = request.add_updates();
+      update->set_type(p4::Update_Type_INSERT);
+      auto member = update->mutable_entity()->mutable_action_profile_member();
+      member->set_action_profile_id(act_prof_id);
+      member->set_member_id(i);
+      set_action(member->mutable_action());
+    }
+    add_table_entry(&request, "ExactOne", i);
+    {
+      auto update = request.add_updates();
+      update->set_type(p4::Update_Type_INSERT);
+      auto table_entry = update->mutable_entity()->mutable_table_entry();
+      table_entry->set_table_id(t_id);
+      auto mf = table_entry->add_match();
+      mf->set_field_id(pi_p4info_table_match_field_id_from_name(
+          p4info, t_id, "header_test.field32"));
+      std::string mf_v(4, '\x00');
+      std::memcpy(&mf_v[0], &i, sizeof(i));
+      mf->mutable_exact()->set_value(mf_v);
+      table_entry->mutable_action()->set_action_profile_member_id(i);
+    }
+  }
+  EXPECT_CALL(*mock, action_prof_member_create(act_prof_id, _, _)).Times(10);
+  EXPECT_CALL(*mock, table_entry_add(_, _, _, _)).Times(20);
+  ASSERT_EQ(mgr.write(request).code(), Code::OK);
+}
+
+class StreamedReadTest : public MultiTableTest {
+ protected:
+  void add_entries(int num_entries) {
+    p4::WriteRequest request;
+    for (int i = 0; i < num_entries; i++)
+      add_table_entry(&request, "ExactOne", i);
+    EXPECT_CALL(*mock, table_entry_add(_, _, _, _)).Times(num_entries);
+    ASSERT_EQ(mgr.write(request).code(), Code::OK);
+  }
+
+  p4::ReadRequest read_request() const {
+    auto t_id = pi_p4info_table_id_from_name(p4info, "ExactOne");
+    p4::ReadRequest request;
+    request.add_entities()->mutable_table_entry()->set_table_id(t_id);
+    return request;
+  }
+};
+
+TEST_F(StreamedReadTest, MaxEntities) {
+  add_entries(25);
+  std::vector<int> chunk_sizes;
+  EXPECT_CALL(*mock, table_entries_fetch(_, _));
+  auto status = mgr.read(
+      read_request(), 10, 0, [&chunk_sizes](p4::ReadResponse *chunk) {
+        chunk_sizes.push_back(chunk->entities_size());
+        return true; });
+  EXPECT_EQ(status.code(), Code::OK);
+  EXPECT_EQ(chunk_sizes, std::vector<int>({10, 10, 5}));
+}
+
+TEST_F(StreamedReadTest, MaxBytes) {
+  add_entries(25);
+  std::vector<size_t> chunk_bytes;
+  constexpr size_t max_bytes = 200;
+  int num_entities = 0;
+  EXPECT_CALL(*mock, table_entries_fetch(_, _));
+  auto status = mgr.read(
+      read_request(), 0, max_bytes,
+      [&chunk_bytes, &num_entities](p4::ReadResponse *chunk) {
+        chunk_bytes.push_back(chunk->ByteSizeLong());
+        num_entities += chunk->entities_size();
+        return true; });
+  EXPECT_EQ(status.code(), Code::OK);
+  EXPECT_EQ(25, num_entities);
+  ASSERT_LT(1u, chunk_bytes.size());
+  // a chunk can exceed the limit by at most one entity
+  for (auto bytes : chunk_bytes) EXPECT_GT(2 * max_bytes, bytes);
+}
+
+TEST_F(StreamedReadTest, Empty) {
+  int num_chunks = 0;
+  EXPECT_CALL(*mock, table_entries_fetch(_, _));
+  auto status = mgr.read(
+      read_request(), 10, 0, [&num_chunks](p4::ReadResponse *chunk) {
+        EXPECT_EQ(0, chunk->entities_size());
+        num_chunks++;
+        return true; });
+  EXPECT_EQ(status.code(), Code::OK);
+  EXPECT_EQ(1, num_chunks);
+}
+
+TEST_F(StreamedReadTest, Cancel) {
+  add_entries(25);
+  int num_chunks = 0;
+  EXPECT_CALL(*mock, table_entries_fetch(_, _));
+  auto status = mgr.read(
+      read_request(), 10, 0, [&num_chunks](p4::ReadResponse *) {
+        num_chunks++;
+        return false; });
+  EXPECT_EQ(status.code(), Code::CANCELLED);
+  EXPECT_EQ(1, num_chunks);
+}
+
+// the entities which were not delivered before the error are not sent
+TEST_F(StreamedReadTest, Error) {
+  add_entries(25);
+  std::vector<int> chunk_sizes;
+  auto request = read_request();
+  request.add_entities()->mutable_table_entry()->set_table_id(
+      pi_p4info_table_id_from_name(p4info, "ExactOne") + 1000);
+  EXPECT_CALL(*mock, table_entries_fetch(_, _));
+  auto status = mgr.read(
+      request, 10, 0, [&chunk_sizes](p4::ReadResponse *chunk) {
+        chunk_sizes.push_back(chunk->entities_size());
+        return true; });
+  EXPECT_NE(status.code(), Code::OK);
+  EXPECT_EQ(chunk_sizes, std::vector<int>({10, 10}));
+}
+
+// same as MultiTableTest, but table reads are served from the shadow copy kept
+// by DeviceMgr
+class ShadowReadTest : public MultiTableTest {
+ protected:
+  void SetUp() override {
+    mgr.set_shadow_reads(true);
+    MultiTableTest::SetUp();
+  }
+};
+
+TEST_F(ShadowReadTest, Read) {
+  constexpr int num_entries_per_table = 20;
+  p4::WriteRequest request;
+  for (int i = 0; i < num_entries_per_table; i++) {
+    add_table_entry(&request, "ExactOne", i);
+    add_table_entry(&request, "LpmOne", i);
+  }
+  EXPECT_CALL(*mock, table_entry_add(_, _, _, _))
+      .Times(2 * num_entries_per_table);
+  ASSERT_EQ(mgr.write(request).code(), Code::OK);
+
+  // modify the first entry, the shadow copy must be updated
+  {
+    p4::WriteRequest modify_request;
+    add_table_entry(&modify_request, "ExactOne", 0);
+    auto update = modify_request.mutable_updates(0);
+    update->set_type(p4::Update_Type_MODIFY);
+    auto table_entry = update->mutable_entity()->mutable_table_entry();
+    table_entry->set_controller_metadata(0xab);
+    table_entry->mutable_action()->mutable_action()->mutable_params(0)
+        ->set_value(std::string(5, '\x00') + "\x01");
+    EXPECT_CALL(*mock, table_entry_modify_wkey(_, _, _));
+    ASSERT_EQ(mgr.write(modify_request).code(), Code::OK);
+  }
+
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(0);
+  EXPECT_EQ(num_entries_per_table, num_entries("ExactOne"));
+  EXPECT_EQ(num_entries_per_table, num_entries("LpmOne"));
+
+  p4::ReadResponse response;
+  p4::Entity entity;
+  entity.mutable_table_entry()->set_table_id(
+      pi_p4info_table_id_from_name(p4info, "ExactOne"));
+  ASSERT_EQ(mgr.read_one(entity, &response).code(), Code::OK);
+  int num_modified = 0;
+  for (const auto &e : response.entities()) {
+    if (e.table_entry().controller_metadata() != 0xab) continue;
+    num_modified++;
+    EXPECT_EQ(std::string(5, '\x00') + "\x01",
+              e.table_entry().action().action().params(0).value());
+  }
+  EXPECT_EQ(1, num_modified);
+
+  // the shadow copy is consistent with the entries fetched from the target
+  ::testing::Mock::VerifyAndClearExpectations(mock);
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(AtLeast(2));
+  EXPECT_EQ(mgr.verify_shadow(0).code(), Code::OK);
+}
+
+TEST_F(ShadowReadTest, IndirectEntry) {
+  auto act_prof_id = pi_p4info_act_prof_id_from_name(p4info, "ActProfWS");
+  auto t_id = pi_p4info_table_id_from_name(p4info, "IndirectWS");
+  p4::WriteRequest request;
+  {
+    auto update = request.add_updates();
+    update->set_type(p4::Update_Type_INSERT);
+    auto member = update->mutable_entity()->mutable_action_profile_member();
+    member->set_action_profile_id(act_prof_id);
+    member->set_member_id(7);
+    set_action(member->mutable_action());
+  }
+  {
+    auto update = request.add_updates();
+    update->set_type(p4::Update_Type_INSERT);
+    auto table_entry = update->mutable_entity()->mutable_table_entry();
+    table_entry->set_table_id(t_id);
+    auto mf = table_entry->add_match();
+    mf->set_field_id(pi_p4info_table_match_field_id_from_name(
+        p4info, t_id, "header_test.field32"));
+    mf->mutable_exact()->set_value(std::string(4, '\x00'));
+    table_entry->mutable_action()->set_action_profile_member_id(7);
+  }
+  EXPECT_CALL(*mock, action_prof_member_create(act_prof_id, _, _));
+  EXPECT_CALL(*mock, table_entry_add(_, _, _, _));
+  ASSERT_EQ(mgr.write(request).code(), Code::OK);
+
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(0);
+  p4::ReadResponse response;
+  p4::Entity entity;
+  entity.mutable_table_entry()->set_table_id(t_id);
+  ASSERT_EQ(mgr.read_one(entity, &response).code(), Code::OK);
+  ASSERT_EQ(1, response.entities_size());
+  EXPECT_EQ(7u, response.entities(0).table_entry().action()
+            .action_profile_member_id());
+
+  ::testing::Mock::VerifyAndClearExpectations(mock);
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _));
+  EXPECT_EQ(mgr.verify_shadow(t_id).code(), Code::OK);
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace proto
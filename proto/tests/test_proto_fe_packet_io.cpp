@@ -21,8 +21,13 @@
 #include <gmock/gmock.h>
 
 #include <algorithm>  // for std::reverse
+#include <array>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <thread>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "PI/frontends/proto/device_mgr.h"
@@ -30,6 +35,7 @@
 #include "google/rpc/code.pb.h"
 
 #include "mock_switch.h"
+#include "src/packet_metadata_plan.h"
 
 namespace pi {
 namespace proto {
@@ -325,6 +331,148 @@ TEST_F(DeviceMgrPacketIOMetadataTest, PacketOut) {
   }
 }
 
+TEST_F(DeviceMgrPacketIOMetadataTest, PacketOutBadMetadata) {
+  p4::PacketOut packet_out;
+  packet_out.set_payload(std::string(10, '\xab'));
+  auto metadata = packet_out.add_metadata();
+  metadata->set_metadata_id(1);
+  metadata->set_value(to_binary(0, bw1));
+  // unknown id
+  metadata = packet_out.add_metadata();
+  metadata->set_metadata_id(num + 1);
+  metadata->set_value(std::string(1, '\x00'));
+  EXPECT_CALL(*mock, packetout_send(_, _)).Times(0);
+  EXPECT_NE(mgr.packet_out_send(packet_out).code(), Code::OK);
+  // value too long
+  metadata->set_metadata_id(2);
+  metadata->set_value(std::string(3, '\x00'));
+  EXPECT_NE(mgr.packet_out_send(packet_out).code(), Code::OK);
+}
+
+// packet-ins are dispatched without locking, while the P4Info (and hence the
+// packet-in header layout) is changed concurrently; every packet has to be
+// parsed consistently with either the old or the new layout
+TEST_F(DeviceMgrPacketIOMetadataTest, PacketInDuringConfigChange) {
+  std::string payload(10, '\xab');
+  BitPattern pattern;
+  for (uint32_t id = 0; id < num; id++)
+    pattern.push_back(1, bitwidths[id]);
+  std::string packet = pattern.bits + payload;
+  std::atomic<int> with_metadata{0};
+  std::atomic<int> without_metadata{0};
+  std::atomic<int> inconsistent{0};
+  auto cb_fn = [&](device_id_t, p4::PacketIn *p, void *) {
+    if (p->metadata_size() == static_cast<int>(num) &&
+        p->payload() == payload) {
+      with_metadata++;
+    } else if (p->metadata_size() == 0 && p->payload() == packet) {
+      without_metadata++;
+    } else {
+      inconsistent++;
+    }
+  };
+  mgr.packet_in_register_cb(cb_fn, nullptr);
+
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> injectors;
+  for (int i = 0; i < 2; i++) {
+    injectors.emplace_back([this, &packet, &stop] {
+        while (!stop) mock->packetin_inject(packet);
+    });
+  }
+  auto received = [&] {
+    return with_metadata + without_metadata + inconsistent;
+  };
+  auto wait_for_packets = [&] {
+    auto start = received();
+    while (received() < start + 10) std::this_thread::yield();
+  };
+  p4::config::P4Info p4info_no_metadata;
+  for (int i = 0; i < 50; i++) {
+    wait_for_packets();
+    p4::ForwardingPipelineConfig config;
+    config.mutable_p4info()->CopyFrom(
+        (i % 2 == 0) ? p4info_no_metadata : p4info_proto);
+    ASSERT_EQ(Code::OK, mgr.pipeline_config_set(
+        p4::SetForwardingPipelineConfigRequest_Action_VERIFY_AND_COMMIT,
+        config).code());
+  }
+  stop = true;
+  for (auto &t : injectors) t.join();
+
+  EXPECT_EQ(0, inconsistent);
+  EXPECT_GT(with_metadata, 0);
+  EXPECT_GT(without_metadata, 0);
+}
+
+using pi::fe::proto::PacketMetadataPlan;
+
+class PacketMetadataPlanTest : public ::testing::Test {
+ protected:
+  // fields are given as (id, bitwidth)
+  void set_layout(const std::vector<std::pair<uint32_t, int> > &layout) {
+    p4::config::ControllerPacketMetadata header;
+    for (const auto &p : layout) {
+      auto metadata = header.add_metadata();
+      metadata->set_id(p.first);
+      metadata->set_bitwidth(p.second);
+    }
+    plan.reset(new PacketMetadataPlan(header));
+  }
+
+  std::unique_ptr<PacketMetadataPlan> plan{nullptr};
+};
+
+// aligned and unaligned fields, metadata provided out of order
+TEST_F(PacketMetadataPlanTest, MixedLayout) {
+  set_layout({{1, 16}, {2, 9}, {3, 7}, {4, 3}, {5, 5}, {6, 48}});
+  EXPECT_EQ(11u, plan->header_size());
+  BitPattern pattern;
+  std::array<int, 6> bitwidths{{16, 9, 7, 3, 5, 48}};
+  std::array<uint64_t, 6> values{{0xabcd, 0x1a5, 0x55, 0x5, 0x1b,
+                                  0x123456789abcULL}};
+  for (size_t i = 0; i < values.size(); i++) {
+    // BitPattern only supports up to 32 bits
+    if (bitwidths[i] > 32) {
+      pattern.push_back(static_cast<int>(values[i] >> 32), bitwidths[i] - 32);
+      pattern.push_back(static_cast<int>(values[i] & 0xffffffff), 32);
+    } else {
+      pattern.push_back(static_cast<int>(values[i]), bitwidths[i]);
+    }
+  }
+
+  p4::PacketIn packet_in;
+  plan->extract(pattern.bits.data(), &packet_in);
+  ASSERT_EQ(6, packet_in.metadata_size());
+  for (size_t i = 0; i < values.size(); i++) {
+    EXPECT_EQ(i + 1, packet_in.metadata(i).metadata_id());
+    EXPECT_EQ(to_binary(values[i], bitwidths[i]),
+              packet_in.metadata(i).value());
+  }
+
+  p4::PacketOut packet_out;
+  for (auto i : {5, 0, 3, 1, 4, 2}) {
+    auto metadata = packet_out.add_metadata();
+    metadata->set_metadata_id(i + 1);
+    metadata->set_value(to_binary(values[i], bitwidths[i]));
+  }
+  std::string hdr(plan->header_size(), '\x00');
+  ASSERT_TRUE(plan->deparse(packet_out, &hdr[0]));
+  EXPECT_EQ(pattern.bits, hdr);
+}
+
+// fields missing from the PacketOut are left to 0
+TEST_F(PacketMetadataPlanTest, MissingField) {
+  set_layout({{1, 9}, {2, 7}});
+  p4::PacketOut packet_out;
+  auto metadata = packet_out.add_metadata();
+  metadata->set_metadata_id(2);
+  metadata->set_value(to_binary(0x7f, 7));
+  std::string hdr(plan->header_size(), '\x00');
+  ASSERT_TRUE(plan->deparse(packet_out, &hdr[0]));
+  EXPECT_EQ(std::string("\x00\x7f", 2), hdr);
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace proto
@@ -0,0 +1,275 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <cstring>  // std::memcpy
+
+#include "PI/frontends/cpp/tables.h"
+#include "PI/int/pi_int.h"
+#include "PI/pi.h"
+
+#include "src/table_info_store.h"
+
+namespace pi {
+namespace proto {
+namespace testing {
+namespace {
+
+using pi::fe::proto::TableInfoStore;
+
+// we do not need a P4Info object to build match keys, we use the PI
+// representation directly
+class TableInfoStoreTest : public ::testing::Test {
+ protected:
+  static constexpr pi_p4_id_t t_id = 0x02000001;
+  static constexpr size_t mk_size = 6;
+
+  // small max size so that the store has to grow
+  TableInfoStoreTest() { store.add_table(t_id, mk_size, 16); }
+
+  std::string make_key_data(uint32_t v) const {
+    std::string data(mk_size, '\x00');
+    std::memcpy(&data[0], &v, sizeof(v));
+    return data;
+  }
+
+  pi_match_key_t make_pi_key(const std::string &data, uint32_t priority) {
+    pi_match_key_t match_key;
+    match_key.p4info = nullptr;
+    match_key.table_id = t_id;
+    match_key.priority = priority;
+    match_key.data_size = data.size();
+    match_key.data = const_cast<char *>(data.data());
+    return match_key;
+  }
+
+  pi::MatchKey make_key(uint32_t v, uint32_t priority = 0) {
+    auto data = make_key_data(v);
+    auto match_key = make_pi_key(data, priority);
+    return pi::MatchKey(&match_key);
+  }
+
+  TableInfoStore store;
+};
+
+constexpr pi_p4_id_t TableInfoStoreTest::t_id;
+constexpr size_t TableInfoStoreTest::mk_size;
+
+TEST_F(TableInfoStoreTest, AddGetRemove) {
+  constexpr uint32_t num_entries = 10000;
+  for (uint32_t i = 0; i < num_entries; i++) {
+    store.add_entry(t_id, make_key(i),
+                    TableInfoStore::Data(i, 0xab00000000 + i));
+  }
+  EXPECT_EQ(num_entries, store.num_entries(t_id));
+
+  for (uint32_t i = 0; i < num_entries; i++) {
+    auto data = store.get_entry(t_id, make_key(i));
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(i, data->handle);
+    EXPECT_EQ(0xab00000000 + i, data->controller_metadata);
+  }
+  EXPECT_EQ(nullptr, store.get_entry(t_id, make_key(num_entries)));
+  // the priority is part of the key
+  EXPECT_EQ(nullptr, store.get_entry(t_id, make_key(0, 1)));
+
+  for (uint32_t i = 0; i < num_entries; i += 2)
+    store.remove_entry(t_id, make_key(i));
+  EXPECT_EQ(num_entries / 2, store.num_entries(t_id));
+  for (uint32_t i = 0; i < num_entries; i++) {
+    auto data = store.get_entry(t_id, make_key(i));
+    if (i % 2 == 0) {
+      EXPECT_EQ(nullptr, data);
+    } else {
+      ASSERT_NE(nullptr, data);
+      EXPECT_EQ(i, data->handle);
+    }
+  }
+}
+
+TEST_F(TableInfoStoreTest, Priority) {
+  store.add_entry(t_id, make_key(7, 1), TableInfoStore::Data(1, 0));
+  store.add_entry(t_id, make_key(7, 2), TableInfoStore::Data(2, 0));
+  EXPECT_EQ(2u, store.num_entries(t_id));
+  EXPECT_EQ(1u, store.get_entry(t_id, make_key(7, 1))->handle);
+  EXPECT_EQ(2u, store.get_entry(t_id, make_key(7, 2))->handle);
+  EXPECT_EQ(nullptr, store.get_entry(t_id, make_key(7, 3)));
+}
+
+TEST_F(TableInfoStoreTest, DuplicateAdd) {
+  store.add_entry(t_id, make_key(1), TableInfoStore::Data(1, 0));
+  store.add_entry(t_id, make_key(1), TableInfoStore::Data(2, 0));
+  EXPECT_EQ(1u, store.num_entries(t_id));
+  EXPECT_EQ(1u, store.get_entry(t_id, make_key(1))->handle);
+}
+
+TEST_F(TableInfoStoreTest, View) {
+  store.add_entry(t_id, make_key(3, 9), TableInfoStore::Data(3, 0));
+  auto data = make_key_data(3);
+  auto match_key = make_pi_key(data, 9);
+  TableInfoStore::MatchKeyView view(&match_key);
+  auto entry = store.get_entry(t_id, view);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(3u, entry->handle);
+  store.remove_entry(t_id, view);
+  EXPECT_EQ(nullptr, store.get_entry(t_id, make_key(3, 9)));
+}
+
+// random sequence of additions and removals, which creates a lot of deleted
+// slots, checked against a std::map
+TEST_F(TableInfoStoreTest, Churn) {
+  std::map<std::tuple<uint32_t, uint32_t>, pi_entry_handle_t> expected;
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<uint32_t> key_dist(0, 2000);
+  std::uniform_int_distribution<uint32_t> priority_dist(0, 3);
+  for (pi_entry_handle_t h = 0; h < 100000; h++) {
+    auto k = std::make_tuple(key_dist(gen), priority_dist(gen));
+    auto mk = make_key(std::get<0>(k), std::get<1>(k));
+    if (expected.count(k)) {
+      ASSERT_EQ(expected[k], store.get_entry(t_id, mk)->handle);
+      store.remove_entry(t_id, mk);
+      expected.erase(k);
+    } else {
+      ASSERT_EQ(nullptr, store.get_entry(t_id, mk));
+      store.add_entry(t_id, mk, TableInfoStore::Data(h, 0));
+      expected[k] = h;
+    }
+    ASSERT_EQ(expected.size(), store.num_entries(t_id));
+  }
+  for (const auto &p : expected) {
+    auto mk = make_key(std::get<0>(p.first), std::get<1>(p.first));
+    auto data = store.get_entry(t_id, mk);
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(p.second, data->handle);
+  }
+}
+
+// readers share the table lock, a writer waits for all of them
+TEST_F(TableInfoStoreTest, SharedLock) {
+  auto reader_lock_1 = store.lock_table_shared(t_id);
+  auto reader_lock_2 = store.lock_table_shared(t_id);
+  std::atomic<bool> written{false};
+  std::thread writer([this, &written] {
+      auto lock = store.lock_table(t_id);
+      store.add_entry(t_id, make_key(1), TableInfoStore::Data(1, 0));
+      written = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(written);
+  reader_lock_1.unlock();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(written);
+  reader_lock_2.unlock();
+  writer.join();
+  EXPECT_TRUE(written);
+  EXPECT_EQ(1u, store.num_entries(t_id));
+}
+
+// concurrent readers and writers, each reader checks that it always sees the
+// entries in pairs (the writers add and remove them 2 at a time)
+TEST_F(TableInfoStoreTest, ConcurrentReadersWriters) {
+  constexpr uint32_t num_iterations = 2000;
+  constexpr size_t num_readers = 3;
+  std::atomic<bool> done{false};
+  std::atomic<size_t> errors{0};
+  std::vector<std::thread> readers;
+  for (size_t r = 0; r < num_readers; r++) {
+    readers.emplace_back([this, &done, &errors] {
+        while (!done) {
+          auto lock = store.lock_table_shared(t_id);
+          if (store.num_entries(t_id) % 2 != 0) errors++;
+          for (uint32_t i = 0; i < 16; i += 2) {
+            bool first = (store.get_entry(t_id, make_key(i)) != nullptr);
+            bool second = (store.get_entry(t_id, make_key(i + 1)) != nullptr);
+            if (first != second) errors++;
+          }
+        }
+    });
+  }
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<uint32_t> key_dist(0, 7);
+  for (uint32_t it = 0; it < num_iterations; it++) {
+    auto i = 2 * key_dist(gen);
+    auto lock = store.lock_table(t_id);
+    if (store.get_entry(t_id, make_key(i)) == nullptr) {
+      store.add_entry(t_id, make_key(i), TableInfoStore::Data(i, 0));
+      store.add_entry(t_id, make_key(i + 1), TableInfoStore::Data(i + 1, 0));
+    } else {
+      store.remove_entry(t_id, make_key(i));
+      store.remove_entry(t_id, make_key(i + 1));
+    }
+  }
+  done = true;
+  for (auto &t : readers) t.join();
+  EXPECT_EQ(0u, errors);
+}
+
+// shadow records are stored with the entries and survive rehashing
+TEST_F(TableInfoStoreTest, Shadow) {
+  constexpr pi_p4_id_t t_id_shadow = t_id + 1;
+  constexpr size_t shadow_size = 9;
+  store.add_table(t_id_shadow, mk_size, 4, shadow_size);
+  EXPECT_EQ(0u, store.shadow_size(t_id));
+  EXPECT_EQ(shadow_size, store.shadow_size(t_id_shadow));
+  auto make_shadow = [](uint32_t v) {
+    std::string shadow(shadow_size, static_cast<char>(v));
+    return shadow;
+  };
+  constexpr uint32_t num_entries = 100;
+  for (uint32_t i = 0; i < num_entries; i++) {
+    auto data = make_key_data(i);
+    auto pi_mk = make_pi_key(data, 0);
+    pi_mk.table_id = t_id_shadow;
+    pi::MatchKey mk_shadow(&pi_mk);
+    store.add_entry(t_id_shadow, mk_shadow, TableInfoStore::Data(i, i),
+                    make_shadow(i).data());
+    if (i % 2 == 0)
+      store.update_shadow(t_id_shadow, mk_shadow, make_shadow(i + 1).data());
+  }
+  size_t num_visited = 0;
+  store.for_each_entry(
+      t_id_shadow,
+      [&num_visited, &make_shadow](const TableInfoStore::MatchKeyView &mk,
+                                   const TableInfoStore::Data &data,
+                                   const char *shadow) {
+        uint32_t v;
+        std::memcpy(&v, mk.data, sizeof(v));
+        EXPECT_EQ(v, data.handle);
+        auto expected = make_shadow((v % 2 == 0) ? v + 1 : v);
+        EXPECT_EQ(expected, std::string(shadow, shadow_size));
+        num_visited++;
+      });
+  EXPECT_EQ(num_entries, num_visited);
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace proto
+}  // namespace pi
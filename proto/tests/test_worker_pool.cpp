@@ -0,0 +1,94 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "src/worker_pool.h"
+
+namespace pi {
+namespace proto {
+namespace testing {
+namespace {
+
+using pi::fe::proto::WorkerPool;
+
+TEST(WorkerPool, RunAll) {
+  WorkerPool pool(3);
+  std::atomic<int> count{0};
+  std::vector<WorkerPool::Task> tasks;
+  for (int i = 0; i < 100; i++) tasks.emplace_back([&count] { count++; });
+  pool.run_all(&tasks);
+  EXPECT_EQ(100, count.load());
+  // the pool can be reused
+  pool.run_all(&tasks);
+  EXPECT_EQ(200, count.load());
+}
+
+TEST(WorkerPool, NoWorkers) {
+  WorkerPool pool(0);
+  int count = 0;
+  std::vector<WorkerPool::Task> tasks(10, [&count] { count++; });
+  pool.run_all(&tasks);
+  EXPECT_EQ(10, count);
+}
+
+TEST(WorkerPool, ConcurrentCallers) {
+  WorkerPool pool(2);
+  std::atomic<int> count{0};
+  auto caller = [&pool, &count] {
+    std::vector<WorkerPool::Task> tasks(50, [&count] { count++; });
+    pool.run_all(&tasks);
+  };
+  std::thread t1(caller);
+  std::thread t2(caller);
+  t1.join();
+  t2.join();
+  EXPECT_EQ(100, count.load());
+}
+
+// a task which throws must not prevent run_all from returning, and the
+// exception is reported to the caller
+TEST(WorkerPool, TaskThrows) {
+  WorkerPool pool(2);
+  std::atomic<int> count{0};
+  std::vector<WorkerPool::Task> tasks;
+  for (int i = 0; i < 20; i++) {
+    tasks.emplace_back([&count, i] {
+      if (i % 5 == 0) throw std::runtime_error("task failed");
+      count++;
+    });
+  }
+  EXPECT_THROW(pool.run_all(&tasks), std::runtime_error);
+  EXPECT_EQ(16, count.load());
+  // the pool is still usable
+  std::vector<WorkerPool::Task> more(10, [&count] { count++; });
+  pool.run_all(&more);
+  EXPECT_EQ(26, count.load());
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace proto
+}  // namespace pi
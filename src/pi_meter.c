@@ -28,11 +28,13 @@ static bool is_direct_meter(const pi_p4info_t *p4info, pi_p4_id_t meter_id) {
 
 pi_status_t pi_meter_read(pi_session_handle_t session_handle,
                           pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                          size_t index, pi_meter_spec_t *meter_spec) {
+                          size_t index, int flags,
+                          pi_meter_spec_t *meter_spec) {
   const pi_p4info_t *p4info = pi_get_device_p4info(dev_tgt.dev_id);
   if (!p4info) return PI_STATUS_DEV_NOT_ASSIGNED;
   if (is_direct_meter(p4info, meter_id)) return PI_STATUS_METER_IS_DIRECT;
-  return _pi_meter_read(session_handle, dev_tgt, meter_id, index, meter_spec);
+  return _pi_meter_read(session_handle, dev_tgt, meter_id, index, flags,
+                        meter_spec);
 }
 
 pi_status_t pi_meter_set(pi_session_handle_t session_handle,
@@ -53,13 +55,13 @@ pi_status_t pi_meter_set(pi_session_handle_t session_handle,
 
 pi_status_t pi_meter_read_direct(pi_session_handle_t session_handle,
                                  pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                                 pi_entry_handle_t entry_handle,
+                                 pi_entry_handle_t entry_handle, int flags,
                                  pi_meter_spec_t *meter_spec) {
   const pi_p4info_t *p4info = pi_get_device_p4info(dev_tgt.dev_id);
   if (!p4info) return PI_STATUS_DEV_NOT_ASSIGNED;
   if (!is_direct_meter(p4info, meter_id)) return PI_STATUS_METER_IS_NOT_DIRECT;
   return _pi_meter_read_direct(session_handle, dev_tgt, meter_id, entry_handle,
-                               meter_spec);
+                               flags, meter_spec);
 }
 
 pi_status_t pi_meter_set_direct(pi_session_handle_t session_handle,
@@ -918,15 +918,18 @@ static void meter_read(char *req, pi_rpc_type_t direct_or_not) {
   req += retrieve_p4_id(req, &meter_id);
   uint64_t h;
   req += retrieve_uint64(req, &h);
+  uint32_t flags;
+  req += retrieve_uint32(req, &flags);
 
   pi_meter_spec_t meter_spec;
   pi_status_t status;
   switch (direct_or_not) {
     case PI_RPC_METER_READ:
-      status = _pi_meter_read(sess, dev_tgt, meter_id, h, &meter_spec);
+      status = _pi_meter_read(sess, dev_tgt, meter_id, h, flags, &meter_spec);
       break;
     case PI_RPC_METER_READ_DIRECT:
-      status = _pi_meter_read_direct(sess, dev_tgt, meter_id, h, &meter_spec);
+      status = _pi_meter_read_direct(sess, dev_tgt, meter_id, h, flags,
+                                     &meter_spec);
       break;
     default:
       assert(0);
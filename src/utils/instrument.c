@@ -0,0 +1,264 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <PI/target/pi_instrument.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PI_INSTRUMENT_USE_TSC
+#endif
+
+typedef struct {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t buckets[PI_INSTRUMENT_NUM_BUCKETS];
+} func_stats_t;
+
+// one per thread, only written by its owner thread; slot 0 is unused
+typedef struct thread_stats_s {
+  struct thread_stats_s *next;
+  func_stats_t funcs[PI_INSTRUMENT_MAX_FUNCS + 1];
+} thread_stats_t;
+
+int _pi_instrument_on = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+// slots are never released, the names point to __func__ strings
+static const char *slot_names[PI_INSTRUMENT_MAX_FUNCS + 1];
+static int num_slots = 0;
+static thread_stats_t *all_stats = NULL;
+static int timing = 0;
+// incremented by pi_instrument_destroy, so that threads know that their stats
+// were released
+static unsigned epoch = 1;
+// fixed-point (16 bits) conversion factor from ticks to nanoseconds
+static uint64_t ns_per_tick = 1 << 16;
+
+static __thread thread_stats_t *my_stats = NULL;
+static __thread unsigned my_epoch = 0;
+
+static uint64_t get_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t get_ticks() {
+#ifdef PI_INSTRUMENT_USE_TSC
+  return __rdtsc();
+#else
+  return get_ns();
+#endif
+}
+
+static void calibrate() {
+#ifdef PI_INSTRUMENT_USE_TSC
+  struct timespec delay = {0, 10000000};  // 10ms
+  uint64_t ns_start = get_ns();
+  uint64_t ticks_start = get_ticks();
+  nanosleep(&delay, NULL);
+  uint64_t ns = get_ns() - ns_start;
+  uint64_t ticks = get_ticks() - ticks_start;
+  ns_per_tick = (ticks == 0) ? (1 << 16) : (ns << 16) / ticks;
+#else
+  ns_per_tick = 1 << 16;
+#endif
+}
+
+static size_t get_bucket(uint64_t ns) {
+  size_t bucket = (ns == 0) ? 0 : (size_t)(64 - __builtin_clzll(ns));
+  return (bucket < PI_INSTRUMENT_NUM_BUCKETS) ? bucket
+                                              : PI_INSTRUMENT_NUM_BUCKETS - 1;
+}
+
+// the lock must be held; threads allocate new stats on their next call
+static void release_stats() {
+  while (all_stats) {
+    thread_stats_t *next = all_stats->next;
+    free(all_stats);
+    all_stats = next;
+  }
+  __atomic_add_fetch(&epoch, 1, __ATOMIC_RELEASE);
+}
+
+void pi_instrument_init(int flags) {
+  pthread_mutex_lock(&lock);
+  release_stats();
+  timing = flags & PI_INSTRUMENT_FLAGS_TIMING;
+  if (timing) calibrate();
+  __atomic_store_n(&_pi_instrument_on, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&lock);
+}
+
+void pi_instrument_destroy() {
+  pthread_mutex_lock(&lock);
+  __atomic_store_n(&_pi_instrument_on, 0, __ATOMIC_RELEASE);
+  release_stats();
+  pthread_mutex_unlock(&lock);
+}
+
+static int register_fn(pi_instrument_fn_t *fn) {
+  pthread_mutex_lock(&lock);
+  int slot = fn->slot;
+  if (slot == 0) {
+    if (num_slots == PI_INSTRUMENT_MAX_FUNCS) {
+      slot = -1;
+    } else {
+      slot = ++num_slots;
+      slot_names[slot] = fn->name;
+    }
+    __atomic_store_n(&fn->slot, slot, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&lock);
+  return slot;
+}
+
+static thread_stats_t *get_my_stats() {
+  unsigned current_epoch = __atomic_load_n(&epoch, __ATOMIC_ACQUIRE);
+  if (my_epoch == current_epoch) return my_stats;
+  thread_stats_t *stats = calloc(1, sizeof(thread_stats_t));
+  pthread_mutex_lock(&lock);
+  stats->next = all_stats;
+  all_stats = stats;
+  pthread_mutex_unlock(&lock);
+  my_stats = stats;
+  my_epoch = current_epoch;
+  return stats;
+}
+
+pi_instrument_call_t _pi_instrument_call_begin(pi_instrument_fn_t *fn) {
+  pi_instrument_call_t call = {0, 0, NULL};
+  int slot = __atomic_load_n(&fn->slot, __ATOMIC_ACQUIRE);
+  if (slot == 0) slot = register_fn(fn);
+  if (slot < 0) return call;
+  func_stats_t *stats = &get_my_stats()->funcs[slot];
+  stats->count++;
+  if (!timing) return call;
+  call.slot = slot;
+  call.stats = stats;
+  call.start = get_ticks();
+  return call;
+}
+
+void _pi_instrument_call_end(pi_instrument_call_t *call) {
+  uint64_t ns = ((get_ticks() - call->start) * ns_per_tick) >> 16;
+  func_stats_t *stats = (func_stats_t *)call->stats;
+  stats->total_ns += ns;
+  if (ns > stats->max_ns) stats->max_ns = ns;
+  stats->buckets[get_bucket(ns)]++;
+}
+
+// the lock must be held
+static void aggregate(int slot, func_stats_t *res) {
+  memset(res, 0, sizeof(*res));
+  for (const thread_stats_t *t = all_stats; t; t = t->next) {
+    const func_stats_t *stats = &t->funcs[slot];
+    res->count += stats->count;
+    res->total_ns += stats->total_ns;
+    if (stats->max_ns > res->max_ns) res->max_ns = stats->max_ns;
+    for (size_t i = 0; i < PI_INSTRUMENT_NUM_BUCKETS; i++)
+      res->buckets[i] += stats->buckets[i];
+  }
+}
+
+int64_t pi_instrument_get_count(const char *func_name) {
+  int64_t count = -1;
+  pthread_mutex_lock(&lock);
+  for (int slot = 1; slot <= num_slots; slot++) {
+    if (strcmp(slot_names[slot], func_name)) continue;
+    func_stats_t stats;
+    aggregate(slot, &stats);
+    if (stats.count > 0) count = (int64_t)stats.count;
+    break;
+  }
+  pthread_mutex_unlock(&lock);
+  return count;
+}
+
+static int cmp_slot_names(const void *a, const void *b) {
+  return strcmp(slot_names[*(const int *)a], slot_names[*(const int *)b]);
+}
+
+// upper bound of the bucket in which the given fraction of calls falls
+static uint64_t percentile(const func_stats_t *stats, double fraction) {
+  uint64_t target = (uint64_t)(fraction * stats->count);
+  uint64_t cumulated = 0;
+  for (size_t i = 0; i < PI_INSTRUMENT_NUM_BUCKETS; i++) {
+    cumulated += stats->buckets[i];
+    if (cumulated > target) return (i == 0) ? 0 : ((uint64_t)1 << i);
+  }
+  return stats->max_ns;
+}
+
+static void dump_full(FILE *f, const char *name, const func_stats_t *stats) {
+  fprintf(f, "%s : %llu", name, (unsigned long long)stats->count);
+  if (!timing) {
+    fprintf(f, "\n");
+    return;
+  }
+  fprintf(f,
+          " calls, mean %llu ns, p50 < %llu ns, p99 < %llu ns, max %llu ns\n",
+          (unsigned long long)(stats->total_ns / stats->count),
+          (unsigned long long)percentile(stats, 0.5),
+          (unsigned long long)percentile(stats, 0.99),
+          (unsigned long long)stats->max_ns);
+  for (size_t i = 0; i < PI_INSTRUMENT_NUM_BUCKETS; i++) {
+    if (stats->buckets[i] == 0) continue;
+    uint64_t lo = (i == 0) ? 0 : ((uint64_t)1 << (i - 1));
+    if (i == PI_INSTRUMENT_NUM_BUCKETS - 1) {
+      fprintf(f, "  [%llu, inf) ns : %llu\n", (unsigned long long)lo,
+              (unsigned long long)stats->buckets[i]);
+    } else {
+      fprintf(f, "  [%llu, %llu) ns : %llu\n", (unsigned long long)lo,
+              (unsigned long long)((uint64_t)1 << i),
+              (unsigned long long)stats->buckets[i]);
+    }
+  }
+}
+
+int pi_instrument_dump_to_file(const char *path,
+                               pi_instrument_dump_mode_t mode) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) return 1;
+  pthread_mutex_lock(&lock);
+  int slots[PI_INSTRUMENT_MAX_FUNCS];
+  for (int slot = 1; slot <= num_slots; slot++) slots[slot - 1] = slot;
+  qsort(slots, num_slots, sizeof(*slots), cmp_slot_names);
+  for (int i = 0; i < num_slots; i++) {
+    func_stats_t stats;
+    aggregate(slots[i], &stats);
+    if (stats.count == 0) continue;
+    const char *name = slot_names[slots[i]];
+    if (mode == PI_INSTRUMENT_DUMP_COUNTS)
+      fprintf(f, "%s : %d\n", name, (int)stats.count);
+    else
+      dump_full(f, name, &stats);
+  }
+  pthread_mutex_unlock(&lock);
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,159 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#include "batch.h"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "common.h"
+
+namespace pibmv2 {
+
+extern conn_mgr_t *conn_mgr_state;
+
+namespace {
+
+std::mutex batches_mutex;
+std::unordered_map<pi_session_handle_t, std::unique_ptr<Batch> > batches;
+
+// number of batches currently holding a connection, for each device
+std::array<std::atomic<int>, NUM_DEVICES> pipelines_in_use;
+
+Batch *get_batch(pi_session_handle_t session_handle) {
+  std::lock_guard<std::mutex> lock(batches_mutex);
+  auto it = batches.find(session_handle);
+  return (it == batches.end()) ? nullptr : it->second.get();
+}
+
+}  // namespace
+
+constexpr size_t Batch::kMaxPending;
+
+Batch::~Batch() {
+  flush();
+}
+
+bool
+Batch::reserve_pipeline(pi_dev_id_t dev_id, int max_pipelines) {
+  if (pipelines.find(dev_id) != pipelines.end()) return true;
+  auto &in_use = pipelines_in_use[dev_id];
+  int n = in_use.load();
+  do {
+    if (n >= max_pipelines) return false;
+  } while (!in_use.compare_exchange_weak(n, n + 1));
+  pipelines.emplace(
+      dev_id, DevicePipeline{conn_mgr_client(conn_mgr_state, dev_id), {}});
+  return true;
+}
+
+void
+Batch::enqueue(pi_dev_id_t dev_id, const std::string &t_name,
+               const SendFn &send, RecvFn recv) {
+  auto it = pipelines.find(dev_id);
+  assert(it != pipelines.end());
+  auto &pipeline = it->second;
+  send(pipeline.client.c);
+  pipeline.pending.push_back({std::move(recv), t_name});
+  if (!in_recv && pipeline.pending.size() > kMaxPending)
+    process_one(&pipeline);
+}
+
+void
+Batch::process_one(DevicePipeline *pipeline) {
+  auto op = std::move(pipeline->pending.front());
+  pipeline->pending.pop_front();
+  in_recv = true;
+  try {
+    op.recv(pipeline->client.c);
+  } catch (InvalidTableOperation &ito) {
+    const char *what =
+        _TableOperationErrorCode_VALUES_TO_NAMES.find(ito.code)->second;
+    std::cout << "Invalid table (" << op.t_name << ") operation ("
+              << ito.code << "): " << what << std::endl;
+    if (status == PI_STATUS_SUCCESS)
+      status = static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + ito.code);
+  } catch (::apache::thrift::TException &te) {
+    std::cout << "Thrift error for table (" << op.t_name << ") operation: "
+              << te.what() << std::endl;
+    if (status == PI_STATUS_SUCCESS) status = PI_STATUS_TARGET_TRANSPORT_ERROR;
+  }
+  in_recv = false;
+}
+
+void
+Batch::flush() {
+  for (auto &p : pipelines) {
+    // recv functions may enqueue new requests
+    while (!p.second.pending.empty()) process_one(&p.second);
+  }
+  // releases the connections, and then the slots reserved for them
+  for (auto it = pipelines.begin(); it != pipelines.end();) {
+    auto dev_id = it->first;
+    it = pipelines.erase(it);
+    pipelines_in_use[dev_id]--;
+  }
+}
+
+pi_status_t batch_begin(pi_session_handle_t session_handle) {
+  std::unique_ptr<Batch> previous(new Batch());
+  {
+    std::lock_guard<std::mutex> lock(batches_mutex);
+    batches[session_handle].swap(previous);
+  }
+  if (!previous) return PI_STATUS_SUCCESS;
+  // flushed without holding batches_mutex, since this waits for the replies
+  previous->flush();
+  return previous->get_status();
+}
+
+pi_status_t batch_end(pi_session_handle_t session_handle) {
+  std::unique_ptr<Batch> batch;
+  {
+    std::lock_guard<std::mutex> lock(batches_mutex);
+    auto it = batches.find(session_handle);
+    if (it == batches.end()) return PI_STATUS_SUCCESS;
+    batch = std::move(it->second);
+    batches.erase(it);
+  }
+  batch->flush();
+  return batch->get_status();
+}
+
+Batch *batch_get(pi_session_handle_t session_handle, pi_dev_id_t dev_id) {
+  auto d_info = get_device_info(dev_id);
+  if (!d_info->pipeline_batches) return nullptr;
+  auto batch = get_batch(session_handle);
+  if (batch == nullptr) return nullptr;
+  return batch->reserve_pipeline(dev_id, d_info->max_pipelines) ? batch
+                                                                 : nullptr;
+}
+
+void batch_flush(pi_session_handle_t session_handle) {
+  auto batch = get_batch(session_handle);
+  if (batch) batch->flush();
+}
+
+}  // namespace pibmv2
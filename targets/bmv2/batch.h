@@ -0,0 +1,117 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#ifndef PI_BMV2_BATCH_H_
+#define PI_BMV2_BATCH_H_
+
+#include <PI/pi.h>
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "conn_mgr.h"
+
+namespace pibmv2 {
+
+// When batch pipelining is enabled for a device (with the "pipeline_batches"
+// assign extra), the table writes issued by a session between pi_batch_begin
+// and pi_batch_end are pipelined on a Thrift connection: we use the
+// send_* / recv_* methods of the Thrift client and we do not wait for a reply
+// before sending the next request. Replies are processed in order, either when
+// too many requests are outstanding, when the session issues a request which
+// cannot be pipelined, or at the latest when the batch ends.
+// This has 2 consequences for the PI client, which is why it is opt-in:
+//  - the entry handles returned by _pi_table_entry_add are written to the
+//    caller's memory when the reply is received, and are only guaranteed to be
+//    valid after pi_batch_end returns; the memory needs to remain valid until
+//    then
+//  - errors are reported by pi_batch_end (first error encountered)
+// A batch holds one of the device's pooled Thrift connections from its first
+// pipelined request until it is flushed (see batch_flush), so the number of
+// batches pipelining at the same time on a device is capped at
+// num_thrift_conns - 1: the last connection is left for the requests which are
+// not pipelined. Once the cap is reached, other batches just issue their
+// requests synchronously, they never wait for a pipelining batch to end. With
+// num_thrift_conns set to 1, pipelining is effectively disabled.
+class Batch {
+ public:
+  // both functions are given the StandardClient for the device
+  using SendFn = std::function<void(StandardClient *)>;
+  using RecvFn = std::function<void(StandardClient *)>;
+
+  // max number of requests in flight on a connection before we start
+  // processing replies
+  static constexpr size_t kMaxPending = 256;
+
+  ~Batch();
+
+  // returns false if the batch cannot pipeline requests for this device
+  // because max_pipelines batches are already doing so; otherwise acquires a
+  // connection for the batch if it does not already hold one
+  bool reserve_pipeline(pi_dev_id_t dev_id, int max_pipelines);
+
+  // t_name is only used for error messages; recv may call enqueue itself (to
+  // issue a request which depends on the reply); reserve_pipeline must have
+  // succeeded for dev_id
+  void enqueue(pi_dev_id_t dev_id, const std::string &t_name,
+               const SendFn &send, RecvFn recv);
+
+  // processes all outstanding replies and releases Thrift connections
+  void flush();
+
+  pi_status_t get_status() const { return status; }
+
+ private:
+  struct PendingOp {
+    RecvFn recv;
+    std::string t_name;
+  };
+
+  struct DevicePipeline {
+    Client client;
+    std::deque<PendingOp> pending;
+  };
+
+  void process_one(DevicePipeline *pipeline);
+
+  std::unordered_map<pi_dev_id_t, DevicePipeline> pipelines{};
+  pi_status_t status{PI_STATUS_SUCCESS};
+  bool in_recv{false};
+};
+
+// if the session already has an ongoing batch, it is ended first and its
+// status is returned
+pi_status_t batch_begin(pi_session_handle_t session_handle);
+
+pi_status_t batch_end(pi_session_handle_t session_handle);
+
+// returns nullptr if the session has no ongoing batch, if pipelining is not
+// enabled for the device or if too many batches are already pipelining
+// requests for the device (see Batch::reserve_pipeline)
+Batch *batch_get(pi_session_handle_t session_handle, pi_dev_id_t dev_id);
+
+// needs to be called before any request which is not pipelined, to ensure that
+// the requests issued by the session are applied in order
+void batch_flush(pi_session_handle_t session_handle);
+
+}  // namespace pibmv2
+
+#endif  // PI_BMV2_BATCH_H_
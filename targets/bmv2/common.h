@@ -28,11 +28,16 @@
 #include <string>
 #include <unordered_map>
 
+#define NUM_DEVICES 256
+
 namespace pibmv2 {
 
 typedef struct {
   int assigned;
   const pi_p4info_t *p4info;
+  // see batch.h
+  int pipeline_batches;
+  int max_pipelines;
 } device_info_t;
 
 extern device_info_t device_info_state[];
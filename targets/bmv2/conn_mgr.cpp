@@ -25,42 +25,47 @@
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TTransportUtils.h>
 
+#include <array>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <vector>
 
-namespace pibmv2 {
+#include "common.h"
 
-#define NUM_DEVICES 256
+namespace pibmv2 {
 
 using namespace ::apache::thrift;  // NOLINT(build/namespaces)
 using namespace ::apache::thrift::protocol;  // NOLINT(build/namespaces)
 using namespace ::apache::thrift::transport;  // NOLINT(build/namespaces)
 
-struct ClientImp {
+struct ConnImp {
+  boost::shared_ptr<TTransport> transport{nullptr};
   StandardClient *client{nullptr};
   SimplePreLAGClient *mc_client{nullptr};
   SimpleSwitchClient *sswitch_client{nullptr};
   std::mutex mutex{};
-};
 
-struct conn_mgr_t {
-  std::array<ClientImp, NUM_DEVICES> clients;
-  boost::shared_ptr<TTransport> transports[NUM_DEVICES];
+  ~ConnImp() {
+    delete client;
+    delete mc_client;
+    delete sswitch_client;
+  }
 };
 
-conn_mgr_t *conn_mgr_create() {
-  conn_mgr_t *conn_mgr_state = new conn_mgr_t();
-  return conn_mgr_state;
-}
+struct DevicePool {
+  std::vector<std::unique_ptr<ConnImp> > conns{};
+  // round-robin starting point for the next acquisition
+  std::atomic<size_t> next{0};
+};
 
-void conn_mgr_destroy(conn_mgr_t *conn_mgr_state) {
-  // close connections?
-  delete conn_mgr_state;
-}
+struct conn_mgr_t {
+  std::array<DevicePool, NUM_DEVICES> devices;
+};
 
-int conn_mgr_client_init(conn_mgr_t *conn_mgr_state, int dev_id,
-                         int thrift_port_num) {
-  assert(!conn_mgr_state->clients[dev_id].client);
+namespace {
 
+std::unique_ptr<ConnImp> open_one_conn(int dev_id, int thrift_port_num) {
   boost::shared_ptr<TTransport> socket(
       new TSocket("localhost", thrift_port_num));
   boost::shared_ptr<TTransport> transport(new TBufferedTransport(socket));
@@ -80,45 +85,93 @@ int conn_mgr_client_init(conn_mgr_t *conn_mgr_state, int dev_id,
     std::cout << "Could not connect to port " << thrift_port_num
               << "(device " << dev_id << ")" << std::endl;
 
-    return 1;
+    return nullptr;
   }
 
-  conn_mgr_state->transports[dev_id] = transport;
-  conn_mgr_state->clients[dev_id].client =
-      new StandardClient(standard_protocol);
-  conn_mgr_state->clients[dev_id].mc_client =
-      new SimplePreLAGClient(mc_protocol);
-  conn_mgr_state->clients[dev_id].sswitch_client =
-      new SimpleSwitchClient(sswitch_protocol);
+  std::unique_ptr<ConnImp> conn(new ConnImp());
+  conn->transport = transport;
+  conn->client = new StandardClient(standard_protocol);
+  conn->mc_client = new SimplePreLAGClient(mc_protocol);
+  conn->sswitch_client = new SimpleSwitchClient(sswitch_protocol);
+  return conn;
+}
+
+void close_all_conns(DevicePool *pool) {
+  for (auto &conn : pool->conns) conn->transport->close();
+  pool->conns.clear();
+}
+
+// Acquiring a connection never blocks as long as one of them is idle: we probe
+// the connections with try_lock, starting from a different one each time so
+// that concurrent callers spread over the pool. We only block (on the
+// connection we started from) when all of them are in use.
+template <typename T, typename F>
+T acquire(conn_mgr_t *conn_mgr_state, int dev_id, F get_client) {
+  auto &pool = conn_mgr_state->devices[dev_id];
+  const size_t num_conns = pool.conns.size();
+  assert(num_conns > 0);
+  const size_t start = pool.next.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i = 0; i < num_conns; i++) {
+    auto &conn = pool.conns[(start + i) % num_conns];
+    std::unique_lock<std::mutex> lock(conn->mutex, std::try_to_lock);
+    if (lock.owns_lock()) return {get_client(conn.get()), std::move(lock)};
+  }
+  auto &conn = pool.conns[start % num_conns];
+  return {get_client(conn.get()), std::unique_lock<std::mutex>(conn->mutex)};
+}
+
+}  // namespace
+
+conn_mgr_t *conn_mgr_create() {
+  conn_mgr_t *conn_mgr_state = new conn_mgr_t();
+  return conn_mgr_state;
+}
+
+void conn_mgr_destroy(conn_mgr_t *conn_mgr_state) {
+  for (auto &pool : conn_mgr_state->devices) close_all_conns(&pool);
+  delete conn_mgr_state;
+}
+
+int conn_mgr_client_init(conn_mgr_t *conn_mgr_state, int dev_id,
+                         int thrift_port_num, int num_conns) {
+  auto &pool = conn_mgr_state->devices[dev_id];
+  assert(pool.conns.empty());
+  assert(num_conns > 0);
+
+  for (int i = 0; i < num_conns; i++) {
+    auto conn = open_one_conn(dev_id, thrift_port_num);
+    if (!conn) {
+      close_all_conns(&pool);
+      return 1;
+    }
+    pool.conns.push_back(std::move(conn));
+  }
+  pool.next = 0;
 
   return 0;
 }
 
 int conn_mgr_client_close(conn_mgr_t *conn_mgr_state, int dev_id) {
-  assert(conn_mgr_state->clients[dev_id].client);
-  conn_mgr_state->transports[dev_id]->close();
-  delete conn_mgr_state->clients[dev_id].client;
-  delete conn_mgr_state->clients[dev_id].mc_client;
-  delete conn_mgr_state->clients[dev_id].sswitch_client;
-  conn_mgr_state->clients[dev_id].client = NULL;
-  conn_mgr_state->clients[dev_id].mc_client = NULL;
-  conn_mgr_state->clients[dev_id].sswitch_client = NULL;
+  auto &pool = conn_mgr_state->devices[dev_id];
+  assert(!pool.conns.empty());
+  close_all_conns(&pool);
   return 0;
 }
 
 Client conn_mgr_client(conn_mgr_t *conn_mgr_state, int dev_id) {
-  auto &state = conn_mgr_state->clients[dev_id];
-  return {state.client, std::unique_lock<std::mutex>(state.mutex)};
+  return acquire<Client>(conn_mgr_state, dev_id,
+                         [](ConnImp *conn) { return conn->client; });
 }
 
 McClient conn_mgr_mc_client(conn_mgr_t *conn_mgr_state, int dev_id) {
-  auto &state = conn_mgr_state->clients[dev_id];
-  return {state.mc_client, std::unique_lock<std::mutex>(state.mutex)};
+  return acquire<McClient>(conn_mgr_state, dev_id,
+                           [](ConnImp *conn) { return conn->mc_client; });
 }
 
 SSwitchClient conn_mgr_sswitch_client(conn_mgr_t *conn_mgr_state, int dev_id) {
-  auto &state = conn_mgr_state->clients[dev_id];
-  return {state.sswitch_client, std::unique_lock<std::mutex>(state.mutex)};
+  return acquire<SSwitchClient>(
+      conn_mgr_state, dev_id,
+      [](ConnImp *conn) { return conn->sswitch_client; });
 }
 
 }  // namespace pibmv2
@@ -50,6 +50,14 @@ struct SSwitchClient {
 
 struct conn_mgr_t;
 
+// Each device gets a pool of independent Thrift connections; a call to
+// conn_mgr_client() (or its mc / sswitch variants) grabs whichever connection
+// is currently idle, so a long-running read (e.g. a table fetch or a counter
+// poll) does not hold up writes issued concurrently by other sessions. The
+// connection is returned to the pool when the returned object goes out of
+// scope.
+constexpr int kConnMgrDefaultNumConns = 4;
+
 conn_mgr_t *conn_mgr_create();
 void conn_mgr_destroy(conn_mgr_t *conn_mgr_state);
 
@@ -57,7 +65,8 @@ Client conn_mgr_client(conn_mgr_t *, int dev_id);
 McClient conn_mgr_mc_client(conn_mgr_t *, int dev_id);
 SSwitchClient conn_mgr_sswitch_client(conn_mgr_t *, int dev_id);
 
-int conn_mgr_client_init(conn_mgr_t *, int dev_id, int thrift_port_num);
+int conn_mgr_client_init(conn_mgr_t *, int dev_id, int thrift_port_num,
+                         int num_conns = kConnMgrDefaultNumConns);
 int conn_mgr_client_close(conn_mgr_t *, int dev_id);
 
 }  // namespace pibmv2
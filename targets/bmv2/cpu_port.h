@@ -0,0 +1,64 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#ifndef PI_BMV2_CPU_PORT_H_
+#define PI_BMV2_CPU_PORT_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <cstdint>
+
+namespace pibmv2 {
+
+// Interface to the CPU port of a bmv2 device, used by CpuSendRecv to exchange
+// packets with the control plane. There are 2 implementations: one based on
+// libpcap, which is the default, and one based on an AF_PACKET socket with
+// TPACKET_V3 mmap'd rings (Linux only).
+class CpuPort {
+ public:
+  // the packet data is only valid for the duration of the call
+  using PacketCb = std::function<void(const char *pkt, size_t size)>;
+
+  virtual ~CpuPort() { }
+
+  // can be used with select / epoll; readable when recv_burst has packets to
+  // process
+  virtual int get_fd() const = 0;
+
+  // processes received packets, returns the number of packets given to cb
+  virtual size_t recv_burst(const PacketCb &cb) = 0;
+
+  // returns 0 on success
+  virtual int send(const char *pkt, size_t size) = 0;
+
+  // number of packets accepted by send which the kernel later refused to
+  // transmit because they were malformed; only the TPACKET_V3 backend can
+  // tell these apart from other send errors
+  virtual uint64_t get_tx_malformed() const { return 0; }
+
+  // both return nullptr on error
+  static std::unique_ptr<CpuPort> make_pcap(const std::string &iface);
+  static std::unique_ptr<CpuPort> make_tpacket_v3(const std::string &iface);
+};
+
+}  // namespace pibmv2
+
+#endif  // PI_BMV2_CPU_PORT_H_
@@ -0,0 +1,159 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Measures the packet rate of a CpuPort backend. Packets are sent on one
+// interface and received on another one (typically the 2 ends of a veth pair,
+// see cpu_port_bench.sh). Each packet carries a sequence number, which lets us
+// count lost and reordered packets.
+// Usage: cpu_port_bench pcap|tpacket_v3 <tx iface> <rx iface> [num packets]
+//        [packet size]
+
+#include <arpa/inet.h>
+#include <poll.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "cpu_port.h"
+
+namespace {
+
+// IEEE local experimental ethertype, so that we can ignore the packets sent by
+// the kernel itself on the interfaces (e.g. IPv6 neighbor discovery)
+constexpr uint16_t kEtherType = 0x88b5;
+constexpr size_t kEthHdrSize = 14;
+constexpr size_t kMinPktSize = kEthHdrSize + sizeof(uint64_t);
+
+std::unique_ptr<pibmv2::CpuPort> make_port(const std::string &backend,
+                                           const std::string &iface) {
+  if (backend == "pcap") return pibmv2::CpuPort::make_pcap(iface);
+  if (backend == "tpacket_v3") return pibmv2::CpuPort::make_tpacket_v3(iface);
+  return nullptr;
+}
+
+struct RxStats {
+  // also read by the sending thread
+  std::atomic<uint64_t> received{0};
+  uint64_t reordered{0};
+};
+
+void recv_loop(pibmv2::CpuPort *port, uint64_t num_pkts,
+               const std::atomic<bool> *stop, RxStats *stats) {
+  uint64_t next_seq = 0;
+  auto cb = [stats, &next_seq](const char *pkt, size_t size) {
+    if (size < kMinPktSize) return;
+    uint16_t ether_type;
+    std::memcpy(&ether_type, pkt + 12, sizeof(ether_type));
+    if (ether_type != htons(kEtherType)) return;
+    uint64_t seq;
+    std::memcpy(&seq, pkt + kEthHdrSize, sizeof(seq));
+    if (seq < next_seq)
+      stats->reordered++;
+    else
+      next_seq = seq + 1;
+    stats->received++;
+  };
+  struct pollfd pfd;
+  pfd.fd = port->get_fd();
+  pfd.events = POLLIN;
+  while (stats->received < num_pkts && !*stop) {
+    if (poll(&pfd, 1, 100) > 0) port->recv_burst(cb);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0] << " pcap|tpacket_v3 <tx iface> "
+              << "<rx iface> [num packets] [packet size]\n";
+    return 1;
+  }
+  std::string backend(argv[1]);
+  uint64_t num_pkts = (argc > 4) ? std::strtoull(argv[4], nullptr, 0) : 200000;
+  size_t pkt_size = (argc > 5) ? std::strtoul(argv[5], nullptr, 0) : 64;
+  if (pkt_size < kMinPktSize) pkt_size = kMinPktSize;
+
+  auto tx_port = make_port(backend, argv[2]);
+  auto rx_port = make_port(backend, argv[3]);
+  if (!tx_port || !rx_port) {
+    std::cerr << "Cannot open " << backend << " ports (are you root?)\n";
+    return 1;
+  }
+
+  RxStats stats;
+  std::atomic<bool> stop{false};
+  std::thread receiver(recv_loop, rx_port.get(), num_pkts, &stop, &stats);
+
+  // broadcast destination, zero source
+  std::vector<char> pkt(pkt_size, 0);
+  std::memset(pkt.data(), 0xff, 6);
+  uint16_t ether_type = htons(kEtherType);
+  std::memcpy(pkt.data() + 12, &ether_type, sizeof(ether_type));
+
+  uint64_t send_failures = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t seq = 0; seq < num_pkts; seq++) {
+    std::memcpy(pkt.data() + kEthHdrSize, &seq, sizeof(seq));
+    // the TX ring may be full, we give the kernel some time to drain it
+    int attempts = 0;
+    while (tx_port->send(pkt.data(), pkt.size()) != 0) {
+      if (++attempts == 1000) {
+        send_failures++;
+        break;
+      }
+      std::this_thread::yield();
+    }
+  }
+  auto sent_time = std::chrono::steady_clock::now();
+
+  // we give the last packets 1 second to arrive
+  auto deadline = sent_time + std::chrono::seconds(1);
+  while (stats.received < num_pkts - send_failures &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  stop = true;
+  receiver.join();
+  auto end = std::chrono::steady_clock::now();
+
+  std::chrono::duration<double> elapsed = end - start;
+  std::cout << "backend: " << backend << "\n"
+            << "packet size: " << pkt_size << " bytes\n"
+            << "sent: " << (num_pkts - send_failures)
+            << " (send failures: " << send_failures
+            << ", malformed: " << tx_port->get_tx_malformed() << ")\n"
+            << "received: " << stats.received
+            << " (reordered: " << stats.reordered << ")\n"
+            << "elapsed: " << elapsed.count() << " s\n"
+            << "rate: " << static_cast<uint64_t>(stats.received /
+                                                 elapsed.count())
+            << " packets/s\n";
+  return (stats.received == num_pkts && stats.reordered == 0) ? 0 : 2;
+}
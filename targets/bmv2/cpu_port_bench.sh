@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+
+# Reproduces the CPU port throughput measurements: creates a veth pair and runs
+# cpu_port_bench for both backends, sending on one end of the pair and
+# receiving on the other one. Needs to be run as root, after
+# "make cpu_port_bench" in this directory.
+# Usage: cpu_port_bench.sh [num packets] [packet size]
+
+set -e
+
+THIS_DIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )
+BENCH=${BENCH:-$THIS_DIR/cpu_port_bench}
+NUM_PKTS=${1:-200000}
+PKT_SIZE=${2:-64}
+
+VETH0=pibench0
+VETH1=pibench1
+
+cleanup() {
+    ip link del $VETH0 2>/dev/null || true
+}
+trap cleanup EXIT
+
+cleanup
+ip link add $VETH0 type veth peer name $VETH1
+for intf in $VETH0 $VETH1; do
+    ip link set dev $intf up
+    # avoid IPv6 traffic generated by the kernel on the interfaces
+    sysctl -q net.ipv6.conf.$intf.disable_ipv6=1 || true
+done
+
+for backend in pcap tpacket_v3; do
+    echo "----------------------------------------"
+    $BENCH $backend $VETH0 $VETH1 $NUM_PKTS $PKT_SIZE || \
+        echo "FAILED (exit code $?)"
+done
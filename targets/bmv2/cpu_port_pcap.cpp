@@ -0,0 +1,111 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#include "cpu_port.h"
+
+#include <pcap/pcap.h>
+
+#include <memory>
+#include <string>
+
+namespace pibmv2 {
+
+namespace {
+
+class CpuPortPcap : public CpuPort {
+ public:
+  explicit CpuPortPcap(pcap_t *pcap, int fd)
+      : pcap(pcap), fd(fd) { }
+
+  ~CpuPortPcap() override {
+    pcap_close(pcap);
+  }
+
+  int get_fd() const override { return fd; }
+
+  // we only read one packet per call, pcap_next_ex would block otherwise
+  size_t recv_burst(const PacketCb &cb) override {
+    struct pcap_pkthdr *pkt_header;
+    const unsigned char *pkt_data;
+
+    if (pcap_next_ex(pcap, &pkt_header, &pkt_data) != 1) return 0;
+
+    if (pkt_header->caplen != pkt_header->len) return 0;
+
+    cb(reinterpret_cast<const char *>(pkt_data),
+       static_cast<size_t>(pkt_header->len));
+    return 1;
+  }
+
+  int send(const char *pkt, size_t size) override {
+    return pcap_sendpacket(pcap, reinterpret_cast<const unsigned char *>(pkt),
+                           static_cast<int>(size));
+  }
+
+ private:
+  pcap_t *pcap;
+  int fd;
+};
+
+}  // namespace
+
+std::unique_ptr<CpuPort>
+CpuPort::make_pcap(const std::string &iface) {
+  char errbuf[PCAP_ERRBUF_SIZE];
+  pcap_t *pcap = pcap_create(iface.c_str(), errbuf);
+
+  if (!pcap) return nullptr;
+
+  if (pcap_set_promisc(pcap, 1) != 0) {
+    pcap_close(pcap);
+    return nullptr;
+  }
+
+#ifdef WITH_PCAP_FIX
+  if (pcap_set_timeout(pcap, 1) != 0) {
+    pcap_close(pcap);
+    return nullptr;
+  }
+
+  if (pcap_set_immediate_mode(pcap, 1) != 0) {
+    pcap_close(pcap);
+    return nullptr;
+  }
+#endif
+
+  if (pcap_activate(pcap) != 0) {
+    pcap_close(pcap);
+    return nullptr;
+  }
+
+  int fd = pcap_get_selectable_fd(pcap);
+  if (fd < 0) {
+    pcap_close(pcap);
+    return nullptr;
+  }
+
+  // if (pcap_setnonblock(pcap, 1, errbuf) < 0) {
+  //   pcap_close(pcap);
+  //   return nullptr;
+  // }
+
+  return std::unique_ptr<CpuPort>(new CpuPortPcap(pcap, fd));
+}
+
+}  // namespace pibmv2
@@ -0,0 +1,279 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#include "cpu_port.h"
+
+#include <memory>
+#include <string>
+
+#ifdef WITH_TPACKET_V3
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+
+#include <cerrno>
+#include <cstring>
+
+namespace pibmv2 {
+
+namespace {
+
+// The RX ring is made of blocks, each of which can hold many packets. The
+// kernel hands over a block to us when it is full or when it times out
+// (kRetireBlockTovMs), and we process all the packets it contains in one go,
+// directly from the shared memory. The TX ring is made of fixed-size frames.
+class CpuPortTpacketV3 : public CpuPort {
+ public:
+  static constexpr unsigned int kBlockSize = 1 << 18;
+  static constexpr unsigned int kBlockNr = 64;
+  static constexpr unsigned int kFrameSize = 1 << 11;
+  static constexpr unsigned int kRetireBlockTovMs = 1;
+  static constexpr unsigned int kTxBlockSize = 1 << 16;
+  static constexpr unsigned int kTxBlockNr = 16;
+
+  ~CpuPortTpacketV3() override {
+    if (ring != MAP_FAILED) munmap(ring, ring_size);
+    if (fd >= 0) close(fd);
+  }
+
+  int get_fd() const override { return fd; }
+
+  size_t recv_burst(const PacketCb &cb) override {
+    size_t num_pkts = 0;
+    while (true) {
+      auto *block = reinterpret_cast<struct tpacket_block_desc *>(
+          rx_ring + rx_block * kBlockSize);
+      if (!(block_status(block) & TP_STATUS_USER)) break;
+
+      auto num_pkts_in_block = block->hdr.bh1.num_pkts;
+      auto *hdr = reinterpret_cast<struct tpacket3_hdr *>(
+          reinterpret_cast<char *>(block) + block->hdr.bh1.offset_to_first_pkt);
+      for (decltype(num_pkts_in_block) i = 0; i < num_pkts_in_block; i++) {
+        // drop truncated packets, like for pcap
+        if (hdr->tp_snaplen == hdr->tp_len) {
+          cb(reinterpret_cast<const char *>(hdr) + hdr->tp_mac,
+             static_cast<size_t>(hdr->tp_snaplen));
+          num_pkts++;
+        }
+        hdr = reinterpret_cast<struct tpacket3_hdr *>(
+            reinterpret_cast<char *>(hdr) + hdr->tp_next_offset);
+      }
+
+      // give the block back to the kernel
+      release_block(block);
+      rx_block = (rx_block + 1) % kBlockNr;
+    }
+    return num_pkts;
+  }
+
+  int send(const char *pkt, size_t size) override {
+    if (!tx_ring) {
+      return (::send(fd, pkt, size, 0) == static_cast<ssize_t>(size)) ? 0 : -1;
+    }
+    if (size > kFrameSize - kTxDataOffset) return -1;
+
+    std::unique_lock<std::mutex> lock(tx_mutex);
+    auto *hdr = reinterpret_cast<struct tpacket3_hdr *>(
+        tx_ring + tx_frame * kFrameSize);
+    auto status = frame_status(hdr);
+    // the kernel refused to send the packet previously written to this frame,
+    // we report it and reuse the frame
+    if (status & TP_STATUS_WRONG_FORMAT) {
+      report_malformed();
+      status = TP_STATUS_AVAILABLE;
+    }
+    // ring is full, the kernel has not yet sent the frame
+    if (status != TP_STATUS_AVAILABLE) return -1;
+
+    std::memcpy(reinterpret_cast<char *>(hdr) + kTxDataOffset, pkt, size);
+    hdr->tp_len = static_cast<uint32_t>(size);
+    hdr->tp_next_offset = 0;
+    set_frame_status(hdr, TP_STATUS_SEND_REQUEST);
+    tx_frame = (tx_frame + 1) % kTxFrameNr;
+
+    // non-blocking: frames which cannot be sent right away stay in the ring
+    // and will be sent on the next call
+    if (::send(fd, nullptr, 0, MSG_DONTWAIT) < 0 &&
+        errno != EAGAIN && errno != ENOBUFS) {
+      // we do not set PACKET_LOSS, so the kernel stops at the first malformed
+      // frame and flags it with TP_STATUS_WRONG_FORMAT; if it is not the one
+      // we just wrote, it is reported when we get back to it
+      if (frame_status(hdr) & TP_STATUS_WRONG_FORMAT) {
+        report_malformed();
+        set_frame_status(hdr, TP_STATUS_AVAILABLE);
+      }
+      return -1;
+    }
+    return 0;
+  }
+
+  uint64_t get_tx_malformed() const override { return tx_malformed.load(); }
+
+  static std::unique_ptr<CpuPort> make(const std::string &iface);
+
+ private:
+  // the kernel expects packet data to start right after the header for TX
+  static constexpr size_t kTxDataOffset =
+      TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+  static constexpr unsigned int kTxFrameNr =
+      kTxBlockSize / kFrameSize * kTxBlockNr;
+
+  CpuPortTpacketV3() = default;
+
+  static uint32_t block_status(struct tpacket_block_desc *block) {
+    return __atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+  }
+
+  static void release_block(struct tpacket_block_desc *block) {
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+  }
+
+  static uint32_t frame_status(struct tpacket3_hdr *hdr) {
+    return __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+  }
+
+  static void set_frame_status(struct tpacket3_hdr *hdr, uint32_t status) {
+    __atomic_store_n(&hdr->tp_status, status, __ATOMIC_RELEASE);
+  }
+
+  // no log here, a misbehaving sender could flood it from the packet path;
+  // the count is exported by pi_bmv2_get_cpu_port_stats
+  void report_malformed() { tx_malformed++; }
+
+  int fd{-1};
+  void *ring{MAP_FAILED};
+  size_t ring_size{0};
+  char *rx_ring{nullptr};
+  char *tx_ring{nullptr};  // nullptr if TX ring is not supported
+  unsigned int rx_block{0};
+  unsigned int tx_frame{0};
+  std::mutex tx_mutex{};
+  std::atomic<uint64_t> tx_malformed{0};
+};
+
+constexpr unsigned int CpuPortTpacketV3::kBlockSize;
+constexpr unsigned int CpuPortTpacketV3::kBlockNr;
+constexpr unsigned int CpuPortTpacketV3::kFrameSize;
+constexpr unsigned int CpuPortTpacketV3::kTxBlockSize;
+constexpr unsigned int CpuPortTpacketV3::kTxBlockNr;
+constexpr unsigned int CpuPortTpacketV3::kTxFrameNr;
+constexpr size_t CpuPortTpacketV3::kTxDataOffset;
+
+std::unique_ptr<CpuPort>
+CpuPortTpacketV3::make(const std::string &iface) {
+  std::unique_ptr<CpuPortTpacketV3> port(new CpuPortTpacketV3());
+
+  unsigned int ifindex = if_nametoindex(iface.c_str());
+  if (ifindex == 0) return nullptr;
+
+  port->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (port->fd < 0) return nullptr;
+
+  int version = TPACKET_V3;
+  if (setsockopt(port->fd, SOL_PACKET, PACKET_VERSION,
+                 &version, sizeof(version)) < 0) {
+    return nullptr;
+  }
+
+  struct tpacket_req3 rx_req;
+  std::memset(&rx_req, 0, sizeof(rx_req));
+  rx_req.tp_block_size = kBlockSize;
+  rx_req.tp_block_nr = kBlockNr;
+  rx_req.tp_frame_size = kFrameSize;
+  rx_req.tp_frame_nr = kBlockSize / kFrameSize * kBlockNr;
+  rx_req.tp_retire_blk_tov = kRetireBlockTovMs;
+  if (setsockopt(port->fd, SOL_PACKET, PACKET_RX_RING,
+                 &rx_req, sizeof(rx_req)) < 0) {
+    return nullptr;
+  }
+  size_t rx_ring_size = static_cast<size_t>(kBlockSize) * kBlockNr;
+
+  // TX rings are only supported with TPACKET_V3 since Linux 4.11, we fall back
+  // to send() for older kernels
+  struct tpacket_req3 tx_req;
+  std::memset(&tx_req, 0, sizeof(tx_req));
+  tx_req.tp_block_size = kTxBlockSize;
+  tx_req.tp_block_nr = kTxBlockNr;
+  tx_req.tp_frame_size = kFrameSize;
+  tx_req.tp_frame_nr = kTxFrameNr;
+  bool has_tx_ring = (setsockopt(port->fd, SOL_PACKET, PACKET_TX_RING,
+                                 &tx_req, sizeof(tx_req)) == 0);
+  size_t tx_ring_size =
+      has_tx_ring ? static_cast<size_t>(kTxBlockSize) * kTxBlockNr : 0;
+
+  port->ring_size = rx_ring_size + tx_ring_size;
+  port->ring = mmap(nullptr, port->ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, port->fd, 0);
+  if (port->ring == MAP_FAILED) return nullptr;
+  port->rx_ring = static_cast<char *>(port->ring);
+  if (has_tx_ring) port->tx_ring = port->rx_ring + rx_ring_size;
+
+  struct sockaddr_ll addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = static_cast<int>(ifindex);
+  if (bind(port->fd, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) < 0) {
+    return nullptr;
+  }
+
+  struct packet_mreq mreq;
+  std::memset(&mreq, 0, sizeof(mreq));
+  mreq.mr_ifindex = static_cast<int>(ifindex);
+  mreq.mr_type = PACKET_MR_PROMISC;
+  if (setsockopt(port->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                 &mreq, sizeof(mreq)) < 0) {
+    return nullptr;
+  }
+
+  return std::unique_ptr<CpuPort>(port.release());
+}
+
+}  // namespace
+
+std::unique_ptr<CpuPort>
+CpuPort::make_tpacket_v3(const std::string &iface) {
+  return CpuPortTpacketV3::make(iface);
+}
+
+}  // namespace pibmv2
+
+#else
+
+namespace pibmv2 {
+
+std::unique_ptr<CpuPort>
+CpuPort::make_tpacket_v3(const std::string &iface) {
+  (void) iface;
+  return nullptr;
+}
+
+}  // namespace pibmv2
+
+#endif  // WITH_TPACKET_V3
@@ -23,26 +23,139 @@
 #include <PI/pi.h>
 #include <PI/target/pi_imp.h>
 
-#include <pcap/pcap.h>
-
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <cassert>
+#include <cerrno>
+#include <cstdint>
 
 namespace pibmv2 {
 
-CpuSendRecv::CpuSendRecv() {
-  FD_ZERO(&fds);
+namespace {
+
+// Bounded single-producer / single-consumer queue of packets. Slot buffers are
+// reused, so once the queue has warmed up there is no memory allocation.
+class PacketQueue {
+ public:
+  explicit PacketQueue(size_t depth)
+      : slots(round_up_pow2(std::max<size_t>(depth, 2))),
+        mask(slots.size() - 1) { }
+
+  // producer only, returns false if the queue is full
+  bool push(const char *pkt, size_t size) {
+    auto t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+    slots[t & mask].assign(pkt, pkt + size);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only, returns the number of packets given to f
+  template <typename F>
+  size_t drain(F f) {
+    auto h = head.load(std::memory_order_relaxed);
+    auto t = tail.load(std::memory_order_acquire);
+    size_t n = 0;
+    for (; h != t; h++, n++) {
+      const auto &slot = slots[h & mask];
+      f(slot.data(), slot.size());
+      head.store(h + 1, std::memory_order_release);
+    }
+    return n;
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_acquire) ==
+        tail.load(std::memory_order_acquire);
+  }
+
+ private:
+  static size_t round_up_pow2(size_t v) {
+    size_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+  }
+
+  std::vector<std::vector<char> > slots;
+  const size_t mask;
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+}  // namespace
+
+struct CpuSendRecv::Worker {
+  // sleeping is checked with the mutex held: the worker sets it and checks its
+  // queues for packets under the same mutex, so either it sees the packets we
+  // just pushed or we see it sleeping
+  void notify() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (sleeping) cv.notify_one();
+  }
+
+  std::thread thread{};
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  // protected by mutex
+  bool sleeping{false};
+};
+
+struct CpuSendRecv::Device {
+  Device(const std::string &cpu_iface, pi_dev_id_t dev_id,
+         std::unique_ptr<CpuPort> port, Worker *worker, size_t queue_depth)
+      : cpu_iface(cpu_iface), dev_id(dev_id), port(std::move(port)),
+        worker(worker), queue(queue_depth) { }
+
+  std::string cpu_iface;
+  pi_dev_id_t dev_id;
+  std::unique_ptr<CpuPort> port;
+  // nullptr if callbacks are run by the receive thread
+  Worker *worker;
+  PacketQueue queue;
+  std::atomic<uint64_t> drops{0};
+};
+
+constexpr size_t CpuSendRecv::kDefaultNumWorkers;
+constexpr size_t CpuSendRecv::kMaxWorkers;
+constexpr size_t CpuSendRecv::kDefaultQueueDepth;
+
+CpuSendRecv::CpuSendRecv()
+    : devices(std::make_shared<const DeviceList>()) {
+  epoll_fd = epoll_create1(0);
+  assert(epoll_fd >= 0);
+  stop_fd = eventfd(0, 0);
+  assert(stop_fd >= 0);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = UINT64_MAX;  // cannot be a device id
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event);
 }
 
 CpuSendRecv::~CpuSendRecv() {
-  {
-    std::unique_lock<std::mutex> lock(mutex);
-    stop_recv_thread = true;
+  stop = true;
+  uint64_t one = 1;
+  if (write(stop_fd, &one, sizeof(one)) != sizeof(one)) assert(0);
+  if (recv_thread.joinable()) recv_thread.join();
+  for (size_t i = 0; i < num_workers; i++) {
+    {
+      std::unique_lock<std::mutex> lock(workers[i]->mutex);
+      workers[i]->cv.notify_one();
+    }
+    workers[i]->thread.join();
   }
-  recv_thread.join();
+  close(stop_fd);
+  close(epoll_fd);
 }
 
 void
@@ -50,99 +163,102 @@ CpuSendRecv::start() {
   recv_thread = std::thread(&CpuSendRecv::recv_loop, this);
 }
 
-int
-CpuSendRecv::add_device(const std::string &cpu_iface, pi_dev_id_t dev_id) {
-  OneDevice device = {cpu_iface, dev_id, nullptr, -1};
-
-  char errbuf[PCAP_ERRBUF_SIZE];
-  device.pcap = pcap_create(cpu_iface.c_str(), errbuf);
-
-  if (!device.pcap) return -1;
-
-  if (pcap_set_promisc(device.pcap, 1) != 0) {
-    pcap_close(device.pcap);
-    return -1;
-  }
+CpuSendRecv::DeviceListPtr
+CpuSendRecv::get_devices() const {
+  return std::atomic_load(&devices);
+}
 
-#ifdef WITH_PCAP_FIX
-  if (pcap_set_timeout(device.pcap, 1) != 0) {
-    pcap_close(device.pcap);
-    return -1;
+std::shared_ptr<CpuSendRecv::Device>
+CpuSendRecv::get_device(pi_dev_id_t dev_id) const {
+  auto current = get_devices();
+  for (const auto &device : *current) {
+    if (device->dev_id == dev_id) return device;
   }
+  return nullptr;
+}
 
-  if (pcap_set_immediate_mode(device.pcap, 1) != 0) {
-    pcap_close(device.pcap);
-    return -1;
+int
+CpuSendRecv::add_device(const std::string &cpu_iface, pi_dev_id_t dev_id,
+                        Backend backend, size_t num_workers_,
+                        size_t queue_depth) {
+  if (num_workers_ > kMaxWorkers) return -1;
+
+  std::unique_ptr<CpuPort> port;
+  switch (backend) {
+    case Backend::PCAP:
+      port = CpuPort::make_pcap(cpu_iface);
+      break;
+    case Backend::TPACKET_V3:
+      port = CpuPort::make_tpacket_v3(cpu_iface);
+      break;
   }
-#endif
+  if (!port) return -1;
+  int fd = port->get_fd();
 
-  if (pcap_activate(device.pcap) != 0) {
-    pcap_close(device.pcap);
-    return -1;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (; num_workers < num_workers_; num_workers++) {
+    auto *worker = new Worker();
+    workers[num_workers].reset(worker);
+    worker->thread = std::thread(&CpuSendRecv::work_loop, this, worker);
   }
-
-  device.fd = pcap_get_selectable_fd(device.pcap);
-  if (device.fd < 0) {
-    pcap_close(device.pcap);
+  Worker *worker = nullptr;
+  if (num_workers_ > 0) worker = workers[dev_id % num_workers_].get();
+
+  auto new_devices = std::make_shared<DeviceList>(*get_devices());
+  new_devices->push_back(std::make_shared<Device>(
+      cpu_iface, dev_id, std::move(port), worker, queue_depth));
+  std::atomic_store(&devices, DeviceListPtr(std::move(new_devices)));
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = dev_id;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    lock.unlock();
+    remove_device(dev_id);
     return -1;
   }
-
-  // if (pcap_setnonblock(device.pcap, 1, errbuf) < 0) {
-  //   pcap_close(device.pcap);
-  //   return -1;
-  // }
-
-  std::unique_lock<std::mutex> lock(mutex);
-  devices.push_back(std::move(device));
-  if (device.fd > max_fd) max_fd = device.fd;
-  FD_SET(device.fd, &fds);
   return 0;
 }
 
 int
 CpuSendRecv::remove_device(pi_dev_id_t dev_id) {
   std::unique_lock<std::mutex> lock(mutex);
-  auto it = devices.begin();
-  for (; it != devices.end(); it++) {
-    if (it->dev_id == dev_id) break;
+  auto current = get_devices();
+  auto new_devices = std::make_shared<DeviceList>();
+  std::shared_ptr<Device> removed(nullptr);
+  for (const auto &device : *current) {
+    if (device->dev_id == dev_id)
+      removed = device;
+    else
+      new_devices->push_back(device);
   }
-  if (it == devices.end()) return -1;
-  FD_CLR(it->fd, &fds);
-  devices.erase(it);
+  if (!removed) return -1;
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, removed->port->get_fd(), NULL);
+  std::atomic_store(&devices, DeviceListPtr(std::move(new_devices)));
+  // the device object itself is released when the last thread using the old
+  // snapshot is done with it
   return 0;
 }
 
 void
 CpuSendRecv::recv_loop() {
-  int n;
-  fd_set current_fds;
-  int current_max_fd;
+  constexpr int max_events = 16;
+  struct epoll_event events[max_events];
 
-  struct timeval timeout;
   while (1) {
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 100000;
-
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      current_fds = fds;
-      current_max_fd = max_fd;
-    }
-
-    n = select(current_max_fd + 1, &current_fds, NULL, NULL, &timeout);
+    int n = epoll_wait(epoll_fd, events, max_events, -1);
     assert(n >= 0 || errno == EINTR);
 
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      if (stop_recv_thread) return;
-
-      if (n <= 0) continue;
-
-      for (const auto &device : devices) {
-        if (n == 0) break;
-        if (FD_ISSET(device.fd, &current_fds)) {
-          --n;
-          recv_one(device);
+    auto current = get_devices();
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.u64 == UINT64_MAX) return;
+      // we identify devices by id and not by pointer since the device may
+      // have been removed after epoll_wait returned
+      auto dev_id = static_cast<pi_dev_id_t>(events[i].data.u64);
+      for (const auto &device : *current) {
+        if (device->dev_id == dev_id) {
+          recv_one(device.get());
+          break;
         }
       }
     }
@@ -150,34 +266,74 @@ CpuSendRecv::recv_loop() {
 }
 
 void
-CpuSendRecv::recv_one(const OneDevice &device) {
-  struct pcap_pkthdr *pkt_header;
-  const unsigned char *pkt_data;
-
-  if (pcap_next_ex(device.pcap, &pkt_header, &pkt_data) != 1) {
+CpuSendRecv::recv_one(Device *device) {
+  if (!device->worker) {
+    // no copy: pkt points to the backend's buffer
+    device->port->recv_burst([device](const char *pkt, size_t size) {
+      pi_status_t pi_status = pi_packetin_receive(device->dev_id, pkt, size);
+      (void)pi_status;
+    });
     return;
   }
 
-  if (pkt_header->caplen != pkt_header->len) {
-    return;
-  }
+  auto n = device->port->recv_burst([device](const char *pkt, size_t size) {
+    if (!device->queue.push(pkt, size)) device->drops++;
+  });
+  if (n > 0) device->worker->notify();
+}
 
-  size_t size = static_cast<size_t>(pkt_header->len);
-  const char *data = reinterpret_cast<const char *>(pkt_data);
-  pi_status_t pi_status = pi_packetin_receive(device.dev_id, data, size);
-  (void)pi_status;
+void
+CpuSendRecv::work_loop(Worker *worker) {
+  auto drain = [worker](const DeviceList &current) {
+    size_t n = 0;
+    for (const auto &device : current) {
+      if (device->worker != worker) continue;
+      auto dev_id = device->dev_id;
+      n += device->queue.drain([dev_id](const char *pkt, size_t size) {
+        pi_status_t pi_status = pi_packetin_receive(dev_id, pkt, size);
+        (void)pi_status;
+      });
+    }
+    return n;
+  };
+  auto has_pending = [worker](const DeviceList &current) {
+    for (const auto &device : current) {
+      if (device->worker == worker && !device->queue.empty()) return true;
+    }
+    return false;
+  };
+
+  while (!stop) {
+    auto current = get_devices();
+    if (drain(*current) > 0) continue;
+
+    std::unique_lock<std::mutex> lock(worker->mutex);
+    worker->sleeping = true;
+    // the receive thread only notifies us if we are sleeping, so we need to
+    // check for packets again after setting the flag
+    if (!has_pending(*current) && !stop) {
+      // timeout in case a device was added for this worker while we were
+      // waiting: we only check the queues of the devices in our snapshot
+      worker->cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    worker->sleeping = false;
+  }
 }
 
 int
 CpuSendRecv::send_pkt(pi_dev_id_t dev_id, const char *pkt, size_t size) {
-  for (const auto &device : devices) {
-    if (device.dev_id == dev_id) {
-      return pcap_sendpacket(device.pcap,
-                             reinterpret_cast<const unsigned char *>(pkt),
-                             static_cast<int>(size));
-    }
-  }
-  return -2;
+  auto device = get_device(dev_id);
+  if (!device) return -2;
+  return device->port->send(pkt, size);
+}
+
+int
+CpuSendRecv::get_stats(pi_dev_id_t dev_id, DeviceStats *stats) const {
+  auto device = get_device(dev_id);
+  if (!device) return -1;
+  stats->drops = device->drops.load();
+  stats->tx_malformed = device->port->get_tx_malformed();
+  return 0;
 }
 
 }  // namespace pibmv2
@@ -20,43 +20,91 @@
 
 #include <PI/pi.h>
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
-typedef struct pcap pcap_t;
+#include <cstdint>
+
+#include "cpu_port.h"
 
 namespace pibmv2 {
 
+// Packets received on the CPU ports are not given to the application by the
+// receive thread itself (unless there are no workers), but handed over to a
+// pool of worker threads through a bounded single-producer / single-consumer
+// queue per device. This way a slow packet-in callback does not prevent other
+// devices from receiving packets. Each device is served by a single worker, so
+// packet order is preserved. When a device queue is full, packets are dropped
+// and counted.
+// The list of devices is an immutable snapshot, replaced (RCU-style) by
+// add_device / remove_device, so that the data path never takes a lock.
 class CpuSendRecv {
  public:
+  enum class Backend {
+    PCAP,
+    // AF_PACKET socket with TPACKET_V3 rings, see cpu_port_tpacket_v3.cpp
+    TPACKET_V3
+  };
+
+  static constexpr size_t kDefaultNumWorkers = 1;
+  static constexpr size_t kMaxWorkers = 64;
+  static constexpr size_t kDefaultQueueDepth = 1024;
+
   CpuSendRecv();
 
   ~CpuSendRecv();
 
   void start();
-  int add_device(const std::string &cpu_iface, pi_dev_id_t dev_id);
+  // The worker pool is shared by all devices; it is grown as needed to
+  // num_workers threads, but never shrinks. If num_workers is 0, the
+  // packet-in callbacks for the device are called by the receive thread, with
+  // no copy of the packet.
+  int add_device(const std::string &cpu_iface, pi_dev_id_t dev_id,
+                 Backend backend = Backend::PCAP,
+                 size_t num_workers = kDefaultNumWorkers,
+                 size_t queue_depth = kDefaultQueueDepth);
   int remove_device(pi_dev_id_t dev_id);
 
   int send_pkt(pi_dev_id_t dev_id, const char *pkt, size_t size);
 
- private:
-  struct OneDevice {
-    std::string cpu_iface;
-    pi_dev_id_t dev_id;
-    pcap_t *pcap;
-    int fd;
+  struct DeviceStats {
+    // packets dropped because the device queue was full
+    uint64_t drops;
+    // see CpuPort::get_tx_malformed
+    uint64_t tx_malformed;
   };
 
+  // returns -1 if the device was not added
+  int get_stats(pi_dev_id_t dev_id, DeviceStats *stats) const;
+
+ private:
+  struct Device;
+  struct Worker;
+  using DeviceList = std::vector<std::shared_ptr<Device> >;
+  using DeviceListPtr = std::shared_ptr<const DeviceList>;
+
+  DeviceListPtr get_devices() const;
+  std::shared_ptr<Device> get_device(pi_dev_id_t dev_id) const;
+
   void recv_loop();
-  void recv_one(const OneDevice &device);
+  void recv_one(Device *device);
+  void work_loop(Worker *worker);
 
-  fd_set fds;
-  int max_fd{0};
-  std::vector<OneDevice> devices{};
+  int epoll_fd{-1};
+  // used to wake up recv_thread when stopping
+  int stop_fd{-1};
+  // only accessed with std::atomic_load / std::atomic_store
+  DeviceListPtr devices{};
   std::thread recv_thread{};
-  bool stop_recv_thread{false};
+  std::array<std::unique_ptr<Worker>, kMaxWorkers> workers;
+  size_t num_workers{0};
+  std::atomic<bool> stop{false};
+  // serializes add_device / remove_device
   mutable std::mutex mutex{};
 };
 
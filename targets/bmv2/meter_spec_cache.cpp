@@ -0,0 +1,86 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "meter_spec_cache.h"
+
+#include <array>
+#include <vector>
+
+#include "common.h"
+
+namespace pibmv2 {
+
+namespace {
+
+std::array<MeterSpecCache, NUM_DEVICES> meter_spec_cache_state;
+
+}  // namespace
+
+void
+MeterSpecCache::set(pi_p4_id_t meter_id, uint64_t idx,
+                    const pi_meter_spec_t &spec) {
+  std::unique_lock<std::mutex> lock(mutex);
+  specs[Key{meter_id, idx}] = spec;
+}
+
+bool
+MeterSpecCache::get(pi_p4_id_t meter_id, uint64_t idx,
+                    pi_meter_spec_t *spec) const {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto it = specs.find(Key{meter_id, idx});
+  if (it == specs.end()) return false;
+  *spec = it->second;
+  return true;
+}
+
+void
+MeterSpecCache::erase(const std::vector<pi_p4_id_t> &meter_ids, uint64_t idx) {
+  if (meter_ids.empty()) return;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (auto meter_id : meter_ids) specs.erase(Key{meter_id, idx});
+}
+
+void
+MeterSpecCache::clear() {
+  std::unique_lock<std::mutex> lock(mutex);
+  specs.clear();
+}
+
+MeterSpecCache *
+get_meter_spec_cache(pi_dev_id_t dev_id) {
+  return &meter_spec_cache_state.at(dev_id);
+}
+
+pi_meter_spec_t
+complete_meter_spec(const pi_p4info_t *p4info, pi_p4_id_t meter_id,
+                    const pi_meter_spec_t &spec) {
+  pi_meter_spec_t new_spec = spec;
+  if (spec.meter_unit == PI_METER_UNIT_DEFAULT) {
+    new_spec.meter_unit = static_cast<pi_meter_unit_t>(
+        pi_p4info_meter_get_unit(p4info, meter_id));
+  }
+  if (spec.meter_type == PI_METER_TYPE_DEFAULT) {
+    new_spec.meter_type = static_cast<pi_meter_type_t>(
+        pi_p4info_meter_get_type(p4info, meter_id));
+  }
+  return new_spec;
+}
+
+}  // namespace pibmv2
@@ -0,0 +1,88 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_BMV2_METER_SPEC_CACHE_H_
+#define PI_BMV2_METER_SPEC_CACHE_H_
+
+#include <PI/p4info.h>
+#include <PI/pi.h>
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace pibmv2 {
+
+// Write-through cache of the meter configurations set through PI, for both
+// indirect meters (keyed by index) and direct meters (keyed by entry
+// handle). Reading a meter configuration from bmv2 requires a Thrift round
+// trip and a lossy rate conversion, while PI already knows the answer, unless
+// the meter was configured through another channel (e.g. the bmv2 CLI), in
+// which case the PI client can request a read from the device with
+// PI_METER_FLAGS_HW_SYNC.
+// The cache is cleared when the device config is updated or when the device
+// is removed, and direct meter configurations are dropped when the table entry
+// is deleted.
+class MeterSpecCache {
+ public:
+  void set(pi_p4_id_t meter_id, uint64_t idx, const pi_meter_spec_t &spec);
+
+  // returns false if the configuration is not in the cache
+  bool get(pi_p4_id_t meter_id, uint64_t idx, pi_meter_spec_t *spec) const;
+
+  // drops the configuration of all the given meters for index / handle idx
+  void erase(const std::vector<pi_p4_id_t> &meter_ids, uint64_t idx);
+
+  void clear();
+
+ private:
+  struct Key {
+    pi_p4_id_t meter_id;
+    uint64_t idx;
+
+    bool operator==(const Key &other) const {
+      return meter_id == other.meter_id && idx == other.idx;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &k) const {
+      return std::hash<uint64_t>()(
+          k.idx ^ (static_cast<uint64_t>(k.meter_id) << 40));
+    }
+  };
+
+  mutable std::mutex mutex{};
+  std::unordered_map<Key, pi_meter_spec_t, KeyHash> specs{};
+};
+
+MeterSpecCache *get_meter_spec_cache(pi_dev_id_t dev_id);
+
+// replaces PI_METER_UNIT_DEFAULT and PI_METER_TYPE_DEFAULT with the values
+// from the P4 program, so that cached specs look the same as the ones read
+// from the device
+pi_meter_spec_t complete_meter_spec(const pi_p4info_t *p4info,
+                                    pi_p4_id_t meter_id,
+                                    const pi_meter_spec_t &spec);
+
+}  // namespace pibmv2
+
+#endif  // PI_BMV2_METER_SPEC_CACHE_H_
@@ -0,0 +1,190 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#include "p4info_cache.h"
+
+#include <PI/int/serialize.h>
+
+#include <array>
+#include <string>
+#include <utility>
+
+namespace pibmv2 {
+
+using namespace ::bm_runtime::standard;  // NOLINT(build/namespaces)
+
+namespace {
+
+std::array<P4InfoCachePtr, NUM_DEVICES> p4info_cache_state;
+
+}  // namespace
+
+P4InfoCache::P4InfoCache(const pi_p4info_t *p4info) {
+  for (auto a_id = pi_p4info_action_begin(p4info);
+       a_id != pi_p4info_action_end(p4info);
+       a_id = pi_p4info_action_next(p4info, a_id)) {
+    std::string a_name(pi_p4info_action_name_from_id(p4info, a_id));
+    actions.emplace(
+        a_name, ADataSize(a_id, pi_p4info_action_data_size(p4info, a_id)));
+    names.emplace(a_id, std::move(a_name));
+  }
+
+  for (auto t_id = pi_p4info_table_begin(p4info);
+       t_id != pi_p4info_table_end(p4info);
+       t_id = pi_p4info_table_next(p4info, t_id)) {
+    TableInfo t_info;
+    t_info.name = std::string(pi_p4info_table_name_from_id(p4info, t_id));
+    t_info.ap_id = pi_p4info_table_get_implementation(p4info, t_id);
+    t_info.mkey_nbytes = pi_p4info_table_match_key_size(p4info, t_id);
+    t_info.requires_priority = false;
+
+    size_t num_match_fields = pi_p4info_table_num_match_fields(p4info, t_id);
+    for (size_t i = 0; i < num_match_fields; i++) {
+      auto finfo = pi_p4info_table_match_field_info(p4info, t_id, i);
+      BmMatchParam param;
+      switch (finfo->match_type) {
+        case PI_P4INFO_MATCH_TYPE_VALID:
+          param.type = BmMatchParamType::type::VALID;
+          param.__set_valid(BmMatchParamValid());
+          break;
+        case PI_P4INFO_MATCH_TYPE_EXACT:
+          param.type = BmMatchParamType::type::EXACT;
+          param.__set_exact(BmMatchParamExact());
+          break;
+        case PI_P4INFO_MATCH_TYPE_LPM:
+          param.type = BmMatchParamType::type::LPM;
+          param.__set_lpm(BmMatchParamLPM());
+          break;
+        case PI_P4INFO_MATCH_TYPE_TERNARY:
+          param.type = BmMatchParamType::type::TERNARY;
+          param.__set_ternary(BmMatchParamTernary());
+          t_info.requires_priority = true;
+          break;
+        case PI_P4INFO_MATCH_TYPE_RANGE:
+          param.type = BmMatchParamType::type::RANGE;
+          param.__set_range(BmMatchParamRange());
+          t_info.requires_priority = true;
+          break;
+        default:
+          assert(0);
+      }
+      t_info.key_template.push_back(std::move(param));
+      t_info.field_nbytes.push_back((finfo->bitwidth + 7) / 8);
+    }
+
+    size_t num_actions;
+    auto action_ids = pi_p4info_table_get_actions(p4info, t_id, &num_actions);
+    t_info.action_map = ADataSize::compute_action_sizes(p4info, action_ids,
+                                                        num_actions);
+
+    tables.emplace(t_id, std::move(t_info));
+  }
+
+  for (auto ap_id = pi_p4info_act_prof_begin(p4info);
+       ap_id != pi_p4info_act_prof_end(p4info);
+       ap_id = pi_p4info_act_prof_next(p4info, ap_id)) {
+    ActProfInfo ap_info;
+    ap_info.name = std::string(pi_p4info_act_prof_name_from_id(p4info, ap_id));
+    size_t num_actions;
+    auto action_ids = pi_p4info_act_prof_get_actions(p4info, ap_id,
+                                                     &num_actions);
+    ap_info.action_map = ADataSize::compute_action_sizes(p4info, action_ids,
+                                                         num_actions);
+    act_profs.emplace(ap_id, std::move(ap_info));
+  }
+
+  for (auto c_id = pi_p4info_counter_begin(p4info);
+       c_id != pi_p4info_counter_end(p4info);
+       c_id = pi_p4info_counter_next(p4info, c_id)) {
+    names.emplace(c_id,
+                  std::string(pi_p4info_counter_name_from_id(p4info, c_id)));
+    auto t_id = pi_p4info_counter_get_direct(p4info, c_id);
+    auto t_info = table(t_id);
+    if (t_info != nullptr) direct_t_names.emplace(c_id, t_info->name);
+  }
+
+  for (auto m_id = pi_p4info_meter_begin(p4info);
+       m_id != pi_p4info_meter_end(p4info);
+       m_id = pi_p4info_meter_next(p4info, m_id)) {
+    names.emplace(m_id,
+                  std::string(pi_p4info_meter_name_from_id(p4info, m_id)));
+    auto t_id = pi_p4info_meter_get_direct(p4info, m_id);
+    auto it = tables.find(t_id);
+    if (it != tables.end()) {
+      direct_t_names.emplace(m_id, it->second.name);
+      it->second.direct_meters.push_back(m_id);
+    }
+  }
+}
+
+bool
+P4InfoCache::build_match_key(pi_p4_id_t table_id,
+                             const pi_match_key_t *match_key,
+                             BmMatchParams *mkey) const {
+  const auto &t_info = *table(table_id);
+  *mkey = t_info.key_template;
+
+  const char *mk_data = match_key->data;
+  uint32_t pLen;
+
+  for (size_t i = 0; i < mkey->size(); i++) {
+    auto &param = (*mkey)[i];
+    size_t nbytes = t_info.field_nbytes[i];
+    switch (param.type) {
+      case BmMatchParamType::type::VALID:
+        param.valid.key = (*mk_data != 0);
+        mk_data++;
+        break;
+      case BmMatchParamType::type::EXACT:
+        param.exact.key.assign(mk_data, nbytes);
+        mk_data += nbytes;
+        break;
+      case BmMatchParamType::type::LPM:
+        param.lpm.key.assign(mk_data, nbytes);
+        mk_data += nbytes;
+        mk_data += retrieve_uint32(mk_data, &pLen);
+        param.lpm.prefix_length = static_cast<int32_t>(pLen);
+        break;
+      case BmMatchParamType::type::TERNARY:
+        param.ternary.key.assign(mk_data, nbytes);
+        mk_data += nbytes;
+        param.ternary.mask.assign(mk_data, nbytes);
+        mk_data += nbytes;
+        break;
+      case BmMatchParamType::type::RANGE:
+        param.range.start.assign(mk_data, nbytes);
+        mk_data += nbytes;
+        param.range.end_.assign(mk_data, nbytes);
+        mk_data += nbytes;
+        break;
+    }
+  }
+
+  return t_info.requires_priority;
+}
+
+P4InfoCachePtr get_p4info_cache(pi_dev_id_t dev_id) {
+  return std::atomic_load(&p4info_cache_state[dev_id]);
+}
+
+void set_p4info_cache(pi_dev_id_t dev_id, P4InfoCachePtr cache) {
+  std::atomic_store(&p4info_cache_state[dev_id], std::move(cache));
+}
+
+}  // namespace pibmv2
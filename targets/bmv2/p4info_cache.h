@@ -0,0 +1,132 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#ifndef PI_BMV2_P4INFO_CACHE_H_
+#define PI_BMV2_P4INFO_CACHE_H_
+
+#include <PI/int/pi_int.h>
+#include <PI/p4info.h>
+#include <PI/pi.h>
+
+#include <bm/Standard.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+namespace pibmv2 {
+
+// Everything the bmv2 Thrift calls need from the P4Info (object names, action
+// sizes, match key layouts), computed once per device when the device is
+// assigned and every time its config is updated. The call paths used to go
+// through the p4info and build these objects on every call.
+// Instances are immutable once built, which means they can be shared between
+// concurrent sessions without any synchronization.
+class P4InfoCache {
+ public:
+  using ActionMap = std::unordered_map<std::string, ADataSize>;
+
+  struct TableInfo {
+    std::string name;
+    pi_p4_id_t ap_id;
+    size_t mkey_nbytes;
+    bool requires_priority;
+    // one entry per match field, with the type already set, the
+    // build_match_key method only needs to fill in the values
+    ::bm_runtime::standard::BmMatchParams key_template;
+    std::vector<size_t> field_nbytes;
+    // keyed by action name, as returned by bmv2
+    ActionMap action_map;
+    std::vector<pi_p4_id_t> direct_meters;
+  };
+
+  struct ActProfInfo {
+    std::string name;
+    ActionMap action_map;
+  };
+
+  explicit P4InfoCache(const pi_p4info_t *p4info);
+
+  // All the lookups return nullptr if the id / name is unknown: the callers are
+  // extern "C" functions and report an error status instead.
+
+  const TableInfo *table(pi_p4_id_t table_id) const {
+    return find(tables, table_id);
+  }
+
+  const ActProfInfo *act_prof(pi_p4_id_t act_prof_id) const {
+    return find(act_profs, act_prof_id);
+  }
+
+  const std::string *action_name(pi_p4_id_t action_id) const {
+    return find(names, action_id);
+  }
+
+  const std::string *counter_name(pi_p4_id_t counter_id) const {
+    return find(names, counter_id);
+  }
+
+  const std::string *meter_name(pi_p4_id_t meter_id) const {
+    return find(names, meter_id);
+  }
+
+  // name of the table a direct counter / meter is attached to
+  const std::string *direct_t_name(pi_p4_id_t res_id) const {
+    return find(direct_t_names, res_id);
+  }
+
+  const ADataSize *action_from_name(const std::string &a_name) const {
+    return find(actions, a_name);
+  }
+
+  // returns true iff priority needs to be set in the entry options; table_id
+  // must be known to the cache
+  bool build_match_key(pi_p4_id_t table_id, const pi_match_key_t *match_key,
+                       ::bm_runtime::standard::BmMatchParams *mkey) const;
+
+ private:
+  template <typename M>
+  static const typename M::mapped_type *find(const M &map,
+                                             const typename M::key_type &k) {
+    auto it = map.find(k);
+    return (it == map.end()) ? nullptr : &it->second;
+  }
+
+  std::unordered_map<pi_p4_id_t, TableInfo> tables{};
+  std::unordered_map<pi_p4_id_t, ActProfInfo> act_profs{};
+  // action, counter and meter names; P4 ids are unique across resource types
+  std::unordered_map<pi_p4_id_t, std::string> names{};
+  std::unordered_map<pi_p4_id_t, std::string> direct_t_names{};
+  ActionMap actions{};
+};
+
+using P4InfoCachePtr = std::shared_ptr<const P4InfoCache>;
+
+// the cache is swapped atomically on config updates, callers keep a reference
+// to it for the duration of the call
+P4InfoCachePtr get_p4info_cache(pi_dev_id_t dev_id);
+
+void set_p4info_cache(pi_dev_id_t dev_id, P4InfoCachePtr cache);
+
+}  // namespace pibmv2
+
+#endif  // PI_BMV2_P4INFO_CACHE_H_
@@ -28,8 +28,10 @@
 #include <vector>
 
 #include "action_helpers.h"
+#include "batch.h"
 #include "common.h"
 #include "conn_mgr.h"
+#include "p4info_cache.h"
 
 namespace pibmv2 {
 
@@ -44,15 +46,19 @@ pi_status_t _pi_act_prof_mbr_create(pi_session_handle_t session_handle,
                                     pi_p4_id_t act_prof_id,
                                     const pi_action_data_t *action_data,
                                     pi_indirect_handle_t *mbr_handle) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto ap_info = cache->act_prof(act_prof_id);
+  auto a_name_ptr = cache->action_name(action_data->action_id);
+  if (ap_info == nullptr || a_name_ptr == nullptr)
+    return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_name = ap_info->name;
+  const auto &a_name = *a_name_ptr;
   auto adata = pibmv2::build_action_data(action_data, p4info);
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
-  std::string a_name(pi_p4info_action_name_from_id(p4info,
-                                                   action_data->action_id));
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
 
@@ -74,12 +80,14 @@ pi_status_t _pi_act_prof_mbr_delete(pi_session_handle_t session_handle,
                                     pi_dev_id_t dev_id,
                                     pi_p4_id_t act_prof_id,
                                     pi_indirect_handle_t mbr_handle) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+  auto ap_info = cache->act_prof(act_prof_id);
+  if (ap_info == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_name = ap_info->name;
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
 
@@ -101,16 +109,20 @@ pi_status_t _pi_act_prof_mbr_modify(pi_session_handle_t session_handle,
                                     pi_p4_id_t act_prof_id,
                                     pi_indirect_handle_t mbr_handle,
                                     const pi_action_data_t *action_data) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
 
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+  auto ap_info = cache->act_prof(act_prof_id);
+  auto a_name_ptr = cache->action_name(action_data->action_id);
+  if (ap_info == nullptr || a_name_ptr == nullptr)
+    return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_name = ap_info->name;
+  const auto &a_name = *a_name_ptr;
   auto adata = pibmv2::build_action_data(action_data, p4info);
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
-  std::string a_name(pi_p4info_action_name_from_id(p4info,
-                                                   action_data->action_id));
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
 
@@ -133,13 +145,15 @@ pi_status_t _pi_act_prof_grp_create(pi_session_handle_t session_handle,
                                     pi_p4_id_t act_prof_id,
                                     size_t max_size,
                                     pi_indirect_handle_t *grp_handle) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
   (void) max_size;  // no bound needed / supported in bmv2
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto ap_info = cache->act_prof(act_prof_id);
+  if (ap_info == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_name = ap_info->name;
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
 
@@ -162,12 +176,14 @@ pi_status_t _pi_act_prof_grp_delete(pi_session_handle_t session_handle,
                                     pi_dev_id_t dev_id,
                                     pi_p4_id_t act_prof_id,
                                     pi_indirect_handle_t grp_handle) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+  auto ap_info = cache->act_prof(act_prof_id);
+  if (ap_info == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_name = ap_info->name;
 
   grp_handle = pibmv2::IndirectHMgr::clear_grp_h(grp_handle);
 
@@ -191,12 +207,14 @@ pi_status_t _pi_act_prof_grp_add_mbr(pi_session_handle_t session_handle,
                                      pi_p4_id_t act_prof_id,
                                      pi_indirect_handle_t grp_handle,
                                      pi_indirect_handle_t mbr_handle) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+  auto ap_info = cache->act_prof(act_prof_id);
+  if (ap_info == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_name = ap_info->name;
 
   grp_handle = pibmv2::IndirectHMgr::clear_grp_h(grp_handle);
 
@@ -221,12 +239,14 @@ pi_status_t _pi_act_prof_grp_remove_mbr(pi_session_handle_t session_handle,
                                         pi_p4_id_t act_prof_id,
                                         pi_indirect_handle_t grp_handle,
                                         pi_indirect_handle_t mbr_handle) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+  auto ap_info = cache->act_prof(act_prof_id);
+  if (ap_info == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_name = ap_info->name;
 
   grp_handle = pibmv2::IndirectHMgr::clear_grp_h(grp_handle);
 
@@ -250,12 +270,16 @@ pi_status_t _pi_act_prof_entries_fetch(pi_session_handle_t session_handle,
                                        pi_dev_id_t dev_id,
                                        pi_p4_id_t act_prof_id,
                                        pi_act_prof_fetch_res_t *res) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
-  std::string ap_name(pi_p4info_act_prof_name_from_id(p4info, act_prof_id));
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+  auto ap_info_ptr = cache->act_prof(act_prof_id);
+  if (ap_info_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &ap_info = *ap_info_ptr;
+  const auto &ap_name = ap_info.name;
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
 
@@ -280,13 +304,14 @@ pi_status_t _pi_act_prof_entries_fetch(pi_session_handle_t session_handle,
     data_size += members.size() * sizeof(s_pi_indirect_handle_t);
     // action id and action data nbytes
     data_size += members.size() * (sizeof(s_pi_p4_id_t) + sizeof(uint32_t));
-    size_t num_actions;
-    auto action_ids = pi_p4info_act_prof_get_actions(p4info, act_prof_id,
-                                                     &num_actions);
-    auto action_map = pibmv2::ADataSize::compute_action_sizes(
-        p4info, action_ids, num_actions);
-    for (const auto &mbr : members)
-      data_size += action_map.at(mbr.action_name).s;
+    const auto &action_map = ap_info.action_map;
+    for (const auto &mbr : members) {
+      // checked here so that the second pass below can assume the lookup
+      // succeeds
+      auto it = action_map.find(mbr.action_name);
+      if (it == action_map.end()) return PI_STATUS_TARGET_ERROR;
+      data_size += it->second.s;
+    }
 
     char *data = new char[data_size];
     res->entries_members_size = data_size;
@@ -294,7 +319,7 @@ pi_status_t _pi_act_prof_entries_fetch(pi_session_handle_t session_handle,
 
     for (const auto &mbr : members) {
       data += emit_indirect_handle(data, mbr.mbr_handle);
-      const auto &adata_size = action_map.at(mbr.action_name);
+      const auto &adata_size = action_map.find(mbr.action_name)->second;
       data += emit_p4_id(data, adata_size.id);
       data += emit_uint32(data, adata_size.s);
       data = pibmv2::dump_action_data(p4info, data, adata_size.id,
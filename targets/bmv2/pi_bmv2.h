@@ -0,0 +1,56 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file
+//! Functions specific to the bmv2 target, installed as
+//! <PI/target/pi_bmv2.h>.
+
+#ifndef PI_BMV2_PI_BMV2_H_
+#define PI_BMV2_PI_BMV2_H_
+
+#include <PI/pi_base.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Counters for the CPU port of a device (see the "cpu_iface" assign extra).
+//! They are reset when the device is removed.
+typedef struct {
+  //! packet-ins dropped because the device queue was full (see the
+  //! "cpu_iface_queue_depth" assign extra)
+  uint64_t packetin_drops;
+  //! packet-outs which the kernel refused to send because they were
+  //! malformed; always 0 with the pcap backend
+  uint64_t packetout_malformed;
+} pi_bmv2_cpu_port_stats_t;
+
+//! Returns PI_STATUS_DEV_NOT_ASSIGNED if the device was assigned without a CPU
+//! interface, or not assigned at all.
+pi_status_t pi_bmv2_get_cpu_port_stats(pi_dev_id_t dev_id,
+                                       pi_bmv2_cpu_port_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PI_BMV2_PI_BMV2_H_
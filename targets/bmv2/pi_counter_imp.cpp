@@ -26,9 +26,11 @@
 #include <string>
 #include <thread>
 
+#include "batch.h"
 #include "common.h"
 #include "conn_mgr.h"
 #include "direct_res_spec.h"
+#include "p4info_cache.h"
 
 namespace pibmv2 {
 
@@ -65,13 +67,6 @@ void merge_current_value(pi_counter_data_t *desired_data,
   }
 }
 
-std::string get_direct_t_name(const pi_p4info_t *p4info, pi_p4_id_t c_id) {
-  pi_p4_id_t t_id = pi_p4info_counter_get_direct(p4info, c_id);
-  // guaranteed by PI common code
-  assert(t_id != PI_INVALID_ID);
-  return std::string(pi_p4info_table_name_from_id(p4info, t_id));
-}
-
 }  // namespace
 
 extern "C" {
@@ -80,13 +75,15 @@ pi_status_t _pi_counter_read(pi_session_handle_t session_handle,
                              pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                              size_t index, int flags,
                              pi_counter_data_t *counter_data) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
   (void)flags;
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string c_name(pi_p4info_counter_name_from_id(p4info, counter_id));
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto c_name_ptr = cache->counter_name(counter_id);
+  if (c_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &c_name = *c_name_ptr;
 
   BmCounterValue value;
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
@@ -109,12 +106,14 @@ pi_status_t _pi_counter_write(pi_session_handle_t session_handle,
                               pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                               size_t index,
                               const pi_counter_data_t *counter_data) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string c_name(pi_p4info_counter_name_from_id(p4info, counter_id));
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto c_name_ptr = cache->counter_name(counter_id);
+  if (c_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &c_name = *c_name_ptr;
 
   // very poor man solution: bmv2 does not (yet) let us set only one of bytes /
   // packets, so we first retrieve the current data and use it
@@ -146,13 +145,15 @@ pi_status_t _pi_counter_read_direct(pi_session_handle_t session_handle,
                                     pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                                     pi_entry_handle_t entry_handle, int flags,
                                     pi_counter_data_t *counter_data) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
   (void)flags;
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string t_name = get_direct_t_name(p4info, counter_id);
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto t_name_ptr = cache->direct_t_name(counter_id);
+  if (t_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = *t_name_ptr;
 
   BmCounterValue value;
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
@@ -176,12 +177,14 @@ pi_status_t _pi_counter_write_direct(pi_session_handle_t session_handle,
                                      pi_p4_id_t counter_id,
                                      pi_entry_handle_t entry_handle,
                                      const pi_counter_data_t *counter_data) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string t_name = get_direct_t_name(p4info, counter_id);
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto t_name_ptr = cache->direct_t_name(counter_id);
+  if (t_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = *t_name_ptr;
 
   // very poor man solution: bmv2 does not (yet) let us set only one of bytes /
   // packets, so we first retrieve the current data and use it
@@ -21,16 +21,20 @@
 #include <PI/pi.h>
 #include <PI/target/pi_imp.h>
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <string>
 
 #include <cstring>  // for memset
 
+#include "batch.h"
 #include "common.h"
 #include "conn_mgr.h"
 #include "cpu_send_recv.h"
-
-#define NUM_DEVICES 256
+#include "meter_spec_cache.h"
+#include "p4info_cache.h"
+#include "pi_bmv2.h"
 
 namespace pibmv2 {
 
@@ -38,8 +42,9 @@ conn_mgr_t *conn_mgr_state = NULL;
 
 device_info_t device_info_state[NUM_DEVICES];
 
-extern void start_learn_listener(const std::string &addr, int rpc_port_num);
-extern void stop_learn_listener();
+extern bool start_learn_listener(pi_dev_id_t dev_id, const std::string &addr);
+extern void stop_learn_listener(pi_dev_id_t dev_id);
+extern void stop_learn_listeners();
 
 }  // namespace pibmv2
 
@@ -47,6 +52,8 @@ namespace {
 
 pibmv2::CpuSendRecv *cpu_send_recv = nullptr;
 
+std::atomic<pi_session_handle_t> next_session_handle{0};
+
 }  // namespace
 
 extern "C" {
@@ -65,7 +72,13 @@ pi_status_t _pi_assign_device(pi_dev_id_t dev_id, const pi_p4info_t *p4info,
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(!d_info->assigned);
   int rpc_port_num = -1;
+  int num_thrift_conns = pibmv2::kConnMgrDefaultNumConns;
+  bool pipeline_batches = false;
   std::string bm_notifications_addr("");
+  std::string cpu_iface("");
+  auto cpu_iface_backend = pibmv2::CpuSendRecv::Backend::PCAP;
+  size_t cpu_iface_workers = pibmv2::CpuSendRecv::kDefaultNumWorkers;
+  size_t cpu_iface_queue_depth = pibmv2::CpuSendRecv::kDefaultQueueDepth;
   for (; !extra->end_of_extras; extra++) {
     std::string key(extra->key);
     if (key == "port" && extra->v) {
@@ -75,21 +88,69 @@ pi_status_t _pi_assign_device(pi_dev_id_t dev_id, const pi_p4info_t *p4info,
       catch (const std::exception& e) {
         return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
       }
+    } else if (key == "num_thrift_conns" && extra->v) {
+      try {
+        num_thrift_conns = std::stoi(std::string(extra->v), nullptr, 0);
+      }
+      catch (const std::exception& e) {
+        return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+      }
+      if (num_thrift_conns <= 0) return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+    } else if (key == "pipeline_batches" && extra->v) {
+      pipeline_batches = (std::string(extra->v) == "1" ||
+                          std::string(extra->v) == "true");
     } else if (key == "notifications" && extra->v) {
       bm_notifications_addr = std::string(extra->v);
     } else if (key == "cpu_iface" && extra->v) {
-      int rc = cpu_send_recv->add_device(std::string(extra->v), dev_id);
-      if (rc < 0) return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+      cpu_iface = std::string(extra->v);
+    } else if (key == "cpu_iface_backend" && extra->v) {
+      std::string backend(extra->v);
+      if (backend == "pcap")
+        cpu_iface_backend = pibmv2::CpuSendRecv::Backend::PCAP;
+      else if (backend == "tpacket_v3")
+        cpu_iface_backend = pibmv2::CpuSendRecv::Backend::TPACKET_V3;
+      else
+        return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+    } else if (key == "cpu_iface_workers" && extra->v) {
+      try {
+        cpu_iface_workers = std::stoul(std::string(extra->v), nullptr, 0);
+      }
+      catch (const std::exception& e) {
+        return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+      }
+    } else if (key == "cpu_iface_queue_depth" && extra->v) {
+      try {
+        cpu_iface_queue_depth = std::stoul(std::string(extra->v), nullptr, 0);
+      }
+      catch (const std::exception& e) {
+        return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+      }
     }
   }
   if (rpc_port_num == -1) return PI_STATUS_MISSING_INIT_EXTRA_PARAM;
-  if (conn_mgr_client_init(pibmv2::conn_mgr_state, dev_id, rpc_port_num))
+  if (cpu_iface != "") {
+    int rc = cpu_send_recv->add_device(cpu_iface, dev_id, cpu_iface_backend,
+                                       cpu_iface_workers,
+                                       cpu_iface_queue_depth);
+    if (rc < 0) return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+  }
+  if (conn_mgr_client_init(pibmv2::conn_mgr_state, dev_id, rpc_port_num,
+                           num_thrift_conns))
     return PI_STATUS_TARGET_TRANSPORT_ERROR;
 
-  if (bm_notifications_addr != "")
-    pibmv2::start_learn_listener(bm_notifications_addr, rpc_port_num);
+  if (bm_notifications_addr != "" &&
+      !pibmv2::start_learn_listener(dev_id, bm_notifications_addr)) {
+    pibmv2::conn_mgr_client_close(pibmv2::conn_mgr_state, dev_id);
+    if (cpu_iface != "") cpu_send_recv->remove_device(dev_id);
+    return PI_STATUS_INVALID_INIT_EXTRA_PARAM;
+  }
 
+  pibmv2::set_p4info_cache(
+      dev_id, std::make_shared<const pibmv2::P4InfoCache>(p4info));
   d_info->p4info = p4info;
+  d_info->pipeline_batches = pipeline_batches;
+  // one connection is always left for the requests which are not pipelined
+  d_info->max_pipelines = num_thrift_conns - 1;
   d_info->assigned = 1;
   return PI_STATUS_SUCCESS;
 }
@@ -112,6 +173,10 @@ pi_status_t _pi_update_device_start(pi_dev_id_t dev_id,
     return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + iso.code);
   }
 
+  pibmv2::set_p4info_cache(
+      dev_id, std::make_shared<const pibmv2::P4InfoCache>(p4info));
+  // the meter configurations are not carried over to the new config
+  pibmv2::get_meter_spec_cache(dev_id)->clear();
   d_info->p4info = p4info;
   return PI_STATUS_SUCCESS;
 }
@@ -127,45 +192,52 @@ pi_status_t _pi_update_device_end(pi_dev_id_t dev_id) {
               << what << std::endl;
     return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + iso.code);
   }
+  // meters configured since _pi_update_device_start belonged to the old config
+  pibmv2::get_meter_spec_cache(dev_id)->clear();
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_remove_device(pi_dev_id_t dev_id) {
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
+  pibmv2::stop_learn_listener(dev_id);
   pibmv2::conn_mgr_client_close(pibmv2::conn_mgr_state, dev_id);
   cpu_send_recv->remove_device(dev_id);
+  pibmv2::set_p4info_cache(dev_id, nullptr);
+  pibmv2::get_meter_spec_cache(dev_id)->clear();
   d_info->assigned = 0;
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_destroy() {
+  pibmv2::stop_learn_listeners();
   pibmv2::conn_mgr_destroy(pibmv2::conn_mgr_state);
-  pibmv2::stop_learn_listener();
   delete cpu_send_recv;
   return PI_STATUS_SUCCESS;
 }
 
-// bmv2 does not support transaction and has no use for the session_handle
+// bmv2 does not support transactions, the session handle is only used to keep
+// track of pipelined batches (see batch.h)
 pi_status_t _pi_session_init(pi_session_handle_t *session_handle) {
-  *session_handle = 0;
+  *session_handle = next_session_handle++;
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_session_cleanup(pi_session_handle_t session_handle) {
-  (void) session_handle;
+  // in case the client did not end its batch
+  pibmv2::batch_end(session_handle);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_batch_begin(pi_session_handle_t session_handle) {
-  (void) session_handle;
-  return PI_STATUS_SUCCESS;
+  return pibmv2::batch_begin(session_handle);
 }
 
+// with bmv2, all operations are committed to hardware by the time we receive
+// the Thrift reply, so hw_sync does not change anything
 pi_status_t _pi_batch_end(pi_session_handle_t session_handle, bool hw_sync) {
-  (void) session_handle;
   (void) hw_sync;
-  return PI_STATUS_SUCCESS;
+  return pibmv2::batch_end(session_handle);
 }
 
 pi_status_t _pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
@@ -175,4 +247,14 @@ pi_status_t _pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
   return PI_STATUS_SUCCESS;
 }
 
+pi_status_t pi_bmv2_get_cpu_port_stats(pi_dev_id_t dev_id,
+                                       pi_bmv2_cpu_port_stats_t *stats) {
+  pibmv2::CpuSendRecv::DeviceStats device_stats;
+  if (cpu_send_recv->get_stats(dev_id, &device_stats) != 0)
+    return PI_STATUS_DEV_NOT_ASSIGNED;
+  stats->packetin_drops = device_stats.drops;
+  stats->packetout_malformed = device_stats.tx_malformed;
+  return PI_STATUS_SUCCESS;
+}
+
 }
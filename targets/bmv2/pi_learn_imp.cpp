@@ -18,59 +18,232 @@
  *
  */
 
-#include <bm/bm_apps/learn.h>
-
-#include <PI/p4info.h>
 #include <PI/pi.h>
 #include <PI/target/pi_learn_imp.h>
 
-#include <cstdio>
+#include <nanomsg/nn.h>
+#include <nanomsg/pubsub.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <cerrno>
+#include <cstddef>  // for offsetof
+#include <cstdint>
+#include <cstring>
 
 #include "common.h"
+#include "conn_mgr.h"
 
-// IMPORTANT: we temporary disabled support for this because of a p4info update
+// The p4info has no digest / field list objects, so the learn_id we report to
+// PI is simply the bmv2 learn list id (as set by the P4 compiler); it is also
+// the id we expect back in _pi_learn_msg_ack.
+
+namespace pibmv2 {
+
+extern conn_mgr_t *conn_mgr_state;
+
+}  // namespace pibmv2
 
 namespace {
 
-// TODO(antonin): support for multi-devices
-bm_apps::LearnListener *learn_listener = NULL;
-
-void cb_fn(const bm_apps::LearnListener::MsgInfo &msg_info,
-           const char *data, void *cookie) {
-  (void)data;
-  (void)cookie;
-  pibmv2::device_info_t *d_info = pibmv2::get_device_info(msg_info.switch_id);
-  if (!d_info) {
-    printf("Unknown switch id\n");
-    return;
+// header of the learn notifications published by bmv2 (see
+// bm_sim/learning.cpp), the samples follow it immediately
+struct __attribute__((packed)) LearnMsgHdr {
+  char sub_topic[4];
+  int switch_id;
+  int cxt_id;
+  int list_id;
+  uint64_t buffer_id;
+  unsigned int num_samples;
+  char _padding[4];
+};
+
+class LearnListener;
+
+// pi_learn_msg_t has to be the first member: _pi_learn_msg_done only gets a
+// pointer to it
+struct PooledMsg {
+  pi_learn_msg_t msg;
+  void *nn_buf;
+  // keeps the listener (and therefore the pool) alive until the message is
+  // released, even if the device is removed in the meantime
+  std::shared_ptr<LearnListener> listener;
+};
+
+static_assert(offsetof(PooledMsg, msg) == 0,
+              "pi_learn_msg_t must be the first member of PooledMsg");
+
+// One listener per device. Messages are received with NN_MSG, which means
+// nanomsg allocates the buffer and gives us ownership of it; the entries of
+// the pi_learn_msg_t point directly into that buffer, which is only freed when
+// the application is done with the message. The pi_learn_msg_t themselves
+// come from a fixed-size pool, so dispatching a message does not allocate. If
+// the pool is exhausted, the listener blocks until a message is released,
+// which in turn pushes back on bmv2.
+class LearnListener : public std::enable_shared_from_this<LearnListener> {
+ public:
+  static constexpr size_t kPoolSize = 256;
+
+  LearnListener(pi_dev_id_t dev_id, const std::string &addr)
+      : dev_id(dev_id), addr(addr), pool(kPoolSize) {
+    free_msgs.reserve(kPoolSize);
+    for (auto &m : pool) free_msgs.push_back(&m);
   }
-  const pi_p4info_t *p4info = d_info->p4info;
-  assert(p4info);
-  // pi_learn_msg_t *msg = new pi_learn_msg_t;
-  // msg->dev_tgt.dev_id = msg_info.switch_id;
-  // msg->dev_tgt.dev_pipe_mask = msg_info.cxt_id;
-  // // total hack for now
-  // msg->learn_id = (PI_FIELD_LIST_ID << 24) | (msg_info.list_id - 1);
-  // msg->msg_id = msg_info.buffer_id;
-  // msg->num_entries = msg_info.num_samples;
-  // msg->entry_size = get_learn_sample_size(p4info, msg->learn_id);
-  // msg->entries = const_cast<char *>(data);  // ouch
-  // pi_learn_new_msg(msg);
-}
+
+  ~LearnListener() {
+    if (sock >= 0) nn_close(sock);
+  }
+
+  bool start() {
+    sock = nn_socket(AF_SP, NN_SUB);
+    if (sock < 0) return false;
+    int to = kRecvTimeoutMs;
+    if (nn_setsockopt(sock, NN_SUB, NN_SUB_SUBSCRIBE, "LEA|", 4) < 0 ||
+        nn_setsockopt(sock, NN_SOL_SOCKET, NN_RCVTIMEO, &to, sizeof(to)) < 0 ||
+        nn_connect(sock, addr.c_str()) < 0) {
+      std::cout << "Error when connecting to bmv2 notifications socket '"
+                << addr << "': " << nn_strerror(nn_errno()) << "\n";
+      return false;
+    }
+    listener_thread = std::thread(&LearnListener::listen_loop, this);
+    return true;
+  }
+
+  void stop() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stop_listening = true;
+    }
+    can_acquire.notify_one();
+    if (listener_thread.joinable()) listener_thread.join();
+  }
+
+  void release(PooledMsg *pooled) {
+    nn_freemsg(pooled->nn_buf);
+    pooled->nn_buf = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      free_msgs.push_back(pooled);
+    }
+    can_acquire.notify_one();
+  }
+
+ private:
+  // used to periodically check stop_listening
+  static constexpr int kRecvTimeoutMs = 100;
+
+  PooledMsg *acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    can_acquire.wait(lock, [this] {
+        return stop_listening || !free_msgs.empty(); });
+    if (stop_listening) return nullptr;
+    auto pooled = free_msgs.back();
+    free_msgs.pop_back();
+    return pooled;
+  }
+
+  void listen_loop() {
+    while (!stop_listening) {
+      void *buf = nullptr;
+      int nbytes = nn_recv(sock, &buf, NN_MSG, 0);
+      if (nbytes < 0) {
+        int e = nn_errno();
+        if (e == EAGAIN || e == ETIMEDOUT || e == EINTR) continue;
+        std::cout << "Error when receiving learn notification: "
+                  << nn_strerror(e) << "\n";
+        break;
+      }
+      size_t size = static_cast<size_t>(nbytes);
+      if (size < sizeof(LearnMsgHdr)) {
+        nn_freemsg(buf);
+        continue;
+      }
+      LearnMsgHdr hdr;
+      std::memcpy(&hdr, buf, sizeof(hdr));
+      if (hdr.switch_id != static_cast<int>(dev_id)) {
+        std::cout << "Learn notification for unexpected switch id "
+                  << hdr.switch_id << " on device " << dev_id << "\n";
+        nn_freemsg(buf);
+        continue;
+      }
+
+      auto pooled = acquire();
+      if (!pooled) {
+        nn_freemsg(buf);
+        break;
+      }
+      size_t data_size = size - sizeof(hdr);
+      pi_learn_msg_t *msg = &pooled->msg;
+      msg->dev_tgt.dev_id = dev_id;
+      msg->dev_tgt.dev_pipe_mask = hdr.cxt_id;
+      msg->learn_id = static_cast<pi_p4_id_t>(hdr.list_id);
+      msg->msg_id = hdr.buffer_id;
+      msg->num_entries = hdr.num_samples;
+      msg->entry_size =
+          (hdr.num_samples == 0) ? 0 : data_size / hdr.num_samples;
+      msg->entries = static_cast<char *>(buf) + sizeof(hdr);
+      pooled->nn_buf = buf;
+      pooled->listener = shared_from_this();
+      // nobody will call pi_learn_msg_done if no callback was found
+      if (pi_learn_new_msg(msg) != PI_STATUS_SUCCESS) {
+        pooled->listener.reset();
+        release(pooled);
+      }
+    }
+  }
+
+  pi_dev_id_t dev_id;
+  std::string addr;
+  int sock{-1};
+  std::vector<PooledMsg> pool;
+  std::vector<PooledMsg *> free_msgs;
+  std::mutex mutex{};
+  std::condition_variable can_acquire{};
+  // written with mutex held, so that acquire() cannot miss the update, but
+  // also read without it by listen_loop()
+  std::atomic<bool> stop_listening{false};
+  std::thread listener_thread{};
+};
+
+// guards the listeners array, listeners are only added / removed when a device
+// is assigned / removed, so contention is not a concern
+std::mutex listeners_mutex;
+std::array<std::shared_ptr<LearnListener>, NUM_DEVICES> listeners;
 
 }  // namespace
 
 namespace pibmv2 {
 
-void start_learn_listener(const std::string &addr, int rpc_port_num) {
-  learn_listener = new bm_apps::LearnListener(addr, "localhost", rpc_port_num);
-  learn_listener->register_cb(cb_fn, NULL);
-  learn_listener->start();
+bool start_learn_listener(pi_dev_id_t dev_id, const std::string &addr) {
+  auto listener = std::make_shared<LearnListener>(dev_id, addr);
+  if (!listener->start()) return false;
+  std::unique_lock<std::mutex> lock(listeners_mutex);
+  listeners[dev_id] = std::move(listener);
+  return true;
 }
 
-void stop_learn_listener() {
-  if (learn_listener) delete learn_listener;
+void stop_learn_listener(pi_dev_id_t dev_id) {
+  std::shared_ptr<LearnListener> listener;
+  {
+    std::unique_lock<std::mutex> lock(listeners_mutex);
+    listener = std::move(listeners[dev_id]);
+  }
+  // outstanding messages hold a reference to the listener, which will be
+  // destroyed when the last one is released
+  if (listener) listener->stop();
+}
+
+void stop_learn_listeners() {
+  for (size_t dev_id = 0; dev_id < NUM_DEVICES; dev_id++)
+    stop_learn_listener(static_cast<pi_dev_id_t>(dev_id));
 }
 
 }  // namespace pibmv2
@@ -82,15 +255,30 @@ pi_status_t _pi_learn_msg_ack(pi_session_handle_t session_handle,
                               pi_p4_id_t learn_id,
                               pi_learn_msg_id_t msg_id) {
   (void)session_handle;
-  (void)dev_id;
-  if (!learn_listener) return PI_STATUS_TARGET_ERROR;
-  bm_apps::LearnListener::list_id_t id = (0xffffff & learn_id) + 1;
-  learn_listener->ack_buffer(0, id, msg_id);
+  auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
+  try {
+    client.c->bm_learning_ack_buffer(0, static_cast<int32_t>(learn_id),
+                                     static_cast<int64_t>(msg_id));
+  } catch (InvalidLearnOperation &ilo) {
+    const char *what =
+        _LearnOperationErrorCode_VALUES_TO_NAMES.find(ilo.code)->second;
+    std::cout << "Invalid learn operation (" << ilo.code << "): "
+              << what << std::endl;
+    return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + ilo.code);
+  } catch (::apache::thrift::TException &te) {
+    std::cout << "Thrift error when acking learn message: " << te.what()
+              << std::endl;
+    return PI_STATUS_TARGET_TRANSPORT_ERROR;
+  }
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_learn_msg_done(pi_learn_msg_t *msg) {
-  delete msg;
+  auto pooled = reinterpret_cast<PooledMsg *>(msg);
+  // the listener may be destroyed when this goes out of scope, after the
+  // message has been returned to its pool
+  auto listener = std::move(pooled->listener);
+  listener->release(pooled);
   return PI_STATUS_SUCCESS;
 }
 
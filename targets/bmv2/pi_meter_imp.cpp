@@ -26,9 +26,12 @@
 #include <string>
 #include <vector>
 
+#include "batch.h"
 #include "common.h"
 #include "conn_mgr.h"
 #include "direct_res_spec.h"
+#include "meter_spec_cache.h"
+#include "p4info_cache.h"
 
 namespace pibmv2 {
 
@@ -64,13 +67,6 @@ convert_to_meter_spec(const pi_p4info_t *p4info, pi_p4_id_t m_id,
   conv(rates.at(1), &meter_spec->pir, &meter_spec->pburst);
 }
 
-std::string get_direct_t_name(const pi_p4info_t *p4info, pi_p4_id_t m_id) {
-  pi_p4_id_t t_id = pi_p4info_meter_get_direct(p4info, m_id);
-  // guaranteed by PI common code
-  assert(t_id != PI_INVALID_ID);
-  return std::string(pi_p4info_table_name_from_id(p4info, t_id));
-}
-
 }  // namespace
 
 extern "C" {
@@ -78,14 +74,21 @@ extern "C" {
 pi_status_t _pi_meter_read(pi_session_handle_t session_handle,
                            pi_dev_tgt_t dev_tgt,
                            pi_p4_id_t meter_id,
-                           size_t index,
+                           size_t index, int flags,
                            pi_meter_spec_t *meter_spec) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string m_name(pi_p4info_meter_name_from_id(p4info, meter_id));
+  auto spec_cache = pibmv2::get_meter_spec_cache(dev_tgt.dev_id);
+  if (!(flags & PI_METER_FLAGS_HW_SYNC) &&
+      spec_cache->get(meter_id, index, meter_spec)) {
+    return PI_STATUS_SUCCESS;
+  }
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto m_name_ptr = cache->meter_name(meter_id);
+  if (m_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &m_name = *m_name_ptr;
 
   std::vector<BmMeterRateConfig> rates;
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
@@ -99,7 +102,8 @@ pi_status_t _pi_meter_read(pi_session_handle_t session_handle,
     return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + imo.code);
   }
   if (rates.empty()) return PI_STATUS_METER_SPEC_NOT_SET;
-  convert_to_meter_spec(p4info, meter_id, meter_spec, rates);
+  convert_to_meter_spec(d_info->p4info, meter_id, meter_spec, rates);
+  spec_cache->set(meter_id, index, *meter_spec);
 
   return PI_STATUS_SUCCESS;
 }
@@ -109,12 +113,14 @@ pi_status_t _pi_meter_set(pi_session_handle_t session_handle,
                           pi_p4_id_t meter_id,
                           size_t index,
                           const pi_meter_spec_t *meter_spec) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string m_name(pi_p4info_meter_name_from_id(p4info, meter_id));
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto m_name_ptr = cache->meter_name(meter_id);
+  if (m_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &m_name = *m_name_ptr;
 
   auto rates = pibmv2::convert_from_meter_spec(meter_spec);
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
@@ -127,20 +133,30 @@ pi_status_t _pi_meter_set(pi_session_handle_t session_handle,
               << imo.code << "): " << what << std::endl;
     return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + imo.code);
   }
+  pibmv2::get_meter_spec_cache(dev_tgt.dev_id)->set(
+      meter_id, index,
+      pibmv2::complete_meter_spec(d_info->p4info, meter_id, *meter_spec));
 
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_meter_read_direct(pi_session_handle_t session_handle,
                                   pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                                  pi_entry_handle_t entry_handle,
+                                  pi_entry_handle_t entry_handle, int flags,
                                   pi_meter_spec_t *meter_spec) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string t_name = get_direct_t_name(p4info, meter_id);
+  auto spec_cache = pibmv2::get_meter_spec_cache(dev_tgt.dev_id);
+  if (!(flags & PI_METER_FLAGS_HW_SYNC) &&
+      spec_cache->get(meter_id, entry_handle, meter_spec)) {
+    return PI_STATUS_SUCCESS;
+  }
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto t_name_ptr = cache->direct_t_name(meter_id);
+  if (t_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = *t_name_ptr;
 
   std::vector<BmMeterRateConfig> rates;
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
@@ -154,7 +170,8 @@ pi_status_t _pi_meter_read_direct(pi_session_handle_t session_handle,
     return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + ito.code);
   }
   if (rates.empty()) return PI_STATUS_METER_SPEC_NOT_SET;
-  convert_to_meter_spec(p4info, meter_id, meter_spec, rates);
+  convert_to_meter_spec(d_info->p4info, meter_id, meter_spec, rates);
+  spec_cache->set(meter_id, entry_handle, *meter_spec);
 
   return PI_STATUS_SUCCESS;
 }
@@ -163,12 +180,14 @@ pi_status_t _pi_meter_set_direct(pi_session_handle_t session_handle,
                                  pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
                                  pi_entry_handle_t entry_handle,
                                  const pi_meter_spec_t *meter_spec) {
-  (void)session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-  std::string t_name = get_direct_t_name(p4info, meter_id);
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+  auto t_name_ptr = cache->direct_t_name(meter_id);
+  if (t_name_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = *t_name_ptr;
 
   auto rates = pibmv2::convert_from_meter_spec(meter_spec);
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
@@ -181,6 +200,9 @@ pi_status_t _pi_meter_set_direct(pi_session_handle_t session_handle,
               << ito.code << "): " << what << std::endl;
     return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + ito.code);
   }
+  pibmv2::get_meter_spec_cache(dev_tgt.dev_id)->set(
+      meter_id, entry_handle,
+      pibmv2::complete_meter_spec(d_info->p4info, meter_id, *meter_spec));
 
   return PI_STATUS_SUCCESS;
 }
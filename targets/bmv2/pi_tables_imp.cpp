@@ -31,9 +31,12 @@
 #include <cstring>
 
 #include "action_helpers.h"
+#include "batch.h"
 #include "common.h"
 #include "conn_mgr.h"
 #include "direct_res_spec.h"
+#include "meter_spec_cache.h"
+#include "p4info_cache.h"
 
 namespace pibmv2 {
 
@@ -43,99 +46,24 @@ extern conn_mgr_t *conn_mgr_state;
 
 namespace {
 
-std::vector<BmMatchParam> build_key(pi_p4_id_t table_id,
-                                    const pi_match_key_t *match_key,
-                                    const pi_p4info_t *p4info,
-                                    bool *requires_priority) {
-  std::vector<BmMatchParam> key;
-  *requires_priority = false;
-
-  const char *mk_data = match_key->data;
-
-  BmMatchParam param;
-  BmMatchParamValid param_valid;
-  BmMatchParamExact param_exact;
-  BmMatchParamLPM param_lpm;
-  BmMatchParamTernary param_ternary;
-  BmMatchParamRange param_range;
-
-  size_t num_match_fields = pi_p4info_table_num_match_fields(p4info, table_id);
-  for (size_t i = 0; i < num_match_fields; i++) {
-    auto finfo = pi_p4info_table_match_field_info(p4info, table_id, i);
-    size_t f_bw = finfo->bitwidth;
-    size_t nbytes = (f_bw + 7) / 8;
-    uint32_t pLen;
-
-    switch (finfo->match_type) {
-      case PI_P4INFO_MATCH_TYPE_VALID:
-        param_valid.key = (*mk_data != 0);
-        mk_data++;
-        param = BmMatchParam();
-        param.type = BmMatchParamType::type::VALID;
-        param.__set_valid(param_valid);  // does a copy of param_valid
-        key.push_back(std::move(param));
-        break;
-      case PI_P4INFO_MATCH_TYPE_EXACT:
-        param_exact.key = std::string(mk_data, nbytes);
-        mk_data += nbytes;
-        param = BmMatchParam();
-        param.type = BmMatchParamType::type::EXACT;
-        param.__set_exact(param_exact);  // does a copy of param_exact
-        key.push_back(std::move(param));
-        break;
-      case PI_P4INFO_MATCH_TYPE_LPM:
-        param_lpm.key = std::string(mk_data, nbytes);
-        mk_data += nbytes;
-        mk_data += retrieve_uint32(mk_data, &pLen);
-        param_lpm.prefix_length = static_cast<int32_t>(pLen);
-        param = BmMatchParam();
-        param.type = BmMatchParamType::type::LPM;
-        param.__set_lpm(param_lpm);  // does a copy of param_lpm
-        key.push_back(std::move(param));
-        break;
-      case PI_P4INFO_MATCH_TYPE_TERNARY:
-        param_ternary.key = std::string(mk_data, nbytes);
-        mk_data += nbytes;
-        param_ternary.mask = std::string(mk_data, nbytes);
-        mk_data += nbytes;
-        param = BmMatchParam();
-        param.type = BmMatchParamType::type::TERNARY;
-        param.__set_ternary(param_ternary);  // does a copy of param_ternary
-        key.push_back(std::move(param));
-
-        *requires_priority = true;
-        break;
-      case PI_P4INFO_MATCH_TYPE_RANGE:
-        param_range.start = std::string(mk_data, nbytes);
-        mk_data += nbytes;
-        param_range.end_ = std::string(mk_data, nbytes);
-        mk_data += nbytes;
-        param = BmMatchParam();
-        param.type = BmMatchParamType::type::RANGE;
-        param.__set_range(param_range);  // does a copy of param_range
-        key.push_back(std::move(param));
-
-        *requires_priority = true;
-        break;
-      default:
-        assert(0);
-    }
-  }
-
-  return key;
+// for action data entries, the action must be known to the cache, in which
+// case the helpers below can dereference action_name() safely
+bool is_action_known(const pibmv2::P4InfoCache &cache,
+                     const pi_table_entry_t *table_entry) {
+  return table_entry->entry_type != PI_ACTION_ENTRY_TYPE_DATA ||
+      cache.action_name(table_entry->entry.action_data->action_id) != nullptr;
 }
 
-void build_key_and_options(pi_p4_id_t table_id,
+void build_key_and_options(const pibmv2::P4InfoCache &cache,
+                           pi_p4_id_t table_id,
                            const pi_match_key_t *match_key,
-                           const pi_p4info_t *p4info,
                            BmMatchParams *mkey, BmAddEntryOptions *options) {
-  bool requires_priority = false;
-  *mkey = build_key(table_id, match_key, p4info, &requires_priority);
-  if (requires_priority) options->__set_priority(match_key->priority);
+  if (cache.build_match_key(table_id, match_key, mkey))
+    options->__set_priority(match_key->priority);
 }
 
-
-pi_entry_handle_t add_entry(const pi_p4info_t *p4info,
+pi_entry_handle_t add_entry(const pibmv2::P4InfoCache &cache,
+                            const pi_p4info_t *p4info,
                             pi_dev_tgt_t dev_tgt,
                             const std::string &t_name,
                             const BmMatchParams &mkey,
@@ -143,7 +71,7 @@ pi_entry_handle_t add_entry(const pi_p4info_t *p4info,
                             const BmAddEntryOptions &options) {
   auto action_data = pibmv2::build_action_data(adata, p4info);
   pi_p4_id_t action_id = adata->action_id;
-  std::string a_name(pi_p4info_action_name_from_id(p4info, action_id));
+  const std::string &a_name = *cache.action_name(action_id);
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
 
@@ -171,13 +99,14 @@ pi_entry_handle_t add_indirect_entry(const pi_p4info_t *p4info,
   }
 }
 
-void set_default_entry(const pi_p4info_t *p4info,
+void set_default_entry(const pibmv2::P4InfoCache &cache,
+                       const pi_p4info_t *p4info,
                        pi_dev_tgt_t dev_tgt,
                        const std::string &t_name,
                        const pi_action_data_t *adata) {
   auto action_data = pibmv2::build_action_data(adata, p4info);
   pi_p4_id_t action_id = adata->action_id;
-  std::string a_name(pi_p4info_action_name_from_id(p4info, action_id));
+  const std::string &a_name = *cache.action_name(action_id);
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id);
 
@@ -200,14 +129,15 @@ void set_default_indirect_entry(const pi_p4info_t *p4info,
   }
 }
 
-void modify_entry(const pi_p4info_t *p4info,
+void modify_entry(const pibmv2::P4InfoCache &cache,
+                  const pi_p4info_t *p4info,
                   pi_dev_id_t dev_id,
                   const std::string &t_name,
                   pi_entry_handle_t entry_handle,
                   const pi_action_data_t *adata) {
   auto action_data = pibmv2::build_action_data(adata, p4info);
   pi_p4_id_t action_id = adata->action_id;
-  std::string a_name(pi_p4info_action_name_from_id(p4info, action_id));
+  const std::string &a_name = *cache.action_name(action_id);
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
 
@@ -234,15 +164,19 @@ void modify_indirect_entry(const pi_p4info_t *p4info,
   }
 }
 
-void retrieve_entry(const pi_p4info_t *p4info, const std::string &a_name,
-                    const BmActionData &action_data,
-                    pi_table_entry_t *table_entry) {
-  const pi_p4_id_t action_id = pi_p4info_action_id_from_name(
-      p4info, a_name.c_str());
+pi_status_t retrieve_entry(const pibmv2::P4InfoCache &cache,
+                           const pi_p4info_t *p4info,
+                           const std::string &a_name,
+                           const BmActionData &action_data,
+                           pi_table_entry_t *table_entry) {
+  auto adata_info_ptr = cache.action_from_name(a_name);
+  if (adata_info_ptr == nullptr) return PI_STATUS_TARGET_ERROR;
+  const auto &adata_info = *adata_info_ptr;
+  const pi_p4_id_t action_id = adata_info.id;
 
   table_entry->entry_type = PI_ACTION_ENTRY_TYPE_DATA;
 
-  const size_t adata_size = pi_p4info_action_data_size(p4info, action_id);
+  const size_t adata_size = adata_info.s;
 
   // no alignment issue with new[]
   char *data_ = new char[sizeof(pi_action_data_t) + adata_size];
@@ -257,6 +191,7 @@ void retrieve_entry(const pi_p4info_t *p4info, const std::string &a_name,
   table_entry->entry.action_data = adata;
 
   data_ = pibmv2::dump_action_data(p4info, data_, action_id, action_data);
+  return PI_STATUS_SUCCESS;
 }
 
 void retrieve_indirect_entry(const pi_p4info_t *p4info, int32_t h,
@@ -276,7 +211,6 @@ void set_direct_resources(const pi_p4info_t *p4info, pi_dev_id_t dev_id,
                           const std::string &t_name,
                           pi_entry_handle_t entry_handle,
                           const pi_direct_res_config_t *direct_res_config) {
-  (void)p4info;
   if (!direct_res_config) return;
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
   for (size_t i = 0; i < direct_res_config->num_configs; i++) {
@@ -292,15 +226,227 @@ void set_direct_resources(const pi_p4info_t *p4info, pi_dev_id_t dev_id,
         break;
       case PI_METER_ID:
         {
-          auto rates = pibmv2::convert_from_meter_spec(
-              reinterpret_cast<pi_meter_spec_t *>(config->config));
+          auto meter_spec = pibmv2::complete_meter_spec(
+              p4info, config->res_id,
+              *reinterpret_cast<pi_meter_spec_t *>(config->config));
+          auto rates = pibmv2::convert_from_meter_spec(&meter_spec);
           client.c->bm_mt_set_meter_rates(0, t_name, entry_handle, rates);
+          pibmv2::get_meter_spec_cache(dev_id)->set(
+              config->res_id, entry_handle, meter_spec);
+        }
+        break;
+      default:  // TODO(antonin): what to do?
+        assert(0);
+    }
+  }
+}
+
+// Pipelined versions of the table writes, used when the session has an ongoing
+// batch and pipelining is enabled for the device (see batch.h). Everything the
+// recv functions need is copied, since they may run after the PI call returns.
+
+struct DirectMeter {
+  pi_p4_id_t meter_id;
+  pi_meter_spec_t meter_spec;
+  std::vector<BmMeterRateConfig> rates;
+};
+
+struct DirectResources {
+  std::vector<BmCounterValue> counters{};
+  std::vector<DirectMeter> meters{};
+};
+
+DirectResources convert_direct_resources(
+    const pi_p4info_t *p4info,
+    const pi_direct_res_config_t *direct_res_config) {
+  DirectResources resources;
+  if (!direct_res_config) return resources;
+  for (size_t i = 0; i < direct_res_config->num_configs; i++) {
+    pi_direct_res_config_one_t *config = &direct_res_config->configs[i];
+    pi_res_type_id_t type = PI_GET_TYPE_ID(config->res_id);
+    switch (type) {
+      case PI_COUNTER_ID:
+        resources.counters.push_back(pibmv2::convert_from_counter_data(
+            reinterpret_cast<pi_counter_data_t *>(config->config)));
+        break;
+      case PI_METER_ID:
+        {
+          auto meter_spec = pibmv2::complete_meter_spec(
+              p4info, config->res_id,
+              *reinterpret_cast<pi_meter_spec_t *>(config->config));
+          auto rates = pibmv2::convert_from_meter_spec(&meter_spec);
+          resources.meters.push_back(
+              {config->res_id, meter_spec, std::move(rates)});
         }
         break;
       default:  // TODO(antonin): what to do?
         assert(0);
     }
   }
+  return resources;
+}
+
+void pipeline_direct_resources(pibmv2::Batch *batch, pi_dev_id_t dev_id,
+                               const std::string &t_name,
+                               pi_entry_handle_t entry_handle,
+                               const DirectResources &resources) {
+  for (const auto &value : resources.counters) {
+    batch->enqueue(
+        dev_id, t_name,
+        [&](StandardClient *c) {
+          c->send_bm_mt_write_counter(0, t_name, entry_handle, value); },
+        [](StandardClient *c) { c->recv_bm_mt_write_counter(); });
+  }
+  for (const auto &meter : resources.meters) {
+    auto meter_id = meter.meter_id;
+    auto meter_spec = meter.meter_spec;
+    batch->enqueue(
+        dev_id, t_name,
+        [&](StandardClient *c) {
+          c->send_bm_mt_set_meter_rates(
+              0, t_name, entry_handle, meter.rates); },
+        [dev_id, entry_handle, meter_id, meter_spec](StandardClient *c) {
+          c->recv_bm_mt_set_meter_rates();
+          pibmv2::get_meter_spec_cache(dev_id)->set(
+              meter_id, entry_handle, meter_spec);
+        });
+  }
+}
+
+void pipeline_entry_add(pibmv2::Batch *batch,
+                        const pibmv2::P4InfoCache &cache,
+                        const pi_p4info_t *p4info,
+                        pi_dev_id_t dev_id,
+                        pi_p4_id_t table_id,
+                        const std::string &t_name,
+                        const BmMatchParams &mkey,
+                        const BmAddEntryOptions &options,
+                        const pi_table_entry_t *table_entry,
+                        pi_entry_handle_t *entry_handle) {
+  // the entry handle is only known once we receive the reply, which is also
+  // when we can configure the direct resources
+  auto resources = convert_direct_resources(p4info,
+                                            table_entry->direct_res_config);
+  const auto &direct_meters = cache.table(table_id)->direct_meters;
+  auto on_reply = [batch, dev_id, t_name, resources, direct_meters,
+                   entry_handle](BmEntryHandle h) {
+    *entry_handle = static_cast<pi_entry_handle_t>(h);
+    // the handle may have belonged to a deleted entry
+    pibmv2::get_meter_spec_cache(dev_id)->erase(direct_meters, *entry_handle);
+    pipeline_direct_resources(batch, dev_id, t_name, *entry_handle, resources);
+  };
+
+  switch (table_entry->entry_type) {
+    case PI_ACTION_ENTRY_TYPE_DATA:
+      {
+        const pi_action_data_t *adata = table_entry->entry.action_data;
+        auto action_data = pibmv2::build_action_data(adata, p4info);
+        const auto &a_name = *cache.action_name(adata->action_id);
+        batch->enqueue(
+            dev_id, t_name,
+            [&](StandardClient *c) {
+              c->send_bm_mt_add_entry(
+                  0, t_name, mkey, a_name, action_data, options); },
+            [on_reply](StandardClient *c) {
+              on_reply(c->recv_bm_mt_add_entry()); });
+      }
+      break;
+    case PI_ACTION_ENTRY_TYPE_INDIRECT:
+      {
+        pi_indirect_handle_t h = table_entry->entry.indirect_handle;
+        if (!pibmv2::IndirectHMgr::is_grp_h(h)) {
+          batch->enqueue(
+              dev_id, t_name,
+              [&](StandardClient *c) {
+                c->send_bm_mt_indirect_add_entry(
+                    0, t_name, mkey, h, options); },
+              [on_reply](StandardClient *c) {
+                on_reply(c->recv_bm_mt_indirect_add_entry()); });
+        } else {
+          h = pibmv2::IndirectHMgr::clear_grp_h(h);
+          batch->enqueue(
+              dev_id, t_name,
+              [&](StandardClient *c) {
+                c->send_bm_mt_indirect_ws_add_entry(
+                    0, t_name, mkey, h, options); },
+              [on_reply](StandardClient *c) {
+                on_reply(c->recv_bm_mt_indirect_ws_add_entry()); });
+        }
+      }
+      break;
+    default:
+      assert(0);
+  }
+}
+
+void pipeline_entry_modify(pibmv2::Batch *batch,
+                           const pibmv2::P4InfoCache &cache,
+                           const pi_p4info_t *p4info,
+                           pi_dev_id_t dev_id,
+                           const std::string &t_name,
+                           pi_entry_handle_t entry_handle,
+                           const pi_table_entry_t *table_entry) {
+  switch (table_entry->entry_type) {
+    case PI_ACTION_ENTRY_TYPE_DATA:
+      {
+        const pi_action_data_t *adata = table_entry->entry.action_data;
+        auto action_data = pibmv2::build_action_data(adata, p4info);
+        const auto &a_name = *cache.action_name(adata->action_id);
+        batch->enqueue(
+            dev_id, t_name,
+            [&](StandardClient *c) {
+              c->send_bm_mt_modify_entry(
+                  0, t_name, entry_handle, a_name, action_data); },
+            [](StandardClient *c) { c->recv_bm_mt_modify_entry(); });
+      }
+      break;
+    case PI_ACTION_ENTRY_TYPE_INDIRECT:
+      {
+        pi_indirect_handle_t h = table_entry->entry.indirect_handle;
+        if (!pibmv2::IndirectHMgr::is_grp_h(h)) {
+          batch->enqueue(
+              dev_id, t_name,
+              [&](StandardClient *c) {
+                c->send_bm_mt_indirect_modify_entry(
+                    0, t_name, entry_handle, h); },
+              [](StandardClient *c) {
+                c->recv_bm_mt_indirect_modify_entry(); });
+        } else {
+          h = pibmv2::IndirectHMgr::clear_grp_h(h);
+          batch->enqueue(
+              dev_id, t_name,
+              [&](StandardClient *c) {
+                c->send_bm_mt_indirect_ws_modify_entry(
+                    0, t_name, entry_handle, h); },
+              [](StandardClient *c) {
+                c->recv_bm_mt_indirect_ws_modify_entry(); });
+        }
+      }
+      break;
+    default:
+      assert(0);
+  }
+  pipeline_direct_resources(
+      batch, dev_id, t_name, entry_handle,
+      convert_direct_resources(p4info, table_entry->direct_res_config));
+}
+
+void pipeline_entry_delete(pibmv2::Batch *batch, pi_dev_id_t dev_id,
+                           const std::string &t_name, bool is_indirect,
+                           pi_entry_handle_t entry_handle) {
+  if (!is_indirect) {
+    batch->enqueue(
+        dev_id, t_name,
+        [&](StandardClient *c) {
+          c->send_bm_mt_delete_entry(0, t_name, entry_handle); },
+        [](StandardClient *c) { c->recv_bm_mt_delete_entry(); });
+  } else {
+    batch->enqueue(
+        dev_id, t_name,
+        [&](StandardClient *c) {
+          c->send_bm_mt_indirect_delete_entry(0, t_name, entry_handle); },
+        [](StandardClient *c) { c->recv_bm_mt_indirect_delete_entry(); });
+  }
 }
 
 pi_status_t retrieve_entry_wkey(pi_dev_id_t dev_id, pi_p4_id_t table_id,
@@ -308,13 +454,15 @@ pi_status_t retrieve_entry_wkey(pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                 BmMtEntry *entry) {
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+
+  auto t_info = cache->table(table_id);
+  if (t_info == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = t_info->name;
 
   BmMatchParams mkey;
   BmAddEntryOptions options;
-  build_key_and_options(table_id, match_key, p4info, &mkey, &options);
-
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
+  build_key_and_options(*cache, table_id, match_key, &mkey, &options);
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
 
@@ -343,24 +491,36 @@ pi_status_t _pi_table_entry_add(pi_session_handle_t session_handle,
                                 int overwrite,
                                 pi_entry_handle_t *entry_handle) {
   (void) overwrite;  // TODO(antonin)
-  (void) session_handle;
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
+
+  auto t_info = cache->table(table_id);
+  if (t_info == nullptr || !is_action_known(*cache, table_entry))
+    return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = t_info->name;
 
   BmMatchParams mkey;
   BmAddEntryOptions options;
-  build_key_and_options(table_id, match_key, p4info, &mkey, &options);
+  build_key_and_options(*cache, table_id, match_key, &mkey, &options);
 
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
+  auto batch = pibmv2::batch_get(session_handle, dev_tgt.dev_id);
+  if (batch) {
+    pipeline_entry_add(batch, *cache, p4info, dev_tgt.dev_id, table_id, t_name,
+                       mkey, options, table_entry, entry_handle);
+    return PI_STATUS_SUCCESS;
+  }
+  pibmv2::batch_flush(session_handle);
 
   // TODO(antonin): entry timeout
   try {
     switch (table_entry->entry_type) {
       case PI_ACTION_ENTRY_TYPE_DATA:
-        *entry_handle = add_entry(p4info, dev_tgt, t_name, mkey,
-                                  table_entry->entry.action_data, options);
+        *entry_handle = add_entry(*cache, p4info, dev_tgt, t_name, mkey,
+                                  table_entry->entry.action_data,
+                                  options);
         break;
       case PI_ACTION_ENTRY_TYPE_INDIRECT:
         *entry_handle = add_indirect_entry(p4info, dev_tgt, t_name, mkey,
@@ -370,6 +530,9 @@ pi_status_t _pi_table_entry_add(pi_session_handle_t session_handle,
       default:
         assert(0);
     }
+    // the handle may have belonged to a deleted entry
+    pibmv2::get_meter_spec_cache(dev_tgt.dev_id)->erase(
+        t_info->direct_meters, *entry_handle);
     // direct resources
     set_direct_resources(p4info, dev_tgt.dev_id, t_name, *entry_handle,
                          table_entry->direct_res_config);
@@ -388,13 +551,17 @@ pi_status_t _pi_table_default_action_set(pi_session_handle_t session_handle,
                                          pi_dev_tgt_t dev_tgt,
                                          pi_p4_id_t table_id,
                                          const pi_table_entry_t *table_entry) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
+  auto cache = pibmv2::get_p4info_cache(dev_tgt.dev_id);
 
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
+  auto t_info = cache->table(table_id);
+  if (t_info == nullptr || !is_action_known(*cache, table_entry))
+    return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = t_info->name;
 
   try {
     if (table_entry->entry_type == PI_ACTION_ENTRY_TYPE_DATA) {
@@ -412,7 +579,7 @@ pi_status_t _pi_table_default_action_set(pi_session_handle_t session_handle,
           return PI_STATUS_CONST_DEFAULT_ACTION_NON_MUTABLE_PARAMS;
       }
 
-      set_default_entry(p4info, dev_tgt, t_name, adata);
+      set_default_entry(*cache, p4info, dev_tgt, t_name, adata);
     } else if (table_entry->entry_type == PI_ACTION_ENTRY_TYPE_INDIRECT) {
       set_default_indirect_entry(p4info, dev_tgt, t_name,
                                  table_entry->entry.indirect_handle);
@@ -434,13 +601,16 @@ pi_status_t _pi_table_default_action_get(pi_session_handle_t session_handle,
                                          pi_dev_id_t dev_id,
                                          pi_p4_id_t table_id,
                                          pi_table_entry_t *table_entry) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
+  auto cache = pibmv2::get_p4info_cache(dev_id);
 
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
+  auto t_info = cache->table(table_id);
+  if (t_info == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = t_info->name;
 
   BmActionEntry entry;
   try {
@@ -459,8 +629,8 @@ pi_status_t _pi_table_default_action_get(pi_session_handle_t session_handle,
       table_entry->entry_type = PI_ACTION_ENTRY_TYPE_NONE;
       break;
     case BmActionEntryType::ACTION_DATA:
-      retrieve_entry(p4info, entry.action_name, entry.action_data, table_entry);
-      break;
+      return retrieve_entry(*cache, p4info, entry.action_name,
+                            entry.action_data, table_entry);
     case BmActionEntryType::MBR_HANDLE:
       retrieve_indirect_entry(p4info, entry.mbr_handle, false, table_entry);
       break;
@@ -488,19 +658,32 @@ pi_status_t _pi_table_entry_delete(pi_session_handle_t session_handle,
                                    pi_dev_id_t dev_id,
                                    pi_p4_id_t table_id,
                                    pi_entry_handle_t entry_handle) {
-  (void) session_handle;
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
-  const pi_p4info_t *p4info = d_info->p4info;
-
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
-  auto ap_id = pi_p4info_table_get_implementation(p4info, table_id);
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+
+  auto t_info_ptr = cache->table(table_id);
+  if (t_info_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_info = *t_info_ptr;
+  const auto &t_name = t_info.name;
+  const bool is_indirect = (t_info.ap_id != PI_INVALID_ID);
+
+  // done first, in case the delete succeeds but we fail to get the reply
+  pibmv2::get_meter_spec_cache(dev_id)->erase(t_info.direct_meters,
+                                              entry_handle);
+
+  auto batch = pibmv2::batch_get(session_handle, dev_id);
+  if (batch) {
+    pipeline_entry_delete(batch, dev_id, t_name, is_indirect, entry_handle);
+    return PI_STATUS_SUCCESS;
+  }
+  pibmv2::batch_flush(session_handle);
 
   auto client = conn_mgr_client(pibmv2::conn_mgr_state, dev_id);
 
   try {
-    if (ap_id == PI_INVALID_ID)
+    if (!is_indirect)
       client.c->bm_mt_delete_entry(0, t_name, entry_handle);
     else
       client.c->bm_mt_indirect_delete_entry(0, t_name, entry_handle);
@@ -522,6 +705,7 @@ pi_status_t _pi_table_entry_delete(pi_session_handle_t session_handle,
 pi_status_t _pi_table_entry_delete_wkey(pi_session_handle_t session_handle,
                                         pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                         const pi_match_key_t *match_key) {
+  pibmv2::batch_flush(session_handle);
   BmMtEntry entry;
   pi_status_t status = retrieve_entry_wkey(dev_id, table_id, match_key, &entry);
   if (status != PI_STATUS_SUCCESS) return status;
@@ -534,17 +718,28 @@ pi_status_t _pi_table_entry_modify(pi_session_handle_t session_handle,
                                    pi_p4_id_t table_id,
                                    pi_entry_handle_t entry_handle,
                                    const pi_table_entry_t *table_entry) {
-  (void) session_handle;
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
-
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
+  auto cache = pibmv2::get_p4info_cache(dev_id);
+
+  auto t_info = cache->table(table_id);
+  if (t_info == nullptr || !is_action_known(*cache, table_entry))
+    return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_name = t_info->name;
+
+  auto batch = pibmv2::batch_get(session_handle, dev_id);
+  if (batch) {
+    pipeline_entry_modify(batch, *cache, p4info, dev_id, t_name, entry_handle,
+                          table_entry);
+    return PI_STATUS_SUCCESS;
+  }
+  pibmv2::batch_flush(session_handle);
 
   try {
     if (table_entry->entry_type == PI_ACTION_ENTRY_TYPE_DATA) {
-      modify_entry(p4info, dev_id, t_name, entry_handle,
+      modify_entry(*cache, p4info, dev_id, t_name, entry_handle,
                    table_entry->entry.action_data);
     } else if (table_entry->entry_type == PI_ACTION_ENTRY_TYPE_INDIRECT) {
       modify_indirect_entry(p4info, dev_id, t_name, entry_handle,
@@ -569,6 +764,7 @@ pi_status_t _pi_table_entry_modify_wkey(pi_session_handle_t session_handle,
                                         pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                         const pi_match_key_t *match_key,
                                         const pi_table_entry_t *table_entry) {
+  pibmv2::batch_flush(session_handle);
   BmMtEntry entry;
   pi_status_t status = retrieve_entry_wkey(dev_id, table_id, match_key, &entry);
   if (status != PI_STATUS_SUCCESS) return status;
@@ -580,13 +776,17 @@ pi_status_t _pi_table_entries_fetch(pi_session_handle_t session_handle,
                                     pi_dev_id_t dev_id,
                                     pi_p4_id_t table_id,
                                     pi_table_fetch_res_t *res) {
-  (void) session_handle;
+  pibmv2::batch_flush(session_handle);
 
   pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_id);
   assert(d_info->assigned);
   const pi_p4info_t *p4info = d_info->p4info;
+  auto cache = pibmv2::get_p4info_cache(dev_id);
 
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
+  auto t_info_ptr = cache->table(table_id);
+  if (t_info_ptr == nullptr) return PI_STATUS_NETV_INVALID_OBJ_ID;
+  const auto &t_info = *t_info_ptr;
+  const auto &t_name = t_info.name;
 
   std::vector<BmMtEntry> entries;
   try {
@@ -610,20 +810,23 @@ pi_status_t _pi_table_entries_fetch(pi_session_handle_t session_handle,
   data_size += entries.size() * sizeof(uint32_t);  // for priority
   data_size += entries.size() * sizeof(uint32_t);  // for properties
 
-  res->mkey_nbytes = pi_p4info_table_match_key_size(p4info, table_id);
+  res->mkey_nbytes = t_info.mkey_nbytes;
   data_size += entries.size() * res->mkey_nbytes;
 
-  size_t num_actions;
-  auto action_ids = pi_p4info_table_get_actions(p4info, table_id, &num_actions);
-  auto action_map = pibmv2::ADataSize::compute_action_sizes(p4info, action_ids,
-                                                            num_actions);
+  const auto &action_map = t_info.action_map;
 
   for (const auto &e : entries) {
     switch (e.action_entry.action_type) {
       case BmActionEntryType::NONE:
         break;
       case BmActionEntryType::ACTION_DATA:
-        data_size += action_map.at(e.action_entry.action_name).s;
+        {
+          // an action we do not know about, checked here so that the second
+          // pass below can assume the lookup succeeds
+          auto it = action_map.find(e.action_entry.action_name);
+          if (it == action_map.end()) return PI_STATUS_TARGET_ERROR;
+          data_size += it->second.s;
+        }
         data_size += sizeof(s_pi_p4_id_t);  // action id
         data_size += sizeof(uint32_t);  // action data nbytes
         break;
@@ -687,7 +890,8 @@ pi_status_t _pi_table_entries_fetch(pi_session_handle_t session_handle,
       case BmActionEntryType::ACTION_DATA:
         {
           data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_DATA);
-          const auto &adata_size = action_map.at(action_entry.action_name);
+          const auto &adata_size =
+              action_map.find(action_entry.action_name)->second;
           data += emit_p4_id(data, adata_size.id);
           data += emit_uint32(data, adata_size.s);
           data = pibmv2::dump_action_data(p4info, data, adata_size.id,
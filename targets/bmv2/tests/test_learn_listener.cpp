@@ -0,0 +1,220 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Tests the learn listener of the bmv2 target without a running bmv2: the
+// test publishes the learn notifications itself on a nanomsg PUB socket.
+
+#include <PI/pi.h>
+#include <PI/pi_learn.h>
+
+#include <nanomsg/nn.h>
+#include <nanomsg/pubsub.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstring>
+
+// Unity is compiled as C
+extern "C" {
+#include "unity/unity_fixture.h"
+}
+
+namespace pibmv2 {
+
+extern bool start_learn_listener(pi_dev_id_t dev_id, const std::string &addr);
+extern void stop_learn_listener(pi_dev_id_t dev_id);
+
+}  // namespace pibmv2
+
+namespace {
+
+constexpr pi_dev_id_t kDevId = 0;
+const char *const kAddr = "ipc:///tmp/pi_bmv2_test_learn_listener.ipc";
+
+// same layout as the header published by bmv2 (see pi_learn_imp.cpp)
+struct __attribute__((packed)) LearnMsgHdr {
+  char sub_topic[4];
+  int switch_id;
+  int cxt_id;
+  int list_id;
+  uint64_t buffer_id;
+  unsigned int num_samples;
+  char _padding[4];
+};
+
+struct Received {
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  std::vector<pi_learn_msg_t *> msgs{};
+};
+
+Received received;
+int pub_sock = -1;
+
+void learn_cb(pi_learn_msg_t *msg, void *cb_cookie) {
+  auto *r = static_cast<Received *>(cb_cookie);
+  std::unique_lock<std::mutex> lock(r->mutex);
+  r->msgs.push_back(msg);
+  r->cv.notify_all();
+}
+
+void publish(int switch_id, int list_id, uint64_t buffer_id,
+             const std::vector<uint32_t> &samples) {
+  LearnMsgHdr hdr;
+  std::memset(&hdr, 0, sizeof(hdr));
+  std::memcpy(hdr.sub_topic, "LEA|", sizeof(hdr.sub_topic));
+  hdr.switch_id = switch_id;
+  hdr.list_id = list_id;
+  hdr.buffer_id = buffer_id;
+  hdr.num_samples = static_cast<unsigned int>(samples.size());
+  std::vector<char> buf(sizeof(hdr) + samples.size() * sizeof(uint32_t));
+  std::memcpy(buf.data(), &hdr, sizeof(hdr));
+  if (!samples.empty()) {
+    std::memcpy(buf.data() + sizeof(hdr), samples.data(),
+                samples.size() * sizeof(uint32_t));
+  }
+  TEST_ASSERT_EQUAL_INT(static_cast<int>(buf.size()),
+                        nn_send(pub_sock, buf.data(), buf.size(), 0));
+}
+
+// The subscription of the listener reaches the publisher asynchronously, and
+// until it does the messages we publish are dropped. So we keep publishing the
+// same message until the listener receives it.
+void publish_until_received(int list_id, uint64_t buffer_id,
+                            const std::vector<uint32_t> &samples) {
+  for (int i = 0; i < 50; i++) {
+    publish(static_cast<int>(kDevId), list_id, buffer_id, samples);
+    std::unique_lock<std::mutex> lock(received.mutex);
+    if (received.cv.wait_for(lock, std::chrono::milliseconds(100),
+                             [] { return !received.msgs.empty(); })) {
+      return;
+    }
+  }
+  TEST_FAIL_MESSAGE("Learn message not received");
+}
+
+// Unity assertions longjmp out of the test, so we never assert with the mutex
+// held and work on a copy of the received messages instead
+std::vector<pi_learn_msg_t *> get_received() {
+  std::unique_lock<std::mutex> lock(received.mutex);
+  return received.msgs;
+}
+
+void done_all() {
+  std::vector<pi_learn_msg_t *> msgs;
+  {
+    std::unique_lock<std::mutex> lock(received.mutex);
+    msgs.swap(received.msgs);
+  }
+  for (auto msg : msgs)
+    TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, pi_learn_msg_done(msg));
+}
+
+}  // namespace
+
+TEST_GROUP(LearnListener);
+
+TEST_SETUP(LearnListener) {
+  pub_sock = nn_socket(AF_SP, NN_PUB);
+  TEST_ASSERT_TRUE(pub_sock >= 0);
+  TEST_ASSERT_TRUE(nn_bind(pub_sock, kAddr) >= 0);
+  pi_learn_register_default_cb(learn_cb, &received);
+}
+
+TEST_TEAR_DOWN(LearnListener) {
+  pibmv2::stop_learn_listener(kDevId);
+  done_all();
+  pi_learn_deregister_default_cb();
+  nn_close(pub_sock);
+}
+
+TEST(LearnListener, StartStop) {
+  TEST_ASSERT_TRUE(pibmv2::start_learn_listener(kDevId, kAddr));
+  pibmv2::stop_learn_listener(kDevId);
+  // the device can be re-assigned
+  TEST_ASSERT_TRUE(pibmv2::start_learn_listener(kDevId, kAddr));
+  pibmv2::stop_learn_listener(kDevId);
+  // no-op
+  pibmv2::stop_learn_listener(kDevId);
+}
+
+TEST(LearnListener, BadAddress) {
+  TEST_ASSERT_FALSE(pibmv2::start_learn_listener(kDevId, "bad_address"));
+}
+
+TEST(LearnListener, Receive) {
+  TEST_ASSERT_TRUE(pibmv2::start_learn_listener(kDevId, kAddr));
+  const std::vector<uint32_t> samples = {0xab, 0xcd};
+  publish_until_received(7, 99, samples);
+  const auto *msg = get_received().front();
+  TEST_ASSERT_EQUAL_UINT(kDevId, msg->dev_tgt.dev_id);
+  TEST_ASSERT_EQUAL_UINT(7, msg->learn_id);
+  TEST_ASSERT_EQUAL_UINT64(99, msg->msg_id);
+  TEST_ASSERT_EQUAL_UINT(samples.size(), msg->num_entries);
+  TEST_ASSERT_EQUAL_UINT(sizeof(uint32_t), msg->entry_size);
+  TEST_ASSERT_EQUAL_MEMORY(samples.data(), msg->entries,
+                           samples.size() * sizeof(uint32_t));
+  done_all();
+  pibmv2::stop_learn_listener(kDevId);
+}
+
+TEST(LearnListener, IgnoreOtherSwitch) {
+  TEST_ASSERT_TRUE(pibmv2::start_learn_listener(kDevId, kAddr));
+  for (int i = 0; i < 50; i++) {
+    publish(static_cast<int>(kDevId) + 1, 1, 1, {0});
+    publish(static_cast<int>(kDevId), 2, 2, {0});
+    std::unique_lock<std::mutex> lock(received.mutex);
+    if (received.cv.wait_for(lock, std::chrono::milliseconds(100),
+                             [] { return !received.msgs.empty(); })) {
+      break;
+    }
+  }
+  auto msgs = get_received();
+  TEST_ASSERT_FALSE(msgs.empty());
+  for (const auto *msg : msgs) TEST_ASSERT_EQUAL_UINT(2, msg->learn_id);
+  pibmv2::stop_learn_listener(kDevId);
+}
+
+// the application may release messages after the device is removed
+TEST(LearnListener, DoneAfterStop) {
+  TEST_ASSERT_TRUE(pibmv2::start_learn_listener(kDevId, kAddr));
+  publish_until_received(1, 1, {0});
+  pibmv2::stop_learn_listener(kDevId);
+  done_all();
+}
+
+TEST_GROUP_RUNNER(LearnListener) {
+  RUN_TEST_CASE(LearnListener, StartStop);
+  RUN_TEST_CASE(LearnListener, BadAddress);
+  RUN_TEST_CASE(LearnListener, Receive);
+  RUN_TEST_CASE(LearnListener, IgnoreOtherSwitch);
+  RUN_TEST_CASE(LearnListener, DoneAfterStop);
+}
+
+static void run() { RUN_TEST_GROUP(LearnListener); }
+
+int main(int argc, const char *argv[]) {
+  return UnityMain(argc, argv, run);
+}
@@ -0,0 +1,365 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "dummy_act_prof.h"
+
+#include <PI/int/pi_int.h>
+#include <PI/int/serialize.h>
+#include <PI/p4info.h>
+
+#include <Judy.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  pi_p4_id_t action_id;
+  size_t adata_size;
+  char *adata;
+  // number of groups and table entries using the member
+  size_t ref_count;
+} member_t;
+
+typedef struct {
+  size_t max_size;  // 0 means no limit
+  size_t num_mbrs;
+  size_t capacity;
+  pi_indirect_handle_t *mbrs;
+  // number of table entries using the group
+  size_t ref_count;
+} group_t;
+
+struct dummy_act_prof_s {
+  pi_p4_id_t act_prof_id;
+  bool with_selector;
+  size_t max_size;  // 0 means no limit
+  // JudyL arrays, member handle -> member_t * and group handle (without
+  // DUMMY_GRP_H_FLAG) -> group_t *
+  Pvoid_t members;
+  Pvoid_t groups;
+  size_t num_members;
+  size_t num_groups;
+};
+
+static bool is_grp_h(pi_indirect_handle_t h) {
+  return (h & DUMMY_GRP_H_FLAG);
+}
+
+static member_t *get_member(const dummy_act_prof_t *act_prof,
+                            pi_indirect_handle_t h) {
+  if (is_grp_h(h)) return NULL;
+  Word_t *PValue;
+  JLG(PValue, act_prof->members, (Word_t)h);
+  return (PValue == NULL) ? NULL : (member_t *)*PValue;
+}
+
+static group_t *get_group(const dummy_act_prof_t *act_prof,
+                          pi_indirect_handle_t h) {
+  if (!is_grp_h(h)) return NULL;
+  Word_t *PValue;
+  JLG(PValue, act_prof->groups, (Word_t)(h & ~DUMMY_GRP_H_FLAG));
+  return (PValue == NULL) ? NULL : (group_t *)*PValue;
+}
+
+// returns false if all the handles are in use
+static bool alloc_handle(Pvoid_t array, Word_t *h) {
+  int Rc_int;
+  *h = 0;
+  JLFE(Rc_int, array, *h);
+  return (Rc_int == 1 && *h < DUMMY_GRP_H_FLAG);
+}
+
+static void member_set_action_data(member_t *mbr,
+                                   const pi_action_data_t *action_data) {
+  mbr->action_id = action_data->action_id;
+  mbr->adata_size = action_data->data_size;
+  mbr->adata = realloc(mbr->adata, action_data->data_size);
+  memcpy(mbr->adata, action_data->data, action_data->data_size);
+}
+
+dummy_act_prof_t *dummy_act_prof_create(const pi_p4info_t *p4info,
+                                        pi_p4_id_t act_prof_id) {
+  dummy_act_prof_t *act_prof = malloc(sizeof(dummy_act_prof_t));
+  act_prof->act_prof_id = act_prof_id;
+  act_prof->with_selector =
+      pi_p4info_act_prof_has_selector(p4info, act_prof_id);
+  act_prof->max_size = pi_p4info_act_prof_max_size(p4info, act_prof_id);
+  act_prof->members = (Pvoid_t)NULL;
+  act_prof->groups = (Pvoid_t)NULL;
+  act_prof->num_members = 0;
+  act_prof->num_groups = 0;
+  return act_prof;
+}
+
+void dummy_act_prof_destroy(dummy_act_prof_t *act_prof) {
+  Word_t index = 0;
+  Word_t *PValue;
+  Word_t Rc_word;
+  JLF(PValue, act_prof->members, index);
+  while (PValue != NULL) {
+    member_t *mbr = (member_t *)*PValue;
+    free(mbr->adata);
+    free(mbr);
+    JLN(PValue, act_prof->members, index);
+  }
+  JLFA(Rc_word, act_prof->members);
+  index = 0;
+  JLF(PValue, act_prof->groups, index);
+  while (PValue != NULL) {
+    group_t *grp = (group_t *)*PValue;
+    free(grp->mbrs);
+    free(grp);
+    JLN(PValue, act_prof->groups, index);
+  }
+  JLFA(Rc_word, act_prof->groups);
+  (void)Rc_word;
+  free(act_prof);
+}
+
+pi_status_t dummy_act_prof_mbr_create(dummy_act_prof_t *act_prof,
+                                      const pi_action_data_t *action_data,
+                                      pi_indirect_handle_t *mbr_handle) {
+  if (act_prof->max_size > 0 && act_prof->num_members >= act_prof->max_size)
+    return DUMMY_STATUS(DUMMY_ERROR_ACT_PROF_FULL);
+  Word_t h;
+  if (!alloc_handle(act_prof->members, &h))
+    return DUMMY_STATUS(DUMMY_ERROR_ACT_PROF_FULL);
+  member_t *mbr = malloc(sizeof(member_t));
+  mbr->adata = NULL;
+  member_set_action_data(mbr, action_data);
+  mbr->ref_count = 0;
+  Word_t *PValue;
+  JLI(PValue, act_prof->members, h);
+  *PValue = (Word_t)mbr;
+  act_prof->num_members++;
+  *mbr_handle = h;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_act_prof_mbr_delete(dummy_act_prof_t *act_prof,
+                                      pi_indirect_handle_t mbr_handle) {
+  member_t *mbr = get_member(act_prof, mbr_handle);
+  if (!mbr) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  if (mbr->ref_count > 0) return DUMMY_STATUS(DUMMY_ERROR_RESOURCE_IN_USE);
+  int Rc_int;
+  JLD(Rc_int, act_prof->members, (Word_t)mbr_handle);
+  assert(Rc_int == 1);
+  free(mbr->adata);
+  free(mbr);
+  act_prof->num_members--;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_act_prof_mbr_modify(dummy_act_prof_t *act_prof,
+                                      pi_indirect_handle_t mbr_handle,
+                                      const pi_action_data_t *action_data) {
+  member_t *mbr = get_member(act_prof, mbr_handle);
+  if (!mbr) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  member_set_action_data(mbr, action_data);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_act_prof_grp_create(dummy_act_prof_t *act_prof,
+                                      size_t max_size,
+                                      pi_indirect_handle_t *grp_handle) {
+  if (!act_prof->with_selector) return DUMMY_STATUS(DUMMY_ERROR_NO_SELECTOR);
+  if (act_prof->max_size > 0 && act_prof->num_groups >= act_prof->max_size)
+    return DUMMY_STATUS(DUMMY_ERROR_ACT_PROF_FULL);
+  Word_t h;
+  if (!alloc_handle(act_prof->groups, &h))
+    return DUMMY_STATUS(DUMMY_ERROR_ACT_PROF_FULL);
+  group_t *grp = malloc(sizeof(group_t));
+  grp->max_size = max_size;
+  grp->num_mbrs = 0;
+  grp->capacity = 0;
+  grp->mbrs = NULL;
+  grp->ref_count = 0;
+  Word_t *PValue;
+  JLI(PValue, act_prof->groups, h);
+  *PValue = (Word_t)grp;
+  act_prof->num_groups++;
+  *grp_handle = h | DUMMY_GRP_H_FLAG;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_act_prof_grp_delete(dummy_act_prof_t *act_prof,
+                                      pi_indirect_handle_t grp_handle) {
+  group_t *grp = get_group(act_prof, grp_handle);
+  if (!grp) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  if (grp->ref_count > 0) return DUMMY_STATUS(DUMMY_ERROR_RESOURCE_IN_USE);
+  for (size_t i = 0; i < grp->num_mbrs; i++) {
+    member_t *mbr = get_member(act_prof, grp->mbrs[i]);
+    assert(mbr);
+    mbr->ref_count--;
+  }
+  int Rc_int;
+  JLD(Rc_int, act_prof->groups, (Word_t)(grp_handle & ~DUMMY_GRP_H_FLAG));
+  assert(Rc_int == 1);
+  free(grp->mbrs);
+  free(grp);
+  act_prof->num_groups--;
+  return PI_STATUS_SUCCESS;
+}
+
+static size_t group_find_mbr(const group_t *grp,
+                             pi_indirect_handle_t mbr_handle) {
+  size_t i = 0;
+  for (; i < grp->num_mbrs; i++) {
+    if (grp->mbrs[i] == mbr_handle) break;
+  }
+  return i;
+}
+
+pi_status_t dummy_act_prof_grp_add_mbr(dummy_act_prof_t *act_prof,
+                                       pi_indirect_handle_t grp_handle,
+                                       pi_indirect_handle_t mbr_handle) {
+  group_t *grp = get_group(act_prof, grp_handle);
+  if (!grp) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  member_t *mbr = get_member(act_prof, mbr_handle);
+  if (!mbr) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  if (group_find_mbr(grp, mbr_handle) != grp->num_mbrs)
+    return DUMMY_STATUS(DUMMY_ERROR_MEMBER_ALREADY_IN_GROUP);
+  if (grp->max_size > 0 && grp->num_mbrs >= grp->max_size)
+    return DUMMY_STATUS(DUMMY_ERROR_GROUP_FULL);
+  if (grp->num_mbrs == grp->capacity) {
+    grp->capacity = (grp->capacity == 0) ? 4 : 2 * grp->capacity;
+    grp->mbrs = realloc(grp->mbrs, grp->capacity * sizeof(*grp->mbrs));
+  }
+  grp->mbrs[grp->num_mbrs++] = mbr_handle;
+  mbr->ref_count++;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_act_prof_grp_remove_mbr(dummy_act_prof_t *act_prof,
+                                          pi_indirect_handle_t grp_handle,
+                                          pi_indirect_handle_t mbr_handle) {
+  group_t *grp = get_group(act_prof, grp_handle);
+  if (!grp) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  size_t i = group_find_mbr(grp, mbr_handle);
+  if (i == grp->num_mbrs)
+    return DUMMY_STATUS(DUMMY_ERROR_MEMBER_NOT_IN_GROUP);
+  // preserve member order, for fetch
+  memmove(&grp->mbrs[i], &grp->mbrs[i + 1],
+          (grp->num_mbrs - i - 1) * sizeof(*grp->mbrs));
+  grp->num_mbrs--;
+  member_t *mbr = get_member(act_prof, mbr_handle);
+  assert(mbr);
+  mbr->ref_count--;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_act_prof_ref(dummy_act_prof_t *act_prof,
+                               pi_indirect_handle_t h) {
+  if (is_grp_h(h)) {
+    group_t *grp = get_group(act_prof, h);
+    if (!grp) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+    grp->ref_count++;
+  } else {
+    member_t *mbr = get_member(act_prof, h);
+    if (!mbr) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+    mbr->ref_count++;
+  }
+  return PI_STATUS_SUCCESS;
+}
+
+void dummy_act_prof_unref(dummy_act_prof_t *act_prof, pi_indirect_handle_t h) {
+  if (is_grp_h(h)) {
+    group_t *grp = get_group(act_prof, h);
+    assert(grp && grp->ref_count > 0);
+    grp->ref_count--;
+  } else {
+    member_t *mbr = get_member(act_prof, h);
+    assert(mbr && mbr->ref_count > 0);
+    mbr->ref_count--;
+  }
+}
+
+void dummy_act_prof_fetch(const dummy_act_prof_t *act_prof,
+                          pi_act_prof_fetch_res_t *res) {
+  Word_t index;
+  Word_t *PValue;
+
+  // members
+  {
+    res->num_members = act_prof->num_members;
+    size_t data_size = 0;
+    index = 0;
+    JLF(PValue, act_prof->members, index);
+    while (PValue != NULL) {
+      const member_t *mbr = (const member_t *)*PValue;
+      data_size += sizeof(s_pi_indirect_handle_t) + sizeof(s_pi_p4_id_t) +
+                   sizeof(uint32_t) + mbr->adata_size;
+      JLN(PValue, act_prof->members, index);
+    }
+
+    char *data = malloc(data_size);
+    res->entries_members_size = data_size;
+    res->entries_members = data;
+
+    index = 0;
+    JLF(PValue, act_prof->members, index);
+    while (PValue != NULL) {
+      const member_t *mbr = (const member_t *)*PValue;
+      data += emit_indirect_handle(data, index);
+      data += emit_p4_id(data, mbr->action_id);
+      data += emit_uint32(data, mbr->adata_size);
+      memcpy(data, mbr->adata, mbr->adata_size);
+      data += mbr->adata_size;
+      JLN(PValue, act_prof->members, index);
+    }
+  }
+
+  // groups
+  {
+    res->num_groups = act_prof->num_groups;
+    // handle, number of members and offset in member handles list
+    size_t data_size = act_prof->num_groups *
+                       (sizeof(s_pi_indirect_handle_t) + 2 * sizeof(uint32_t));
+    size_t num_member_handles = 0;
+    index = 0;
+    JLF(PValue, act_prof->groups, index);
+    while (PValue != NULL) {
+      num_member_handles += ((const group_t *)*PValue)->num_mbrs;
+      JLN(PValue, act_prof->groups, index);
+    }
+
+    char *data = malloc(data_size);
+    res->entries_groups_size = data_size;
+    res->entries_groups = data;
+    res->num_cumulated_mbr_handles = num_member_handles;
+    res->mbr_handles =
+        malloc(num_member_handles * sizeof(pi_indirect_handle_t));
+
+    size_t handle_offset = 0;
+    index = 0;
+    JLF(PValue, act_prof->groups, index);
+    while (PValue != NULL) {
+      const group_t *grp = (const group_t *)*PValue;
+      data += emit_indirect_handle(data, index | DUMMY_GRP_H_FLAG);
+      data += emit_uint32(data, grp->num_mbrs);
+      data += emit_uint32(data, handle_offset);
+      memcpy(&res->mbr_handles[handle_offset], grp->mbrs,
+             grp->num_mbrs * sizeof(pi_indirect_handle_t));
+      handle_offset += grp->num_mbrs;
+      JLN(PValue, act_prof->groups, index);
+    }
+  }
+}
@@ -0,0 +1,80 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_TARGETS_DUMMY_DUMMY_ACT_PROF_H_
+#define PI_TARGETS_DUMMY_DUMMY_ACT_PROF_H_
+
+#include <PI/pi.h>
+
+#include "dummy_device.h"
+
+// An action profile, with members and (if it has a selector) groups. Group
+// handles have DUMMY_GRP_H_FLAG set, so that the handle stored in an indirect
+// table entry is enough to tell a member from a group.
+// Members and groups are reference counted: a member cannot be deleted while
+// it belongs to a group or is used by a table entry, and the same goes for a
+// group used by a table entry.
+
+#define DUMMY_GRP_H_FLAG (1 << 24)
+
+dummy_act_prof_t *dummy_act_prof_create(const pi_p4info_t *p4info,
+                                        pi_p4_id_t act_prof_id);
+
+void dummy_act_prof_destroy(dummy_act_prof_t *act_prof);
+
+pi_status_t dummy_act_prof_mbr_create(dummy_act_prof_t *act_prof,
+                                      const pi_action_data_t *action_data,
+                                      pi_indirect_handle_t *mbr_handle);
+
+pi_status_t dummy_act_prof_mbr_delete(dummy_act_prof_t *act_prof,
+                                      pi_indirect_handle_t mbr_handle);
+
+pi_status_t dummy_act_prof_mbr_modify(dummy_act_prof_t *act_prof,
+                                      pi_indirect_handle_t mbr_handle,
+                                      const pi_action_data_t *action_data);
+
+pi_status_t dummy_act_prof_grp_create(dummy_act_prof_t *act_prof,
+                                      size_t max_size,
+                                      pi_indirect_handle_t *grp_handle);
+
+pi_status_t dummy_act_prof_grp_delete(dummy_act_prof_t *act_prof,
+                                      pi_indirect_handle_t grp_handle);
+
+pi_status_t dummy_act_prof_grp_add_mbr(dummy_act_prof_t *act_prof,
+                                       pi_indirect_handle_t grp_handle,
+                                       pi_indirect_handle_t mbr_handle);
+
+pi_status_t dummy_act_prof_grp_remove_mbr(dummy_act_prof_t *act_prof,
+                                          pi_indirect_handle_t grp_handle,
+                                          pi_indirect_handle_t mbr_handle);
+
+// used by tables for indirect entries; h can be a member or a group handle
+pi_status_t dummy_act_prof_ref(dummy_act_prof_t *act_prof,
+                               pi_indirect_handle_t h);
+
+void dummy_act_prof_unref(dummy_act_prof_t *act_prof, pi_indirect_handle_t h);
+
+// serializes members and groups in the format expected by
+// pi_act_prof_mbrs_next / pi_act_prof_grps_next, the buffers are allocated
+// with malloc
+void dummy_act_prof_fetch(const dummy_act_prof_t *act_prof,
+                          pi_act_prof_fetch_res_t *res);
+
+#endif  // PI_TARGETS_DUMMY_DUMMY_ACT_PROF_H_
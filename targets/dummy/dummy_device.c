@@ -0,0 +1,295 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "dummy_device.h"
+
+#include <PI/p4info.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "dummy_act_prof.h"
+#include "dummy_table.h"
+
+#define NUM_DEVICES 256
+
+typedef struct {
+  pthread_mutex_t lock;
+  int assigned;
+  dummy_model_t *model;
+  // built by dummy_device_update_start, swapped in by dummy_device_update_end
+  dummy_model_t *pending_model;
+} dummy_device_t;
+
+static dummy_device_t devices[NUM_DEVICES];
+
+void dummy_meter_set(const pi_p4info_t *p4info, pi_p4_id_t meter_id,
+                     dummy_meter_t *meter, const pi_meter_spec_t *meter_spec) {
+  meter->spec = *meter_spec;
+  if (meter->spec.meter_unit == PI_METER_UNIT_DEFAULT) {
+    meter->spec.meter_unit =
+        (pi_meter_unit_t)pi_p4info_meter_get_unit(p4info, meter_id);
+  }
+  if (meter->spec.meter_type == PI_METER_TYPE_DEFAULT) {
+    meter->spec.meter_type =
+        (pi_meter_type_t)pi_p4info_meter_get_type(p4info, meter_id);
+  }
+  meter->is_set = 1;
+}
+
+void dummy_counter_write(pi_counter_data_t *dst, const pi_counter_data_t *src) {
+  if (src->valid & PI_COUNTER_UNIT_PACKETS) dst->packets = src->packets;
+  if (src->valid & PI_COUNTER_UNIT_BYTES) dst->bytes = src->bytes;
+}
+
+void dummy_counter_read(const pi_p4info_t *p4info, pi_p4_id_t counter_id,
+                        const pi_counter_data_t *src, pi_counter_data_t *dst) {
+  *dst = *src;
+  switch (pi_p4info_counter_get_unit(p4info, counter_id)) {
+    case PI_P4INFO_COUNTER_UNIT_BYTES:
+      dst->valid = PI_COUNTER_UNIT_BYTES;
+      break;
+    case PI_P4INFO_COUNTER_UNIT_PACKETS:
+      dst->valid = PI_COUNTER_UNIT_PACKETS;
+      break;
+    case PI_P4INFO_COUNTER_UNIT_BOTH:
+      dst->valid = PI_COUNTER_UNIT_BYTES | PI_COUNTER_UNIT_PACKETS;
+      break;
+  }
+}
+
+static void *model_get(Pcvoid_t array, pi_p4_id_t id) {
+  Word_t *PValue;
+  JLG(PValue, array, (Word_t)id);
+  return (PValue == NULL) ? NULL : (void *)*PValue;
+}
+
+static void model_set(Pvoid_t *array, pi_p4_id_t id, void *obj) {
+  Word_t *PValue;
+  JLI(PValue, *array, (Word_t)id);
+  *PValue = (Word_t)obj;
+}
+
+dummy_table_t *dummy_model_table(const dummy_model_t *model,
+                                 pi_p4_id_t table_id) {
+  return model_get(model->tables, table_id);
+}
+
+dummy_act_prof_t *dummy_model_act_prof(const dummy_model_t *model,
+                                       pi_p4_id_t act_prof_id) {
+  return model_get(model->act_profs, act_prof_id);
+}
+
+dummy_counter_array_t *dummy_model_counter(const dummy_model_t *model,
+                                           pi_p4_id_t counter_id) {
+  return model_get(model->counters, counter_id);
+}
+
+dummy_meter_array_t *dummy_model_meter(const dummy_model_t *model,
+                                       pi_p4_id_t meter_id) {
+  return model_get(model->meters, meter_id);
+}
+
+static dummy_model_t *model_create(const pi_p4info_t *p4info) {
+  dummy_model_t *model = calloc(1, sizeof(dummy_model_t));
+  model->p4info = p4info;
+
+  // action profiles first, tables need them
+  for (pi_p4_id_t id = pi_p4info_act_prof_begin(p4info);
+       id != pi_p4info_act_prof_end(p4info);
+       id = pi_p4info_act_prof_next(p4info, id)) {
+    model_set(&model->act_profs, id, dummy_act_prof_create(p4info, id));
+  }
+
+  for (pi_p4_id_t id = pi_p4info_table_begin(p4info);
+       id != pi_p4info_table_end(p4info);
+       id = pi_p4info_table_next(p4info, id)) {
+    pi_p4_id_t act_prof_id = pi_p4info_table_get_implementation(p4info, id);
+    dummy_act_prof_t *act_prof = (act_prof_id == PI_INVALID_ID)
+                                     ? NULL
+                                     : dummy_model_act_prof(model, act_prof_id);
+    model_set(&model->tables, id, dummy_table_create(p4info, id, act_prof));
+  }
+
+  for (pi_p4_id_t id = pi_p4info_counter_begin(p4info);
+       id != pi_p4info_counter_end(p4info);
+       id = pi_p4info_counter_next(p4info, id)) {
+    if (pi_p4info_counter_get_direct(p4info, id) != PI_INVALID_ID) continue;
+    dummy_counter_array_t *counter = malloc(sizeof(dummy_counter_array_t));
+    counter->size = pi_p4info_counter_get_size(p4info, id);
+    counter->values = calloc(counter->size, sizeof(pi_counter_data_t));
+    model_set(&model->counters, id, counter);
+  }
+
+  for (pi_p4_id_t id = pi_p4info_meter_begin(p4info);
+       id != pi_p4info_meter_end(p4info);
+       id = pi_p4info_meter_next(p4info, id)) {
+    if (pi_p4info_meter_get_direct(p4info, id) != PI_INVALID_ID) continue;
+    dummy_meter_array_t *meter = malloc(sizeof(dummy_meter_array_t));
+    meter->size = pi_p4info_meter_get_size(p4info, id);
+    meter->values = calloc(meter->size, sizeof(dummy_meter_t));
+    model_set(&model->meters, id, meter);
+  }
+
+  return model;
+}
+
+static void model_destroy(dummy_model_t *model) {
+  if (!model) return;
+  Word_t index;
+  Word_t *PValue;
+  Word_t Rc_word;
+
+  // tables first, they hold references to action profile members and groups
+  index = 0;
+  JLF(PValue, model->tables, index);
+  while (PValue != NULL) {
+    dummy_table_destroy((dummy_table_t *)*PValue);
+    JLN(PValue, model->tables, index);
+  }
+  JLFA(Rc_word, model->tables);
+
+  index = 0;
+  JLF(PValue, model->act_profs, index);
+  while (PValue != NULL) {
+    dummy_act_prof_destroy((dummy_act_prof_t *)*PValue);
+    JLN(PValue, model->act_profs, index);
+  }
+  JLFA(Rc_word, model->act_profs);
+
+  index = 0;
+  JLF(PValue, model->counters, index);
+  while (PValue != NULL) {
+    dummy_counter_array_t *counter = (dummy_counter_array_t *)*PValue;
+    free(counter->values);
+    free(counter);
+    JLN(PValue, model->counters, index);
+  }
+  JLFA(Rc_word, model->counters);
+
+  index = 0;
+  JLF(PValue, model->meters, index);
+  while (PValue != NULL) {
+    dummy_meter_array_t *meter = (dummy_meter_array_t *)*PValue;
+    free(meter->values);
+    free(meter);
+    JLN(PValue, model->meters, index);
+  }
+  JLFA(Rc_word, model->meters);
+  (void)Rc_word;
+
+  free(model);
+}
+
+void dummy_devices_init() {
+  for (size_t i = 0; i < NUM_DEVICES; i++) {
+    pthread_mutex_init(&devices[i].lock, NULL);
+    devices[i].assigned = 0;
+    devices[i].model = NULL;
+    devices[i].pending_model = NULL;
+  }
+}
+
+void dummy_devices_destroy() {
+  for (size_t i = 0; i < NUM_DEVICES; i++) {
+    model_destroy(devices[i].model);
+    model_destroy(devices[i].pending_model);
+    devices[i].model = NULL;
+    devices[i].pending_model = NULL;
+    devices[i].assigned = 0;
+    pthread_mutex_destroy(&devices[i].lock);
+  }
+}
+
+pi_status_t dummy_device_assign(pi_dev_id_t dev_id,
+                                const pi_p4info_t *p4info) {
+  if (dev_id >= NUM_DEVICES) return PI_STATUS_DEV_OUT_OF_RANGE;
+  dummy_device_t *device = &devices[dev_id];
+  dummy_model_t *model = model_create(p4info);
+  pthread_mutex_lock(&device->lock);
+  device->model = model;
+  device->assigned = 1;
+  pthread_mutex_unlock(&device->lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_device_update_start(pi_dev_id_t dev_id,
+                                      const pi_p4info_t *p4info) {
+  if (dev_id >= NUM_DEVICES) return PI_STATUS_DEV_OUT_OF_RANGE;
+  dummy_device_t *device = &devices[dev_id];
+  dummy_model_t *model = model_create(p4info);
+  dummy_model_t *old_pending;
+  pthread_mutex_lock(&device->lock);
+  old_pending = device->pending_model;
+  device->pending_model = model;
+  pthread_mutex_unlock(&device->lock);
+  // in case dummy_device_update_end was never called for a previous update
+  model_destroy(old_pending);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_device_update_end(pi_dev_id_t dev_id) {
+  if (dev_id >= NUM_DEVICES) return PI_STATUS_DEV_OUT_OF_RANGE;
+  dummy_device_t *device = &devices[dev_id];
+  dummy_model_t *old_model;
+  pthread_mutex_lock(&device->lock);
+  if (!device->pending_model) {
+    pthread_mutex_unlock(&device->lock);
+    return PI_STATUS_DEV_NOT_ASSIGNED;
+  }
+  old_model = device->model;
+  device->model = device->pending_model;
+  device->pending_model = NULL;
+  device->assigned = 1;
+  pthread_mutex_unlock(&device->lock);
+  model_destroy(old_model);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_device_remove(pi_dev_id_t dev_id) {
+  if (dev_id >= NUM_DEVICES) return PI_STATUS_DEV_OUT_OF_RANGE;
+  dummy_device_t *device = &devices[dev_id];
+  dummy_model_t *model, *pending_model;
+  pthread_mutex_lock(&device->lock);
+  model = device->model;
+  pending_model = device->pending_model;
+  device->model = NULL;
+  device->pending_model = NULL;
+  device->assigned = 0;
+  pthread_mutex_unlock(&device->lock);
+  model_destroy(model);
+  model_destroy(pending_model);
+  return PI_STATUS_SUCCESS;
+}
+
+dummy_model_t *dummy_device_acquire(pi_dev_id_t dev_id) {
+  if (dev_id >= NUM_DEVICES) return NULL;
+  dummy_device_t *device = &devices[dev_id];
+  pthread_mutex_lock(&device->lock);
+  if (!device->assigned) {
+    pthread_mutex_unlock(&device->lock);
+    return NULL;
+  }
+  return device->model;
+}
+
+void dummy_device_release(pi_dev_id_t dev_id) {
+  pthread_mutex_unlock(&devices[dev_id].lock);
+}
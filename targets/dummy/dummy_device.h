@@ -0,0 +1,127 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_TARGETS_DUMMY_DUMMY_DEVICE_H_
+#define PI_TARGETS_DUMMY_DUMMY_DEVICE_H_
+
+#include <PI/pi.h>
+
+#include <Judy.h>
+
+// The dummy target keeps an in-memory model of each assigned device (tables,
+// action profiles, counters and meters), built from the device's p4info. This
+// lets the whole PI stack be exercised (and benchmarked) without a real
+// device.
+// All the objects of a device are protected by a single device lock: the
+// _pi_* functions call dummy_device_acquire before touching the model and
+// dummy_device_release once they are done.
+
+// errors specific to the dummy target, returned as
+// PI_STATUS_TARGET_ERROR + error code
+typedef enum {
+  DUMMY_ERROR_NONE = 0,
+  DUMMY_ERROR_TABLE_FULL,
+  DUMMY_ERROR_DUPLICATE_ENTRY,
+  DUMMY_ERROR_INVALID_HANDLE,
+  DUMMY_ERROR_WRONG_ENTRY_TYPE,
+  DUMMY_ERROR_ACT_PROF_FULL,
+  DUMMY_ERROR_GROUP_FULL,
+  DUMMY_ERROR_NO_SELECTOR,
+  DUMMY_ERROR_RESOURCE_IN_USE,
+  DUMMY_ERROR_MEMBER_NOT_IN_GROUP,
+  DUMMY_ERROR_MEMBER_ALREADY_IN_GROUP,
+  DUMMY_ERROR_INVALID_PREFIX_LENGTH,
+} dummy_error_t;
+
+#define DUMMY_STATUS(error) ((pi_status_t)(PI_STATUS_TARGET_ERROR + (error)))
+
+typedef struct {
+  int is_set;
+  pi_meter_spec_t spec;
+} dummy_meter_t;
+
+typedef struct {
+  size_t size;
+  pi_counter_data_t *values;
+} dummy_counter_array_t;
+
+typedef struct {
+  size_t size;
+  dummy_meter_t *values;
+} dummy_meter_array_t;
+
+// the unit and type of the stored spec are never PI_METER_*_DEFAULT, they are
+// replaced with the ones from the p4info
+void dummy_meter_set(const pi_p4info_t *p4info, pi_p4_id_t meter_id,
+                     dummy_meter_t *meter, const pi_meter_spec_t *meter_spec);
+
+// only the members flagged as valid in src are written
+void dummy_counter_write(pi_counter_data_t *dst, const pi_counter_data_t *src);
+
+// sets the valid flags of dst based on the unit of the counter
+void dummy_counter_read(const pi_p4info_t *p4info, pi_p4_id_t counter_id,
+                        const pi_counter_data_t *src, pi_counter_data_t *dst);
+
+typedef struct dummy_table_s dummy_table_t;
+typedef struct dummy_act_prof_s dummy_act_prof_t;
+
+typedef struct {
+  const pi_p4info_t *p4info;
+  // all JudyL arrays, indexed by P4 id
+  Pvoid_t tables;
+  Pvoid_t act_profs;
+  // indirect counters and meters only, direct resources are stored with the
+  // table entries
+  Pvoid_t counters;
+  Pvoid_t meters;
+} dummy_model_t;
+
+// the lookup functions return NULL if the id is unknown
+dummy_table_t *dummy_model_table(const dummy_model_t *model,
+                                 pi_p4_id_t table_id);
+dummy_act_prof_t *dummy_model_act_prof(const dummy_model_t *model,
+                                       pi_p4_id_t act_prof_id);
+dummy_counter_array_t *dummy_model_counter(const dummy_model_t *model,
+                                           pi_p4_id_t counter_id);
+dummy_meter_array_t *dummy_model_meter(const dummy_model_t *model,
+                                       pi_p4_id_t meter_id);
+
+void dummy_devices_init();
+
+void dummy_devices_destroy();
+
+pi_status_t dummy_device_assign(pi_dev_id_t dev_id, const pi_p4info_t *p4info);
+
+// a new (empty) model is built for the new p4info and replaces the current one
+// in dummy_device_update_end
+pi_status_t dummy_device_update_start(pi_dev_id_t dev_id,
+                                      const pi_p4info_t *p4info);
+
+pi_status_t dummy_device_update_end(pi_dev_id_t dev_id);
+
+pi_status_t dummy_device_remove(pi_dev_id_t dev_id);
+
+// returns the model with the device lock held, or NULL (and the lock is not
+// held) if the device is not assigned
+dummy_model_t *dummy_device_acquire(pi_dev_id_t dev_id);
+
+void dummy_device_release(pi_dev_id_t dev_id);
+
+#endif  // PI_TARGETS_DUMMY_DUMMY_DEVICE_H_
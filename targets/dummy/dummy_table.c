@@ -0,0 +1,810 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "dummy_table.h"
+
+#include <PI/int/pi_int.h>
+#include <PI/int/serialize.h>
+#include <PI/p4info.h>
+
+#include <Judy.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dummy_act_prof.h"
+
+typedef enum {
+  TABLE_KIND_EXACT,
+  TABLE_KIND_LPM,
+  TABLE_KIND_TERNARY,
+} table_kind_t;
+
+typedef struct {
+  pi_p4info_match_type_t match_type;
+  size_t bitwidth;
+  size_t nbytes;
+  // offset of the field in the PI match key and in the lookup key
+  size_t mk_offset;
+  size_t key_offset;
+} field_t;
+
+typedef struct {
+  pi_action_entry_type_t entry_type;
+  pi_p4_id_t action_id;
+  size_t adata_size;
+  char *adata;
+  pi_indirect_handle_t indirect_handle;
+} action_entry_t;
+
+typedef struct {
+  pi_entry_handle_t handle;
+  uint32_t priority;
+  char *mk;
+  action_entry_t action;
+  pi_entry_properties_t properties;
+  // one per direct counter / meter of the table, in the same order as
+  // direct_counters / direct_meters
+  pi_counter_data_t *counters;
+  dummy_meter_t *meters;
+} entry_t;
+
+typedef struct trie_node_s {
+  struct trie_node_s *children[2];
+  entry_t *entry;
+} trie_node_t;
+
+struct dummy_table_s {
+  const pi_p4info_t *p4info;
+  pi_p4_id_t table_id;
+  table_kind_t kind;
+  size_t max_size;  // 0 means no limit
+  size_t num_entries;
+  size_t num_fields;
+  field_t *fields;
+  size_t mkey_nbytes;
+  size_t key_nbytes;
+  size_t lpm_field;  // only for TABLE_KIND_LPM
+  dummy_act_prof_t *act_prof;
+  size_t num_direct_counters;
+  pi_p4_id_t *direct_counters;
+  size_t num_direct_meters;
+  pi_p4_id_t *direct_meters;
+  // JudyL, entry handle -> entry_t *
+  Pvoid_t entries;
+  // JudyHS, match key -> entry_t *; for non-exact tables the key is prefixed
+  // with the priority, since the same match key can be used with different
+  // priorities (always 0 for LPM tables, see canonical_mk)
+  Pvoid_t keys;
+  // used to build JudyHS and trie keys, big enough for both
+  char *scratch;
+  // used by canonical_mk, mkey_nbytes bytes
+  char *mk_scratch;
+  trie_node_t *trie;
+  // TABLE_KIND_TERNARY only, sorted by priority
+  entry_t **sorted;
+  size_t sorted_capacity;
+  action_entry_t default_entry;
+};
+
+static size_t get_bit(const char *key, size_t i) {
+  return (((const unsigned char *)key)[i / 8] >> (7 - (i % 8))) & 1;
+}
+
+static bool prefix_match(const char *v1, const char *v2, size_t nbits) {
+  size_t nbytes = nbits / 8;
+  if (memcmp(v1, v2, nbytes)) return false;
+  size_t rem = nbits % 8;
+  if (rem == 0) return true;
+  unsigned char mask = (unsigned char)(0xff << (8 - rem));
+  return ((v1[nbytes] ^ v2[nbytes]) & mask) == 0;
+}
+
+static uint32_t get_prefix_length(const field_t *field, const char *mk) {
+  uint32_t pLen;
+  retrieve_uint32(mk + field->mk_offset + field->nbytes, &pLen);
+  return pLen;
+}
+
+// clears the bits of v past the first nbits
+static void clear_bits_from(char *v, size_t nbytes, size_t nbits) {
+  size_t i = nbits / 8;
+  if (i >= nbytes) return;
+  size_t rem = nbits % 8;
+  if (rem != 0) v[i++] &= (char)(0xff << (8 - rem));
+  memset(v + i, 0, nbytes - i);
+}
+
+// the trie key is made of the exact fields followed by the LPM field
+static size_t build_trie_key(const dummy_table_t *table, const char *src,
+                             bool from_mk, char *dst) {
+  size_t nbits = 0;
+  for (size_t i = 0; i < table->num_fields; i++) {
+    if (i == table->lpm_field) continue;
+    const field_t *field = &table->fields[i];
+    memcpy(dst, src + (from_mk ? field->mk_offset : field->key_offset),
+           field->nbytes);
+    dst += field->nbytes;
+    nbits += 8 * field->nbytes;
+  }
+  const field_t *field = &table->fields[table->lpm_field];
+  memcpy(dst, src + (from_mk ? field->mk_offset : field->key_offset),
+         field->nbytes);
+  // the field value is right-aligned in its bytes
+  nbits += 8 * field->nbytes - field->bitwidth;
+  return nbits + (from_mk ? get_prefix_length(field, src) : field->bitwidth);
+}
+
+static void trie_insert(trie_node_t **root, const char *key, size_t nbits,
+                        entry_t *entry) {
+  trie_node_t **node = root;
+  for (size_t i = 0;; i++) {
+    if (*node == NULL) *node = calloc(1, sizeof(trie_node_t));
+    if (i == nbits) break;
+    node = &(*node)->children[get_bit(key, i)];
+  }
+  assert((*node)->entry == NULL);
+  (*node)->entry = entry;
+}
+
+// prunes the nodes which become empty
+static void trie_remove(trie_node_t **node, const char *key, size_t nbits,
+                        size_t depth) {
+  assert(*node);
+  if (depth == nbits) {
+    (*node)->entry = NULL;
+  } else {
+    trie_remove(&(*node)->children[get_bit(key, depth)], key, nbits,
+                depth + 1);
+  }
+  if (!(*node)->entry && !(*node)->children[0] && !(*node)->children[1]) {
+    free(*node);
+    *node = NULL;
+  }
+}
+
+static entry_t *trie_lookup(const trie_node_t *node, const char *key,
+                            size_t nbits) {
+  entry_t *best = NULL;
+  for (size_t i = 0; node != NULL; i++) {
+    if (node->entry) best = node->entry;
+    if (i == nbits) break;
+    node = node->children[get_bit(key, i)];
+  }
+  return best;
+}
+
+static void trie_destroy(trie_node_t *node) {
+  if (node == NULL) return;
+  trie_destroy(node->children[0]);
+  trie_destroy(node->children[1]);
+  free(node);
+}
+
+static bool field_matches(const field_t *field, const char *mk,
+                          const char *key) {
+  const char *v = mk + field->mk_offset;
+  const char *k = key + field->key_offset;
+  switch (field->match_type) {
+    case PI_P4INFO_MATCH_TYPE_VALID:
+    case PI_P4INFO_MATCH_TYPE_EXACT:
+      return !memcmp(v, k, field->nbytes);
+    case PI_P4INFO_MATCH_TYPE_LPM:
+      return prefix_match(v, k, 8 * field->nbytes - field->bitwidth +
+                                    get_prefix_length(field, mk));
+    case PI_P4INFO_MATCH_TYPE_TERNARY: {
+      const char *m = v + field->nbytes;
+      for (size_t i = 0; i < field->nbytes; i++)
+        if ((v[i] & m[i]) != (k[i] & m[i])) return false;
+      return true;
+    }
+    case PI_P4INFO_MATCH_TYPE_RANGE:
+      return memcmp(v, k, field->nbytes) <= 0 &&
+             memcmp(k, v + field->nbytes, field->nbytes) <= 0;
+    default:
+      assert(0);
+  }
+  return false;
+}
+
+// first position with a priority strictly greater than the given one
+static size_t sorted_upper_bound(const dummy_table_t *table,
+                                 uint32_t priority) {
+  size_t lo = 0, hi = table->num_entries;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (table->sorted[mid]->priority <= priority)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void sorted_insert(dummy_table_t *table, entry_t *entry) {
+  if (table->num_entries == table->sorted_capacity) {
+    table->sorted_capacity =
+        (table->sorted_capacity == 0) ? 16 : 2 * table->sorted_capacity;
+    table->sorted = realloc(table->sorted,
+                            table->sorted_capacity * sizeof(entry_t *));
+  }
+  // entries with the same priority are kept in insertion order
+  size_t pos = sorted_upper_bound(table, entry->priority);
+  memmove(&table->sorted[pos + 1], &table->sorted[pos],
+          (table->num_entries - pos) * sizeof(entry_t *));
+  table->sorted[pos] = entry;
+}
+
+static void sorted_remove(dummy_table_t *table, entry_t *entry) {
+  size_t pos = sorted_upper_bound(table, entry->priority);
+  while (pos > 0 && table->sorted[pos - 1] != entry) pos--;
+  assert(pos > 0);
+  pos--;
+  memmove(&table->sorted[pos], &table->sorted[pos + 1],
+          (table->num_entries - pos - 1) * sizeof(entry_t *));
+}
+
+// An LPM entry is identified by its trie node, i.e. by the exact fields and
+// the first prefix length bits of the LPM field: the priority and the bits
+// past the prefix length are ignored, so that for example 10.0.0.0/8 and
+// 10.1.0.0/8 are the same entry. The match key used for LPM tables is
+// therefore a copy of mk (in mk_scratch) with these bits cleared, and the
+// priority used is 0. Returns NULL if the prefix length is invalid.
+static const char *canonical_mk(dummy_table_t *table, const char *mk,
+                                uint32_t *priority) {
+  if (table->kind == TABLE_KIND_EXACT) {
+    *priority = 0;
+    return mk;
+  }
+  if (table->kind == TABLE_KIND_TERNARY) return mk;
+  *priority = 0;
+  const field_t *field = &table->fields[table->lpm_field];
+  uint32_t pLen = get_prefix_length(field, mk);
+  if (pLen > field->bitwidth) return NULL;
+  memcpy(table->mk_scratch, mk, table->mkey_nbytes);
+  clear_bits_from(table->mk_scratch + field->mk_offset, field->nbytes,
+                  8 * field->nbytes - field->bitwidth + pLen);
+  return table->mk_scratch;
+}
+
+// builds the JudyHS key in scratch and returns its size
+static size_t build_hs_key(dummy_table_t *table, uint32_t priority,
+                           const char *mk) {
+  char *dst = table->scratch;
+  if (table->kind != TABLE_KIND_EXACT) dst += emit_uint32(dst, priority);
+  memcpy(dst, mk, table->mkey_nbytes);
+  return (dst - table->scratch) + table->mkey_nbytes;
+}
+
+static entry_t *find_entry_by_key(dummy_table_t *table, uint32_t priority,
+                                  const char *mk) {
+  size_t size = build_hs_key(table, priority, mk);
+  Word_t *PValue;
+  JHSG(PValue, table->keys, table->scratch, size);
+  return (PValue == NULL) ? NULL : (entry_t *)*PValue;
+}
+
+static entry_t *find_entry_by_handle(const dummy_table_t *table,
+                                     pi_entry_handle_t entry_handle) {
+  Word_t *PValue;
+  JLG(PValue, table->entries, (Word_t)entry_handle);
+  return (PValue == NULL) ? NULL : (entry_t *)*PValue;
+}
+
+static void action_entry_clear(dummy_table_t *table, action_entry_t *action) {
+  if (action->entry_type == PI_ACTION_ENTRY_TYPE_INDIRECT)
+    dummy_act_prof_unref(table->act_prof, action->indirect_handle);
+  free(action->adata);
+  memset(action, 0, sizeof(*action));
+}
+
+static pi_status_t action_entry_set(dummy_table_t *table,
+                                    action_entry_t *action,
+                                    const pi_table_entry_t *table_entry) {
+  switch (table_entry->entry_type) {
+    case PI_ACTION_ENTRY_TYPE_DATA: {
+      if (table->act_prof) return DUMMY_STATUS(DUMMY_ERROR_WRONG_ENTRY_TYPE);
+      const pi_action_data_t *adata = table_entry->entry.action_data;
+      char *data = malloc(adata->data_size);
+      memcpy(data, adata->data, adata->data_size);
+      action_entry_clear(table, action);
+      action->entry_type = PI_ACTION_ENTRY_TYPE_DATA;
+      action->action_id = adata->action_id;
+      action->adata_size = adata->data_size;
+      action->adata = data;
+    } break;
+    case PI_ACTION_ENTRY_TYPE_INDIRECT: {
+      if (!table->act_prof) return DUMMY_STATUS(DUMMY_ERROR_WRONG_ENTRY_TYPE);
+      pi_indirect_handle_t h = table_entry->entry.indirect_handle;
+      // reference first, in case h is already the current handle
+      pi_status_t status = dummy_act_prof_ref(table->act_prof, h);
+      if (status != PI_STATUS_SUCCESS) return status;
+      action_entry_clear(table, action);
+      action->entry_type = PI_ACTION_ENTRY_TYPE_INDIRECT;
+      action->indirect_handle = h;
+    } break;
+    default:
+      return PI_STATUS_INVALID_ENTRY_TYPE;
+  }
+  return PI_STATUS_SUCCESS;
+}
+
+static size_t find_res(const pi_p4_id_t *ids, size_t num, pi_p4_id_t id) {
+  size_t i = 0;
+  for (; i < num; i++) {
+    if (ids[i] == id) break;
+  }
+  return i;
+}
+
+static pi_status_t check_direct_res(const dummy_table_t *table,
+                                    const pi_direct_res_config_t *config) {
+  if (!config) return PI_STATUS_SUCCESS;
+  for (size_t i = 0; i < config->num_configs; i++) {
+    pi_p4_id_t res_id = config->configs[i].res_id;
+    switch (PI_GET_TYPE_ID(res_id)) {
+      case PI_COUNTER_ID:
+        if (find_res(table->direct_counters, table->num_direct_counters,
+                     res_id) == table->num_direct_counters)
+          return PI_STATUS_NOT_A_DIRECT_RES_OF_TABLE;
+        break;
+      case PI_METER_ID:
+        if (find_res(table->direct_meters, table->num_direct_meters, res_id) ==
+            table->num_direct_meters)
+          return PI_STATUS_NOT_A_DIRECT_RES_OF_TABLE;
+        break;
+      default:
+        return PI_STATUS_INVALID_RES_TYPE_ID;
+    }
+  }
+  return PI_STATUS_SUCCESS;
+}
+
+// config needs to have been checked with check_direct_res
+static void set_direct_res(const dummy_table_t *table, entry_t *entry,
+                           const pi_direct_res_config_t *config) {
+  if (!config) return;
+  for (size_t i = 0; i < config->num_configs; i++) {
+    pi_p4_id_t res_id = config->configs[i].res_id;
+    const void *res_config = config->configs[i].config;
+    if (PI_GET_TYPE_ID(res_id) == PI_COUNTER_ID) {
+      size_t idx = find_res(table->direct_counters, table->num_direct_counters,
+                            res_id);
+      dummy_counter_write(&entry->counters[idx],
+                          (const pi_counter_data_t *)res_config);
+    } else {
+      size_t idx = find_res(table->direct_meters, table->num_direct_meters,
+                            res_id);
+      dummy_meter_set(table->p4info, res_id, &entry->meters[idx],
+                      (const pi_meter_spec_t *)res_config);
+    }
+  }
+}
+
+static void set_properties(entry_t *entry,
+                           const pi_entry_properties_t *properties) {
+  if (properties)
+    entry->properties = *properties;
+  else
+    pi_entry_properties_clear(&entry->properties);
+}
+
+dummy_table_t *dummy_table_create(const pi_p4info_t *p4info,
+                                  pi_p4_id_t table_id,
+                                  dummy_act_prof_t *act_prof) {
+  dummy_table_t *table = calloc(1, sizeof(dummy_table_t));
+  table->p4info = p4info;
+  table->table_id = table_id;
+  table->max_size = pi_p4info_table_max_size(p4info, table_id);
+  table->act_prof = act_prof;
+
+  table->num_fields = pi_p4info_table_num_match_fields(p4info, table_id);
+  table->fields = calloc(table->num_fields, sizeof(field_t));
+  table->mkey_nbytes = pi_p4info_table_match_key_size(p4info, table_id);
+  size_t num_lpm = 0, num_other = 0;
+  for (size_t i = 0; i < table->num_fields; i++) {
+    const pi_p4info_match_field_info_t *finfo =
+        pi_p4info_table_match_field_info(p4info, table_id, i);
+    field_t *field = &table->fields[i];
+    field->match_type = finfo->match_type;
+    field->bitwidth = finfo->bitwidth;
+    field->nbytes = (finfo->bitwidth + 7) / 8;
+    field->mk_offset =
+        pi_p4info_table_match_field_offset(p4info, table_id, finfo->mf_id);
+    field->key_offset = table->key_nbytes;
+    table->key_nbytes += field->nbytes;
+    if (field->match_type == PI_P4INFO_MATCH_TYPE_LPM) {
+      num_lpm++;
+      table->lpm_field = i;
+    } else if (field->match_type != PI_P4INFO_MATCH_TYPE_EXACT &&
+               field->match_type != PI_P4INFO_MATCH_TYPE_VALID) {
+      num_other++;
+    }
+  }
+  if (num_lpm == 0 && num_other == 0)
+    table->kind = TABLE_KIND_EXACT;
+  else if (num_lpm == 1 && num_other == 0)
+    table->kind = TABLE_KIND_LPM;
+  else
+    table->kind = TABLE_KIND_TERNARY;
+
+  size_t scratch_size = sizeof(uint32_t) + table->mkey_nbytes;
+  if (scratch_size < table->key_nbytes) scratch_size = table->key_nbytes;
+  table->scratch = malloc(scratch_size);
+  table->mk_scratch = malloc(table->mkey_nbytes);
+
+  size_t num_direct_res;
+  const pi_p4_id_t *direct_res =
+      pi_p4info_table_get_direct_resources(p4info, table_id, &num_direct_res);
+  table->direct_counters = malloc(num_direct_res * sizeof(pi_p4_id_t));
+  table->direct_meters = malloc(num_direct_res * sizeof(pi_p4_id_t));
+  for (size_t i = 0; i < num_direct_res; i++) {
+    switch (PI_GET_TYPE_ID(direct_res[i])) {
+      case PI_COUNTER_ID:
+        table->direct_counters[table->num_direct_counters++] = direct_res[i];
+        break;
+      case PI_METER_ID:
+        table->direct_meters[table->num_direct_meters++] = direct_res[i];
+        break;
+      default:
+        break;
+    }
+  }
+
+  table->entries = (Pvoid_t)NULL;
+  table->keys = (Pvoid_t)NULL;
+  return table;
+}
+
+static void entry_free(dummy_table_t *table, entry_t *entry) {
+  action_entry_clear(table, &entry->action);
+  free(entry->mk);
+  free(entry->counters);
+  free(entry->meters);
+  free(entry);
+}
+
+void dummy_table_destroy(dummy_table_t *table) {
+  Word_t index = 0;
+  Word_t *PValue;
+  Word_t Rc_word;
+  JLF(PValue, table->entries, index);
+  while (PValue != NULL) {
+    entry_free(table, (entry_t *)*PValue);
+    JLN(PValue, table->entries, index);
+  }
+  JLFA(Rc_word, table->entries);
+  JHSFA(Rc_word, table->keys);
+  (void)Rc_word;
+  action_entry_clear(table, &table->default_entry);
+  trie_destroy(table->trie);
+  free(table->sorted);
+  free(table->scratch);
+  free(table->mk_scratch);
+  free(table->direct_counters);
+  free(table->direct_meters);
+  free(table->fields);
+  free(table);
+}
+
+pi_status_t dummy_table_entry_add(dummy_table_t *table,
+                                  const pi_match_key_t *match_key,
+                                  const pi_table_entry_t *table_entry,
+                                  int overwrite,
+                                  pi_entry_handle_t *entry_handle) {
+  uint32_t priority = match_key->priority;
+  const char *mk = canonical_mk(table, match_key->data, &priority);
+  if (mk == NULL) return DUMMY_STATUS(DUMMY_ERROR_INVALID_PREFIX_LENGTH);
+  pi_status_t status =
+      check_direct_res(table, table_entry->direct_res_config);
+  if (status != PI_STATUS_SUCCESS) return status;
+
+  entry_t *entry = find_entry_by_key(table, priority, mk);
+  if (entry) {
+    if (!overwrite) return DUMMY_STATUS(DUMMY_ERROR_DUPLICATE_ENTRY);
+    *entry_handle = entry->handle;
+    return dummy_table_entry_modify(table, entry->handle, table_entry);
+  }
+
+  if (table->max_size > 0 && table->num_entries >= table->max_size)
+    return DUMMY_STATUS(DUMMY_ERROR_TABLE_FULL);
+
+  entry = calloc(1, sizeof(entry_t));
+  status = action_entry_set(table, &entry->action, table_entry);
+  if (status != PI_STATUS_SUCCESS) {
+    free(entry);
+    return status;
+  }
+
+  // lowest available handle
+  Word_t h = 0;
+  int Rc_int;
+  JLFE(Rc_int, table->entries, h);
+  assert(Rc_int == 1);
+  entry->handle = h;
+  entry->priority = priority;
+  entry->mk = malloc(table->mkey_nbytes);
+  memcpy(entry->mk, mk, table->mkey_nbytes);
+  set_properties(entry, table_entry->entry_properties);
+  entry->counters =
+      calloc(table->num_direct_counters, sizeof(pi_counter_data_t));
+  entry->meters = calloc(table->num_direct_meters, sizeof(dummy_meter_t));
+  set_direct_res(table, entry, table_entry->direct_res_config);
+
+  Word_t *PValue;
+  JLI(PValue, table->entries, h);
+  *PValue = (Word_t)entry;
+  size_t size = build_hs_key(table, priority, entry->mk);
+  JHSI(PValue, table->keys, table->scratch, size);
+  *PValue = (Word_t)entry;
+
+  switch (table->kind) {
+    case TABLE_KIND_EXACT:
+      // the keys index is used for lookups
+      break;
+    case TABLE_KIND_LPM:
+      size = build_trie_key(table, entry->mk, true, table->scratch);
+      trie_insert(&table->trie, table->scratch, size, entry);
+      break;
+    case TABLE_KIND_TERNARY:
+      sorted_insert(table, entry);
+      break;
+  }
+  table->num_entries++;
+
+  *entry_handle = entry->handle;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_table_entry_modify(dummy_table_t *table,
+                                     pi_entry_handle_t entry_handle,
+                                     const pi_table_entry_t *table_entry) {
+  entry_t *entry = find_entry_by_handle(table, entry_handle);
+  if (!entry) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  pi_status_t status =
+      check_direct_res(table, table_entry->direct_res_config);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = action_entry_set(table, &entry->action, table_entry);
+  if (status != PI_STATUS_SUCCESS) return status;
+  if (table_entry->entry_properties)
+    set_properties(entry, table_entry->entry_properties);
+  set_direct_res(table, entry, table_entry->direct_res_config);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_table_entry_delete(dummy_table_t *table,
+                                     pi_entry_handle_t entry_handle) {
+  entry_t *entry = find_entry_by_handle(table, entry_handle);
+  if (!entry) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+
+  switch (table->kind) {
+    case TABLE_KIND_EXACT:
+      break;
+    case TABLE_KIND_LPM: {
+      size_t nbits = build_trie_key(table, entry->mk, true, table->scratch);
+      trie_remove(&table->trie, table->scratch, nbits, 0);
+    } break;
+    case TABLE_KIND_TERNARY:
+      sorted_remove(table, entry);
+      break;
+  }
+
+  int Rc_int;
+  size_t size = build_hs_key(table, entry->priority, entry->mk);
+  JHSD(Rc_int, table->keys, table->scratch, size);
+  assert(Rc_int == 1);
+  JLD(Rc_int, table->entries, (Word_t)entry_handle);
+  assert(Rc_int == 1);
+  table->num_entries--;
+
+  entry_free(table, entry);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_table_entry_find(dummy_table_t *table,
+                                   const pi_match_key_t *match_key,
+                                   pi_entry_handle_t *entry_handle) {
+  uint32_t priority = match_key->priority;
+  const char *mk = canonical_mk(table, match_key->data, &priority);
+  if (mk == NULL) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  entry_t *entry = find_entry_by_key(table, priority, mk);
+  if (!entry) return DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  *entry_handle = entry->handle;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t dummy_table_default_set(dummy_table_t *table,
+                                    const pi_table_entry_t *table_entry) {
+  if (table_entry->entry_type == PI_ACTION_ENTRY_TYPE_DATA &&
+      pi_p4info_table_has_const_default_action(table->p4info,
+                                               table->table_id)) {
+    bool has_mutable_action_params;
+    pi_p4_id_t default_action_id = pi_p4info_table_get_const_default_action(
+        table->p4info, table->table_id, &has_mutable_action_params);
+    if (default_action_id != table_entry->entry.action_data->action_id)
+      return PI_STATUS_CONST_DEFAULT_ACTION;
+    if (!has_mutable_action_params)
+      return PI_STATUS_CONST_DEFAULT_ACTION_NON_MUTABLE_PARAMS;
+  }
+  return action_entry_set(table, &table->default_entry, table_entry);
+}
+
+pi_status_t dummy_table_default_get(const dummy_table_t *table,
+                                    pi_table_entry_t *table_entry) {
+  const action_entry_t *action = &table->default_entry;
+  table_entry->entry_type = action->entry_type;
+  table_entry->entry_properties = NULL;
+  table_entry->direct_res_config = NULL;
+  switch (action->entry_type) {
+    case PI_ACTION_ENTRY_TYPE_NONE:
+      break;
+    case PI_ACTION_ENTRY_TYPE_DATA: {
+      // single allocation for the struct and the data
+      pi_action_data_t *adata =
+          malloc(sizeof(pi_action_data_t) + action->adata_size);
+      adata->p4info = table->p4info;
+      adata->action_id = action->action_id;
+      adata->data_size = action->adata_size;
+      adata->data = (char *)(adata + 1);
+      memcpy(adata->data, action->adata, action->adata_size);
+      table_entry->entry.action_data = adata;
+    } break;
+    case PI_ACTION_ENTRY_TYPE_INDIRECT:
+      table_entry->entry.indirect_handle = action->indirect_handle;
+      break;
+  }
+  return PI_STATUS_SUCCESS;
+}
+
+void dummy_table_default_done(pi_table_entry_t *table_entry) {
+  if (table_entry->entry_type == PI_ACTION_ENTRY_TYPE_DATA)
+    free(table_entry->entry.action_data);
+}
+
+static size_t entry_serialized_size(const dummy_table_t *table,
+                                    const entry_t *entry) {
+  size_t size = sizeof(s_pi_entry_handle_t) + sizeof(uint32_t) +
+                table->mkey_nbytes + sizeof(s_pi_action_entry_type_t);
+  switch (entry->action.entry_type) {
+    case PI_ACTION_ENTRY_TYPE_DATA:
+      size += sizeof(s_pi_p4_id_t) + sizeof(uint32_t) +
+              entry->action.adata_size;
+      break;
+    case PI_ACTION_ENTRY_TYPE_INDIRECT:
+      size += sizeof(s_pi_indirect_handle_t);
+      break;
+    default:
+      break;
+  }
+  size += sizeof(uint32_t);
+  if (pi_entry_properties_is_set(&entry->properties,
+                                 PI_ENTRY_PROPERTY_TYPE_TTL))
+    size += sizeof(uint32_t);
+  return size;
+}
+
+static char *emit_entry(const dummy_table_t *table, const entry_t *entry,
+                        char *dst) {
+  dst += emit_entry_handle(dst, entry->handle);
+  dst += emit_uint32(dst, entry->priority);
+  memcpy(dst, entry->mk, table->mkey_nbytes);
+  dst += table->mkey_nbytes;
+  dst += emit_action_entry_type(dst, entry->action.entry_type);
+  switch (entry->action.entry_type) {
+    case PI_ACTION_ENTRY_TYPE_DATA:
+      dst += emit_p4_id(dst, entry->action.action_id);
+      dst += emit_uint32(dst, entry->action.adata_size);
+      memcpy(dst, entry->action.adata, entry->action.adata_size);
+      dst += entry->action.adata_size;
+      break;
+    case PI_ACTION_ENTRY_TYPE_INDIRECT:
+      dst += emit_indirect_handle(dst, entry->action.indirect_handle);
+      break;
+    default:
+      break;
+  }
+  dst += emit_uint32(dst, entry->properties.valid_properties);
+  if (pi_entry_properties_is_set(&entry->properties,
+                                 PI_ENTRY_PROPERTY_TYPE_TTL))
+    dst += emit_uint32(dst, entry->properties.ttl);
+  return dst;
+}
+
+void dummy_table_fetch(const dummy_table_t *table, pi_table_fetch_res_t *res) {
+  Word_t index;
+  Word_t *PValue;
+
+  size_t data_size = 0;
+  index = 0;
+  JLF(PValue, table->entries, index);
+  while (PValue != NULL) {
+    data_size += entry_serialized_size(table, (const entry_t *)*PValue);
+    JLN(PValue, table->entries, index);
+  }
+
+  res->num_entries = table->num_entries;
+  res->mkey_nbytes = table->mkey_nbytes;
+  res->entries_size = data_size;
+  res->entries = malloc(data_size);
+
+  char *dst = res->entries;
+  index = 0;
+  JLF(PValue, table->entries, index);
+  while (PValue != NULL) {
+    dst = emit_entry(table, (const entry_t *)*PValue, dst);
+    JLN(PValue, table->entries, index);
+  }
+  assert(dst == res->entries + data_size);
+}
+
+bool dummy_table_lookup(dummy_table_t *table, const char *key,
+                        pi_entry_handle_t *entry_handle) {
+  entry_t *entry = NULL;
+  switch (table->kind) {
+    case TABLE_KIND_EXACT: {
+      // for exact tables, the lookup key is the match key
+      Word_t *PValue;
+      JHSG(PValue, table->keys, (void *)key, table->key_nbytes);
+      if (PValue != NULL) entry = (entry_t *)*PValue;
+    } break;
+    case TABLE_KIND_LPM: {
+      size_t nbits = build_trie_key(table, key, false, table->scratch);
+      entry = trie_lookup(table->trie, table->scratch, nbits);
+    } break;
+    case TABLE_KIND_TERNARY:
+      for (size_t i = 0; i < table->num_entries && !entry; i++) {
+        entry_t *candidate = table->sorted[i];
+        size_t f = 0;
+        for (; f < table->num_fields; f++) {
+          if (!field_matches(&table->fields[f], candidate->mk, key)) break;
+        }
+        if (f == table->num_fields) entry = candidate;
+      }
+      break;
+  }
+  if (!entry) return false;
+  *entry_handle = entry->handle;
+  return true;
+}
+
+size_t dummy_table_num_entries(const dummy_table_t *table) {
+  return table->num_entries;
+}
+
+pi_counter_data_t *dummy_table_direct_counter(dummy_table_t *table,
+                                              pi_entry_handle_t entry_handle,
+                                              pi_p4_id_t counter_id) {
+  size_t idx = find_res(table->direct_counters, table->num_direct_counters,
+                        counter_id);
+  if (idx == table->num_direct_counters) return NULL;
+  entry_t *entry = find_entry_by_handle(table, entry_handle);
+  return (entry == NULL) ? NULL : &entry->counters[idx];
+}
+
+dummy_meter_t *dummy_table_direct_meter(dummy_table_t *table,
+                                        pi_entry_handle_t entry_handle,
+                                        pi_p4_id_t meter_id) {
+  size_t idx =
+      find_res(table->direct_meters, table->num_direct_meters, meter_id);
+  if (idx == table->num_direct_meters) return NULL;
+  entry_t *entry = find_entry_by_handle(table, entry_handle);
+  return (entry == NULL) ? NULL : &entry->meters[idx];
+}
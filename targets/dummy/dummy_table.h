@@ -0,0 +1,96 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_TARGETS_DUMMY_DUMMY_TABLE_H_
+#define PI_TARGETS_DUMMY_DUMMY_TABLE_H_
+
+#include <PI/pi.h>
+
+#include <stdbool.h>
+
+#include "dummy_device.h"
+
+// A match table. Entries are indexed by handle and by match key (for
+// duplicate detection and the _wkey operations). The lookup structure depends
+// on the match types of the table:
+//  - exact (and valid) fields only: hash table on the match key
+//  - one LPM field, the other fields exact: binary trie, the LPM field being
+//    the last part of the trie key
+//  - anything else (ternary, range, several LPM fields): list of entries
+//    ordered by priority; as in bmv2, a lower priority value means a higher
+//    priority
+
+// act_prof is NULL unless the table is implemented with an action profile
+dummy_table_t *dummy_table_create(const pi_p4info_t *p4info,
+                                  pi_p4_id_t table_id,
+                                  dummy_act_prof_t *act_prof);
+
+void dummy_table_destroy(dummy_table_t *table);
+
+pi_status_t dummy_table_entry_add(dummy_table_t *table,
+                                  const pi_match_key_t *match_key,
+                                  const pi_table_entry_t *table_entry,
+                                  int overwrite,
+                                  pi_entry_handle_t *entry_handle);
+
+pi_status_t dummy_table_entry_modify(dummy_table_t *table,
+                                     pi_entry_handle_t entry_handle,
+                                     const pi_table_entry_t *table_entry);
+
+pi_status_t dummy_table_entry_delete(dummy_table_t *table,
+                                     pi_entry_handle_t entry_handle);
+
+// finds the handle of the entry with the given match key
+pi_status_t dummy_table_entry_find(dummy_table_t *table,
+                                   const pi_match_key_t *match_key,
+                                   pi_entry_handle_t *entry_handle);
+
+pi_status_t dummy_table_default_set(dummy_table_t *table,
+                                    const pi_table_entry_t *table_entry);
+
+// action data is allocated with malloc, release it with
+// dummy_table_default_done
+pi_status_t dummy_table_default_get(const dummy_table_t *table,
+                                    pi_table_entry_t *table_entry);
+
+void dummy_table_default_done(pi_table_entry_t *table_entry);
+
+// serializes all entries in the format expected by pi_table_entries_next,
+// res->entries is allocated with malloc
+void dummy_table_fetch(const dummy_table_t *table, pi_table_fetch_res_t *res);
+
+// key is the concatenation of the values of all match fields, in the p4info
+// order, each field using (bitwidth + 7) / 8 bytes; returns false on a miss
+bool dummy_table_lookup(dummy_table_t *table, const char *key,
+                        pi_entry_handle_t *entry_handle);
+
+size_t dummy_table_num_entries(const dummy_table_t *table);
+
+// return NULL if there is no such entry or if the counter / meter is not a
+// direct resource of the table
+pi_counter_data_t *dummy_table_direct_counter(dummy_table_t *table,
+                                              pi_entry_handle_t entry_handle,
+                                              pi_p4_id_t counter_id);
+
+dummy_meter_t *dummy_table_direct_meter(dummy_table_t *table,
+                                        pi_entry_handle_t entry_handle,
+                                        pi_p4_id_t meter_id);
+
+#endif  // PI_TARGETS_DUMMY_DUMMY_TABLE_H_
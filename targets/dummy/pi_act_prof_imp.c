@@ -18,85 +18,111 @@
  *
  */
 
-#include "PI/pi.h"
+#include <PI/int/pi_int.h>
+#include <PI/pi.h>
+#include <PI/target/pi_act_prof_imp.h>
+#include <PI/target/pi_instrument.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
-#include "func_counter.h"
+#include "dummy_act_prof.h"
+#include "dummy_device.h"
+
+// on success, the device lock is held and needs to be released by the caller
+static pi_status_t acquire_act_prof(pi_dev_id_t dev_id, pi_p4_id_t act_prof_id,
+                                    dummy_act_prof_t **act_prof) {
+  dummy_model_t *model = dummy_device_acquire(dev_id);
+  if (!model) return PI_STATUS_DEV_NOT_ASSIGNED;
+  *act_prof = dummy_model_act_prof(model, act_prof_id);
+  if (!*act_prof) {
+    dummy_device_release(dev_id);
+    return PI_STATUS_NETV_INVALID_OBJ_ID;
+  }
+  return PI_STATUS_SUCCESS;
+}
 
 pi_status_t _pi_act_prof_mbr_create(pi_session_handle_t session_handle,
                                     pi_dev_tgt_t dev_tgt,
                                     pi_p4_id_t act_prof_id,
                                     const pi_action_data_t *action_data,
                                     pi_indirect_handle_t *mbr_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)act_prof_id;
-  (void)action_data;
-  (void)mbr_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_tgt.dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_act_prof_mbr_create(act_prof, action_data, mbr_handle);
+  dummy_device_release(dev_tgt.dev_id);
+  return status;
 }
 
 pi_status_t _pi_act_prof_mbr_delete(pi_session_handle_t session_handle,
                                     pi_dev_id_t dev_id, pi_p4_id_t act_prof_id,
                                     pi_indirect_handle_t mbr_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)act_prof_id;
-  (void)mbr_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_act_prof_mbr_delete(act_prof, mbr_handle);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_act_prof_mbr_modify(pi_session_handle_t session_handle,
                                     pi_dev_id_t dev_id, pi_p4_id_t act_prof_id,
                                     pi_indirect_handle_t mbr_handle,
                                     const pi_action_data_t *action_data) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)act_prof_id;
-  (void)mbr_handle;
-  (void)action_data;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_act_prof_mbr_modify(act_prof, mbr_handle, action_data);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_act_prof_grp_create(pi_session_handle_t session_handle,
                                     pi_dev_tgt_t dev_tgt,
                                     pi_p4_id_t act_prof_id, size_t max_size,
                                     pi_indirect_handle_t *grp_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)act_prof_id;
-  (void)max_size;
-  (void)grp_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_tgt.dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_act_prof_grp_create(act_prof, max_size, grp_handle);
+  dummy_device_release(dev_tgt.dev_id);
+  return status;
 }
 
 pi_status_t _pi_act_prof_grp_delete(pi_session_handle_t session_handle,
                                     pi_dev_id_t dev_id, pi_p4_id_t act_prof_id,
                                     pi_indirect_handle_t grp_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)act_prof_id;
-  (void)grp_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_act_prof_grp_delete(act_prof, grp_handle);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_act_prof_grp_add_mbr(pi_session_handle_t session_handle,
                                      pi_dev_id_t dev_id, pi_p4_id_t act_prof_id,
                                      pi_indirect_handle_t grp_handle,
                                      pi_indirect_handle_t mbr_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)act_prof_id;
-  (void)grp_handle;
-  (void)mbr_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_act_prof_grp_add_mbr(act_prof, grp_handle, mbr_handle);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_act_prof_grp_remove_mbr(pi_session_handle_t session_handle,
@@ -104,31 +130,36 @@ pi_status_t _pi_act_prof_grp_remove_mbr(pi_session_handle_t session_handle,
                                         pi_p4_id_t act_prof_id,
                                         pi_indirect_handle_t grp_handle,
                                         pi_indirect_handle_t mbr_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)act_prof_id;
-  (void)grp_handle;
-  (void)mbr_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_act_prof_grp_remove_mbr(act_prof, grp_handle, mbr_handle);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_act_prof_entries_fetch(pi_session_handle_t session_handle,
                                        pi_dev_id_t dev_id,
                                        pi_p4_id_t act_prof_id,
                                        pi_act_prof_fetch_res_t *res) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)act_prof_id;
-  (void)res;
-  func_counter_increment(__func__);
+  dummy_act_prof_t *act_prof;
+  pi_status_t status = acquire_act_prof(dev_id, act_prof_id, &act_prof);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_act_prof_fetch(act_prof, res);
+  dummy_device_release(dev_id);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_act_prof_entries_fetch_done(pi_session_handle_t session_handle,
                                             pi_act_prof_fetch_res_t *res) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)res;
-  func_counter_increment(__func__);
+  free(res->entries_members);
+  free(res->entries_groups);
+  free(res->mbr_handles);
   return PI_STATUS_SUCCESS;
 }
@@ -18,23 +18,72 @@
  *
  */
 
+#include <PI/p4info.h>
+#include <PI/pi.h>
 #include <PI/target/pi_counter_imp.h>
+#include <PI/target/pi_instrument.h>
 
 #include <stdio.h>
 
-#include "func_counter.h"
+#include "dummy_device.h"
+#include "dummy_table.h"
+
+// on success, the device lock is held and needs to be released by the caller
+static pi_status_t acquire_counter(pi_dev_id_t dev_id, pi_p4_id_t counter_id,
+                                   size_t index, const pi_p4info_t **p4info,
+                                   pi_counter_data_t **data) {
+  dummy_model_t *model = dummy_device_acquire(dev_id);
+  if (!model) return PI_STATUS_DEV_NOT_ASSIGNED;
+  dummy_counter_array_t *counter = dummy_model_counter(model, counter_id);
+  pi_status_t status = PI_STATUS_SUCCESS;
+  if (!counter)
+    status = PI_STATUS_NETV_INVALID_OBJ_ID;
+  else if (index >= counter->size)
+    status = PI_STATUS_OUT_OF_BOUND_IDX;
+  if (status != PI_STATUS_SUCCESS) {
+    dummy_device_release(dev_id);
+    return status;
+  }
+  *p4info = model->p4info;
+  *data = &counter->values[index];
+  return PI_STATUS_SUCCESS;
+}
+
+static pi_status_t acquire_direct_counter(pi_dev_id_t dev_id,
+                                          pi_p4_id_t counter_id,
+                                          pi_entry_handle_t entry_handle,
+                                          const pi_p4info_t **p4info,
+                                          pi_counter_data_t **data) {
+  dummy_model_t *model = dummy_device_acquire(dev_id);
+  if (!model) return PI_STATUS_DEV_NOT_ASSIGNED;
+  dummy_table_t *table = dummy_model_table(
+      model, pi_p4info_counter_get_direct(model->p4info, counter_id));
+  *data = (table == NULL)
+              ? NULL
+              : dummy_table_direct_counter(table, entry_handle, counter_id);
+  if (!*data) {
+    dummy_device_release(dev_id);
+    return (table == NULL) ? PI_STATUS_NETV_INVALID_OBJ_ID
+                           : DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  }
+  *p4info = model->p4info;
+  return PI_STATUS_SUCCESS;
+}
 
 pi_status_t _pi_counter_read(pi_session_handle_t session_handle,
                              pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                              size_t index, int flags,
                              pi_counter_data_t *counter_data) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)counter_id;
-  (void)index;
   (void)flags;
-  (void)counter_data;
-  func_counter_increment(__func__);
+  const pi_p4info_t *p4info;
+  pi_counter_data_t *data;
+  pi_status_t status =
+      acquire_counter(dev_tgt.dev_id, counter_id, index, &p4info, &data);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_counter_read(p4info, counter_id, data, counter_data);
+  dummy_device_release(dev_tgt.dev_id);
   return PI_STATUS_SUCCESS;
 }
 
@@ -42,12 +91,15 @@ pi_status_t _pi_counter_write(pi_session_handle_t session_handle,
                               pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                               size_t index,
                               const pi_counter_data_t *counter_data) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)counter_id;
-  (void)index;
-  (void)counter_data;
-  func_counter_increment(__func__);
+  const pi_p4info_t *p4info;
+  pi_counter_data_t *data;
+  pi_status_t status =
+      acquire_counter(dev_tgt.dev_id, counter_id, index, &p4info, &data);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_counter_write(data, counter_data);
+  dummy_device_release(dev_tgt.dev_id);
   return PI_STATUS_SUCCESS;
 }
 
@@ -55,13 +107,16 @@ pi_status_t _pi_counter_read_direct(pi_session_handle_t session_handle,
                                     pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                                     pi_entry_handle_t entry_handle, int flags,
                                     pi_counter_data_t *counter_data) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)counter_id;
-  (void)entry_handle;
   (void)flags;
-  (void)counter_data;
-  func_counter_increment(__func__);
+  const pi_p4info_t *p4info;
+  pi_counter_data_t *data;
+  pi_status_t status = acquire_direct_counter(dev_tgt.dev_id, counter_id,
+                                              entry_handle, &p4info, &data);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_counter_read(p4info, counter_id, data, counter_data);
+  dummy_device_release(dev_tgt.dev_id);
   return PI_STATUS_SUCCESS;
 }
 
@@ -70,23 +125,24 @@ pi_status_t _pi_counter_write_direct(pi_session_handle_t session_handle,
                                      pi_p4_id_t counter_id,
                                      pi_entry_handle_t entry_handle,
                                      const pi_counter_data_t *counter_data) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)counter_id;
-  (void)entry_handle;
-  (void)counter_data;
-  func_counter_increment(__func__);
+  const pi_p4info_t *p4info;
+  pi_counter_data_t *data;
+  pi_status_t status = acquire_direct_counter(dev_tgt.dev_id, counter_id,
+                                              entry_handle, &p4info, &data);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_counter_write(data, counter_data);
+  dummy_device_release(dev_tgt.dev_id);
   return PI_STATUS_SUCCESS;
 }
 
+// the model is always in sync, the callback (if any) is called right away
 pi_status_t _pi_counter_hw_sync(pi_session_handle_t session_handle,
                                 pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                                 PICounterHwSyncCb cb, void *cb_cookie) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)counter_id;
-  (void)cb;
-  (void)cb_cookie;
-  func_counter_increment(__func__);
+  if (cb) cb(dev_tgt.dev_id, counter_id, cb_cookie);
   return PI_STATUS_SUCCESS;
 }
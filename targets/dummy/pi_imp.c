@@ -20,99 +20,119 @@
 
 #include <PI/pi.h>
 #include <PI/target/pi_imp.h>
+#include <PI/target/pi_instrument.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "func_counter.h"
+#include "dummy_device.h"
 
 static char *counter_dump_path = NULL;
+// latencies are only measured if the PI_DUMMY_INSTRUMENT_TIMING environment
+// variable is set, as enabling timing costs a 10ms calibration on every init
+static int timing = 0;
+
+static void dump_latencies(const char *path) {
+  static const char suffix[] = ".latency";
+  char *latency_path = malloc(strlen(path) + sizeof(suffix));
+  strcpy(latency_path, path);
+  strcat(latency_path, suffix);
+  pi_instrument_dump_to_file(latency_path, PI_INSTRUMENT_DUMP_FULL);
+  free(latency_path);
+}
 
 pi_status_t _pi_init(void *extra) {
   if (extra)
     counter_dump_path = strdup((const char *)extra);
   else
     counter_dump_path = strdup("func_counter.txt");
-  func_counter_init();
-  func_counter_increment(__func__);
+  const char *timing_env = getenv("PI_DUMMY_INSTRUMENT_TIMING");
+  timing = (timing_env != NULL && strcmp(timing_env, "0") != 0);
+  pi_instrument_init(timing ? PI_INSTRUMENT_FLAGS_TIMING
+                            : PI_INSTRUMENT_FLAGS_NONE);
+  // only recorded once the instrumentation is on
+  {
+    PI_INSTRUMENT_FUNC();
+    dummy_devices_init();
+  }
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_assign_device(pi_dev_id_t dev_id, const pi_p4info_t *p4info,
                               pi_assign_extra_t *extra) {
-  (void)dev_id;
-  (void)p4info;
+  PI_INSTRUMENT_FUNC();
   (void)extra;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  return dummy_device_assign(dev_id, p4info);
 }
 
 pi_status_t _pi_update_device_start(pi_dev_id_t dev_id,
                                     const pi_p4info_t *p4info,
                                     const char *device_data,
                                     size_t device_data_size) {
-  (void)dev_id;
-  (void)p4info;
+  PI_INSTRUMENT_FUNC();
   (void)device_data;
   (void)device_data_size;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  return dummy_device_update_start(dev_id, p4info);
 }
 
 pi_status_t _pi_update_device_end(pi_dev_id_t dev_id) {
-  (void)dev_id;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  PI_INSTRUMENT_FUNC();
+  return dummy_device_update_end(dev_id);
 }
 
 pi_status_t _pi_remove_device(pi_dev_id_t dev_id) {
-  (void)dev_id;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  PI_INSTRUMENT_FUNC();
+  return dummy_device_remove(dev_id);
 }
 
 pi_status_t _pi_destroy() {
-  func_counter_increment(__func__);
+  // the call needs to end before the counters are released
+  {
+    PI_INSTRUMENT_FUNC();
+    dummy_devices_destroy();
+  }
   if (counter_dump_path) {
-    func_counter_dump_to_file(counter_dump_path);
+    // same format as the old function call counters
+    pi_instrument_dump_to_file(counter_dump_path, PI_INSTRUMENT_DUMP_COUNTS);
+    if (timing) dump_latencies(counter_dump_path);
     free(counter_dump_path);
     counter_dump_path = NULL;
   }
-  func_counter_destroy();
+  pi_instrument_destroy();
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_session_init(pi_session_handle_t *session_handle) {
+  PI_INSTRUMENT_FUNC();
   *session_handle = 0;
-  func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_session_cleanup(pi_session_handle_t session_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_batch_begin(pi_session_handle_t session_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_batch_end(pi_session_handle_t session_handle, bool hw_sync) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
   (void)hw_sync;
-  func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
                                size_t size) {
+  PI_INSTRUMENT_FUNC();
   (void)dev_id;
   (void)pkt;
   (void)size;
-  func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
@@ -18,25 +18,25 @@
  *
  */
 
+#include <PI/target/pi_instrument.h>
 #include <PI/target/pi_learn_imp.h>
 
 #include <stdio.h>
 
-#include "func_counter.h"
 
 pi_status_t _pi_learn_msg_ack(pi_session_handle_t session_handle,
                               pi_dev_id_t dev_id, pi_p4_id_t learn_id,
                               pi_learn_msg_id_t msg_id) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
   (void)dev_id;
   (void)learn_id;
   (void)msg_id;
-  func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_learn_msg_done(pi_learn_msg_t *msg) {
+  PI_INSTRUMENT_FUNC();
   (void)msg;
-  func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
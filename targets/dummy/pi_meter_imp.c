@@ -18,58 +18,126 @@
  *
  */
 
+#include <PI/p4info.h>
+#include <PI/pi.h>
+#include <PI/target/pi_instrument.h>
 #include <PI/target/pi_meter_imp.h>
 
 #include <stdio.h>
 
-#include "func_counter.h"
+#include "dummy_device.h"
+#include "dummy_table.h"
+
+// on success, the device lock is held and needs to be released by the caller
+static pi_status_t acquire_meter(pi_dev_id_t dev_id, pi_p4_id_t meter_id,
+                                 size_t index, const pi_p4info_t **p4info,
+                                 dummy_meter_t **meter) {
+  dummy_model_t *model = dummy_device_acquire(dev_id);
+  if (!model) return PI_STATUS_DEV_NOT_ASSIGNED;
+  dummy_meter_array_t *array = dummy_model_meter(model, meter_id);
+  pi_status_t status = PI_STATUS_SUCCESS;
+  if (!array)
+    status = PI_STATUS_NETV_INVALID_OBJ_ID;
+  else if (index >= array->size)
+    status = PI_STATUS_OUT_OF_BOUND_IDX;
+  if (status != PI_STATUS_SUCCESS) {
+    dummy_device_release(dev_id);
+    return status;
+  }
+  *p4info = model->p4info;
+  *meter = &array->values[index];
+  return PI_STATUS_SUCCESS;
+}
+
+static pi_status_t acquire_direct_meter(pi_dev_id_t dev_id,
+                                        pi_p4_id_t meter_id,
+                                        pi_entry_handle_t entry_handle,
+                                        const pi_p4info_t **p4info,
+                                        dummy_meter_t **meter) {
+  dummy_model_t *model = dummy_device_acquire(dev_id);
+  if (!model) return PI_STATUS_DEV_NOT_ASSIGNED;
+  dummy_table_t *table = dummy_model_table(
+      model, pi_p4info_meter_get_direct(model->p4info, meter_id));
+  *meter = (table == NULL)
+               ? NULL
+               : dummy_table_direct_meter(table, entry_handle, meter_id);
+  if (!*meter) {
+    dummy_device_release(dev_id);
+    return (table == NULL) ? PI_STATUS_NETV_INVALID_OBJ_ID
+                           : DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE);
+  }
+  *p4info = model->p4info;
+  return PI_STATUS_SUCCESS;
+}
+
+static pi_status_t read_meter(const dummy_meter_t *meter,
+                              pi_meter_spec_t *meter_spec) {
+  if (!meter->is_set) return PI_STATUS_METER_SPEC_NOT_SET;
+  *meter_spec = meter->spec;
+  return PI_STATUS_SUCCESS;
+}
 
 pi_status_t _pi_meter_read(pi_session_handle_t session_handle,
                            pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                           size_t index, pi_meter_spec_t *meter_spec) {
+                           size_t index, int flags,
+                           pi_meter_spec_t *meter_spec) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)meter_id;
-  (void)index;
-  (void)meter_spec;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  (void)flags;
+  const pi_p4info_t *p4info;
+  dummy_meter_t *meter;
+  pi_status_t status =
+      acquire_meter(dev_tgt.dev_id, meter_id, index, &p4info, &meter);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = read_meter(meter, meter_spec);
+  dummy_device_release(dev_tgt.dev_id);
+  return status;
 }
 
 pi_status_t _pi_meter_set(pi_session_handle_t session_handle,
                           pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
                           size_t index, const pi_meter_spec_t *meter_spec) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)meter_id;
-  (void)index;
-  (void)meter_spec;
-  func_counter_increment(__func__);
+  const pi_p4info_t *p4info;
+  dummy_meter_t *meter;
+  pi_status_t status =
+      acquire_meter(dev_tgt.dev_id, meter_id, index, &p4info, &meter);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_meter_set(p4info, meter_id, meter, meter_spec);
+  dummy_device_release(dev_tgt.dev_id);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_meter_read_direct(pi_session_handle_t session_handle,
                                   pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                                  pi_entry_handle_t entry_handle,
+                                  pi_entry_handle_t entry_handle, int flags,
                                   pi_meter_spec_t *meter_spec) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)meter_id;
-  (void)entry_handle;
-  (void)meter_spec;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  (void)flags;
+  const pi_p4info_t *p4info;
+  dummy_meter_t *meter;
+  pi_status_t status = acquire_direct_meter(dev_tgt.dev_id, meter_id,
+                                            entry_handle, &p4info, &meter);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = read_meter(meter, meter_spec);
+  dummy_device_release(dev_tgt.dev_id);
+  return status;
 }
 
 pi_status_t _pi_meter_set_direct(pi_session_handle_t session_handle,
                                  pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
                                  pi_entry_handle_t entry_handle,
                                  const pi_meter_spec_t *meter_spec) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)meter_id;
-  (void)entry_handle;
-  (void)meter_spec;
-  func_counter_increment(__func__);
+  const pi_p4info_t *p4info;
+  dummy_meter_t *meter;
+  pi_status_t status = acquire_direct_meter(dev_tgt.dev_id, meter_id,
+                                            entry_handle, &p4info, &meter);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_meter_set(p4info, meter_id, meter, meter_spec);
+  dummy_device_release(dev_tgt.dev_id);
   return PI_STATUS_SUCCESS;
 }
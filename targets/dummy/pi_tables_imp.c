@@ -18,11 +18,29 @@
  *
  */
 
-#include "PI/pi.h"
+#include <PI/int/pi_int.h>
+#include <PI/pi.h>
+#include <PI/target/pi_instrument.h>
+#include <PI/target/pi_tables_imp.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
-#include "func_counter.h"
+#include "dummy_device.h"
+#include "dummy_table.h"
+
+// on success, the device lock is held and needs to be released by the caller
+static pi_status_t acquire_table(pi_dev_id_t dev_id, pi_p4_id_t table_id,
+                                 dummy_table_t **table) {
+  dummy_model_t *model = dummy_device_acquire(dev_id);
+  if (!model) return PI_STATUS_DEV_NOT_ASSIGNED;
+  *table = dummy_model_table(model, table_id);
+  if (!*table) {
+    dummy_device_release(dev_id);
+    return PI_STATUS_NETV_INVALID_OBJ_ID;
+  }
+  return PI_STATUS_SUCCESS;
+}
 
 pi_status_t _pi_table_entry_add(pi_session_handle_t session_handle,
                                 pi_dev_tgt_t dev_tgt, pi_p4_id_t table_id,
@@ -30,112 +48,130 @@ pi_status_t _pi_table_entry_add(pi_session_handle_t session_handle,
                                 const pi_table_entry_t *table_entry,
                                 int overwrite,
                                 pi_entry_handle_t *entry_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)table_id;
-  (void)match_key;
-  (void)table_entry;
-  (void)overwrite;
-  (void)entry_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_tgt.dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_table_entry_add(table, match_key, table_entry, overwrite,
+                                 entry_handle);
+  dummy_device_release(dev_tgt.dev_id);
+  return status;
 }
 
 pi_status_t _pi_table_default_action_set(pi_session_handle_t session_handle,
                                          pi_dev_tgt_t dev_tgt,
                                          pi_p4_id_t table_id,
                                          const pi_table_entry_t *table_entry) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_tgt;
-  (void)table_id;
-  (void)table_entry;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_tgt.dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_table_default_set(table, table_entry);
+  dummy_device_release(dev_tgt.dev_id);
+  return status;
 }
 
 pi_status_t _pi_table_default_action_get(pi_session_handle_t session_handle,
                                          pi_dev_id_t dev_id,
                                          pi_p4_id_t table_id,
                                          pi_table_entry_t *table_entry) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)table_id;
-  (void)table_entry;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_table_default_get(table, table_entry);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_table_default_action_done(pi_session_handle_t session_handle,
                                           pi_table_entry_t *table_entry) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)table_entry;
-  func_counter_increment(__func__);
+  dummy_table_default_done(table_entry);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_table_entry_delete(pi_session_handle_t session_handle,
                                    pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                    pi_entry_handle_t entry_handle) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)table_id;
-  (void)entry_handle;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_table_entry_delete(table, entry_handle);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_table_entry_delete_wkey(pi_session_handle_t session_handle,
                                         pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                         const pi_match_key_t *match_key) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)table_id;
-  (void)match_key;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  pi_entry_handle_t entry_handle;
+  status = dummy_table_entry_find(table, match_key, &entry_handle);
+  if (status == PI_STATUS_SUCCESS)
+    status = dummy_table_entry_delete(table, entry_handle);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_table_entry_modify(pi_session_handle_t session_handle,
                                    pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                    pi_entry_handle_t entry_handle,
                                    const pi_table_entry_t *table_entry) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)table_id;
-  (void)entry_handle;
-  (void)table_entry;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  status = dummy_table_entry_modify(table, entry_handle, table_entry);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_table_entry_modify_wkey(pi_session_handle_t session_handle,
                                         pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                         const pi_match_key_t *match_key,
                                         const pi_table_entry_t *table_entry) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)table_id;
-  (void)match_key;
-  (void)table_entry;
-  func_counter_increment(__func__);
-  return PI_STATUS_SUCCESS;
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  pi_entry_handle_t entry_handle;
+  status = dummy_table_entry_find(table, match_key, &entry_handle);
+  if (status == PI_STATUS_SUCCESS)
+    status = dummy_table_entry_modify(table, entry_handle, table_entry);
+  dummy_device_release(dev_id);
+  return status;
 }
 
 pi_status_t _pi_table_entries_fetch(pi_session_handle_t session_handle,
                                     pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                     pi_table_fetch_res_t *res) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)dev_id;
-  (void)table_id;
-  (void)res;
-  func_counter_increment(__func__);
+  dummy_table_t *table;
+  pi_status_t status = acquire_table(dev_id, table_id, &table);
+  if (status != PI_STATUS_SUCCESS) return status;
+  dummy_table_fetch(table, res);
+  dummy_device_release(dev_id);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t _pi_table_entries_fetch_done(pi_session_handle_t session_handle,
                                          pi_table_fetch_res_t *res) {
+  PI_INSTRUMENT_FUNC();
   (void)session_handle;
-  (void)res;
-  func_counter_increment(__func__);
+  free(res->entries);
   return PI_STATUS_SUCCESS;
 }
@@ -41,7 +41,8 @@ static pi_status_t wait_for_meter_spec(uint32_t req_id,
 static pi_status_t meter_read(pi_rpc_type_t type,
                               pi_session_handle_t session_handle,
                               pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                              uint64_t h, pi_meter_spec_t *meter_spec) {
+                              uint64_t h, int flags,
+                              pi_meter_spec_t *meter_spec) {
   assert(type == PI_RPC_METER_READ || type == PI_RPC_METER_READ_DIRECT);
 
   if (!state.init) return PI_STATUS_RPC_NOT_INIT;
@@ -52,6 +53,7 @@ static pi_status_t meter_read(pi_rpc_type_t type,
     s_pi_dev_tgt_t dev_tgt;
     s_pi_p4_id_t meter_id;
     uint64_t h;
+    uint32_t flags;
   } req_t;
   req_t req;
   char *req_ = (char *)&req;
@@ -62,6 +64,7 @@ static pi_status_t meter_read(pi_rpc_type_t type,
   req_ += emit_dev_tgt(req_, dev_tgt);
   req_ += emit_p4_id(req_, meter_id);
   req_ += emit_uint64(req_, h);
+  req_ += emit_uint32(req_, flags);
 
   int rc = nn_send(state.s, &req, sizeof(req), 0);
   if (rc != sizeof(req)) return PI_STATUS_RPC_TRANSPORT_ERROR;
@@ -105,9 +108,10 @@ static pi_status_t meter_set(pi_rpc_type_t type,
 
 pi_status_t _pi_meter_read(pi_session_handle_t session_handle,
                            pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                           size_t index, pi_meter_spec_t *meter_spec) {
+                           size_t index, int flags,
+                           pi_meter_spec_t *meter_spec) {
   return meter_read(PI_RPC_METER_READ, session_handle, dev_tgt, meter_id, index,
-                    meter_spec);
+                    flags, meter_spec);
 }
 
 pi_status_t _pi_meter_set(pi_session_handle_t session_handle,
@@ -119,10 +123,10 @@ pi_status_t _pi_meter_set(pi_session_handle_t session_handle,
 
 pi_status_t _pi_meter_read_direct(pi_session_handle_t session_handle,
                                   pi_dev_tgt_t dev_tgt, pi_p4_id_t meter_id,
-                                  pi_entry_handle_t entry_handle,
+                                  pi_entry_handle_t entry_handle, int flags,
                                   pi_meter_spec_t *meter_spec) {
   return meter_read(PI_RPC_METER_READ_DIRECT, session_handle, dev_tgt, meter_id,
-                    entry_handle, meter_spec);
+                    entry_handle, flags, meter_spec);
 }
 
 pi_status_t _pi_meter_set_direct(pi_session_handle_t session_handle,
@@ -28,6 +28,8 @@ extern void test_bmv2_json_reader();
 extern void test_getnetv();
 extern void test_p4info();
 extern void test_frontends_generic();
+extern void test_instrument();
+extern void test_dummy_table();
 
 static void run() {
 #ifdef TEST_BMV2_JSON_READER
@@ -42,6 +44,12 @@ static void run() {
 #ifdef TEST_FRONTENDS_GENERIC
   test_frontends_generic();
 #endif
+#ifdef TEST_INSTRUMENT
+  test_instrument();
+#endif
+#ifdef TEST_DUMMY_TABLE
+  test_dummy_table();
+#endif
 }
 
 int main(int argc, const char *argv[]) {
@@ -0,0 +1,253 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Unit tests for the match table model of the dummy target
+
+#include "PI/frontends/generic/pi.h"
+#include "PI/p4info.h"
+#include "PI/pi.h"
+
+#include "dummy_device.h"
+#include "dummy_table.h"
+#include "read_file.h"
+
+#include "unity/unity_fixture.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+static pi_p4info_t *p4info;
+static dummy_table_t *table;
+static pi_match_key_t *mkey;
+static pi_action_data_t *adata;
+static pi_table_entry_t t_entry;
+static pi_p4_id_t t_id;
+static pi_p4_id_t f_id;
+
+static void setup_table(const char *t_name) {
+  t_id = pi_p4info_table_id_from_name(p4info, t_name);
+  f_id = pi_p4info_table_match_field_id_from_name(p4info, t_id,
+                                                  "header_test.field32");
+  table = dummy_table_create(p4info, t_id, NULL);
+  pi_match_key_allocate(p4info, t_id, &mkey);
+}
+
+static void teardown_table() {
+  pi_match_key_destroy(mkey);
+  dummy_table_destroy(table);
+}
+
+static void set_exact(uint32_t v) {
+  pi_netv_t fv;
+  pi_match_key_init(mkey);
+  pi_getnetv_u32(p4info, t_id, f_id, v, &fv);
+  pi_match_key_exact_set(mkey, &fv);
+}
+
+static void set_lpm(uint32_t v, pi_prefix_length_t pLen, uint32_t priority) {
+  pi_netv_t fv;
+  pi_match_key_init(mkey);
+  pi_getnetv_u32(p4info, t_id, f_id, v, &fv);
+  pi_match_key_lpm_set(mkey, &fv, pLen);
+  pi_match_key_set_priority(mkey, priority);
+}
+
+static void set_ternary(uint32_t v, uint32_t mask, uint32_t priority) {
+  pi_netv_t fv, fm;
+  pi_match_key_init(mkey);
+  pi_getnetv_u32(p4info, t_id, f_id, v, &fv);
+  pi_getnetv_u32(p4info, t_id, f_id, mask, &fm);
+  pi_match_key_ternary_set(mkey, &fv, &fm);
+  pi_match_key_set_priority(mkey, priority);
+}
+
+static pi_status_t add(int overwrite, pi_entry_handle_t *h) {
+  return dummy_table_entry_add(table, mkey, &t_entry, overwrite, h);
+}
+
+// the lookup key for the tables of this test is a single 32-bit field
+static bool lookup(uint32_t v, pi_entry_handle_t *h) {
+  uint32_t key = htonl(v);
+  return dummy_table_lookup(table, (const char *)&key, h);
+}
+
+static void check_lookup(uint32_t v, pi_entry_handle_t expected) {
+  pi_entry_handle_t h;
+  TEST_ASSERT_TRUE(lookup(v, &h));
+  TEST_ASSERT_EQUAL_UINT64(expected, h);
+}
+
+static void check_miss(uint32_t v) {
+  pi_entry_handle_t h;
+  TEST_ASSERT_FALSE(lookup(v, &h));
+}
+
+TEST_GROUP(DummyTable);
+
+TEST_SETUP(DummyTable) {
+  char *config = read_file(TESTDATADIR
+                           "/"
+                           "unittest.json");
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS,
+                    pi_add_config(config, PI_CONFIG_TYPE_BMV2_JSON, &p4info));
+  free(config);
+  pi_p4_id_t a_id = pi_p4info_action_id_from_name(p4info, "actionA");
+  pi_action_data_allocate(p4info, a_id, &adata);
+  pi_action_data_init(adata);
+  pi_netv_t fv;
+  pi_getnetv_u64(p4info, a_id,
+                 pi_p4info_action_param_id_from_name(p4info, a_id, "param"),
+                 0xab, &fv);
+  pi_action_data_arg_set(adata, &fv);
+  t_entry.entry_type = PI_ACTION_ENTRY_TYPE_DATA;
+  t_entry.entry.action_data = adata;
+  t_entry.entry_properties = NULL;
+  t_entry.direct_res_config = NULL;
+}
+
+TEST_TEAR_DOWN(DummyTable) {
+  pi_action_data_destroy(adata);
+  pi_destroy_config(p4info);
+}
+
+TEST(DummyTable, Exact) {
+  setup_table("ExactOne");
+  pi_entry_handle_t h, h2;
+  set_exact(0x0a000001);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h));
+  TEST_ASSERT_EQUAL(DUMMY_STATUS(DUMMY_ERROR_DUPLICATE_ENTRY), add(0, &h2));
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(1, &h2));
+  TEST_ASSERT_EQUAL_UINT64(h, h2);
+  TEST_ASSERT_EQUAL_UINT(1, dummy_table_num_entries(table));
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS,
+                    dummy_table_entry_find(table, mkey, &h2));
+  TEST_ASSERT_EQUAL_UINT64(h, h2);
+
+  check_lookup(0x0a000001, h);
+  check_miss(0x0a000002);
+
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, dummy_table_entry_delete(table, h));
+  TEST_ASSERT_EQUAL(DUMMY_STATUS(DUMMY_ERROR_INVALID_HANDLE),
+                    dummy_table_entry_delete(table, h));
+  TEST_ASSERT_EQUAL_UINT(0, dummy_table_num_entries(table));
+  check_miss(0x0a000001);
+  teardown_table();
+}
+
+TEST(DummyTable, Lpm) {
+  setup_table("LpmOne");
+  pi_entry_handle_t h0, h8, h16, h24;
+  set_lpm(0, 0, 0);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h0));
+  set_lpm(0x0a000000, 8, 0);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h8));
+  set_lpm(0x0a010000, 16, 0);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h16));
+  set_lpm(0x0a010200, 24, 0);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h24));
+  TEST_ASSERT_EQUAL_UINT(4, dummy_table_num_entries(table));
+
+  check_lookup(0x0a010203, h24);
+  check_lookup(0x0a010303, h16);
+  check_lookup(0x0a020303, h8);
+  check_lookup(0x0b020303, h0);
+
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, dummy_table_entry_delete(table, h16));
+  check_lookup(0x0a010303, h8);
+  check_lookup(0x0a010203, h24);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, dummy_table_entry_delete(table, h0));
+  check_miss(0x0b020303);
+  teardown_table();
+}
+
+// the bits past the prefix length and the priority are not part of an LPM
+// entry's key
+TEST(DummyTable, LpmDuplicate) {
+  setup_table("LpmOne");
+  pi_entry_handle_t h, h2;
+  set_lpm(0x0a000000, 8, 0);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h));
+
+  set_lpm(0x0a010000, 8, 0);
+  TEST_ASSERT_EQUAL(DUMMY_STATUS(DUMMY_ERROR_DUPLICATE_ENTRY), add(0, &h2));
+  set_lpm(0x0a000000, 8, 7);
+  TEST_ASSERT_EQUAL(DUMMY_STATUS(DUMMY_ERROR_DUPLICATE_ENTRY), add(0, &h2));
+  TEST_ASSERT_EQUAL_UINT(1, dummy_table_num_entries(table));
+
+  set_lpm(0x0affffff, 8, 3);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(1, &h2));
+  TEST_ASSERT_EQUAL_UINT64(h, h2);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS,
+                    dummy_table_entry_find(table, mkey, &h2));
+  TEST_ASSERT_EQUAL_UINT64(h, h2);
+  TEST_ASSERT_EQUAL_UINT(1, dummy_table_num_entries(table));
+
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, dummy_table_entry_delete(table, h));
+  check_miss(0x0a000001);
+  set_lpm(0x0a010000, 8, 0);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h));
+  check_lookup(0x0a000001, h);
+  teardown_table();
+}
+
+TEST(DummyTable, LpmInvalidPrefixLength) {
+  setup_table("LpmOne");
+  pi_entry_handle_t h;
+  set_lpm(0x0a000000, 33, 0);
+  TEST_ASSERT_EQUAL(DUMMY_STATUS(DUMMY_ERROR_INVALID_PREFIX_LENGTH),
+                    add(0, &h));
+  TEST_ASSERT_EQUAL_UINT(0, dummy_table_num_entries(table));
+  teardown_table();
+}
+
+TEST(DummyTable, Ternary) {
+  setup_table("TernaryOne");
+  pi_entry_handle_t h_lo, h_hi, h_hi2, h;
+  set_ternary(0x0a000000, 0xff000000, 10);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h_hi));
+  // same match key, different priority: a different entry
+  set_ternary(0x0a000000, 0xff000000, 20);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h_hi2));
+  TEST_ASSERT_EQUAL(DUMMY_STATUS(DUMMY_ERROR_DUPLICATE_ENTRY), add(0, &h));
+  set_ternary(0x0a000001, 0xffffffff, 5);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, add(0, &h_lo));
+  TEST_ASSERT_EQUAL_UINT(3, dummy_table_num_entries(table));
+
+  // lower priority value wins
+  check_lookup(0x0a000001, h_lo);
+  check_lookup(0x0a000002, h_hi);
+  check_miss(0x0b000001);
+
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, dummy_table_entry_delete(table, h_hi));
+  check_lookup(0x0a000002, h_hi2);
+  TEST_ASSERT_EQUAL(PI_STATUS_SUCCESS, dummy_table_entry_delete(table, h_lo));
+  check_lookup(0x0a000001, h_hi2);
+  teardown_table();
+}
+
+TEST_GROUP_RUNNER(DummyTable) {
+  RUN_TEST_CASE(DummyTable, Exact);
+  RUN_TEST_CASE(DummyTable, Lpm);
+  RUN_TEST_CASE(DummyTable, LpmDuplicate);
+  RUN_TEST_CASE(DummyTable, LpmInvalidPrefixLength);
+  RUN_TEST_CASE(DummyTable, Ternary);
+}
+
+void test_dummy_table() { RUN_TEST_GROUP(DummyTable); }
@@ -0,0 +1,134 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "PI/target/pi_instrument.h"
+
+#include "unity/unity_fixture.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+TEST_GROUP(Instrument);
+
+TEST_SETUP(Instrument) { pi_instrument_init(PI_INSTRUMENT_FLAGS_TIMING); }
+
+TEST_TEAR_DOWN(Instrument) { pi_instrument_destroy(); }
+
+static void instrumented_a() { PI_INSTRUMENT_FUNC(); }
+
+static int instrumented_b(int v) {
+  PI_INSTRUMENT_FUNC();
+  if (v > 0) return v;
+  return -v;
+}
+
+static void instrumented_c() { PI_INSTRUMENT_FUNC(); }
+
+TEST(Instrument, Count) {
+  TEST_ASSERT_EQUAL_INT64(-1, pi_instrument_get_count("instrumented_a"));
+  for (int i = 0; i < 10; i++) instrumented_a();
+  instrumented_b(1);
+  instrumented_b(-1);
+  TEST_ASSERT_EQUAL_INT64(10, pi_instrument_get_count("instrumented_a"));
+  TEST_ASSERT_EQUAL_INT64(2, pi_instrument_get_count("instrumented_b"));
+  TEST_ASSERT_EQUAL_INT64(-1, pi_instrument_get_count("instrumented_c"));
+}
+
+TEST(Instrument, Reset) {
+  instrumented_a();
+  pi_instrument_destroy();
+  instrumented_a();  // not recorded
+  pi_instrument_init(PI_INSTRUMENT_FLAGS_NONE);
+  TEST_ASSERT_EQUAL_INT64(-1, pi_instrument_get_count("instrumented_a"));
+  instrumented_a();
+  TEST_ASSERT_EQUAL_INT64(1, pi_instrument_get_count("instrumented_a"));
+}
+
+// init resets the counters even if destroy was not called
+TEST(Instrument, ReInit) {
+  instrumented_a();
+  pi_instrument_init(PI_INSTRUMENT_FLAGS_NONE);
+  TEST_ASSERT_EQUAL_INT64(-1, pi_instrument_get_count("instrumented_a"));
+  instrumented_a();
+  TEST_ASSERT_EQUAL_INT64(1, pi_instrument_get_count("instrumented_a"));
+}
+
+#define NUM_THREADS 4
+#define CALLS_PER_THREAD 1000
+
+static void *call_a(void *arg) {
+  (void)arg;
+  for (int i = 0; i < CALLS_PER_THREAD; i++) instrumented_a();
+  return NULL;
+}
+
+TEST(Instrument, MultipleThreads) {
+  pthread_t threads[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++)
+    pthread_create(&threads[i], NULL, call_a, NULL);
+  for (int i = 0; i < NUM_THREADS; i++) pthread_join(threads[i], NULL);
+  TEST_ASSERT_EQUAL_INT64(NUM_THREADS * CALLS_PER_THREAD,
+                          pi_instrument_get_count("instrumented_a"));
+}
+
+static char *read_dump(pi_instrument_dump_mode_t mode) {
+  char path[] = "/tmp/pi_instrument_XXXXXX";
+  int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd >= 0);
+  TEST_ASSERT_EQUAL_INT(0, pi_instrument_dump_to_file(path, mode));
+  FILE *f = fopen(path, "r");
+  char *buffer = calloc(1, 4096);
+  fread(buffer, 1, 4095, f);
+  fclose(f);
+  remove(path);
+  return buffer;
+}
+
+TEST(Instrument, DumpCounts) {
+  instrumented_c();
+  instrumented_b(0);
+  instrumented_a();
+  instrumented_a();
+  char *dump = read_dump(PI_INSTRUMENT_DUMP_COUNTS);
+  TEST_ASSERT_EQUAL_STRING(
+      "instrumented_a : 2\ninstrumented_b : 1\ninstrumented_c : 1\n", dump);
+  free(dump);
+}
+
+TEST(Instrument, DumpFull) {
+  instrumented_a();
+  char *dump = read_dump(PI_INSTRUMENT_DUMP_FULL);
+  TEST_ASSERT_NOT_NULL(strstr(dump, "instrumented_a : 1 calls, mean "));
+  TEST_ASSERT_NOT_NULL(strstr(dump, ") ns : 1\n"));
+  free(dump);
+}
+
+TEST_GROUP_RUNNER(Instrument) {
+  RUN_TEST_CASE(Instrument, Count);
+  RUN_TEST_CASE(Instrument, Reset);
+  RUN_TEST_CASE(Instrument, ReInit);
+  RUN_TEST_CASE(Instrument, MultipleThreads);
+  RUN_TEST_CASE(Instrument, DumpCounts);
+  RUN_TEST_CASE(Instrument, DumpFull);
+}
+
+void test_instrument() { RUN_TEST_GROUP(Instrument); }